@@ -17,5 +17,12 @@
 @property(nonatomic, strong) NSButton* debugCheckbox; // NEW: Debug logging checkbox
 @property(nonatomic, strong) NSTextField* statusLabel;
 @property(nonatomic, strong) NSButton* authButton;
+@property(nonatomic, strong) NSTextField* listenBrainzUrlField;
+@property(nonatomic, strong) NSSecureTextField* listenBrainzTokenField;
+@property(nonatomic, strong) NSPopUpButton* durabilityPopup;
+@property(nonatomic, strong) NSArray<NSTextField*>* fieldScriptFields; // In foo_lastfm::TrackMapping::Field order
+@property(nonatomic, strong) NSTextField* metricsLabel;
+@property(nonatomic, strong) NSTextField* queueLabel;
+@property(nonatomic, strong) NSTableView* queueTable; // Virtual: rows are read from the queue a page at a time
 
 @end
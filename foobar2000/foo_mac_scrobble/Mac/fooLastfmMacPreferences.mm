@@ -7,9 +7,23 @@
 
 #import "fooLastfmMacPreferences.h"
 #include "../stdafx.h"
+#include "../async_logger.h"
 #include "../config.h"
 #include "../lastfm_api.h"
+#include "../metrics.h"
+#include "../runtime_config.h"
 #include "../safe_log_utils.h"
+#include "../scrobble_queue.h"
+#include "../track_mapping.h"
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Rows of the queue table read at once, and pages of them kept
+static const size_t kQueuePageRows = 100;
+static const size_t kQueueCachedPages = 20;
 
 // Masking helper to obscure sensitive data (API key/secret)
 static std::string mask_show_first_last(const std::string &s, size_t first = 2, size_t last = 2) {
@@ -21,12 +35,19 @@ static std::string mask_show_first_last(const std::string &s, size_t first = 2,
     return masked;
 }
 
-@interface fooLastfmMacPreferences ()
+@interface fooLastfmMacPreferences () <NSTableViewDataSource>
 {
     BOOL showingSecrets;
     std::string realApiKey;
     std::string realApiSecret;
     NSButton *revealButton; // Show/Hide button for API key/secret
+
+    // Queue table model: the pages read so far at queueVersion, kept current from the queue's change log
+    uint64_t queueVersion;
+    size_t queueTotal;
+    std::map<size_t, std::vector<foo_lastfm::QueueEntry>> queuePages;
+    NSTimer *queueTimer;
+    BOOL queueReloadPending; // A reloadQueue is dispatched; rows that find the queue changed do not add another
 }
 @end
 
@@ -35,7 +56,7 @@ static std::string mask_show_first_last(const std::string &s, size_t first = 2,
 - (instancetype)init {
     self = [super init];
     if (self) {
-        if (foo_lastfm::cfg_debug_enabled.get()) {
+        if (foo_lastfm::g_runtime_config.get().debug_enabled) {
             FB2K_console_formatter() << "Last.fm UI: fooLastfmMacPreferences init called";
         }
     }
@@ -43,7 +64,7 @@ static std::string mask_show_first_last(const std::string &s, size_t first = 2,
 }
 
 - (void)loadView {
-    if (foo_lastfm::cfg_debug_enabled.get()) {
+    if (foo_lastfm::g_runtime_config.get().debug_enabled) {
         FB2K_console_formatter() << "Last.fm UI: loadView called";
     }
 
@@ -52,7 +73,7 @@ static std::string mask_show_first_last(const std::string &s, size_t first = 2,
     // Don't set translatesAutoresizingMaskIntoConstraints:NO for main view
     self.view = mainView;
     
-    if (foo_lastfm::cfg_debug_enabled.get()) {
+    if (foo_lastfm::g_runtime_config.get().debug_enabled) {
         FB2K_console_formatter() << "Last.fm UI: loadView completed";
     }
 }
@@ -60,7 +81,7 @@ static std::string mask_show_first_last(const std::string &s, size_t first = 2,
 - (void)viewDidLoad {
     [super viewDidLoad];
     
-    if (foo_lastfm::cfg_debug_enabled.get()) {
+    if (foo_lastfm::g_runtime_config.get().debug_enabled) {
         FB2K_console_formatter() << "Last.fm UI: viewDidLoad called";
         FB2K_console_formatter() << "Last.fm UI: macOS version: " << [[NSProcessInfo processInfo].operatingSystemVersionString UTF8String];
         FB2K_console_formatter() << "Last.fm UI: view frame: " << NSStringFromRect(self.view.frame).UTF8String;
@@ -69,7 +90,7 @@ static std::string mask_show_first_last(const std::string &s, size_t first = 2,
     [self setupUI];
     showingSecrets = NO;
     
-    if (foo_lastfm::cfg_debug_enabled.get()) {
+    if (foo_lastfm::g_runtime_config.get().debug_enabled) {
         FB2K_console_formatter() << "Last.fm UI: viewDidLoad completed";
     }
 }
@@ -77,7 +98,7 @@ static std::string mask_show_first_last(const std::string &s, size_t first = 2,
 - (void)viewWillAppear {
     [super viewWillAppear];
     
-    if (foo_lastfm::cfg_debug_enabled.get()) {
+    if (foo_lastfm::g_runtime_config.get().debug_enabled) {
         FB2K_console_formatter() << "Last.fm UI: viewWillAppear called";
         FB2K_console_formatter() << "Last.fm UI: view bounds: " << NSStringFromRect(self.view.bounds).UTF8String;
         FB2K_console_formatter() << "Last.fm UI: view subviews count: " << (int)self.view.subviews.count;
@@ -102,18 +123,44 @@ static std::string mask_show_first_last(const std::string &s, size_t first = 2,
     [self.thresholdSlider setIntegerValue:foo_lastfm::cfg_scrobble_percent.get()];
     [self.enabledCheckbox setState:foo_lastfm::cfg_enabled.get() ? NSControlStateValueOn : NSControlStateValueOff];
     [self.debugCheckbox setState:foo_lastfm::cfg_debug_enabled.get() ? NSControlStateValueOn : NSControlStateValueOff];
+    [self.listenBrainzUrlField setStringValue:@(foo_lastfm::cfg_listenbrainz_url.get().c_str())];
+    [self.listenBrainzTokenField setStringValue:@(foo_lastfm::cfg_listenbrainz_token.get().c_str())];
+    [self.durabilityPopup selectItemAtIndex:(NSInteger)foo_lastfm::cfg_queue_durability.get()];
+    cfg_string* fieldScripts[] = {&foo_lastfm::cfg_map_artist, &foo_lastfm::cfg_map_title, &foo_lastfm::cfg_map_album,
+                                  &foo_lastfm::cfg_map_album_artist, &foo_lastfm::cfg_map_track_number};
+    for (NSUInteger i = 0; i < self.fieldScriptFields.count; i++) {
+        [self.fieldScriptFields[i] setStringValue:@(fieldScripts[i]->get().c_str())];
+    }
     [self updateThresholdLabel];
     [self updateStatusLabel];
+    [self updateMetricsLabel];
+
+    // Follow the queue while the page is shown
+    [self reloadQueue];
+    [queueTimer invalidate];
+    queueTimer = [NSTimer scheduledTimerWithTimeInterval:1.0
+                                                  target:self
+                                                selector:@selector(onQueueTimer:)
+                                                userInfo:nil
+                                                 repeats:YES];
+}
+
+- (void)viewWillDisappear {
+    [super viewWillDisappear];
+
+    [queueTimer invalidate];
+    queueTimer = nil;
+    queuePages.clear();
 }
 
 - (void)setupUI {
-    if (foo_lastfm::cfg_debug_enabled.get()) {
+    if (foo_lastfm::g_runtime_config.get().debug_enabled) {
         FB2K_console_formatter() << "Last.fm UI: setupUI started";
     }
     
     // Create main stack view for organizing UI elements
     NSStackView* stackView = [[NSStackView alloc] init];
-    if (foo_lastfm::cfg_debug_enabled.get()) {
+    if (foo_lastfm::g_runtime_config.get().debug_enabled) {
         FB2K_console_formatter() << "Last.fm UI: NSStackView created";
     }
 
@@ -122,12 +169,12 @@ static std::string mask_show_first_last(const std::string &s, size_t first = 2,
     [stackView setSpacing:8];
     [stackView setTranslatesAutoresizingMaskIntoConstraints:NO];
     
-    if (foo_lastfm::cfg_debug_enabled.get()) {
+    if (foo_lastfm::g_runtime_config.get().debug_enabled) {
         FB2K_console_formatter() << "Last.fm UI: NSStackView configured";
     }
 
     [self.view addSubview:stackView];
-    if (foo_lastfm::cfg_debug_enabled.get()) {
+    if (foo_lastfm::g_runtime_config.get().debug_enabled) {
         FB2K_console_formatter() << "Last.fm UI: NSStackView added to view";
     }
 
@@ -138,7 +185,7 @@ static std::string mask_show_first_last(const std::string &s, size_t first = 2,
     [stackView.topAnchor constraintEqualToAnchor:self.view.topAnchor constant:inset].active = YES;
     [stackView.bottomAnchor constraintEqualToAnchor:self.view.bottomAnchor constant:-inset].active = YES;
     
-    if (foo_lastfm::cfg_debug_enabled.get()) {
+    if (foo_lastfm::g_runtime_config.get().debug_enabled) {
         FB2K_console_formatter() << "Last.fm UI: NSStackView constraints set";
     }
 
@@ -151,7 +198,7 @@ static std::string mask_show_first_last(const std::string &s, size_t first = 2,
     [titleLabel setFont:[NSFont systemFontOfSize:15]];
     [stackView addArrangedSubview:titleLabel];
     
-    if (foo_lastfm::cfg_debug_enabled.get()) {
+    if (foo_lastfm::g_runtime_config.get().debug_enabled) {
         FB2K_console_formatter() << "Last.fm UI: Title label added";
         FB2K_console_formatter() << "Last.fm UI: StackView arranged subviews count: " << (int)stackView.arrangedSubviews.count;
     }
@@ -218,6 +265,7 @@ static std::string mask_show_first_last(const std::string &s, size_t first = 2,
     self.thresholdSlider = [[NSSlider alloc] init];
     [self.thresholdSlider setMinValue:30];
     [self.thresholdSlider setMaxValue:100];
+    [self.thresholdSlider setContinuous:YES];
     [self.thresholdSlider setTarget:self];
     [self.thresholdSlider setAction:@selector(onThresholdChanged:)];
     [self.thresholdSlider setTranslatesAutoresizingMaskIntoConstraints:NO];
@@ -286,10 +334,157 @@ static std::string mask_show_first_last(const std::string &s, size_t first = 2,
     [self.authButton setAlignment:NSCenterTextAlignment];
     [stackView addArrangedSubview:self.authButton];
 
+    // Add spacer
+    NSView* spacerListenBrainz = [[NSView alloc] init];
+    [spacerListenBrainz.heightAnchor constraintEqualToConstant:16].active = YES;
+    [stackView addArrangedSubview:spacerListenBrainz];
+
+    // Add ListenBrainz section label
+    NSTextField* listenBrainzLabel = [[NSTextField alloc] init];
+    [listenBrainzLabel setStringValue:@"Also scrobble to ListenBrainz (leave the token empty to turn it off):"];
+    [listenBrainzLabel setBezeled:NO];
+    [listenBrainzLabel setDrawsBackground:NO];
+    [listenBrainzLabel setEditable:NO];
+    [stackView addArrangedSubview:listenBrainzLabel];
+
+    // Add ListenBrainz server URL field (any ListenBrainz-compatible service)
+    self.listenBrainzUrlField = [[NSTextField alloc] init];
+    [self.listenBrainzUrlField setPlaceholderString:@"https://api.listenbrainz.org"];
+    [self.listenBrainzUrlField setTarget:self];
+    [self.listenBrainzUrlField setAction:@selector(onListenBrainzChanged:)];
+    [stackView addArrangedSubview:self.listenBrainzUrlField];
+
+    // Add ListenBrainz user token field
+    self.listenBrainzTokenField = [[NSSecureTextField alloc] init];
+    [self.listenBrainzTokenField setPlaceholderString:@"Enter your ListenBrainz user token"];
+    [self.listenBrainzTokenField setTarget:self];
+    [self.listenBrainzTokenField setAction:@selector(onListenBrainzChanged:)];
+    [stackView addArrangedSubview:self.listenBrainzTokenField];
+
+    // Add queue durability label
+    NSTextField* durabilityLabel = [[NSTextField alloc] init];
+    [durabilityLabel setStringValue:@"Offline queue writes:"];
+    [durabilityLabel setBezeled:NO];
+    [durabilityLabel setDrawsBackground:NO];
+    [durabilityLabel setEditable:NO];
+    [stackView addArrangedSubview:durabilityLabel];
+
+    // Add queue durability popup (items in foo_lastfm::Durability order)
+    self.durabilityPopup = [[NSPopUpButton alloc] init];
+    [self.durabilityPopup addItemsWithTitles:@[
+        @"Sync every change to disk (safest, slowest)",
+        @"Sync changes in groups every half second (default)",
+        @"Don't sync (fastest, may lose recent plays on power loss)"
+    ]];
+    [self.durabilityPopup setTarget:self];
+    [self.durabilityPopup setAction:@selector(onDurabilityChanged:)];
+    [stackView addArrangedSubview:self.durabilityPopup];
+
+    // Add track field mapping label
+    NSTextField* fieldScriptsLabel = [[NSTextField alloc] init];
+    [fieldScriptsLabel setStringValue:@"Artist, title, album, album artist and track number (title formatting, empty for the tag):"];
+    [fieldScriptsLabel setBezeled:NO];
+    [fieldScriptsLabel setDrawsBackground:NO];
+    [fieldScriptsLabel setEditable:NO];
+    [stackView addArrangedSubview:fieldScriptsLabel];
+
+    // Add one script field per mapped field, showing the default script as placeholder
+    NSMutableArray<NSTextField*>* fieldScriptFields = [NSMutableArray array];
+    for (int field = 0; field < foo_lastfm::TrackMapping::field_count; field++) {
+        NSTextField* scriptField = [[NSTextField alloc] init];
+        [scriptField setPlaceholderString:@(foo_lastfm::kDefaultFieldScripts[field])];
+        [scriptField setTarget:self];
+        [scriptField setAction:@selector(onFieldScriptsChanged:)];
+        [stackView addArrangedSubview:scriptField];
+        [fieldScriptFields addObject:scriptField];
+    }
+    self.fieldScriptFields = fieldScriptFields;
+
+    // Add spacer
+    NSView* spacerQueue = [[NSView alloc] init];
+    [spacerQueue.heightAnchor constraintEqualToConstant:16].active = YES;
+    [stackView addArrangedSubview:spacerQueue];
+
+    // Add queue section label (shows the number of tracks waiting)
+    self.queueLabel = [[NSTextField alloc] init];
+    [self.queueLabel setStringValue:@"Offline queue:"];
+    [self.queueLabel setBezeled:NO];
+    [self.queueLabel setDrawsBackground:NO];
+    [self.queueLabel setEditable:NO];
+    [stackView addArrangedSubview:self.queueLabel];
+
+    // Add queue table; it only asks for the visible rows, so a backlog of any length opens at once
+    self.queueTable = [[NSTableView alloc] init];
+    NSArray* queueColumns = @[ @[ @"played", @"Played", @120 ], @[ @"artist", @"Artist", @150 ],
+                               @[ @"track", @"Title", @180 ], @[ @"album", @"Album", @150 ] ];
+    for (NSArray* column in queueColumns) {
+        NSTableColumn* tableColumn = [[NSTableColumn alloc] initWithIdentifier:column[0]];
+        [tableColumn setTitle:column[1]];
+        [tableColumn setWidth:[column[2] doubleValue]];
+        [self.queueTable addTableColumn:tableColumn];
+    }
+    [self.queueTable setAllowsMultipleSelection:YES];
+    [self.queueTable setUsesAlternatingRowBackgroundColors:YES];
+    [self.queueTable setDataSource:self];
+
+    NSScrollView* queueScrollView = [[NSScrollView alloc] init];
+    [queueScrollView setDocumentView:self.queueTable];
+    [queueScrollView setHasVerticalScroller:YES];
+    [queueScrollView setBorderType:NSBezelBorder];
+    [queueScrollView.heightAnchor constraintEqualToConstant:160].active = YES;
+    [stackView addArrangedSubview:queueScrollView];
+    [queueScrollView.widthAnchor constraintEqualToAnchor:stackView.widthAnchor].active = YES;
+
+    // Add queue editing buttons
+    NSButton* deleteSelectedButton = [NSButton buttonWithTitle:@"Delete Selected"
+                                                        target:self
+                                                        action:@selector(onDeleteSelectedClicked:)];
+    NSButton* deleteArtistButton = [NSButton buttonWithTitle:@"Delete Artist"
+                                                      target:self
+                                                      action:@selector(onDeleteArtistClicked:)];
+    NSButton* renameArtistButton = [NSButton buttonWithTitle:@"Rename Artist..."
+                                                      target:self
+                                                      action:@selector(onRenameArtistClicked:)];
+    NSStackView* queueButtons =
+        [NSStackView stackViewWithViews:@[ deleteSelectedButton, deleteArtistButton, renameArtistButton ]];
+    [stackView addArrangedSubview:queueButtons];
+
+    // Add spacer
+    NSView* spacer5 = [[NSView alloc] init];
+    [spacer5.heightAnchor constraintEqualToConstant:16].active = YES;
+    [stackView addArrangedSubview:spacer5];
+
+    // Add metrics section label
+    NSTextField* metricsTitleLabel = [[NSTextField alloc] init];
+    [metricsTitleLabel setStringValue:@"Statistics:"];
+    [metricsTitleLabel setBezeled:NO];
+    [metricsTitleLabel setDrawsBackground:NO];
+    [metricsTitleLabel setEditable:NO];
+    [stackView addArrangedSubview:metricsTitleLabel];
+
+    // Add metrics snapshot (multi-line, selectable so it can be copied into bug reports)
+    self.metricsLabel = [[NSTextField alloc] init];
+    [self.metricsLabel setBezeled:NO];
+    [self.metricsLabel setDrawsBackground:NO];
+    [self.metricsLabel setEditable:NO];
+    [self.metricsLabel setSelectable:YES];
+    [self.metricsLabel setUsesSingleLineMode:NO];
+    [self.metricsLabel setLineBreakMode:NSLineBreakByClipping];
+    [self.metricsLabel setFont:[NSFont monospacedSystemFontOfSize:10 weight:NSFontWeightRegular]];
+    [stackView addArrangedSubview:self.metricsLabel];
+
+    // Add metrics refresh button
+    NSButton* metricsRefreshButton = [[NSButton alloc] init];
+    [metricsRefreshButton setTitle:@"Refresh Statistics"];
+    [metricsRefreshButton setBezelStyle:NSBezelStyleRounded];
+    [metricsRefreshButton setTarget:self];
+    [metricsRefreshButton setAction:@selector(onRefreshMetricsClicked:)];
+    [stackView addArrangedSubview:metricsRefreshButton];
+
     // Update status label after UI setup
     [self updateStatusLabel];
     
-    if (foo_lastfm::cfg_debug_enabled.get()) {
+    if (foo_lastfm::g_runtime_config.get().debug_enabled) {
         FB2K_console_formatter() << "Last.fm UI: setupUI completed";
         FB2K_console_formatter() << "Last.fm UI: Final stackView subviews count: " << (int)stackView.arrangedSubviews.count;
         FB2K_console_formatter() << "Last.fm UI: View hierarchy ready";
@@ -316,6 +511,214 @@ static std::string mask_show_first_last(const std::string &s, size_t first = 2,
     }
 }
 
+- (void)updateMetricsLabel {
+    if (!self.metricsLabel) return;
+
+    // Show a snapshot of the lock-free scrobbler counters
+    std::string report = foo_lastfm::format_metrics_report(foo_lastfm::g_metrics.snapshot());
+    [self.metricsLabel setStringValue:@(report.c_str())];
+}
+
+- (IBAction)onRefreshMetricsClicked:(id)sender {
+    [self updateMetricsLabel];
+}
+
+// ============================================================
+// Queue table
+// ============================================================
+- (void)reloadQueue {
+    queueReloadPending = NO;
+    queuePages.clear();
+    if (foo_lastfm::g_scrobble_queue) {
+        foo_lastfm::QueuePage page = foo_lastfm::g_scrobble_queue->get_range(0, 0);
+        queueVersion = page.version;
+        queueTotal = page.total;
+    } else {
+        queueTotal = 0;
+    }
+    [self.queueTable noteNumberOfRowsChanged];
+    [self.queueTable reloadData];
+    [self updateQueueLabel];
+}
+
+- (void)updateQueueLabel {
+    [self.queueLabel setStringValue:[NSString stringWithFormat:@"Offline queue: %zu tracks waiting to be scrobbled",
+                                                               queueTotal]];
+}
+
+- (void)onQueueTimer:(NSTimer*)timer {
+    if (!foo_lastfm::g_scrobble_queue) return;
+
+    foo_lastfm::QueueChanges changes = foo_lastfm::g_scrobble_queue->get_changes(queueVersion);
+    if (changes.version == queueVersion) return;
+
+    // Removals shift the rows after them: read the visible pages again
+    if (changes.reset || !changes.removed.empty()) {
+        [self reloadQueue];
+        return;
+    }
+
+    // Edits are patched into the pages read so far; new tracks go at the end, where a partial page is read again
+    for (const auto& edited : changes.edited) {
+        for (auto& [index, entries] : queuePages) {
+            for (auto& entry : entries) {
+                if (entry.track.seq == edited.track.seq) entry = edited;
+            }
+        }
+    }
+    if (!changes.added.empty()) {
+        queuePages.erase(queuePages.lower_bound(queueTotal / kQueuePageRows), queuePages.end());
+        queueTotal += changes.added.size();
+        [self.queueTable noteNumberOfRowsChanged];
+    }
+    queueVersion = changes.version;
+    [self.queueTable reloadData];
+    [self updateQueueLabel];
+}
+
+// Returns the entry shown in a row, reading its page if needed; nullptr if the queue changed under the table
+- (const foo_lastfm::QueueEntry*)queueEntryAtRow:(NSInteger)row {
+    if (!foo_lastfm::g_scrobble_queue || row < 0) return nullptr;
+
+    const size_t index = (size_t)row / kQueuePageRows;
+    auto cached = queuePages.find(index);
+    if (cached == queuePages.end()) {
+        foo_lastfm::QueuePage page = foo_lastfm::g_scrobble_queue->get_range(index * kQueuePageRows, kQueuePageRows);
+        if (page.version != queueVersion) {
+            // Changed since the other pages were read: reload once after this redraw, however many rows saw it
+            if (!queueReloadPending) {
+                queueReloadPending = YES;
+                __weak typeof(self) weakSelf = self;
+                dispatch_async(dispatch_get_main_queue(), ^{
+                    [weakSelf reloadQueue];
+                });
+            }
+            return nullptr;
+        }
+        if (queuePages.size() >= kQueueCachedPages) {
+            // Drop the page furthest from this one
+            auto distance = [index](size_t other) { return other > index ? other - index : index - other; };
+            auto first = queuePages.begin();
+            auto last = std::prev(queuePages.end());
+            queuePages.erase(distance(first->first) > distance(last->first) ? first : last);
+        }
+        cached = queuePages.emplace(index, std::move(page.entries)).first;
+    }
+    const size_t offset = (size_t)row % kQueuePageRows;
+    return offset < cached->second.size() ? &cached->second[offset] : nullptr;
+}
+
+- (NSInteger)numberOfRowsInTableView:(NSTableView*)tableView {
+    return (NSInteger)queueTotal;
+}
+
+- (id)tableView:(NSTableView*)tableView objectValueForTableColumn:(NSTableColumn*)tableColumn row:(NSInteger)row {
+    const foo_lastfm::QueueEntry* entry = [self queueEntryAtRow:row];
+    if (!entry) return @"";
+
+    NSString* column = tableColumn.identifier;
+    if ([column isEqualToString:@"played"]) {
+        NSDate* played = [NSDate dateWithTimeIntervalSince1970:(NSTimeInterval)entry->track.timestamp];
+        return [NSDateFormatter localizedStringFromDate:played
+                                              dateStyle:NSDateFormatterShortStyle
+                                              timeStyle:NSDateFormatterShortStyle];
+    }
+    const std::string& value = [column isEqualToString:@"artist"] ? entry->track.artist
+                               : [column isEqualToString:@"track"] ? entry->track.track
+                                                                   : entry->track.album;
+    return @(value.c_str()) ?: @"";
+}
+
+// Runs a bulk change off the main thread (it may walk the whole backlog), then brings the table up to date. The
+// QueueUse keeps the queue from being deleted at quit while the change runs.
+- (void)updateQueueInBackground:(void (^)(foo_lastfm::ScrobbleQueue& queue))update {
+    if (!foo_lastfm::g_scrobble_queue) return;
+
+    __weak typeof(self) weakSelf = self;
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+        {
+            foo_lastfm::QueueUse use;
+            if (use.get()) update(*use.get());
+        }
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [weakSelf onQueueTimer:nil];
+        });
+    });
+}
+
+// Returns the artist of the first selected row, or nil without a selection
+- (NSString*)selectedQueueArtist {
+    const foo_lastfm::QueueEntry* entry = [self queueEntryAtRow:self.queueTable.selectedRow];
+    return entry ? @(entry->track.artist.c_str()) : nil;
+}
+
+- (IBAction)onDeleteSelectedClicked:(id)sender {
+    NSIndexSet* selected = self.queueTable.selectedRowIndexes;
+    if (selected.count == 0) return;
+
+    // The rows are resolved to entries in the background, against the version the table shows
+    std::vector<std::pair<size_t, size_t>> ranges;
+    [selected enumerateRangesUsingBlock:^(NSRange range, BOOL* stop) {
+        ranges.emplace_back(range.location, range.length);
+    }];
+    const uint64_t version = queueVersion;
+    [self updateQueueInBackground:^(foo_lastfm::ScrobbleQueue& queue) {
+        std::vector<uint64_t> seqs;
+        for (const auto& [offset, count] : ranges) {
+            // A segment's worth of rows per read, so a large selection never keeps the queue locked for long
+            for (size_t done = 0; done < count; done += foo_lastfm::ScrobbleQueue::kSegmentTracks) {
+                foo_lastfm::QueuePage page = queue.get_range(
+                    offset + done, std::min(count - done, foo_lastfm::ScrobbleQueue::kSegmentTracks));
+                if (page.version != version) {
+                    LASTFM_LOG_INFO("Last.fm: The queue changed before the selection was deleted - please select again");
+                    return;
+                }
+                for (const auto& entry : page.entries) seqs.push_back(entry.track.seq);
+            }
+        }
+        queue.remove_entries(seqs);
+    }];
+    [self.queueTable deselectAll:nil];
+}
+
+- (IBAction)onDeleteArtistClicked:(id)sender {
+    NSString* artist = [self selectedQueueArtist];
+    if (!artist) return;
+
+    NSAlert* confirm = [[NSAlert alloc] init];
+    [confirm setMessageText:[NSString stringWithFormat:@"Delete every queued scrobble by %@?", artist]];
+    [confirm setInformativeText:@"They will not be sent to Last.fm or ListenBrainz."];
+    [confirm addButtonWithTitle:@"Delete"];
+    [confirm addButtonWithTitle:@"Cancel"];
+    if ([confirm runModal] != NSAlertFirstButtonReturn) return;
+
+    std::string name = artist.UTF8String;
+    [self updateQueueInBackground:^(foo_lastfm::ScrobbleQueue& queue) {
+        queue.remove_if([&name](const foo_lastfm::QueuedTrack& queued) { return queued.artist == name; });
+    }];
+}
+
+- (IBAction)onRenameArtistClicked:(id)sender {
+    NSString* artist = [self selectedQueueArtist];
+    if (!artist) return;
+
+    NSAlert* prompt = [[NSAlert alloc] init];
+    [prompt setMessageText:[NSString stringWithFormat:@"Rename %@ in every queued scrobble to:", artist]];
+    [prompt addButtonWithTitle:@"Rename"];
+    [prompt addButtonWithTitle:@"Cancel"];
+    NSTextField* nameField = [[NSTextField alloc] initWithFrame:NSMakeRect(0, 0, 260, 24)];
+    [nameField setStringValue:artist];
+    [prompt setAccessoryView:nameField];
+    if ([prompt runModal] != NSAlertFirstButtonReturn || nameField.stringValue.length == 0) return;
+
+    std::string from = artist.UTF8String;
+    std::string to = nameField.stringValue.UTF8String;
+    [self updateQueueInBackground:^(foo_lastfm::ScrobbleQueue& queue) {
+        queue.edit_if([&from](const foo_lastfm::QueuedTrack& queued) { return queued.artist == from; },
+                      [&to](foo_lastfm::QueuedTrack& queued) { queued.artist = to; });
+    }];
+}
+
 - (IBAction)onToggleShow:(id)sender {
     showingSecrets = !showingSecrets;
 
@@ -352,7 +755,7 @@ static std::string mask_show_first_last(const std::string &s, size_t first = 2,
         foo_lastfm::g_lastfm_api->set_credentials(realApiKey.c_str(), realApiSecret.c_str());
     }
 
-    if (foo_lastfm::cfg_debug_enabled.get()) {
+    if (foo_lastfm::g_runtime_config.get().debug_enabled) {
         FB2K_console_formatter()
             << "Last.fm: API Key updated (length: " << (int)realApiKey.length() << ")";
     }
@@ -369,7 +772,7 @@ static std::string mask_show_first_last(const std::string &s, size_t first = 2,
 
     // Ignore input if in masked mode
     if (!showingSecrets && (entered.empty() || entered.find('*') != std::string::npos)) {
-        if (foo_lastfm::cfg_debug_enabled.get()) {
+        if (foo_lastfm::g_runtime_config.get().debug_enabled) {
             FB2K_console_formatter() << "Last.fm: Secret change ignored (masked input)";
         }
         return;
@@ -382,7 +785,7 @@ static std::string mask_show_first_last(const std::string &s, size_t first = 2,
         foo_lastfm::g_lastfm_api->set_credentials(realApiKey.c_str(), realApiSecret.c_str());
     }
 
-    if (foo_lastfm::cfg_debug_enabled.get()) {
+    if (foo_lastfm::g_runtime_config.get().debug_enabled) {
         FB2K_console_formatter()
             << "Last.fm: API Secret updated (length: " << (int)realApiSecret.length() << ")";
     }
@@ -395,11 +798,19 @@ static std::string mask_show_first_last(const std::string &s, size_t first = 2,
 }
 
 - (IBAction)onThresholdChanged:(id)sender {
+    // The label follows the drag; the threshold is stored once it ends, as every published
+    // runtime config snapshot stays allocated until quit
+    [self updateThresholdLabel];
+    NSEventType eventType = [[NSApp currentEvent] type];
+    if (eventType == NSEventTypeLeftMouseDown || eventType == NSEventTypeLeftMouseDragged) {
+        return;
+    }
+
     // Update scrobble threshold in configuration
     foo_lastfm::cfg_scrobble_percent.set([self.thresholdSlider integerValue]);
-    [self updateThresholdLabel];
+    foo_lastfm::apply_runtime_config();
 
-    if (foo_lastfm::cfg_debug_enabled.get()) {
+    if (foo_lastfm::g_runtime_config.get().debug_enabled) {
         FB2K_console_formatter()
             << "Last.fm: Scrobble threshold changed to "
             << (int)[self.thresholdSlider integerValue] << "%";
@@ -410,18 +821,55 @@ static std::string mask_show_first_last(const std::string &s, size_t first = 2,
     // Enable or disable scrobbling
     bool enabled = [self.enabledCheckbox state] == NSControlStateValueOn;
     foo_lastfm::cfg_enabled.set(enabled);
+    foo_lastfm::apply_runtime_config();
 
-    if (foo_lastfm::cfg_debug_enabled.get()) {
+    if (foo_lastfm::g_runtime_config.get().debug_enabled) {
         FB2K_console_formatter()
             << "Last.fm: Scrobbling "
             << (enabled ? "ENABLED" : "DISABLED");
     }
 }
 
+- (IBAction)onListenBrainzChanged:(id)sender {
+    // Store the ListenBrainz settings and add or remove the target right away
+    std::string url = [[self.listenBrainzUrlField stringValue] UTF8String];
+    std::string token = [[self.listenBrainzTokenField stringValue] UTF8String];
+    if (url.empty()) {
+        url = "https://api.listenbrainz.org";
+        [self.listenBrainzUrlField setStringValue:@(url.c_str())];
+    }
+    foo_lastfm::cfg_listenbrainz_url.set(url.c_str());
+    foo_lastfm::cfg_listenbrainz_token.set(token.c_str());
+    foo_lastfm::apply_listenbrainz_settings();
+
+    if (foo_lastfm::g_runtime_config.get().debug_enabled) {
+        FB2K_console_formatter()
+            << "Last.fm: ListenBrainz scrobbling "
+            << (token.empty() ? "DISABLED" : "ENABLED");
+    }
+}
+
+- (IBAction)onDurabilityChanged:(id)sender {
+    // Store the queue durability and apply it to the running queue
+    foo_lastfm::cfg_queue_durability.set([self.durabilityPopup indexOfSelectedItem]);
+    foo_lastfm::apply_queue_settings();
+}
+
+- (IBAction)onFieldScriptsChanged:(id)sender {
+    // Store the track field scripts and recompile them for the next track
+    cfg_string* fieldScripts[] = {&foo_lastfm::cfg_map_artist, &foo_lastfm::cfg_map_title, &foo_lastfm::cfg_map_album,
+                                  &foo_lastfm::cfg_map_album_artist, &foo_lastfm::cfg_map_track_number};
+    for (NSUInteger i = 0; i < self.fieldScriptFields.count; i++) {
+        fieldScripts[i]->set([[self.fieldScriptFields[i] stringValue] UTF8String]);
+    }
+    foo_lastfm::apply_track_mapping();
+}
+
 - (IBAction)onDebugChanged:(id)sender {
     // Enable or disable debug logging
     bool debug_enabled = [self.debugCheckbox state] == NSControlStateValueOn;
     foo_lastfm::cfg_debug_enabled.set(debug_enabled);
+    foo_lastfm::apply_runtime_config(); // The logger follows the snapshot
     FB2K_console_formatter()
         << "Last.fm: Debug logging "
         << (debug_enabled ? "ENABLED" : "DISABLED");
@@ -467,13 +915,13 @@ static std::string mask_show_first_last(const std::string &s, size_t first = 2,
     realApiSecret = secretStr;
     foo_lastfm::g_lastfm_api->set_credentials(keyStr.c_str(), secretStr.c_str());
 
-    if (foo_lastfm::cfg_debug_enabled.get()) {
+    if (foo_lastfm::g_runtime_config.get().debug_enabled) {
         FB2K_console_formatter() << "Last.fm: Credentials saved to config and API";
     }
 
     // Open authentication URL in browser
     std::string authURL = foo_lastfm::g_lastfm_api->get_auth_url();
-    if (foo_lastfm::cfg_debug_enabled.get()) {
+    if (foo_lastfm::g_runtime_config.get().debug_enabled) {
         std::string masked_url = authURL;
         const std::string key_param = "api_key=";
         auto pos = masked_url.find(key_param);
@@ -540,7 +988,7 @@ static std::string mask_show_first_last(const std::string &s, size_t first = 2,
             [warn setAlertStyle:NSAlertStyleWarning];
             [warn runModal];
 
-            if (foo_lastfm::cfg_debug_enabled.get()) {
+            if (foo_lastfm::g_runtime_config.get().debug_enabled) {
                 std::string input_str = [input UTF8String];
                 const std::string token_param = "token=";
                 auto pos = input_str.find(token_param);
@@ -564,7 +1012,7 @@ static std::string mask_show_first_last(const std::string &s, size_t first = 2,
             [warn setAlertStyle:NSAlertStyleWarning];
             [warn runModal];
 
-            if (foo_lastfm::cfg_debug_enabled.get()) {
+            if (foo_lastfm::g_runtime_config.get().debug_enabled) {
                 FB2K_console_formatter()
                     << "Last.fm WARNING: URL missing token parameter";
             }
@@ -573,7 +1021,7 @@ static std::string mask_show_first_last(const std::string &s, size_t first = 2,
         }
 
         // DEBUG LOG
-        if (foo_lastfm::cfg_debug_enabled.get()) {
+        if (foo_lastfm::g_runtime_config.get().debug_enabled) {
             FB2K_console_formatter()
                 << "Last.fm: Processing token input (length: "
                 << (int)inputStr.length() << ")";
@@ -603,13 +1051,13 @@ static std::string mask_show_first_last(const std::string &s, size_t first = 2,
             [errorAlert setAlertStyle:NSAlertStyleWarning];
             [errorAlert runModal];
 
-            if (foo_lastfm::cfg_debug_enabled.get()) {
+            if (foo_lastfm::g_runtime_config.get().debug_enabled) {
                 FB2K_console_formatter() << "Last.fm ERROR: Failed to extract token from input";
             }
             return;
         }
 
-        if (foo_lastfm::cfg_debug_enabled.get()) {
+        if (foo_lastfm::g_runtime_config.get().debug_enabled) {
             FB2K_console_formatter()
                 << "Last.fm: Extracted token (length: "
                 << (int)token.length()
@@ -648,7 +1096,7 @@ static std::string mask_show_first_last(const std::string &s, size_t first = 2,
                             clean.end());
                 foo_lastfm::cfg_session_key.set(clean.c_str());
 
-                if (foo_lastfm::cfg_debug_enabled.get()) {
+                if (foo_lastfm::g_runtime_config.get().debug_enabled) {
                     FB2K_console_formatter() << "Last.fm: Authentication SUCCESSFUL! Session key saved.";
                 }
 
@@ -662,7 +1110,7 @@ static std::string mask_show_first_last(const std::string &s, size_t first = 2,
                     [weakSelf updateStatusLabel];
                 });
             } else {
-                if (foo_lastfm::cfg_debug_enabled.get()) {
+                if (foo_lastfm::g_runtime_config.get().debug_enabled) {
                     FB2K_console_formatter() << "Last.fm ERROR: Authentication FAILED";
                 }
 
@@ -681,7 +1129,7 @@ static std::string mask_show_first_last(const std::string &s, size_t first = 2,
             }
         });
     } else {
-        if (foo_lastfm::cfg_debug_enabled.get()) {
+        if (foo_lastfm::g_runtime_config.get().debug_enabled) {
             FB2K_console_formatter() << "Last.fm: Authentication cancelled by user";
         }
     }
@@ -693,15 +1141,15 @@ namespace foo_lastfm {
     class preferences_page_lastfm : public preferences_page {
     public:
         service_ptr instantiate() override {
-            if (foo_lastfm::cfg_debug_enabled.get()) {
+            if (foo_lastfm::g_runtime_config.get().debug_enabled) {
                 FB2K_console_formatter() << "Last.fm UI: preferences_page instantiate() called";
             }
             auto controller = [fooLastfmMacPreferences new];
-            if (foo_lastfm::cfg_debug_enabled.get()) {
+            if (foo_lastfm::g_runtime_config.get().debug_enabled) {
                 FB2K_console_formatter() << "Last.fm UI: fooLastfmMacPreferences controller created";
             }
             auto wrapped = fb2k::wrapNSObject(controller);
-            if (foo_lastfm::cfg_debug_enabled.get()) {
+            if (foo_lastfm::g_runtime_config.get().debug_enabled) {
                 FB2K_console_formatter() << "Last.fm UI: NSObject wrapped for foobar2000";
             }
             return wrapped;
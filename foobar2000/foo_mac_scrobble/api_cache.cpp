@@ -0,0 +1,358 @@
+//
+//  api_cache.cpp
+//  foo_mac_scrobble
+//
+//  Created by Oleksandr Velychko on 18/10/2026.
+//
+
+#include "api_cache.h"
+
+#include "async_logger.h"
+#include "clock.h"
+#include "durable_file.h"
+#include "platform.h"
+
+#include <cstring>
+#include <filesystem>
+#include <iterator>
+
+namespace foo_lastfm
+{
+
+ApiCache* g_api_cache = nullptr;
+
+// ============================================================
+// Policy
+// ============================================================
+static constexpr int64_t kHour = 3600;
+static constexpr int64_t kDay = 24 * kHour;
+// How long a "not found" answer is trusted (Last.fm may learn the track later)
+static constexpr int64_t kNegativeTtl = kDay;
+// Counters of the user (userplaycount, userloved) change with every scrobble
+static constexpr int64_t kUserTtl = kHour;
+// Rough per-entry overhead of the list node, map slot and strings
+static constexpr size_t kEntryOverhead = 128;
+
+int64_t ApiCache::ttl_for(const std::map<std::string, std::string>& params)
+{
+    auto it = params.find("method");
+    if (it == params.end())
+        return 0;
+    const std::string& method = it->second;
+
+    if (method == "track.getCorrection" || method == "artist.getCorrection")
+        return 30 * kDay;
+    if (method == "track.getInfo" || method == "artist.getInfo" || method == "album.getInfo")
+        return params.count("username") != 0 ? kUserTtl : 7 * kDay;
+    return 0;
+}
+
+void ApiCache::make_key(const std::map<std::string, std::string>& params, std::string& key)
+{
+    // Credentials do not change the answer, so they stay out of the key
+    key.clear();
+    key += params.at("method");
+    for (const auto& [name, value] : params)
+    {
+        if (name == "method" || name == "api_key" || name == "api_sig" || name == "sk" || name == "format")
+            continue;
+        key += '\x1f';
+        key += name;
+        key += '=';
+        key += value;
+    }
+}
+
+// ============================================================
+// Segment file
+// ============================================================
+// "LFMCACH1" followed by records (native byte order):
+//   i64 expires, u8 negative, u32 key length, u32 body length, key, body
+// A later record for the same key replaces the earlier one.
+static const char kCacheMagic[8] = {'L', 'F', 'M', 'C', 'A', 'C', 'H', '1'};
+static constexpr size_t kRecordHeader = sizeof(int64_t) + 1 + 2 * sizeof(uint32_t);
+// Rewrite the file on load once stale records take more than half of it and it is worth the work
+static constexpr uint64_t kCompactMinBytes = 1024 * 1024;
+
+template <typename T> static void put(std::string& out, T value)
+{
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T> static T get_at(const std::string& in, size_t pos)
+{
+    T value;
+    memcpy(&value, in.data() + pos, sizeof(value));
+    return value;
+}
+
+static std::string encode_record(const std::string& key, const std::string& body, int64_t expires, bool negative)
+{
+    std::string record;
+    record.reserve(kRecordHeader + key.size() + body.size());
+    put(record, expires);
+    put(record, static_cast<uint8_t>(negative ? 1 : 0));
+    put(record, static_cast<uint32_t>(key.size()));
+    put(record, static_cast<uint32_t>(body.size()));
+    record += key;
+    record += body;
+    return record;
+}
+
+ApiCache::ApiCache(size_t memory_budget) : m_memory_budget(memory_budget)
+{
+    m_file_path = platform().profile_dir();
+    m_file_path += "lastfm_api_cache.bin";
+    load();
+}
+
+void ApiCache::load()
+{
+    std::string data;
+    {
+        std::ifstream file(m_file_path, std::ios::binary);
+        if (file.is_open())
+            data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+
+    const int64_t now = current_clock().now_seconds();
+    size_t pos = sizeof(kCacheMagic);
+    uint64_t live_bytes = 0;
+    const bool valid = data.size() >= sizeof(kCacheMagic) && memcmp(data.data(), kCacheMagic, sizeof(kCacheMagic)) == 0;
+    while (valid && data.size() - pos >= kRecordHeader)
+    {
+        const int64_t expires = get_at<int64_t>(data, pos);
+        const bool negative = data[pos + sizeof(int64_t)] != 0;
+        const uint32_t key_length = get_at<uint32_t>(data, pos + sizeof(int64_t) + 1);
+        const uint32_t body_length = get_at<uint32_t>(data, pos + sizeof(int64_t) + 1 + sizeof(uint32_t));
+        const size_t record_size = kRecordHeader + key_length + body_length;
+        if (data.size() - pos < record_size)
+            break;
+
+        std::string key = data.substr(pos + kRecordHeader, key_length);
+        auto previous = m_disk.find(key);
+        if (previous != m_disk.end())
+        {
+            live_bytes -= kRecordHeader + key.size() + previous->second.length;
+            m_disk.erase(previous);
+        }
+        if (expires > now)
+        {
+            live_bytes += record_size;
+            m_disk[std::move(key)] = {pos + kRecordHeader + key_length, body_length, expires, negative};
+        }
+        pos += record_size;
+    }
+
+    // Unknown format, torn tail or mostly stale: rewrite the live records into a fresh file
+    const size_t file_size = valid ? pos : 0;
+    const bool rewrite =
+        !valid || file_size != data.size() ||
+        (file_size > kCompactMinBytes && live_bytes < (file_size - sizeof(kCacheMagic)) / 2);
+    if (rewrite)
+    {
+        std::string compacted(kCacheMagic, sizeof(kCacheMagic));
+        compacted.reserve(sizeof(kCacheMagic) + live_bytes);
+        for (auto& [key, entry] : m_disk)
+        {
+            const std::string body = data.substr(entry.offset, entry.length);
+            const uint64_t offset = compacted.size() + kRecordHeader + key.size();
+            compacted += encode_record(key, body, entry.expires, entry.negative);
+            entry.offset = offset;
+        }
+
+        // The offsets above point into the new file, so a failed write must not leave the old one in place.
+        // The cache is only a cache: no sync, a crash at worst loses it.
+        if (!replace_file(m_file_path, compacted, false))
+        {
+            LASTFM_LOG_INFO("Last.fm: Failed to rewrite the API cache, starting empty");
+            m_disk.clear();
+            std::error_code ec;
+            std::filesystem::remove(m_file_path, ec);
+        }
+        else if (data.size() > compacted.size())
+        {
+            LASTFM_LOG_DEBUG("Last.fm: API cache compacted from %zu to %zu bytes", data.size(), compacted.size());
+        }
+    }
+
+    m_file.open(m_file_path, std::ios::in | std::ios::out | std::ios::binary | std::ios::app);
+    m_file.seekg(0, std::ios::end);
+    m_file_size = static_cast<uint64_t>(m_file.tellg());
+    if (m_file_size == 0)
+    {
+        m_file.write(kCacheMagic, sizeof(kCacheMagic));
+        m_file.flush();
+        m_file_size = sizeof(kCacheMagic);
+    }
+    LASTFM_LOG_DEBUG("Last.fm: API cache loaded, %zu responses on disk", m_disk.size());
+}
+
+bool ApiCache::read_body(const DiskEntry& entry, std::string& body)
+{
+    std::lock_guard<std::mutex> lock(m_file_mutex);
+    body.resize(entry.length);
+    m_file.clear();
+    m_file.seekg(static_cast<std::streamoff>(entry.offset));
+    return static_cast<bool>(m_file.read(body.data(), static_cast<std::streamsize>(entry.length)));
+}
+
+bool ApiCache::append(const std::string& key, const std::string& body, int64_t expires, bool negative,
+                      DiskEntry& entry)
+{
+    const std::string record = encode_record(key, body, expires, negative);
+    std::lock_guard<std::mutex> lock(m_file_mutex);
+    m_file.clear();
+    if (!m_file.write(record.data(), static_cast<std::streamsize>(record.size())) || !m_file.flush())
+        return false;
+    entry = {m_file_size + kRecordHeader + key.size(), static_cast<uint32_t>(body.size()), expires, negative};
+    m_file_size += record.size();
+    return true;
+}
+
+// ============================================================
+// Lookups
+// ============================================================
+void ApiCache::remember(const std::string& key, const std::string& body, int64_t expires, bool negative)
+{
+    auto it = m_memory.find(key);
+    if (it != m_memory.end())
+    {
+        m_memory_bytes -= kEntryOverhead + it->second->key.size() + it->second->body.size();
+        m_lru.erase(it->second);
+        m_memory.erase(it);
+    }
+
+    // A response larger than an eighth of the budget would evict too much; it stays on disk only
+    const size_t size = kEntryOverhead + key.size() + body.size();
+    if (size > m_memory_budget / 8)
+        return;
+
+    m_lru.push_front({key, body, expires, negative});
+    m_memory.emplace(m_lru.front().key, m_lru.begin());
+    m_memory_bytes += size;
+    while (m_memory_bytes > m_memory_budget && !m_lru.empty())
+    {
+        const MemoryEntry& last = m_lru.back();
+        m_memory_bytes -= kEntryOverhead + last.key.size() + last.body.size();
+        m_memory.erase(last.key);
+        m_lru.pop_back();
+    }
+}
+
+ApiCacheResult ApiCache::get(const std::map<std::string, std::string>& params,
+                             const std::function<ApiCacheResult(std::string& body)>& fetch, std::string& out)
+{
+    const int64_t ttl = ttl_for(params);
+    if (ttl == 0)
+        return fetch(out);
+
+    // Built in a per-thread buffer, so a memory hit does not allocate
+    thread_local std::string key_buffer;
+    make_key(params, key_buffer);
+    const int64_t now = current_clock().now_seconds();
+    std::string key;
+    std::promise<Fetched> promise;
+    DiskEntry disk_entry{};
+    bool on_disk = false;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        auto it = m_memory.find(key_buffer);
+        if (it != m_memory.end() && it->second->expires > now)
+        {
+            m_lru.splice(m_lru.begin(), m_lru, it->second);
+            ++m_stats.memory_hits;
+            if (it->second->negative)
+            {
+                ++m_stats.negative_hits;
+                return ApiCacheResult::not_found;
+            }
+            out = it->second->body;
+            return ApiCacheResult::ok;
+        }
+
+        key = key_buffer;
+        auto inflight = m_inflight.find(key);
+        if (inflight != m_inflight.end())
+        {
+            std::shared_future<Fetched> shared = inflight->second;
+            ++m_stats.coalesced;
+            lock.unlock();
+            const Fetched& fetched = shared.get();
+            out = fetched.body;
+            return fetched.result;
+        }
+
+        auto disk = m_disk.find(key);
+        if (disk != m_disk.end() && disk->second.expires > now)
+        {
+            disk_entry = disk->second;
+            on_disk = true;
+        }
+        m_inflight.emplace(key, promise.get_future().share());
+    }
+
+    // This caller owns the key until the promise is fulfilled
+    Fetched fetched{ApiCacheResult::failed, std::string()};
+    bool from_disk = false;
+    if (on_disk && (disk_entry.negative || read_body(disk_entry, fetched.body)))
+    {
+        fetched.result = disk_entry.negative ? ApiCacheResult::not_found : ApiCacheResult::ok;
+        from_disk = true;
+    }
+    else
+    {
+        try
+        {
+            fetched.result = fetch(fetched.body);
+        }
+        catch (...)
+        {
+            fetched.result = ApiCacheResult::failed;
+        }
+    }
+
+    const bool negative = fetched.result == ApiCacheResult::not_found;
+    const int64_t expires = from_disk ? disk_entry.expires : now + (negative ? kNegativeTtl : ttl);
+    if (negative)
+        fetched.body.clear();
+
+    DiskEntry appended{};
+    const bool store = !from_disk && fetched.result != ApiCacheResult::failed;
+    const bool stored = store && append(key, fetched.body, expires, negative, appended);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (from_disk)
+        {
+            ++m_stats.disk_hits;
+            if (negative)
+                ++m_stats.negative_hits;
+        }
+        else
+        {
+            ++m_stats.fetches;
+        }
+        if (fetched.result != ApiCacheResult::failed)
+            remember(key, fetched.body, expires, negative);
+        if (stored)
+            m_disk[key] = appended;
+        m_inflight.erase(key);
+    }
+
+    out = fetched.body;
+    const ApiCacheResult result = fetched.result;
+    promise.set_value(std::move(fetched));
+    return result;
+}
+
+ApiCacheStats ApiCache::stats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ApiCacheStats stats = m_stats;
+    stats.memory_entries = m_lru.size();
+    stats.memory_bytes = m_memory_bytes;
+    stats.disk_entries = m_disk.size();
+    return stats;
+}
+
+} // namespace foo_lastfm
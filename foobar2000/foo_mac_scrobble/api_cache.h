@@ -0,0 +1,126 @@
+//
+//  api_cache.h
+//  foo_mac_scrobble
+//
+//  Created by Oleksandr Velychko on 18/10/2026.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace foo_lastfm
+{
+
+// Outcome of a read request, as cached by ApiCache
+enum class ApiCacheResult
+{
+    ok,        // Response body available
+    not_found, // Last.fm does not know the item; cached as a negative answer
+    failed     // Network or server failure; never cached
+};
+
+// Counters for benchmarks and the debug log
+struct ApiCacheStats
+{
+    uint64_t memory_hits = 0;   // Answered from the LRU
+    uint64_t disk_hits = 0;     // Answered from the segment file
+    uint64_t negative_hits = 0; // Hits on a cached "not found"
+    uint64_t fetches = 0;       // Network requests made
+    uint64_t coalesced = 0;     // Misses that waited for another caller's fetch
+    size_t memory_entries = 0;  // Responses in the LRU
+    size_t memory_bytes = 0;    // Approximate LRU size
+    size_t disk_entries = 0;    // Live responses in the segment file
+};
+
+// Two-tier cache for read-only Last.fm requests (track.getInfo, artist.getInfo, track.getCorrection ...).
+// Responses live in a memory-bounded LRU backed by an append-only segment file in the profile directory,
+// each with a per-method TTL; "not found" answers are cached for a shorter time. Concurrent misses for
+// the same request share one fetch. Methods without a TTL (scrobbling, history pages) bypass the cache.
+class ApiCache
+{
+  public:
+    static constexpr size_t kDefaultMemoryBudget = 4 * 1024 * 1024;
+
+    // Constructor: Loads the segment index from the profile directory (compacting it if mostly stale)
+    explicit ApiCache(size_t memory_budget = kDefaultMemoryBudget);
+
+    // Returns how long responses of a request stay fresh in seconds (0 = not cacheable)
+    static int64_t ttl_for(const std::map<std::string, std::string>& params);
+    // Returns the response to a request, calling fetch on a miss. fetch runs once per key even when
+    // several threads miss at the same time; the others wait for its result.
+    ApiCacheResult get(const std::map<std::string, std::string>& params,
+                       const std::function<ApiCacheResult(std::string& body)>& fetch, std::string& out);
+    // Returns the hit/miss counters and sizes
+    ApiCacheStats stats() const;
+
+  private:
+    // A response held in memory
+    struct MemoryEntry
+    {
+        std::string key;
+        std::string body;
+        int64_t expires;
+        bool negative;
+    };
+
+    // A response in the segment file
+    struct DiskEntry
+    {
+        uint64_t offset; // Offset of the body in the file
+        uint32_t length; // Body length
+        int64_t expires;
+        bool negative;
+    };
+
+    // Result shared by coalesced callers
+    struct Fetched
+    {
+        ApiCacheResult result;
+        std::string body;
+    };
+
+    // Builds the cache key from the request parameters (method first, then sorted parameters)
+    static void make_key(const std::map<std::string, std::string>& params, std::string& key);
+    // Inserts or refreshes a response in the LRU and evicts down to the budget; m_mutex must be held
+    void remember(const std::string& key, const std::string& body, int64_t expires, bool negative);
+    // Reads a body from the segment file
+    bool read_body(const DiskEntry& entry, std::string& body);
+    // Appends a response to the segment file and returns its index entry
+    bool append(const std::string& key, const std::string& body, int64_t expires, bool negative, DiskEntry& entry);
+    // Builds the segment index; rewrites the file when most of it is stale
+    void load();
+
+    // Path to the segment file
+    std::string m_file_path;
+    // Bytes the LRU may hold
+    size_t m_memory_budget;
+    // Guards everything below except the file
+    mutable std::mutex m_mutex;
+    // LRU, most recent first; the map's keys point into the list nodes
+    std::list<MemoryEntry> m_lru;
+    std::unordered_map<std::string_view, std::list<MemoryEntry>::iterator> m_memory;
+    size_t m_memory_bytes = 0;
+    // Segment index
+    std::unordered_map<std::string, DiskEntry> m_disk;
+    // Fetches in flight by key
+    std::unordered_map<std::string, std::shared_future<Fetched>> m_inflight;
+    ApiCacheStats m_stats;
+    // Guards the segment file handle
+    std::mutex m_file_mutex;
+    std::fstream m_file;
+    uint64_t m_file_size = 0;
+};
+
+extern ApiCache* g_api_cache;
+
+} // namespace foo_lastfm
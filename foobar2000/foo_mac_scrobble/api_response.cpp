@@ -0,0 +1,287 @@
+//
+//  api_response.cpp
+//  foo_mac_scrobble
+//
+//  Created by Oleksandr Velychko on 18/10/2026.
+//
+
+#include "api_response.h"
+
+#include <nlohmann/json.hpp>
+#include <string_view>
+
+using json = nlohmann::json;
+
+namespace foo_lastfm
+{
+
+// Keys the decoder looks at; any other key is Key::other
+enum class Key : uint8_t
+{
+    other,
+    item, // Element of an array
+    error,
+    message,
+    session,
+    key,
+    name,
+    scrobbles,
+    attr,
+    accepted,
+    ignored,
+    page_root,
+    page,
+    total_pages,
+    total,
+    track,
+    userplaycount,
+    userloved,
+    text,
+    uts,
+    nowplaying,
+    date,
+    album,
+    artist,
+};
+
+static constexpr struct
+{
+    std::string_view name;
+    Key key;
+} kKeys[] = {
+    {"error", Key::error},
+    {"message", Key::message},
+    {"session", Key::session},
+    {"key", Key::key},
+    {"name", Key::name},
+    {"scrobbles", Key::scrobbles},
+    {"@attr", Key::attr},
+    {"accepted", Key::accepted},
+    {"ignored", Key::ignored},
+    {"recenttracks", Key::page_root},
+    {"lovedtracks", Key::page_root},
+    {"page", Key::page},
+    {"totalPages", Key::total_pages},
+    {"total", Key::total},
+    {"track", Key::track},
+    {"userplaycount", Key::userplaycount},
+    {"userloved", Key::userloved},
+    {"#text", Key::text},
+    {"uts", Key::uts},
+    {"nowplaying", Key::nowplaying},
+    {"date", Key::date},
+    {"album", Key::album},
+    {"artist", Key::artist},
+};
+
+static Key lookup(std::string_view name)
+{
+    for (const auto& entry : kKeys)
+    {
+        if (entry.name == name)
+            return entry.key;
+    }
+    return Key::other;
+}
+
+// A scalar as Last.fm sends it: counters arrive as JSON numbers or as strings depending on the method
+struct Scalar
+{
+    const std::string* text; // Source text (nullptr for an integer)
+    uint64_t number;         // Value of an integer
+};
+
+static uint64_t to_uint(const Scalar& value)
+{
+    if (!value.text)
+        return value.number;
+    uint64_t number = 0;
+    for (char c : *value.text)
+    {
+        if (c < '0' || c > '9')
+            break;
+        number = number * 10 + static_cast<uint64_t>(c - '0');
+    }
+    return number;
+}
+
+static void assign(std::string& to, const Scalar& value)
+{
+    if (value.text)
+        to = *value.text;
+    else
+        to = std::to_string(value.number);
+}
+
+// ============================================================
+// SAX handler
+// ============================================================
+// Tracks the keys from the root to the current value in a fixed array, so skipping the rest of a large answer
+// allocates nothing. Strings handed over by the parser live in its token buffer and are copied only when kept.
+// Last.fm returns "track" of a page as an object instead of an array when the page holds a single row.
+class ApiResponseSax : public nlohmann::json_sax<json>
+{
+  public:
+    explicit ApiResponseSax(ApiResponse& out) : m_out(out) {}
+
+    bool null() override { return true; }
+    bool boolean(bool) override { return true; }
+    bool number_integer(number_integer_t value) override
+    {
+        return scalar({nullptr, static_cast<uint64_t>(value < 0 ? 0 : value)});
+    }
+    bool number_unsigned(number_unsigned_t value) override { return scalar({nullptr, value}); }
+    bool number_float(number_float_t, const string_t& text) override { return scalar({&text, 0}); }
+    bool string(string_t& value) override { return scalar({&value, 0}); }
+    bool binary(binary_t&) override { return true; }
+
+    bool start_object(std::size_t) override
+    {
+        if (m_out.page && is_track_parent())
+        {
+            m_track_depth = m_depth + 1;
+            m_track = LastfmApi::RecentTrack();
+        }
+        push(Key::other);
+        return true;
+    }
+
+    bool key(string_t& value) override
+    {
+        const Key key = lookup(value);
+        if (m_depth <= kMaxDepth)
+            m_path[m_depth - 1] = key;
+        if (m_depth == 1 && key == Key::track)
+            m_out.has_track = true;
+        return true;
+    }
+
+    bool end_object() override
+    {
+        --m_depth;
+        if (m_track_depth != 0 && m_depth + 1 == m_track_depth)
+        {
+            m_out.page->tracks.push_back(std::move(m_track));
+            m_track_depth = 0;
+        }
+        return true;
+    }
+
+    bool start_array(std::size_t) override
+    {
+        push(Key::item);
+        return true;
+    }
+
+    bool end_array() override
+    {
+        --m_depth;
+        return true;
+    }
+
+    bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception& e) override
+    {
+        m_out.parse_error = e.what();
+        return false;
+    }
+
+  private:
+    // Deeper levels are tracked by count only; none of the decoded fields is that deep
+    static constexpr size_t kMaxDepth = 8;
+
+    ApiResponse& m_out;
+    Key m_path[kMaxDepth] = {};
+    size_t m_depth = 0;
+    LastfmApi::RecentTrack m_track;
+    size_t m_track_depth = 0; // Depth inside the current track object (0 when outside)
+
+    void push(Key key)
+    {
+        if (m_depth < kMaxDepth)
+            m_path[m_depth] = key;
+        ++m_depth;
+    }
+
+    Key at(size_t level) const { return level < m_depth && level < kMaxDepth ? m_path[level] : Key::other; }
+
+    bool is_track_parent() const
+    {
+        if (m_depth < 2 || at(0) != Key::page_root || at(1) != Key::track)
+            return false;
+        return m_depth == 2 || (m_depth == 3 && at(2) == Key::item);
+    }
+
+    bool scalar(const Scalar& value)
+    {
+        if (m_track_depth != 0 && m_depth >= m_track_depth)
+        {
+            row(value);
+            return true;
+        }
+
+        switch (m_depth)
+        {
+        case 1:
+            if (at(0) == Key::error)
+                m_out.error = static_cast<int>(to_uint(value));
+            else if (at(0) == Key::message)
+                assign(m_out.message, value);
+            break;
+        case 2:
+            if (at(0) == Key::session && at(1) == Key::key)
+                assign(m_out.session_key, value);
+            else if (at(0) == Key::session && at(1) == Key::name)
+                assign(m_out.session_name, value);
+            else if (at(0) == Key::track && at(1) == Key::userplaycount)
+                m_out.user_playcount = static_cast<uint32_t>(to_uint(value));
+            else if (at(0) == Key::track && at(1) == Key::userloved)
+                m_out.user_loved = to_uint(value) != 0;
+            break;
+        case 3:
+            if (at(0) == Key::scrobbles && at(1) == Key::attr)
+            {
+                if (at(2) == Key::accepted)
+                    m_out.accepted = static_cast<uint32_t>(to_uint(value));
+                else if (at(2) == Key::ignored)
+                    m_out.ignored = static_cast<uint32_t>(to_uint(value));
+            }
+            else if (m_out.page && at(0) == Key::page_root && at(1) == Key::attr)
+            {
+                if (at(2) == Key::page)
+                    m_out.page->page = static_cast<int>(to_uint(value));
+                else if (at(2) == Key::total_pages)
+                    m_out.page->total_pages = static_cast<int>(to_uint(value));
+                else if (at(2) == Key::total)
+                    m_out.page->total = to_uint(value);
+            }
+            break;
+        default:
+            break;
+        }
+        return true;
+    }
+
+    void row(const Scalar& value)
+    {
+        const Key field = at(m_track_depth - 1);
+        const Key sub = m_depth > m_track_depth ? at(m_track_depth) : Key::other;
+        if (m_depth == m_track_depth && field == Key::name)
+            assign(m_track.track, value);
+        else if (field == Key::artist && (sub == Key::text || sub == Key::name))
+            assign(m_track.artist, value);
+        else if (field == Key::album && sub == Key::text)
+            assign(m_track.album, value);
+        else if (field == Key::date && sub == Key::uts)
+            m_track.timestamp = static_cast<time_t>(to_uint(value));
+        else if (field == Key::attr && sub == Key::nowplaying)
+            m_track.now_playing = value.text && *value.text == "true";
+    }
+};
+
+bool decode_api_response(const std::string& body, ApiResponse& out)
+{
+    ApiResponseSax sax(out);
+    return json::sax_parse(body, &sax);
+}
+
+} // namespace foo_lastfm
@@ -0,0 +1,39 @@
+//
+//  api_response.h
+//  foo_mac_scrobble
+//
+//  Created by Oleksandr Velychko on 18/10/2026.
+//
+
+#pragma once
+
+#include "lastfm_api.h"
+
+#include <cstdint>
+#include <string>
+
+namespace foo_lastfm
+{
+
+// The fields of a Last.fm answer the component acts on. Which of them are set depends on the method.
+struct ApiResponse
+{
+    int error = 0;               // Last.fm error code (0 when the answer is not an error)
+    std::string message;         // Error message
+    std::string session_key;     // session.key (auth.getSession)
+    std::string session_name;    // session.name
+    uint32_t accepted = 0;       // scrobbles.@attr.accepted (track.scrobble)
+    uint32_t ignored = 0;        // scrobbles.@attr.ignored
+    bool has_track = false;      // The answer has a "track" object (track.getInfo)
+    uint32_t user_playcount = 0; // track.userplaycount
+    bool user_loved = false;     // track.userloved
+    std::string parse_error;     // Why the body is not well-formed JSON
+    // Receives page, total_pages, total and the rows of a recenttracks or lovedtracks page when set
+    LastfmApi::RecentTracksPage* page = nullptr;
+};
+
+// Decodes body in one streaming pass, without building a DOM: only the fields above are copied out, everything
+// else is skipped as it is read. Returns false when body is not well-formed JSON. out.page is kept.
+bool decode_api_response(const std::string& body, ApiResponse& out);
+
+} // namespace foo_lastfm
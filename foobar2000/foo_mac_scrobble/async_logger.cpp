@@ -0,0 +1,381 @@
+//
+//  async_logger.cpp
+//  foo_mac_scrobble
+//
+//  Created by Oleksandr Velychko on 18/10/2026.
+//
+
+#include "async_logger.h"
+
+#include "metrics.h"
+
+#include <cstdarg>
+#include <cstdio>
+
+namespace foo_lastfm
+{
+
+AsyncLogger g_logger;
+
+// ============================================================
+// Record argument capture
+// ============================================================
+void LogRecord::push_signed(int64_t v)
+{
+    if (argc >= kMaxArgs)
+        return;
+    args[argc].type = LogArgType::i64;
+    args[argc].i = v;
+    ++argc;
+}
+
+void LogRecord::push_unsigned(uint64_t v)
+{
+    if (argc >= kMaxArgs)
+        return;
+    args[argc].type = LogArgType::u64;
+    args[argc].u = v;
+    ++argc;
+}
+
+void LogRecord::push_double(double v)
+{
+    if (argc >= kMaxArgs)
+        return;
+    args[argc].type = LogArgType::f64;
+    args[argc].d = v;
+    ++argc;
+}
+
+void LogRecord::push_string(const char* v, size_t length)
+{
+    if (argc >= kMaxArgs)
+        return;
+
+    // Long strings are truncated to whatever is left of the string area
+    const size_t space = kStringBytes - string_used;
+    const size_t n = length < space ? length : space;
+    memcpy(strings + string_used, v, n);
+
+    args[argc].type = LogArgType::str;
+    args[argc].s.offset = string_used;
+    args[argc].s.length = static_cast<uint16_t>(n);
+    string_used = static_cast<uint16_t>(string_used + n);
+    ++argc;
+}
+
+// ============================================================
+// Deferred formatting
+// ============================================================
+static bool is_length_modifier(char c)
+{
+    return c == 'h' || c == 'l' || c == 'L' || c == 'q' || c == 'j' || c == 'z' || c == 't';
+}
+
+static void append_formatted(std::string& out, const char* spec, ...)
+{
+    char buf[256];
+    va_list args;
+    va_start(args, spec);
+    const int n = vsnprintf(buf, sizeof(buf), spec, args);
+    va_end(args);
+    if (n > 0)
+        out.append(buf, static_cast<size_t>(n) < sizeof(buf) ? static_cast<size_t>(n) : sizeof(buf) - 1);
+}
+
+void format_log_record(const LogRecord& record, std::string& out)
+{
+    out.clear();
+    const char* p = record.fmt;
+    if (!p)
+        return;
+
+    size_t next_arg = 0;
+    while (*p)
+    {
+        if (*p != '%')
+        {
+            const char* literal = p;
+            while (*p && *p != '%')
+                ++p;
+            out.append(literal, p - literal);
+            continue;
+        }
+        if (p[1] == '%')
+        {
+            out += '%';
+            p += 2;
+            continue;
+        }
+
+        // Copy flags, width and precision; drop the caller's length modifier since the
+        // captured value already carries its own width
+        char spec[32];
+        size_t spec_len = 0;
+        spec[spec_len++] = *p++;
+        while (*p && strchr("-+ #0123456789.", *p) && spec_len < sizeof(spec) - 4)
+            spec[spec_len++] = *p++;
+        while (*p && is_length_modifier(*p))
+            ++p;
+        const char conv = *p ? *p++ : 's';
+
+        if (next_arg >= record.argc)
+        {
+            out += "<?>";
+            continue;
+        }
+        const LogArg& arg = record.args[next_arg++];
+
+        switch (conv)
+        {
+        case 'd':
+        case 'i':
+        case 'u':
+        case 'x':
+        case 'X':
+        case 'o':
+        case 'c':
+        {
+            const bool as_signed = (conv == 'd' || conv == 'i') && arg.type == LogArgType::i64;
+            if (conv == 'c')
+            {
+                spec[spec_len++] = 'c';
+            }
+            else
+            {
+                spec[spec_len++] = 'l';
+                spec[spec_len++] = 'l';
+                spec[spec_len++] = (conv == 'd' || conv == 'i') ? (as_signed ? 'd' : 'u') : conv;
+            }
+            spec[spec_len] = '\0';
+
+            long long v = 0;
+            if (arg.type == LogArgType::i64)
+                v = arg.i;
+            else if (arg.type == LogArgType::u64)
+                v = static_cast<long long>(arg.u);
+            else if (arg.type == LogArgType::f64)
+                v = static_cast<long long>(arg.d);
+
+            if (conv == 'c')
+                append_formatted(out, spec, static_cast<int>(v));
+            else
+                append_formatted(out, spec, v);
+            break;
+        }
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+        {
+            spec[spec_len++] = conv;
+            spec[spec_len] = '\0';
+            double v = arg.d;
+            if (arg.type == LogArgType::i64)
+                v = static_cast<double>(arg.i);
+            else if (arg.type == LogArgType::u64)
+                v = static_cast<double>(arg.u);
+            append_formatted(out, spec, v);
+            break;
+        }
+        default:
+        {
+            // %s, %p and anything unknown
+            if (arg.type == LogArgType::str)
+            {
+                spec[spec_len++] = '.';
+                spec[spec_len++] = '*';
+                spec[spec_len++] = 's';
+                spec[spec_len] = '\0';
+                append_formatted(out, spec, static_cast<int>(arg.s.length), record.strings + arg.s.offset);
+            }
+            else if (arg.type == LogArgType::f64)
+                append_formatted(out, "%g", arg.d);
+            else if (arg.type == LogArgType::i64)
+                append_formatted(out, "%lld", static_cast<long long>(arg.i));
+            else if (conv == 'p')
+                append_formatted(out, "0x%llx", static_cast<unsigned long long>(arg.u));
+            else
+                append_formatted(out, "%llu", static_cast<unsigned long long>(arg.u));
+            break;
+        }
+        }
+    }
+}
+
+// ============================================================
+// Ring buffer
+// ============================================================
+AsyncLogger::AsyncLogger()
+{
+    static_assert((kCapacity & (kCapacity - 1)) == 0, "Log ring capacity must be a power of two");
+    for (size_t i = 0; i < kCapacity; ++i)
+        m_ring[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+AsyncLogger::~AsyncLogger()
+{
+    // Only join here: the console is no longer available during static destruction
+    if (m_running.exchange(false))
+    {
+        {
+            // The flusher is now either before its check of m_running or waiting
+            std::lock_guard<std::mutex> lock(m_wake_mutex);
+        }
+        m_wake.notify_all();
+        if (m_thread.joinable())
+            m_thread.join();
+    }
+}
+
+void AsyncLogger::set_sink(std::function<void(const char*)> sink)
+{
+    std::lock_guard<std::mutex> lock(m_drain_mutex);
+    m_sink = std::move(sink);
+}
+
+LogRecord* AsyncLogger::claim(size_t& pos)
+{
+    pos = m_enqueue_pos.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        LogRecord* record = &m_ring[pos & (kCapacity - 1)];
+        const size_t seq = record->sequence.load(std::memory_order_acquire);
+        const intptr_t dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+        if (dif == 0)
+        {
+            if (m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                return record;
+        }
+        else if (dif < 0)
+        {
+            // Ring is full - drop instead of blocking the caller
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            g_metrics.log_dropped.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        else
+        {
+            pos = m_enqueue_pos.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+void AsyncLogger::publish(LogRecord* record, size_t pos)
+{
+    record->sequence.store(pos + 1, std::memory_order_release);
+
+    // Without a flusher thread the caller prints its own message
+    if (!m_running.load(std::memory_order_acquire))
+    {
+        flush();
+        return;
+    }
+
+    // Wake the flusher if it went to sleep on an empty ring. The fence pairs with the one in the flusher: either it
+    // sees this record before it sleeps or this sees it sleeping. During a burst it is awake and this is one load.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_sleeping.load(std::memory_order_relaxed))
+    {
+        std::lock_guard<std::mutex> lock(m_wake_mutex);
+        if (m_sleeping.exchange(false, std::memory_order_relaxed))
+            m_wake.notify_one();
+    }
+}
+
+bool AsyncLogger::pending()
+{
+    std::lock_guard<std::mutex> lock(m_drain_mutex);
+    const LogRecord& record = m_ring[m_dequeue_pos & (kCapacity - 1)];
+    return record.sequence.load(std::memory_order_acquire) == m_dequeue_pos + 1;
+}
+
+void AsyncLogger::drain_locked()
+{
+    for (;;)
+    {
+        LogRecord* record = &m_ring[m_dequeue_pos & (kCapacity - 1)];
+        const size_t seq = record->sequence.load(std::memory_order_acquire);
+        if (seq != m_dequeue_pos + 1)
+            break;
+
+        format_log_record(*record, m_line);
+        record->sequence.store(m_dequeue_pos + kCapacity, std::memory_order_release);
+        ++m_dequeue_pos;
+
+        if (m_sink)
+            m_sink(m_line.c_str());
+        else
+            fprintf(stderr, "%s\n", m_line.c_str());
+    }
+
+    const uint64_t dropped = m_dropped.load(std::memory_order_relaxed);
+    if (dropped != m_dropped_reported)
+    {
+        char buf[96];
+        snprintf(buf, sizeof(buf), "Last.fm: %llu log messages dropped (log buffer full)",
+                 static_cast<unsigned long long>(dropped - m_dropped_reported));
+        m_dropped_reported = dropped;
+        if (m_sink)
+            m_sink(buf);
+        else
+            fprintf(stderr, "%s\n", buf);
+    }
+}
+
+void AsyncLogger::flush()
+{
+    std::lock_guard<std::mutex> lock(m_drain_mutex);
+    drain_locked();
+}
+
+// ============================================================
+// Flusher thread
+// ============================================================
+void AsyncLogger::start()
+{
+    if (m_running.exchange(true))
+        return;
+
+    m_thread = std::thread(
+        [this]()
+        {
+            while (m_running.load(std::memory_order_acquire))
+            {
+                flush();
+                std::unique_lock<std::mutex> lock(m_wake_mutex);
+                // Announce the sleep before looking at the ring once more (see publish())
+                m_sleeping.store(true, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (!pending())
+                    m_wake.wait(lock,
+                                [this]()
+                                {
+                                    return !m_sleeping.load(std::memory_order_relaxed) ||
+                                           !m_running.load(std::memory_order_acquire);
+                                });
+                m_sleeping.store(false, std::memory_order_relaxed);
+            }
+        });
+}
+
+void AsyncLogger::stop()
+{
+    if (m_running.exchange(false))
+    {
+        {
+            // The flusher is now either before its check of m_running or waiting
+            std::lock_guard<std::mutex> lock(m_wake_mutex);
+        }
+        m_wake.notify_all();
+        if (m_thread.joinable())
+            m_thread.join();
+    }
+    flush();
+}
+
+} // namespace foo_lastfm
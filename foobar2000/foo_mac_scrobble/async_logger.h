@@ -0,0 +1,205 @@
+//
+//  async_logger.h
+//  foo_mac_scrobble
+//
+//  Created by Oleksandr Velychko on 18/10/2026.
+//
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+
+// Compile-time log level: 0 = off, 1 = info, 2 = info + debug
+#ifndef FOO_LASTFM_LOG_LEVEL
+#define FOO_LASTFM_LOG_LEVEL 2
+#endif
+
+namespace foo_lastfm
+{
+
+enum class LogLevel : uint8_t
+{
+    info = 1,
+    debug = 2
+};
+
+// Type tag of a captured log argument
+enum class LogArgType : uint8_t
+{
+    i64,
+    u64,
+    f64,
+    str
+};
+
+// Captured log argument; strings are copied into the record's string area
+struct LogArg
+{
+    LogArgType type;
+    union
+    {
+        int64_t i;
+        uint64_t u;
+        double d;
+        struct
+        {
+            uint16_t offset;
+            uint16_t length;
+        } s;
+    };
+};
+
+// Fixed-size binary log record. Only the format pointer and raw argument values are stored;
+// formatting happens later on the flusher thread.
+struct LogRecord
+{
+    static constexpr size_t kMaxArgs = 8;
+    static constexpr size_t kStringBytes = 176;
+
+    std::atomic<size_t> sequence{0};
+    const char* fmt = nullptr;
+    LogLevel level = LogLevel::info;
+    uint8_t argc = 0;
+    uint16_t string_used = 0;
+    LogArg args[kMaxArgs];
+    char strings[kStringBytes];
+
+    void push_signed(int64_t v);
+    void push_unsigned(uint64_t v);
+    void push_double(double v);
+    void push_string(const char* v, size_t length);
+
+    template <typename T> void push(const T& v)
+    {
+        using U = std::decay_t<T>;
+        if constexpr (std::is_same_v<U, std::string> || std::is_same_v<U, std::string_view>)
+            push_string(v.data(), v.size());
+        else if constexpr (std::is_convertible_v<const T&, const char*>)
+        {
+            const char* p = v;
+            push_string(p ? p : "(null)", p ? strlen(p) : 6);
+        }
+        else if constexpr (std::is_floating_point_v<U>)
+            push_double(static_cast<double>(v));
+        else if constexpr (std::is_enum_v<U>)
+            push_signed(static_cast<int64_t>(v));
+        else if constexpr (std::is_integral_v<U> && std::is_signed_v<U>)
+            push_signed(static_cast<int64_t>(v));
+        else if constexpr (std::is_integral_v<U>)
+            push_unsigned(static_cast<uint64_t>(v));
+        else if constexpr (std::is_pointer_v<U>)
+            push_unsigned(reinterpret_cast<uintptr_t>(v));
+        else
+            static_assert(!sizeof(T), "Unsupported log argument type");
+    }
+};
+
+// Formats a record's printf-style format string with its captured arguments
+void format_log_record(const LogRecord& record, std::string& out);
+
+// Asynchronous console logger. Producers claim a slot in a bounded lock-free MPSC ring, copy the
+// format pointer and raw arguments into it and return; a background flusher formats and prints.
+// The flusher sleeps while the ring is empty and only the first message after that wakes it, so an idle
+// player costs no wakeups and a burst one notify. When the ring is full the message is dropped and
+// counted instead of blocking the caller.
+class AsyncLogger
+{
+  public:
+    // Number of ring slots (power of two)
+    static constexpr size_t kCapacity = 1024;
+
+    AsyncLogger();
+    ~AsyncLogger();
+
+    // Sets the function that receives formatted lines (e.g. the foobar2000 console)
+    void set_sink(std::function<void(const char*)> sink);
+    // Starts the background flusher thread
+    void start();
+    // Drains pending records and stops the flusher; later messages are printed synchronously
+    void stop();
+    // Prints all pending records now
+    void flush();
+
+    // Enables or disables debug level at runtime
+    void set_debug_enabled(bool enabled) { m_debug_enabled.store(enabled, std::memory_order_relaxed); }
+    // Checks whether a level is currently enabled
+    bool is_enabled(LogLevel level) const
+    {
+        return level == LogLevel::info || m_debug_enabled.load(std::memory_order_relaxed);
+    }
+    // Number of messages dropped because the ring was full
+    uint64_t dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+    // Captures a message; use the LASTFM_LOG_* macros instead of calling this directly
+    template <typename... Args> void log(LogLevel level, const char* fmt, const Args&... args)
+    {
+        size_t pos;
+        LogRecord* record = claim(pos);
+        if (!record)
+            return;
+
+        record->fmt = fmt;
+        record->level = level;
+        record->argc = 0;
+        record->string_used = 0;
+        (record->push(args), ...);
+        publish(record, pos);
+    }
+
+  private:
+    LogRecord m_ring[kCapacity];
+    alignas(64) std::atomic<size_t> m_enqueue_pos{0};
+    alignas(64) size_t m_dequeue_pos = 0;
+    std::atomic<uint64_t> m_dropped{0};
+    uint64_t m_dropped_reported = 0;
+    std::atomic<bool> m_debug_enabled{false};
+    std::atomic<bool> m_running{false};
+    std::thread m_thread;
+    std::mutex m_drain_mutex;
+    std::mutex m_wake_mutex;
+    std::condition_variable m_wake;
+    std::atomic<bool> m_sleeping{false}; // The flusher found the ring empty and waits for publish()
+    std::function<void(const char*)> m_sink;
+    std::string m_line;
+
+    // Reserves a ring slot; returns nullptr (and counts a drop) if the ring is full
+    LogRecord* claim(size_t& pos);
+    // Makes a filled slot visible to the flusher
+    void publish(LogRecord* record, size_t pos);
+    // Formats and prints everything currently in the ring (caller holds m_drain_mutex)
+    void drain_locked();
+    // Checks whether a published record waits in the ring
+    bool pending();
+};
+
+extern AsyncLogger g_logger;
+
+} // namespace foo_lastfm
+
+// Logging macros: arguments are not evaluated when the level is disabled at runtime,
+// and the whole statement disappears when the level is compiled out.
+#if FOO_LASTFM_LOG_LEVEL >= 1
+#define LASTFM_LOG_INFO(...) ::foo_lastfm::g_logger.log(::foo_lastfm::LogLevel::info, __VA_ARGS__)
+#else
+#define LASTFM_LOG_INFO(...) ((void)0)
+#endif
+
+#if FOO_LASTFM_LOG_LEVEL >= 2
+#define LASTFM_LOG_DEBUG(...)                                                                                          \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if (::foo_lastfm::g_logger.is_enabled(::foo_lastfm::LogLevel::debug))                                          \
+            ::foo_lastfm::g_logger.log(::foo_lastfm::LogLevel::debug, __VA_ARGS__);                                    \
+    } while (0)
+#else
+#define LASTFM_LOG_DEBUG(...) ((void)0)
+#endif
@@ -0,0 +1,39 @@
+//
+//  clock.cpp
+//  foo_mac_scrobble
+//
+//  Created by Oleksandr Velychko on 18/10/2026.
+//
+
+#include "clock.h"
+
+#include <thread>
+
+namespace foo_lastfm
+{
+
+static SystemClock g_system_clock;
+static std::atomic<Clock*> g_clock{&g_system_clock};
+
+int64_t SystemClock::now_ms()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+void SystemClock::sleep_for(std::chrono::milliseconds duration)
+{
+    std::this_thread::sleep_for(duration);
+}
+
+void set_clock(Clock* clock)
+{
+    g_clock.store(clock ? clock : &g_system_clock, std::memory_order_release);
+}
+
+Clock& current_clock()
+{
+    return *g_clock.load(std::memory_order_acquire);
+}
+
+} // namespace foo_lastfm
@@ -0,0 +1,72 @@
+//
+//  clock.h
+//  foo_mac_scrobble
+//
+//  Created by Oleksandr Velychko on 18/10/2026.
+//
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+
+namespace foo_lastfm
+{
+
+// Time source and sleeper used by the scrobbler core for timestamps, backoff and worker cadence.
+// The default is the system clock; the simulator installs a VirtualClock.
+class Clock
+{
+  public:
+    virtual ~Clock() = default;
+
+    // Wall-clock time in milliseconds since the Unix epoch
+    virtual int64_t now_ms() = 0;
+    // Blocks the calling thread for the given duration (or advances virtual time)
+    virtual void sleep_for(std::chrono::milliseconds duration) = 0;
+
+    // Wall-clock time in seconds since the Unix epoch
+    time_t now_seconds() { return static_cast<time_t>(now_ms() / 1000); }
+};
+
+// Real time: std::chrono::system_clock and std::this_thread::sleep_for
+class SystemClock : public Clock
+{
+  public:
+    int64_t now_ms() override;
+    void sleep_for(std::chrono::milliseconds duration) override;
+};
+
+// Manually driven time. sleep_for() returns immediately after advancing the clock,
+// so hours of backoff and worker cadence run in microseconds.
+class VirtualClock : public Clock
+{
+  public:
+    explicit VirtualClock(int64_t start_ms = 0) : m_now_ms(start_ms) {}
+
+    int64_t now_ms() override { return m_now_ms.load(std::memory_order_acquire); }
+    void sleep_for(std::chrono::milliseconds duration) override { advance(duration); }
+
+    // Moves time forward by the given duration
+    void advance(std::chrono::milliseconds delta) { m_now_ms.fetch_add(delta.count(), std::memory_order_acq_rel); }
+    // Moves time forward to the given point; earlier points are ignored
+    void advance_to(int64_t time_ms)
+    {
+        int64_t now = m_now_ms.load(std::memory_order_acquire);
+        while (now < time_ms && !m_now_ms.compare_exchange_weak(now, time_ms, std::memory_order_acq_rel))
+        {
+        }
+    }
+
+  private:
+    std::atomic<int64_t> m_now_ms;
+};
+
+// Installs a clock; nullptr restores the system clock
+void set_clock(Clock* clock);
+// Returns the installed clock
+Clock& current_clock();
+
+} // namespace foo_lastfm
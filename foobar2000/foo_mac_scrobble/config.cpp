@@ -7,6 +7,7 @@
 
 #include "config.h"
 
+#include "durable_file.h"
 #include "stdafx.h"
 
 namespace foo_lastfm
@@ -25,6 +26,30 @@ const GUID guid_cfg_scrobble_percent = {0x56789012, 0x5678, 0x5678, {0x56, 0x78,
 const GUID guid_cfg_enabled = {0x67890123, 0x6789, 0x6789, {0x67, 0x89, 0x01, 0x23, 0xef, 0x01, 0x23, 0x45}};
 // Initialize debug logging enabled flag (default: false)
 const GUID guid_cfg_debug_enabled = {0x78901234, 0x7890, 0x7890, {0x78, 0x90, 0x12, 0x34, 0xf0, 0x12, 0x34, 0x56}};
+// Initialize play count sync high-water mark (default: 0, sync everything)
+const GUID guid_cfg_sync_high_water = {0x89012345, 0x8901, 0x8901, {0x89, 0x01, 0x23, 0x45, 0x01, 0x23, 0x45, 0x67}};
+// Initialize the account the play count sync state belongs to (default: empty)
+const GUID guid_cfg_sync_account = {0x3f405263, 0x192a, 0x3a4b, {0xd5, 0xe6, 0xf7, 0x08, 0x19, 0x2a, 0x3b, 0x4c}};
+// Initialize .scrobbler.log import path (default: empty)
+const GUID guid_cfg_import_path = {0x90123456, 0x9012, 0x9012, {0x90, 0x12, 0x34, 0x56, 0x12, 0x34, 0x56, 0x78}};
+// Initialize .scrobbler.log import resume offset (default: 0)
+const GUID guid_cfg_import_offset = {0x01234567, 0x0123, 0x0123, {0x01, 0x23, 0x45, 0x67, 0x23, 0x45, 0x67, 0x89}};
+// Initialize ListenBrainz service URL (default: api.listenbrainz.org)
+const GUID guid_cfg_listenbrainz_url = {0xb8c9daeb, 0xf1a2, 0xb2c3, {0x5d, 0x6e, 0x7f, 0x80, 0x91, 0xa2, 0xb3, 0xc4}};
+// Initialize ListenBrainz user token (default: empty, ListenBrainz disabled)
+const GUID guid_cfg_listenbrainz_token = {0xc9daebfc, 0xa2b3, 0xc3d4, {0x6e, 0x7f, 0x80, 0x91, 0xa2, 0xb3, 0xc4, 0xd5}};
+// Initialize queue durability (default: group commit)
+const GUID guid_cfg_queue_durability = {0xdaebfc0d, 0xb3c4, 0xd4e5, {0x7f, 0x80, 0x91, 0xa2, 0xb3, 0xc4, 0xd5, 0xe6}};
+// Initialize artist field script (default: empty, the artist tag)
+const GUID guid_cfg_map_artist = {0xebfc0d1e, 0xc4d5, 0xe5f6, {0x80, 0x91, 0xa2, 0xb3, 0xc4, 0xd5, 0xe6, 0xf7}};
+// Initialize title field script (default: empty, the title tag)
+const GUID guid_cfg_map_title = {0xfc0d1e2f, 0xd5e6, 0xf607, {0x91, 0xa2, 0xb3, 0xc4, 0xd5, 0xe6, 0xf7, 0x08}};
+// Initialize album field script (default: empty, the album tag)
+const GUID guid_cfg_map_album = {0x0d1e2f30, 0xe6f7, 0x0718, {0xa2, 0xb3, 0xc4, 0xd5, 0xe6, 0xf7, 0x08, 0x19}};
+// Initialize album artist field script (default: empty, the album artist tag)
+const GUID guid_cfg_map_album_artist = {0x1e2f3041, 0xf708, 0x1829, {0xb3, 0xc4, 0xd5, 0xe6, 0xf7, 0x08, 0x19, 0x2a}};
+// Initialize track number field script (default: empty, the track number tag)
+const GUID guid_cfg_map_track_number = {0x2f304152, 0x0819, 0x293a, {0xc4, 0xd5, 0xe6, 0xf7, 0x08, 0x19, 0x2a, 0x3b}};
 const GUID guid_preferences_page = {0xa7b8c9da, 0xe0f1, 0xa1b2, {0x4c, 0x5d, 0x6e, 0x7f, 0x80, 0x91, 0xa2, 0xb3}};
 
 // Initialize API key
@@ -58,6 +83,30 @@ cfg_bool cfg_debug_enabled(guid_cfg_debug_enabled, true);
 #else
 cfg_bool cfg_debug_enabled(guid_cfg_debug_enabled, false);
 #endif
+// Initialize play count sync high-water mark (default: 0)
+cfg_int cfg_sync_high_water(guid_cfg_sync_high_water, 0);
+// Initialize the account the play count sync state belongs to (default: empty)
+cfg_string cfg_sync_account(guid_cfg_sync_account, "");
+// Initialize .scrobbler.log import path (default: empty)
+cfg_string cfg_import_path(guid_cfg_import_path, "");
+// Initialize .scrobbler.log import resume offset (default: 0)
+cfg_int cfg_import_offset(guid_cfg_import_offset, 0);
+// Initialize ListenBrainz service URL (default: api.listenbrainz.org)
+cfg_string cfg_listenbrainz_url(guid_cfg_listenbrainz_url, "https://api.listenbrainz.org");
+// Initialize ListenBrainz user token (default: empty)
+cfg_string cfg_listenbrainz_token(guid_cfg_listenbrainz_token, "");
+// Initialize queue durability (default: group commit)
+cfg_int cfg_queue_durability(guid_cfg_queue_durability, static_cast<int>(Durability::group_commit));
+// Initialize artist field script (default: empty, the artist tag)
+cfg_string cfg_map_artist(guid_cfg_map_artist, "");
+// Initialize title field script (default: empty, the title tag)
+cfg_string cfg_map_title(guid_cfg_map_title, "");
+// Initialize album field script (default: empty, the album tag)
+cfg_string cfg_map_album(guid_cfg_map_album, "");
+// Initialize album artist field script (default: empty, the album artist tag)
+cfg_string cfg_map_album_artist(guid_cfg_map_album_artist, "");
+// Initialize track number field script (default: empty, the track number tag)
+cfg_string cfg_map_track_number(guid_cfg_map_track_number, "");
 } // namespace foo_lastfm
 
 // Export the GUID for external use
@@ -77,5 +126,29 @@ const GUID guid_cfg_scrobble_percent = foo_lastfm::guid_cfg_scrobble_percent;
 const GUID guid_cfg_enabled = foo_lastfm::guid_cfg_enabled;
 // Initialize debug logging enabled flag (default: false)
 const GUID guid_cfg_debug_enabled = foo_lastfm::guid_cfg_debug_enabled;
+// Initialize play count sync high-water mark (default: 0)
+const GUID guid_cfg_sync_high_water = foo_lastfm::guid_cfg_sync_high_water;
+// Initialize the account the play count sync state belongs to (default: empty)
+const GUID guid_cfg_sync_account = foo_lastfm::guid_cfg_sync_account;
+// Initialize .scrobbler.log import path (default: empty)
+const GUID guid_cfg_import_path = foo_lastfm::guid_cfg_import_path;
+// Initialize .scrobbler.log import resume offset (default: 0)
+const GUID guid_cfg_import_offset = foo_lastfm::guid_cfg_import_offset;
+// Initialize ListenBrainz service URL (default: api.listenbrainz.org)
+const GUID guid_cfg_listenbrainz_url = foo_lastfm::guid_cfg_listenbrainz_url;
+// Initialize ListenBrainz user token (default: empty)
+const GUID guid_cfg_listenbrainz_token = foo_lastfm::guid_cfg_listenbrainz_token;
+// Initialize queue durability (default: group commit)
+const GUID guid_cfg_queue_durability = foo_lastfm::guid_cfg_queue_durability;
+// Initialize artist field script (default: empty, the artist tag)
+const GUID guid_cfg_map_artist = foo_lastfm::guid_cfg_map_artist;
+// Initialize title field script (default: empty, the title tag)
+const GUID guid_cfg_map_title = foo_lastfm::guid_cfg_map_title;
+// Initialize album field script (default: empty, the album tag)
+const GUID guid_cfg_map_album = foo_lastfm::guid_cfg_map_album;
+// Initialize album artist field script (default: empty, the album artist tag)
+const GUID guid_cfg_map_album_artist = foo_lastfm::guid_cfg_map_album_artist;
+// Initialize track number field script (default: empty, the track number tag)
+const GUID guid_cfg_map_track_number = foo_lastfm::guid_cfg_map_track_number;
 const GUID guid_preferences_page = foo_lastfm::guid_preferences_page;
 } // namespace lastfm_config
@@ -28,13 +28,36 @@ extern const GUID guid_cfg_scrobble_percent;
 extern const GUID guid_cfg_enabled;
 // Configuration variable for enabling debug logging
 extern const GUID guid_cfg_debug_enabled;
+// Configuration variable for the newest scrobble already counted by play count sync
+extern const GUID guid_cfg_sync_high_water;
+// Configuration variable for the Last.fm account the play count sync state belongs to
+extern const GUID guid_cfg_sync_account;
+// Configuration variable for the .scrobbler.log being imported
+extern const GUID guid_cfg_import_path;
+// Configuration variable for the offset an interrupted .scrobbler.log import resumes from
+extern const GUID guid_cfg_import_offset;
+// Configuration variable for the ListenBrainz service URL
+extern const GUID guid_cfg_listenbrainz_url;
+// Configuration variable for the ListenBrainz user token
+extern const GUID guid_cfg_listenbrainz_token;
+// Configuration variable for how queue changes reach the disk
+extern const GUID guid_cfg_queue_durability;
+// Configuration variable for the title formatting script of the scrobbled artist
+extern const GUID guid_cfg_map_artist;
+// Configuration variable for the title formatting script of the scrobbled title
+extern const GUID guid_cfg_map_title;
+// Configuration variable for the title formatting script of the scrobbled album
+extern const GUID guid_cfg_map_album;
+// Configuration variable for the title formatting script of the scrobbled album artist
+extern const GUID guid_cfg_map_album_artist;
+// Configuration variable for the title formatting script of the scrobbled track number
+extern const GUID guid_cfg_map_track_number;
 extern const GUID guid_preferences_page;
 } // namespace lastfm_config
 
 // Configuration variables - external declarations
 namespace foo_lastfm
 {
-extern LastfmApi* g_lastfm_api;
 // Configuration variable for Last.fm API key
 extern cfg_string cfg_api_key;
 // Configuration variable for Last.fm API secret
@@ -49,4 +72,38 @@ extern cfg_bool cfg_enabled;
 extern cfg_int cfg_scrobble_percent;
 // Configuration variable for enabling debug logging
 extern cfg_bool cfg_debug_enabled;
+// Configuration variable for the newest scrobble already counted by play count sync
+extern cfg_int cfg_sync_high_water;
+// Configuration variable for the Last.fm account cfg_sync_high_water and the play count records belong to
+extern cfg_string cfg_sync_account;
+// Configuration variable for the .scrobbler.log being imported
+extern cfg_string cfg_import_path;
+// Configuration variable for the offset an interrupted .scrobbler.log import resumes from
+extern cfg_int cfg_import_offset;
+// Configuration variable for the ListenBrainz service URL
+extern cfg_string cfg_listenbrainz_url;
+// Configuration variable for the ListenBrainz user token (empty: ListenBrainz scrobbling is off)
+extern cfg_string cfg_listenbrainz_token;
+// Configuration variable for how queue changes reach the disk (a Durability value, default group_commit)
+extern cfg_int cfg_queue_durability;
+// Configuration variable for the title formatting script of the scrobbled artist (empty: the artist tag)
+extern cfg_string cfg_map_artist;
+// Configuration variable for the title formatting script of the scrobbled title (empty: the title tag)
+extern cfg_string cfg_map_title;
+// Configuration variable for the title formatting script of the scrobbled album (empty: the album tag)
+extern cfg_string cfg_map_album;
+// Configuration variable for the title formatting script of the scrobbled album artist (empty: the album artist tag)
+extern cfg_string cfg_map_album_artist;
+// Configuration variable for the title formatting script of the scrobbled track number (empty: the track number tag)
+extern cfg_string cfg_map_track_number;
+
+// Adds or removes the ListenBrainz scrobbling target after cfg_listenbrainz_url / cfg_listenbrainz_token changed
+void apply_listenbrainz_settings();
+// Applies cfg_queue_durability to the scrobble queue
+void apply_queue_settings();
+// Recompiles the track field scripts after cfg_map_* changed
+void apply_track_mapping();
+// Publishes cfg_enabled, cfg_scrobble_percent and cfg_debug_enabled as the runtime config snapshot hot paths read
+// (g_runtime_config) after one of them changed
+void apply_runtime_config();
 } // namespace foo_lastfm
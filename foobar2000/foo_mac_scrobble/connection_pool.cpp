@@ -0,0 +1,103 @@
+//
+//  connection_pool.cpp
+//  foo_mac_scrobble
+//
+//  Created by Oleksandr Velychko on 18/10/2026.
+//
+
+#include "connection_pool.h"
+
+#include "clock.h"
+#include "metrics.h"
+
+namespace foo_lastfm
+{
+
+ConnectionPool::ConnectionPool()
+{
+    m_share = curl_share_init();
+    if (!m_share)
+        return;
+    curl_share_setopt(m_share, CURLSHOPT_LOCKFUNC, lock);
+    curl_share_setopt(m_share, CURLSHOPT_UNLOCKFUNC, unlock);
+    curl_share_setopt(m_share, CURLSHOPT_USERDATA, this);
+    curl_share_setopt(m_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(m_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    curl_share_setopt(m_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+}
+
+ConnectionPool::~ConnectionPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_warm_mutex);
+        if (m_warm_thread.joinable())
+            m_warm_thread.join();
+    }
+    // Closes the connections still in the cache
+    if (m_share)
+        curl_share_cleanup(m_share);
+}
+
+void ConnectionPool::lock(CURL* /*curl*/, curl_lock_data data, curl_lock_access /*access*/, void* pool)
+{
+    static_cast<ConnectionPool*>(pool)->m_locks[data].lock();
+}
+
+void ConnectionPool::unlock(CURL* /*curl*/, curl_lock_data data, void* pool)
+{
+    static_cast<ConnectionPool*>(pool)->m_locks[data].unlock();
+}
+
+void ConnectionPool::attach(CURL* curl)
+{
+    if (m_share && m_reuse.load())
+        curl_easy_setopt(curl, CURLOPT_SHARE, m_share);
+    curl_easy_setopt(curl, CURLOPT_MAXAGE_CONN, kIdleTimeoutSeconds);
+}
+
+void ConnectionPool::record(CURL* curl, CURLcode result)
+{
+    long connects = 0;
+    curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &connects);
+    if (connects > 0)
+        g_metrics.connections_opened.fetch_add(static_cast<uint64_t>(connects), std::memory_order_relaxed);
+    else if (result == CURLE_OK)
+        g_metrics.connections_reused.fetch_add(1, std::memory_order_relaxed);
+    if (result == CURLE_OK)
+        m_answered_ms.store(current_clock().now_ms());
+}
+
+bool ConnectionPool::answered_within(int64_t max_age_ms) const
+{
+    const int64_t answered = m_answered_ms.load();
+    return m_reuse.load() && answered > 0 && current_clock().now_ms() - answered < max_age_ms;
+}
+
+void ConnectionPool::warm(const std::string& url)
+{
+    if (!m_share || !m_reuse.load() || answered_within(kWarmMs) || m_warming.exchange(true))
+        return;
+
+    std::lock_guard<std::mutex> lock(m_warm_mutex);
+    // The previous warm-up has finished (m_warming was clear); only its thread object is left
+    if (m_warm_thread.joinable())
+        m_warm_thread.join();
+    m_warm_thread = std::thread(
+        [this, url]()
+        {
+            CURL* curl = curl_easy_init();
+            if (curl)
+            {
+                attach(curl);
+                curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+                curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+                curl_easy_setopt(curl, CURLOPT_TIMEOUT, 10L);
+                curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 5L);
+                record(curl, curl_easy_perform(curl));
+                curl_easy_cleanup(curl);
+            }
+            m_warming.store(false);
+        });
+}
+
+} // namespace foo_lastfm
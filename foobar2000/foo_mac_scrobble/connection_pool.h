@@ -0,0 +1,62 @@
+//
+//  connection_pool.h
+//  foo_mac_scrobble
+//
+//  Created by Oleksandr Velychko on 18/10/2026.
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <curl/curl.h>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace foo_lastfm
+{
+
+// Connections kept open to the API host between requests. Easy handles set up with attach() share one connection
+// cache, DNS cache and TLS session cache, so a request reuses the connection an earlier one (or warm()) left open
+// instead of resolving, connecting and handshaking again. Connections idle for longer than kIdleTimeoutSeconds are
+// not reused and get closed.
+class ConnectionPool
+{
+  public:
+    // Idle connections older than this are closed instead of reused
+    static constexpr long kIdleTimeoutSeconds = 60;
+    // An answer this recent means the connection is open; warm() has nothing to do
+    static constexpr int64_t kWarmMs = 2000;
+
+    ConnectionPool();
+    ~ConnectionPool();
+    ConnectionPool(const ConnectionPool&) = delete;
+    ConnectionPool& operator=(const ConnectionPool&) = delete;
+
+    // Makes curl use the shared caches (unless reuse is off) and the idle timeout
+    void attach(CURL* curl);
+    // Counts the connection curl's finished transfer opened or reused and remembers when the host last answered
+    void record(CURL* curl, CURLcode result);
+    // True if a request through the pool got an answer within the last max_age_ms (never while reuse is off)
+    bool answered_within(int64_t max_age_ms) const;
+    // Opens a connection to url (a HEAD request) on a background thread, unless one answered within kWarmMs or a
+    // warm-up is already running. Returns immediately.
+    void warm(const std::string& url);
+    // Off: every request opens its own connection and every probe asks again, as without the pool (for comparisons)
+    void set_reuse(bool reuse) { m_reuse.store(reuse); }
+
+  private:
+    CURLSH* m_share = nullptr;
+    std::mutex m_locks[CURL_LOCK_DATA_LAST];
+    std::atomic<bool> m_reuse{true};
+    std::atomic<int64_t> m_answered_ms{0};
+    std::atomic<bool> m_warming{false};
+    std::mutex m_warm_mutex;
+    std::thread m_warm_thread;
+
+    static void lock(CURL* curl, curl_lock_data data, curl_lock_access access, void* pool);
+    static void unlock(CURL* curl, curl_lock_data data, void* pool);
+};
+
+} // namespace foo_lastfm
@@ -0,0 +1,91 @@
+//
+//  drain_controller.cpp
+//  foo_mac_scrobble
+//
+//  Created by Oleksandr Velychko on 18/10/2026.
+//
+
+#include "drain_controller.h"
+
+#include <algorithm>
+
+namespace foo_lastfm
+{
+
+// Weight of the newest sample in the latency average
+static constexpr double kLatencyWeight = 0.25;
+
+void DrainController::configure(const DrainLimits& limits)
+{
+    if (m_configured && limits == m_limits)
+        return;
+
+    m_limits = limits;
+    m_limits.max_batch = std::max<size_t>(1, limits.max_batch);
+    m_limits.max_concurrency = std::max(1, limits.max_concurrency);
+    m_configured = true;
+    // A fixed drain keeps the configured batch; the transport splits it into requests it takes
+    m_batch_size =
+        limits.adaptive ? std::clamp<size_t>(limits.initial_batch, 1, m_limits.max_batch) : limits.initial_batch;
+    m_concurrency = 1;
+    m_latency_ms = 0;
+}
+
+bool DrainController::on_run(const std::vector<DrainSample>& samples, bool full)
+{
+    if (!m_limits.adaptive || samples.empty())
+        return false;
+
+    bool pressure = false;
+    bool failed = false;
+    for (const auto& sample : samples)
+    {
+        const double latency = static_cast<double>(sample.latency.count());
+        m_latency_ms = m_latency_ms == 0 ? latency : m_latency_ms + kLatencyWeight * (latency - m_latency_ms);
+        pressure = pressure || sample.pushback > 0;
+        failed = failed || !sample.accepted;
+    }
+
+    const size_t batch_size = m_batch_size;
+    const int concurrency = m_concurrency;
+    const bool slow = m_latency_ms > m_limits.target_latency_ms;
+    if (pressure)
+    {
+        // The endpoint pushes back: halve the load once per run, however many requests saw it
+        m_batch_size = std::max<size_t>(1, m_batch_size / 2);
+        m_concurrency = std::max(1, m_concurrency / 2);
+    }
+    else if (failed)
+    {
+        m_concurrency = std::max(1, m_concurrency / 2);
+    }
+    else
+    {
+        // A slow link gets fewer requests in flight, but larger batches still save it round trips
+        if (slow)
+            m_concurrency = std::max(1, m_concurrency / 2);
+        if (full && m_batch_size < m_limits.max_batch)
+            m_batch_size = std::min(m_limits.max_batch, m_batch_size + kBatchStep);
+        else if (full && !slow && m_concurrency < m_limits.max_concurrency)
+            ++m_concurrency;
+    }
+
+    if (m_batch_size < batch_size || m_concurrency < concurrency)
+        ++m_decreases;
+    if (m_batch_size > batch_size || m_concurrency > concurrency)
+        ++m_increases;
+    return m_batch_size != batch_size || m_concurrency != concurrency;
+}
+
+DrainControllerState DrainController::state() const
+{
+    DrainControllerState state;
+    state.batch_size = m_batch_size;
+    state.concurrency = m_concurrency;
+    state.latency_ms = static_cast<int64_t>(m_latency_ms);
+    state.increases = m_increases;
+    state.decreases = m_decreases;
+    return state;
+}
+
+} // namespace foo_lastfm
@@ -0,0 +1,89 @@
+//
+//  drain_controller.h
+//  foo_mac_scrobble
+//
+//  Created by Oleksandr Velychko on 18/10/2026.
+//
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace foo_lastfm
+{
+
+// What one submission request saw, as reported to the drain controller
+struct DrainSample
+{
+    std::chrono::milliseconds latency{0}; // Wall time of the request, retries included
+    bool accepted = false;                // Every track of the request was accepted
+    int pushback = 0;                     // 429 and 5xx answers seen (retried ones included)
+};
+
+// Bounds of the controller, from the queue policy and the transport
+struct DrainLimits
+{
+    bool adaptive = true;         // false: batch_size() stays initial_batch with one request in flight
+    size_t initial_batch = 10;    // Tracks per request to start from
+    size_t max_batch = 50;        // Most tracks the transport takes in one request
+    int max_concurrency = 4;      // Most requests in flight at once
+    int target_latency_ms = 2000; // Smoothed latency above this counts as a slow link
+
+    bool operator==(const DrainLimits& other) const
+    {
+        return adaptive == other.adaptive && initial_batch == other.initial_batch && max_batch == other.max_batch &&
+               max_concurrency == other.max_concurrency && target_latency_ms == other.target_latency_ms;
+    }
+    bool operator!=(const DrainLimits& other) const { return !(*this == other); }
+};
+
+// Current tuning, for metrics and logs
+struct DrainControllerState
+{
+    size_t batch_size = 0;  // Tracks per request
+    int concurrency = 0;    // Requests in flight per run
+    int64_t latency_ms = 0; // Smoothed request latency
+    uint64_t increases = 0; // Additive increases so far
+    uint64_t decreases = 0; // Multiplicative decreases so far
+};
+
+// AIMD tuning of queue draining. A full run without trouble grows the batch by kBatchStep tracks up to the
+// transport's limit, then adds a request in flight. A 429 or 5xx halves both; a failed request halves the requests
+// in flight, and so does a slow link (smoothed latency over the target), which keeps growing the batch but never
+// adds requests. Not thread-safe: the target's drain lock serializes it.
+class DrainController
+{
+  public:
+    // Tracks added to the batch per good run
+    static constexpr size_t kBatchStep = 10;
+
+    DrainController() { configure(DrainLimits()); }
+
+    // Applies new limits; the tuning starts over when they changed
+    void configure(const DrainLimits& limits);
+    // Tracks per request
+    size_t batch_size() const { return m_batch_size; }
+    // Requests in flight per run
+    int concurrency() const { return m_concurrency; }
+    // Tracks one run submits at most
+    size_t run_capacity() const { return m_batch_size * static_cast<size_t>(m_concurrency); }
+    // Feeds the requests of one run. Only a full run (one that used run_capacity()) can grow the tuning.
+    // Returns true if batch_size() or concurrency() changed.
+    bool on_run(const std::vector<DrainSample>& samples, bool full);
+    // Returns the current tuning
+    DrainControllerState state() const;
+
+  private:
+    DrainLimits m_limits;
+    bool m_configured = false;
+    size_t m_batch_size = 0;
+    int m_concurrency = 1;
+    double m_latency_ms = 0; // Exponentially weighted moving average; 0 before the first sample
+    uint64_t m_increases = 0;
+    uint64_t m_decreases = 0;
+};
+
+} // namespace foo_lastfm
@@ -0,0 +1,172 @@
+//
+//  durable_file.cpp
+//  foo_mac_scrobble
+//
+//  Created by Oleksandr Velychko on 18/10/2026.
+//
+
+#include "durable_file.h"
+
+#include "async_logger.h"
+#include "metrics.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace foo_lastfm
+{
+
+// ============================================================
+// Atomic replace
+// ============================================================
+// fsync() on macOS only hands the data to the drive; F_FULLFSYNC also flushes the drive's cache
+static bool sync_fd(int fd)
+{
+    g_metrics.fsyncs.fetch_add(1, std::memory_order_relaxed);
+#ifdef F_FULLFSYNC
+    if (fcntl(fd, F_FULLFSYNC) == 0)
+        return true;
+#endif
+    return fsync(fd) == 0;
+}
+
+static std::string parent_dir(const std::string& path)
+{
+    const size_t slash = path.rfind('/');
+    if (slash == std::string::npos)
+        return ".";
+    return slash == 0 ? "/" : path.substr(0, slash);
+}
+
+bool replace_file(const std::string& path, const std::string& contents, bool sync)
+{
+    const std::string temp_path = path + ".tmp";
+    const int fd = open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        LASTFM_LOG_INFO("Last.fm: Cannot create %s: %s", temp_path, strerror(errno));
+        return false;
+    }
+
+    size_t written = 0;
+    while (written < contents.size())
+    {
+        const ssize_t n = write(fd, contents.data() + written, contents.size() - written);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        written += static_cast<size_t>(n);
+    }
+    bool complete = written == contents.size() && (!sync || sync_fd(fd));
+    int error = errno;
+    // Some file systems only report a failed write when the file is closed
+    if (close(fd) != 0 && complete)
+    {
+        complete = false;
+        error = errno;
+    }
+    if (!complete)
+    {
+        LASTFM_LOG_INFO("Last.fm: Cannot write %s: %s", temp_path, strerror(error));
+        unlink(temp_path.c_str());
+        return false;
+    }
+
+    if (rename(temp_path.c_str(), path.c_str()) != 0)
+    {
+        LASTFM_LOG_INFO("Last.fm: Cannot replace %s: %s", path, strerror(errno));
+        unlink(temp_path.c_str());
+        return false;
+    }
+
+    // The rename itself is only durable once the directory entry is
+    if (sync)
+    {
+        const int dir_fd = open(parent_dir(path).c_str(), O_RDONLY | O_CLOEXEC);
+        if (dir_fd >= 0)
+        {
+            sync_fd(dir_fd);
+            close(dir_fd);
+        }
+    }
+    return true;
+}
+
+// ============================================================
+// Group commit
+// ============================================================
+GroupCommitter::GroupCommitter(std::function<void()> commit) : m_commit(std::move(commit)) {}
+
+GroupCommitter::~GroupCommitter()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+        m_urgent = true;
+    }
+    m_cv.notify_all();
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+void GroupCommitter::request(std::chrono::milliseconds window)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ++m_requested;
+    if (!m_pending)
+    {
+        // A later request never pushes the commit out; the window starts with the first change
+        m_pending = true;
+        m_deadline = std::chrono::steady_clock::now() + window;
+    }
+    if (!m_thread.joinable())
+        m_thread = std::thread([this]() { run(); });
+    m_cv.notify_all();
+}
+
+void GroupCommitter::flush()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_committed >= m_requested)
+        return;
+    const uint64_t target = m_requested;
+    m_urgent = true;
+    m_cv.notify_all();
+    m_cv.wait(lock, [&]() { return m_committed >= target; });
+}
+
+uint64_t GroupCommitter::commits() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_commits;
+}
+
+void GroupCommitter::run()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;)
+    {
+        m_cv.wait(lock, [&]() { return m_pending || m_stop; });
+        if (m_pending && !m_urgent)
+            m_cv.wait_until(lock, m_deadline, [&]() { return m_urgent; });
+        if (!m_pending)
+            break; // Stopping with nothing to write
+
+        m_pending = false;
+        m_urgent = m_stop;
+        const uint64_t covered = m_requested;
+        lock.unlock();
+        m_commit();
+        lock.lock();
+        ++m_commits;
+        m_committed = covered;
+        m_cv.notify_all();
+        if (m_stop && !m_pending)
+            break;
+    }
+}
+
+} // namespace foo_lastfm
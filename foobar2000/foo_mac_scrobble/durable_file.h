@@ -0,0 +1,68 @@
+//
+//  durable_file.h
+//  foo_mac_scrobble
+//
+//  Created by Oleksandr Velychko on 18/10/2026.
+//
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace foo_lastfm
+{
+
+// How changes to a persistent file reach the disk
+enum class Durability
+{
+    per_change,   // Every change is written and synced before the call returns
+    group_commit, // Changes within a short window are written together under one sync
+    best_effort   // Like group_commit without the sync; a power loss may lose recent changes
+};
+
+// Replaces path with contents: writes "path.tmp", syncs it to stable storage when sync is set, renames it over
+// path and syncs the directory. A crash at any point leaves either the old or the new file, never a torn one.
+// Returns false (with path untouched) on failure.
+bool replace_file(const std::string& path, const std::string& contents, bool sync);
+
+// Coalesces requests to persist some state into batched commits. The first request after a commit opens a
+// window; one call of commit() on a background thread then covers every request made until the window closes.
+class GroupCommitter
+{
+  public:
+    // commit() writes the current state; it runs on the committer's thread with none of its locks held
+    explicit GroupCommitter(std::function<void()> commit);
+    // Runs a pending commit and stops the thread
+    ~GroupCommitter();
+
+    // Asks for a commit at most window from now; starts the thread on first use
+    void request(std::chrono::milliseconds window);
+    // Runs a pending commit now and waits for it. Must not be called while holding a lock commit() takes.
+    void flush();
+    // Number of commits made
+    uint64_t commits() const;
+
+  private:
+    std::function<void()> m_commit;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::thread m_thread;
+    bool m_pending = false;
+    bool m_urgent = false; // flush() or the destructor wants the pending commit now
+    bool m_stop = false;
+    std::chrono::steady_clock::time_point m_deadline;
+    uint64_t m_commits = 0;
+    uint64_t m_requested = 0; // Requests so far; flush() waits until a commit covers them
+    uint64_t m_committed = 0; // Requests covered by finished commits
+
+    // Commit loop
+    void run();
+};
+
+} // namespace foo_lastfm
@@ -0,0 +1,423 @@
+//
+//  history_store.cpp
+//  foo_mac_scrobble
+//
+//  Created by Oleksandr Velychko on 18/10/2026.
+//
+
+#include "history_store.h"
+
+#include "async_logger.h"
+#include "platform.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+
+namespace foo_lastfm
+{
+
+HistoryStore* g_scrobble_history = nullptr;
+
+// ============================================================
+// File format
+// ============================================================
+// "LFMHIST1" followed by records, each starting with a tag byte (native byte order):
+//   'S' u32 length, bytes                          - next string id
+//   'A' u32 artist string, u32 title string        - next album id (from 1)
+//   'P' i64 timestamp, u32 artist, u32 album, u32 track, u32 duration
+static const char kHistoryMagic[8] = {'L', 'F', 'M', 'H', 'I', 'S', 'T', '1'};
+static constexpr char kTagString = 'S';
+static constexpr char kTagAlbum = 'A';
+static constexpr char kTagPlay = 'P';
+
+template <typename T> static void put(std::string& out, T value)
+{
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T> static bool get(const std::string& in, size_t& pos, T& value)
+{
+    if (in.size() - pos < sizeof(value))
+        return false;
+    memcpy(&value, in.data() + pos, sizeof(value));
+    pos += sizeof(value);
+    return true;
+}
+
+// Floor division, so days before 1970 still start at midnight
+static int64_t floor_div(int64_t value, int64_t divisor)
+{
+    return value / divisor - (value % divisor != 0 && value < 0 ? 1 : 0);
+}
+
+// Number of timestamps in [from, to) in a sorted list
+static uint64_t count_in_range(const std::vector<int64_t>& sorted, int64_t from, int64_t to)
+{
+    auto first = std::lower_bound(sorted.begin(), sorted.end(), from);
+    auto last = std::lower_bound(first, sorted.end(), to);
+    return static_cast<uint64_t>(last - first);
+}
+
+// Inserts a timestamp keeping the list sorted; plays nearly always arrive in order
+static void insert_sorted(std::vector<int64_t>& sorted, int64_t value)
+{
+    if (sorted.empty() || sorted.back() <= value)
+        sorted.push_back(value);
+    else
+        sorted.insert(std::upper_bound(sorted.begin(), sorted.end(), value), value);
+}
+
+HistoryStore::HistoryStore()
+{
+    m_file_path = platform().profile_dir();
+    m_file_path += "lastfm_scrobble_history.bin";
+    m_albums.emplace_back(0, 0);
+
+    load();
+}
+
+void HistoryStore::load()
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    std::string data;
+    {
+        std::ifstream file(m_file_path, std::ios::binary);
+        if (!file.is_open())
+        {
+            LASTFM_LOG_DEBUG("Last.fm: History file does not exist (first run)");
+            return;
+        }
+        data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+
+    if (data.size() < sizeof(kHistoryMagic) || memcmp(data.data(), kHistoryMagic, sizeof(kHistoryMagic)) != 0)
+    {
+        // Keep the unreadable file for inspection and start a new history
+        std::error_code ec;
+        std::filesystem::rename(m_file_path, m_file_path + ".bad", ec);
+        LASTFM_LOG_INFO("Last.fm: History file has an unknown format, moved aside to %s.bad", m_file_path);
+        return;
+    }
+
+    size_t pos = sizeof(kHistoryMagic);
+    size_t valid_end = pos;
+    while (pos < data.size())
+    {
+        const char tag = data[pos++];
+        bool ok = false;
+        if (tag == kTagString)
+        {
+            uint32_t length = 0;
+            if (get(data, pos, length) && data.size() - pos >= length)
+            {
+                std::string value = data.substr(pos, length);
+                pos += length;
+                m_string_ids.emplace(value, static_cast<uint32_t>(m_strings.size()));
+                m_strings.push_back(std::move(value));
+                ok = true;
+            }
+        }
+        else if (tag == kTagAlbum)
+        {
+            uint32_t artist = 0;
+            uint32_t title = 0;
+            if (get(data, pos, artist) && get(data, pos, title) && artist < m_strings.size() &&
+                title < m_strings.size())
+            {
+                m_album_ids.emplace(album_key(artist, title), static_cast<uint32_t>(m_albums.size()));
+                m_albums.emplace_back(artist, title);
+                ok = true;
+            }
+        }
+        else if (tag == kTagPlay)
+        {
+            HistoryRow row;
+            if (get(data, pos, row.timestamp) && get(data, pos, row.artist) && get(data, pos, row.album) &&
+                get(data, pos, row.track) && get(data, pos, row.duration) && row.artist < m_strings.size() &&
+                row.track < m_strings.size() && row.album < m_albums.size())
+            {
+                index_row(row);
+                ok = true;
+            }
+        }
+
+        if (!ok)
+            break;
+        valid_end = pos;
+    }
+
+    if (valid_end < data.size())
+    {
+        // A crash mid-append leaves a partial record; drop it so new records line up again
+        std::error_code ec;
+        std::filesystem::resize_file(m_file_path, valid_end, ec);
+        LASTFM_LOG_INFO("Last.fm: History file had %zu trailing bytes that could not be read, truncated",
+                        data.size() - valid_end);
+    }
+
+    const auto elapsed =
+        std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    LASTFM_LOG_DEBUG("Last.fm: History loaded, %zu scrobbles, %zu strings in %lld ms", m_rows.size(),
+                     m_strings.size(), (long long)elapsed);
+}
+
+void HistoryStore::index_row(const HistoryRow& row)
+{
+    if (m_rows.empty() || m_rows.back().timestamp <= row.timestamp)
+        m_rows.push_back(row);
+    else
+    {
+        auto it = std::upper_bound(m_rows.begin(), m_rows.end(), row.timestamp,
+                                   [](int64_t t, const HistoryRow& r) { return t < r.timestamp; });
+        m_rows.insert(it, row);
+    }
+
+    insert_sorted(m_artist_plays[row.artist], row.timestamp);
+    if (row.album != 0)
+        insert_sorted(m_album_plays[row.album], row.timestamp);
+}
+
+void HistoryStore::append(const std::vector<LastfmApi::TrackInfo>& tracks)
+{
+    if (tracks.empty())
+        return;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_read_only)
+    {
+        LASTFM_LOG_INFO("Last.fm: History file is read-only until the next start, %zu scrobbles not added",
+                        tracks.size());
+        return;
+    }
+
+    // Stage new dictionary entries so nothing is indexed unless the write succeeds
+    std::vector<std::string> new_strings;
+    std::unordered_map<std::string, uint32_t> staged_strings;
+    std::vector<std::pair<uint32_t, uint32_t>> new_albums;
+    std::unordered_map<uint64_t, uint32_t> staged_albums;
+    std::vector<HistoryRow> rows;
+    std::string records;
+
+    auto intern = [&](const std::string& value) -> uint32_t
+    {
+        auto it = m_string_ids.find(value);
+        if (it != m_string_ids.end())
+            return it->second;
+        auto staged = staged_strings.find(value);
+        if (staged != staged_strings.end())
+            return staged->second;
+
+        const uint32_t id = static_cast<uint32_t>(m_strings.size() + new_strings.size());
+        records += kTagString;
+        put(records, static_cast<uint32_t>(value.size()));
+        records += value;
+        staged_strings.emplace(value, id);
+        new_strings.push_back(value);
+        return id;
+    };
+
+    auto intern_album = [&](uint32_t artist, const std::string& title) -> uint32_t
+    {
+        if (title.empty())
+            return 0;
+        const uint32_t title_id = intern(title);
+        const uint64_t key = album_key(artist, title_id);
+        auto it = m_album_ids.find(key);
+        if (it != m_album_ids.end())
+            return it->second;
+        auto staged = staged_albums.find(key);
+        if (staged != staged_albums.end())
+            return staged->second;
+
+        const uint32_t id = static_cast<uint32_t>(m_albums.size() + new_albums.size());
+        records += kTagAlbum;
+        put(records, artist);
+        put(records, title_id);
+        staged_albums.emplace(key, id);
+        new_albums.emplace_back(artist, title_id);
+        return id;
+    };
+
+    for (const auto& track : tracks)
+    {
+        HistoryRow row;
+        row.timestamp = static_cast<int64_t>(track.timestamp);
+        row.artist = intern(track.artist);
+        // Albums belong to the album artist when the tag is set
+        row.album = intern_album(track.album_artist.empty() ? row.artist : intern(track.album_artist), track.album);
+        row.track = intern(track.track);
+        row.duration = static_cast<uint32_t>(std::max(0, track.duration));
+
+        records += kTagPlay;
+        put(records, row.timestamp);
+        put(records, row.artist);
+        put(records, row.album);
+        put(records, row.track);
+        put(records, row.duration);
+        rows.push_back(row);
+    }
+
+    std::error_code ec;
+    uintmax_t size_before = std::filesystem::file_size(m_file_path, ec);
+    if (ec)
+        size_before = 0;
+    if (size_before == 0)
+        records.insert(0, kHistoryMagic, sizeof(kHistoryMagic));
+
+    bool written;
+    {
+        std::ofstream file(m_file_path, std::ios::binary | std::ios::app);
+        written = file.is_open() && file.write(records.data(), records.size()) && file.flush();
+    }
+    if (!written)
+    {
+        LASTFM_LOG_INFO("Last.fm ERROR: Failed to append %zu scrobbles to history file: %s", tracks.size(),
+                        m_file_path);
+        // Cut off what did reach the file: the next append would follow a partial record, and load() truncates
+        // the file at the first one, dropping every record after it
+        std::filesystem::resize_file(m_file_path, size_before, ec);
+        if (ec && ec != std::errc::no_such_file_or_directory)
+        {
+            LASTFM_LOG_INFO("Last.fm ERROR: Failed to truncate history file after the failed append: %s",
+                            ec.message());
+            m_read_only = true;
+        }
+        return;
+    }
+
+    for (auto& value : new_strings)
+    {
+        m_string_ids.emplace(value, static_cast<uint32_t>(m_strings.size()));
+        m_strings.push_back(std::move(value));
+    }
+    for (const auto& album : new_albums)
+    {
+        m_album_ids.emplace(album_key(album.first, album.second), static_cast<uint32_t>(m_albums.size()));
+        m_albums.push_back(album);
+    }
+    for (const auto& row : rows)
+        index_row(row);
+
+    LASTFM_LOG_DEBUG("Last.fm: Added %zu scrobbles to history (%zu total)", rows.size(), m_rows.size());
+}
+
+size_t HistoryStore::size() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_rows.size();
+}
+
+bool HistoryStore::find_string(const std::string& value, uint32_t& id) const
+{
+    auto it = m_string_ids.find(value);
+    if (it == m_string_ids.end())
+        return false;
+    id = it->second;
+    return true;
+}
+
+bool HistoryStore::find_album(const std::string& artist, const std::string& album, uint32_t& id) const
+{
+    uint32_t artist_id = 0;
+    uint32_t title_id = 0;
+    if (!find_string(artist, artist_id) || !find_string(album, title_id))
+        return false;
+    auto it = m_album_ids.find(album_key(artist_id, title_id));
+    if (it == m_album_ids.end())
+        return false;
+    id = it->second;
+    return true;
+}
+
+uint64_t HistoryStore::count_plays(int64_t from, int64_t to) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto by_time = [](const HistoryRow& r, int64_t t) { return r.timestamp < t; };
+    auto first = std::lower_bound(m_rows.begin(), m_rows.end(), from, by_time);
+    auto last = std::lower_bound(first, m_rows.end(), to, by_time);
+    return static_cast<uint64_t>(last - first);
+}
+
+uint64_t HistoryStore::count_artist_plays(const std::string& artist, int64_t from, int64_t to) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    uint32_t id = 0;
+    if (!find_string(artist, id))
+        return 0;
+    auto it = m_artist_plays.find(id);
+    return it == m_artist_plays.end() ? 0 : count_in_range(it->second, from, to);
+}
+
+uint64_t HistoryStore::count_album_plays(const std::string& artist, const std::string& album, int64_t from,
+                                         int64_t to) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    uint32_t id = 0;
+    if (!find_album(artist, album, id))
+        return 0;
+    auto it = m_album_plays.find(id);
+    return it == m_album_plays.end() ? 0 : count_in_range(it->second, from, to);
+}
+
+std::vector<ArtistPlays> HistoryStore::top_artists(size_t count, int64_t from, int64_t to) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::vector<std::pair<uint32_t, uint64_t>> counts;
+    if (from == kBeginning && to == kEnd)
+    {
+        // All-time counts are the sizes of the per-artist lists
+        counts.reserve(m_artist_plays.size());
+        for (const auto& [artist, plays] : m_artist_plays)
+            counts.emplace_back(artist, plays.size());
+    }
+    else
+    {
+        std::unordered_map<uint32_t, uint64_t> by_artist;
+        auto by_time = [](const HistoryRow& r, int64_t t) { return r.timestamp < t; };
+        auto first = std::lower_bound(m_rows.begin(), m_rows.end(), from, by_time);
+        auto last = std::lower_bound(first, m_rows.end(), to, by_time);
+        for (auto it = first; it != last; ++it)
+            ++by_artist[it->artist];
+        counts.assign(by_artist.begin(), by_artist.end());
+    }
+
+    // Most plays first, ties by name so the order is stable
+    auto more_plays = [this](const std::pair<uint32_t, uint64_t>& a, const std::pair<uint32_t, uint64_t>& b)
+    {
+        return a.second != b.second ? a.second > b.second : m_strings[a.first] < m_strings[b.first];
+    };
+    count = std::min(count, counts.size());
+    std::partial_sort(counts.begin(), counts.begin() + count, counts.end(), more_plays);
+
+    std::vector<ArtistPlays> result;
+    result.reserve(count);
+    for (size_t i = 0; i < count; ++i)
+        result.push_back({m_strings[counts[i].first], counts[i].second});
+    return result;
+}
+
+std::vector<DayPlays> HistoryStore::daily_counts(int64_t from, int64_t to, int utc_offset_seconds) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::vector<DayPlays> result;
+    auto by_time = [](const HistoryRow& r, int64_t t) { return r.timestamp < t; };
+    auto first = std::lower_bound(m_rows.begin(), m_rows.end(), from, by_time);
+    auto last = std::lower_bound(first, m_rows.end(), to, by_time);
+    for (auto it = first; it != last; ++it)
+    {
+        const int64_t day_start = floor_div(it->timestamp + utc_offset_seconds, 86400) * 86400 - utc_offset_seconds;
+        if (result.empty() || result.back().day_start != day_start)
+            result.push_back({day_start, 0});
+        ++result.back().plays;
+    }
+    return result;
+}
+
+} // namespace foo_lastfm
@@ -0,0 +1,110 @@
+//
+//  history_store.h
+//  foo_mac_scrobble
+//
+//  Created by Oleksandr Velychko on 18/10/2026.
+//
+
+#pragma once
+
+#include "lastfm_api.h"
+
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace foo_lastfm
+{
+
+// One acknowledged scrobble; strings are ids into the store's dictionary (24 bytes per row)
+struct HistoryRow
+{
+    int64_t timestamp; // Scrobble timestamp (seconds since epoch)
+    uint32_t artist;   // String id of the artist
+    uint32_t album;    // Album id (0 when the track has no album)
+    uint32_t track;    // String id of the track title
+    uint32_t duration; // Track duration in seconds
+};
+
+// Play count of one artist, as returned by top_artists()
+struct ArtistPlays
+{
+    std::string artist;
+    uint64_t plays;
+};
+
+// Play count of one day, as returned by daily_counts()
+struct DayPlays
+{
+    int64_t day_start; // First second of the day (UTC, shifted by the requested offset)
+    uint64_t plays;
+};
+
+// Append-only local history of acknowledged scrobbles.
+// The file is a log of dictionary and play records, so an append never rewrites earlier data
+// and a torn tail from a crash is cut off on the next load. Queries run on in-memory indexes:
+// rows sorted by time, and per-artist / per-album sorted timestamp lists.
+class HistoryStore
+{
+  public:
+    // Time range covering the whole history
+    static constexpr int64_t kBeginning = std::numeric_limits<int64_t>::min();
+    static constexpr int64_t kEnd = std::numeric_limits<int64_t>::max();
+
+    // Constructor: Loads the history file from the profile directory and builds the indexes
+    HistoryStore();
+
+    // Appends acknowledged scrobbles to disk and to the indexes
+    void append(const std::vector<LastfmApi::TrackInfo>& tracks);
+    // Returns the number of stored scrobbles
+    size_t size() const;
+    // Returns the number of scrobbles in [from, to)
+    uint64_t count_plays(int64_t from = kBeginning, int64_t to = kEnd) const;
+    // Returns the number of scrobbles of an artist in [from, to)
+    uint64_t count_artist_plays(const std::string& artist, int64_t from = kBeginning, int64_t to = kEnd) const;
+    // Returns the number of scrobbles of an album in [from, to)
+    uint64_t count_album_plays(const std::string& artist, const std::string& album, int64_t from = kBeginning,
+                               int64_t to = kEnd) const;
+    // Returns the most played artists in [from, to), most plays first
+    std::vector<ArtistPlays> top_artists(size_t count, int64_t from = kBeginning, int64_t to = kEnd) const;
+    // Returns scrobbles per day in [from, to); days without plays are omitted
+    std::vector<DayPlays> daily_counts(int64_t from, int64_t to, int utc_offset_seconds = 0) const;
+
+  private:
+    // Loads the file and rebuilds the indexes; truncates an incomplete trailing record
+    void load();
+    // Adds a decoded play to the rows and indexes
+    void index_row(const HistoryRow& row);
+    // Looks up a string id; returns false if the string was never stored
+    bool find_string(const std::string& value, uint32_t& id) const;
+    // Looks up an album id; returns false if the album was never stored
+    bool find_album(const std::string& artist, const std::string& album, uint32_t& id) const;
+    // Album dictionary key
+    static uint64_t album_key(uint32_t artist, uint32_t title) { return (uint64_t(artist) << 32) | title; }
+
+    // Path to the history file
+    std::string m_file_path;
+    // Mutex guarding the dictionary, rows and indexes
+    mutable std::mutex m_mutex;
+    // Set when a failed append left a partial record that could not be cut off; appends stop until the next load,
+    // which truncates it, as records written after it would be lost with it
+    bool m_read_only = false;
+    // String dictionary (artists, album titles, track titles)
+    std::vector<std::string> m_strings;
+    std::unordered_map<std::string, uint32_t> m_string_ids;
+    // Album dictionary; album 0 means "no album"
+    std::vector<std::pair<uint32_t, uint32_t>> m_albums;
+    std::unordered_map<uint64_t, uint32_t> m_album_ids;
+    // All plays, sorted by timestamp
+    std::vector<HistoryRow> m_rows;
+    // Sorted play timestamps per artist string id and per album id
+    std::unordered_map<uint32_t, std::vector<int64_t>> m_artist_plays;
+    std::unordered_map<uint32_t, std::vector<int64_t>> m_album_plays;
+};
+
+extern HistoryStore* g_scrobble_history;
+
+} // namespace foo_lastfm
@@ -5,22 +5,27 @@
 //  Created by Oleksandr Velychko on 09/11/2025.
 //
 
+#include "api_cache.h"
+#include "async_logger.h"
 #include "config.h"
+#include "history_store.h"
 #include "lastfm_api.h"
+#include "listenbrainz.h"
+#include "log_import.h"
+#include "playcount_cache.h"
+#include "playcount_index.h"
+#include "platform_fb2k.h"
+#include "runtime_config.h"
 #include "scrobble_queue.h"
 #include "session_manager.h"
 #include "stdafx.h"
+#include "track_mapping.h"
 
 #include <algorithm>
-#include <atomic>
-#include <chrono>
-#include <thread>
 
 namespace foo_lastfm
 {
 
-LastfmApi* g_lastfm_api = nullptr;
-
 // ============================================================
 // Helper: Logging for API credentials
 // ============================================================
@@ -32,73 +37,73 @@ static void log_api_credentials(const char* api_key, const char* api_secret, boo
     const int key_len = api_key ? static_cast<int>(strlen(api_key)) : 0;
     const int secret_len = api_secret ? static_cast<int>(strlen(api_secret)) : 0;
 
-    FB2K_console_formatter() << "Last.fm: Loaded API credentials - key length: " << key_len
-                             << ", secret length: " << secret_len;
+    LASTFM_LOG_DEBUG("Last.fm: Loaded API credentials - key length: %d, secret length: %d", key_len, secret_len);
 
     if (key_len == 0 || secret_len == 0)
     {
-        FB2K_console_formatter() << "Last.fm: WARNING - Invalid or missing API credentials";
+        LASTFM_LOG_DEBUG("Last.fm: WARNING - Invalid or missing API credentials");
         if (key_len == 0)
-            FB2K_console_formatter() << "Last.fm: API Key is missing or empty";
+            LASTFM_LOG_DEBUG("Last.fm: API Key is missing or empty");
         if (secret_len == 0)
-            FB2K_console_formatter() << "Last.fm: API Secret is missing or empty";
+            LASTFM_LOG_DEBUG("Last.fm: API Secret is missing or empty");
     }
     else
     {
-        FB2K_console_formatter() << "Last.fm: Credentials appear valid";
+        LASTFM_LOG_DEBUG("Last.fm: Credentials appear valid");
     }
 }
 
 // ============================================================
-// Background worker thread for queue processing
+// ListenBrainz target
 // ============================================================
-class queue_processor_thread
+static ListenBrainzTransport g_listenbrainz_transport;
+
+void apply_listenbrainz_settings()
 {
-  public:
-    queue_processor_thread() : m_running(false) {}
+    if (!g_scrobble_queue)
+        return;
 
-    void start()
-    {
-        if (m_running)
-            return;
-        m_running = true;
-        m_thread = std::thread(
-            [this]()
-            {
-                while (m_running)
-                {
-                    for (int i = 0; i < 30 && m_running; ++i)
-                    {
-                        std::this_thread::sleep_for(std::chrono::seconds(1));
-                    }
-
-                    if (!m_running)
-                        break;
-
-                    // Call process_queue() without inMainThread to avoid blocking UI
-                    if (g_scrobble_queue)
-                    {
-                        g_scrobble_queue->process_queue();
-                    }
-                }
-            });
-    }
+    const std::string token = cfg_listenbrainz_token.get().c_str();
+    g_listenbrainz_transport.configure(cfg_listenbrainz_url.get().c_str(), token);
+    if (token.empty())
+        g_scrobble_queue->remove_target(kListenBrainzTarget);
+    else
+        g_scrobble_queue->add_target(kListenBrainzTarget, &g_listenbrainz_transport);
+}
 
-    void stop()
-    {
-        m_running = false;
-        if (m_thread.joinable())
-        {
-            m_thread.join();
-        }
-    }
+// ============================================================
+// Queue durability
+// ============================================================
+void apply_queue_settings()
+{
+    if (!g_scrobble_queue)
+        return;
 
-  private:
-    std::atomic<bool> m_running;
-    std::thread m_thread;
-};
+    const int value = static_cast<int>(cfg_queue_durability.get());
+    QueuePolicy policy = g_scrobble_queue->get_policy();
+    policy.durability = static_cast<Durability>(std::clamp(value, 0, static_cast<int>(Durability::best_effort)));
+    g_scrobble_queue->set_policy(policy);
+}
+
+// ============================================================
+// Track field mapping
+// ============================================================
+void apply_track_mapping()
+{
+    g_track_mapping.compile();
+}
 
-static queue_processor_thread* g_queue_processor = nullptr;
+// ============================================================
+// Runtime config snapshot
+// ============================================================
+void apply_runtime_config()
+{
+    RuntimeConfig config;
+    config.enabled = cfg_enabled.get();
+    config.scrobble_percent = static_cast<int>(cfg_scrobble_percent.get());
+    config.debug_enabled = cfg_debug_enabled.get();
+    g_runtime_config.publish(config);
+}
 
 // ============================================================
 // Main plugin init/quit class
@@ -108,11 +113,23 @@ class initquit_lastfm : public initquit
   public:
     void on_init() override
     {
-        FB2K_console_formatter() << "Last.fm Scrobbler: Initializing plugin...";
+        // The scrobbler core reaches foobar2000 only through this platform object
+        set_platform(&g_fb2k_platform);
+
+        // Route all component logging through the async logger
+        g_logger.set_sink([](const char* line) { console::print(line); });
+        // The logger follows debug_enabled of every published config snapshot
+        g_runtime_config.subscribe([](const RuntimeConfig& config)
+                                   { g_logger.set_debug_enabled(config.debug_enabled); });
+        apply_runtime_config();
+        g_logger.start();
+
+        LASTFM_LOG_INFO("Last.fm Scrobbler: Initializing plugin...");
 
         // Initialize core objects
         g_lastfm_api = new LastfmApi();
         g_session_manager = new SessionManager();
+        g_api_cache = new ApiCache();
 
         // Load API credentials from configuration
         pfc::string8 api_key_pfc = cfg_api_key.get();
@@ -120,7 +137,7 @@ class initquit_lastfm : public initquit
         const char* api_key = api_key_pfc.c_str();
         const char* api_secret = api_secret_pfc.c_str();
 
-        log_api_credentials(api_key, api_secret, cfg_debug_enabled.get());
+        log_api_credentials(api_key, api_secret, g_runtime_config.get().debug_enabled);
         g_lastfm_api->set_credentials(api_key, api_secret);
 
         // ============================================================
@@ -133,7 +150,7 @@ class initquit_lastfm : public initquit
             // Loaded from session file
             if (strlen(api_key) == 0 || strlen(api_secret) == 0)
             {
-                FB2K_console_formatter() << "Last.fm: Cannot validate session - missing API credentials";
+                LASTFM_LOG_INFO("Last.fm: Cannot validate session - missing API credentials");
                 g_lastfm_api->set_session_key("");
                 g_session_manager->clear_session();
                 cfg_session_key.set("");
@@ -142,17 +159,16 @@ class initquit_lastfm : public initquit
             else
             {
                 g_lastfm_api->set_session_key(session_key.c_str());
-                if (cfg_debug_enabled.get())
-                    FB2K_console_formatter() << "Last.fm: Validating session...";
+                LASTFM_LOG_DEBUG("Last.fm: Validating session...");
 
                 if (g_lastfm_api->validate_session())
                 {
                     cfg_username.set(username.c_str());
-                    FB2K_console_formatter() << "Last.fm Scrobbler: Authenticated as: " << username.c_str();
+                    LASTFM_LOG_INFO("Last.fm Scrobbler: Authenticated as: %s", username);
                 }
                 else
                 {
-                    FB2K_console_formatter() << "Last.fm: Saved session invalid, clearing...";
+                    LASTFM_LOG_INFO("Last.fm: Saved session invalid, clearing...");
                     g_lastfm_api->set_session_key("");
                     g_session_manager->clear_session();
                     cfg_session_key.set("");
@@ -172,18 +188,17 @@ class initquit_lastfm : public initquit
             if (!session_key_clean.empty())
             {
                 g_lastfm_api->set_session_key(session_key_clean.c_str());
-                if (cfg_debug_enabled.get())
-                    FB2K_console_formatter() << "Last.fm: Validating session from config...";
+                LASTFM_LOG_DEBUG("Last.fm: Validating session from config...");
 
                 if (g_lastfm_api->validate_session())
                 {
                     pfc::string8 old_username = cfg_username.get();
                     g_session_manager->save_session(config_session_key, old_username.c_str());
-                    FB2K_console_formatter() << "Last.fm Scrobbler: Authenticated as: " << old_username.c_str();
+                    LASTFM_LOG_INFO("Last.fm Scrobbler: Authenticated as: %s", old_username.c_str());
                 }
                 else
                 {
-                    FB2K_console_formatter() << "Last.fm: Config session invalid, clearing...";
+                    LASTFM_LOG_INFO("Last.fm: Config session invalid, clearing...");
                     g_lastfm_api->set_session_key("");
                     cfg_session_key.set("");
                     cfg_username.set("");
@@ -191,54 +206,69 @@ class initquit_lastfm : public initquit
             }
             else
             {
-                FB2K_console_formatter() << "Last.fm Scrobbler: Not authenticated - please configure in preferences";
+                LASTFM_LOG_INFO("Last.fm Scrobbler: Not authenticated - please configure in preferences");
             }
         }
 
         // ============================================================
         // Debug summary
         // ============================================================
-        if (cfg_debug_enabled.get())
-        {
-            FB2K_console_formatter() << "Last.fm: Debug logging ENABLED";
-            FB2K_console_formatter() << "Last.fm: Scrobbling is " << (cfg_enabled.get() ? "ENABLED" : "DISABLED");
-            FB2K_console_formatter() << "Last.fm: Scrobble threshold: " << cfg_scrobble_percent.get() << "%";
-        }
+        LASTFM_LOG_DEBUG("Last.fm: Debug logging ENABLED");
+        const RuntimeConfig& config = g_runtime_config.get();
+        LASTFM_LOG_DEBUG("Last.fm: Scrobbling is %s", config.enabled ? "ENABLED" : "DISABLED");
+        LASTFM_LOG_DEBUG("Last.fm: Scrobble threshold: %d%%", config.scrobble_percent);
 
         // ============================================================
         // Initialize queue and start worker
         // ============================================================
+        g_playcount_cache = new PlaycountCache(cfg_username.get().c_str());
+        g_scrobble_history = new HistoryStore();
         g_scrobble_queue = new ScrobbleQueue();
-        g_queue_processor = new queue_processor_thread();
-        g_queue_processor->start();
+        apply_queue_settings();
+        apply_listenbrainz_settings();
+        apply_track_mapping();
+        g_scrobble_queue->start_workers();
 
-        FB2K_console_formatter() << "Last.fm Scrobbler: Initialized successfully";
+        LASTFM_LOG_INFO("Last.fm Scrobbler: Initialized successfully");
     }
 
     void on_quit() override
     {
-        if (cfg_debug_enabled.get())
-            FB2K_console_formatter() << "Last.fm: Plugin shutting down...";
+        LASTFM_LOG_DEBUG("Last.fm: Plugin shutting down...");
 
-        // Stop background worker
-        if (g_queue_processor)
+        // Stop background workers
+        if (g_scrobble_queue)
         {
-            g_queue_processor->stop();
-            delete g_queue_processor;
-            g_queue_processor = nullptr;
+            g_scrobble_queue->stop_workers();
         }
 
-        // Cleanup global instances
+        // Stop a running play count sync, log import and the display field refills before the API goes away
+        stop_playcount_sync();
+        stop_log_import();
+
+        delete wait_playcount_cache_uses();
+
+        // Cleanup global instances; bulk edits from the preferences finish first
+        wait_queue_uses();
         delete g_scrobble_queue;
         g_scrobble_queue = nullptr;
 
+        delete g_scrobble_history;
+        g_scrobble_history = nullptr;
+
         delete g_session_manager;
         g_session_manager = nullptr;
 
         delete g_lastfm_api;
         g_lastfm_api = nullptr;
 
-        FB2K_console_formatter() << "Last.fm Scrobbler: Shutdown complete";
+        delete g_api_cache;
+        g_api_cache = nullptr;
+
+        LASTFM_LOG_INFO("Last.fm Scrobbler: Shutdown complete");
+
+        // Print everything still buffered; later messages are printed synchronously
+        g_logger.stop();
     }
 };
 
@@ -7,47 +7,52 @@
 
 #include "lastfm_api.h"
 
-#include "config.h"
+#include "api_cache.h"
+#include "api_response.h"
+#include "async_logger.h"
+#include "clock.h"
+#include "metrics.h"
+#include "platform.h"
 #include "safe_log_utils.h"
 #include "scrobble_queue.h"
 #include "session_manager.h"
-#include "stdafx.h"
 
-#include <CommonCrypto/CommonDigest.h>
 #include <algorithm>
 #include <chrono>
+#include <cstdlib>
 #include <curl/curl.h>
 #include <iomanip>
-#include <main_thread_callback.h>
-#include <nlohmann/json.hpp>
 #include <sstream>
 #include <thread>
-#include <threaded_process.h>
 
-using json = nlohmann::json;
+namespace foo_lastfm
+{
+LastfmApi* g_lastfm_api = nullptr;
+} // namespace foo_lastfm
 
 const char* LastfmApi::API_URL = "https://ws.audioscrobbler.com/2.0/";
 const char* LastfmApi::AUTH_URL = "https://www.last.fm/api/auth/?api_key=";
 
-void log_debug(const char* fmt, ...)
+// 429 and 5xx answers seen by this thread, for the queue's drain controller
+static thread_local int t_pushback = 0;
+// An answer this recent proves the API host is reachable; well below ConnectionPool::kIdleTimeoutSeconds, so the
+// connection that carried it is usually still open
+static constexpr int64_t kReachableMs = 30 * 1000;
+
+int LastfmApi::take_pushback()
 {
-    if (!foo_lastfm::cfg_debug_enabled.get())
-        return;
-    char buffer[1024];
-    va_list args;
-    va_start(args, fmt);
-    vsnprintf(buffer, sizeof(buffer), fmt, args);
-    va_end(args);
-    FB2K_console_formatter() << buffer;
+    const int pushback = t_pushback;
+    t_pushback = 0;
+    return pushback;
 }
 
 LastfmApi::LastfmApi()
 {
-    log_debug("Last.fm: LastfmApi instance created");
+    LASTFM_LOG_DEBUG("Last.fm: LastfmApi instance created");
 }
 LastfmApi::~LastfmApi()
 {
-    log_debug("Last.fm: LastfmApi instance destroyed");
+    LASTFM_LOG_DEBUG("Last.fm: LastfmApi instance destroyed");
 }
 
 void LastfmApi::set_credentials(const char* api_key, const char* api_secret)
@@ -56,21 +61,15 @@ void LastfmApi::set_credentials(const char* api_key, const char* api_secret)
     std::string new_api_key = api_key ? api_key : "";
     std::string new_api_secret = api_secret ? api_secret : "";
 
-    if (foo_lastfm::cfg_debug_enabled.get())
-    {
-        FB2K_console_formatter() << "Last.fm: Credentials set (api_key: " << redact_secret(new_api_key).c_str()
-                                 << " [len=" << new_api_key.length()
-                                 << "], api_secret: " << redact_secret(new_api_secret).c_str()
-                                 << " [len=" << new_api_secret.length() << "])";
-    }
+    LASTFM_LOG_DEBUG("Last.fm: Credentials set (api_key: %s [len=%zu], api_secret: %s [len=%zu])",
+                     redact_secret(new_api_key), new_api_key.length(), redact_secret(new_api_secret),
+                     new_api_secret.length());
 
     // Clear session if credentials change
     if (new_api_key != m_api_key || new_api_secret != m_api_secret)
     {
-        if (!m_session_key.empty() && foo_lastfm::cfg_debug_enabled.get())
-        {
-            FB2K_console_formatter() << "Last.fm: Credentials changed - clearing session";
-        }
+        if (!m_session_key.empty())
+            LASTFM_LOG_DEBUG("Last.fm: Credentials changed - clearing session");
         m_session_key.clear();
     }
 
@@ -88,8 +87,8 @@ void LastfmApi::set_session_key(const char* session_key)
     if (new_session_key != m_session_key)
     {
         m_session_key = new_session_key;
-        log_debug("Last.fm: Session key set (len=%d, value=%s)", (int)m_session_key.length(),
-                  redact_secret(m_session_key).c_str());
+        LASTFM_LOG_DEBUG("Last.fm: Session key set (len=%zu, value=%s)", m_session_key.length(),
+                         redact_secret(m_session_key));
     }
 }
 
@@ -106,7 +105,7 @@ bool LastfmApi::is_authenticated() const
 
 bool LastfmApi::authenticate(const std::string& token)
 {
-    log_debug("Last.fm: Starting authentication (token length: %d)", (int)token.length());
+    LASTFM_LOG_DEBUG("Last.fm: Starting authentication (token length: %zu)", token.length());
     std::map<std::string, std::string> params{
         {"method", "auth.getSession"},
         {"api_key", m_api_key},
@@ -114,45 +113,25 @@ bool LastfmApi::authenticate(const std::string& token)
     };
 
     std::string response;
-    if (!send_api_request(params, response))
+    foo_lastfm::ApiResponse answer;
+    if (!send_api_request(params, response, nullptr, nullptr, &answer))
         return false;
 
-    // Parse authentication response
-    try
+    if (answer.session_key.empty())
     {
-        auto json_data = json::parse(response);
-        if (json_data.contains("error"))
-        {
-            int code = json_data["error"].get<int>();
-            std::string msg = json_data["message"].get<std::string>();
-            FB2K_console_formatter() << "Last.fm ERROR: " << code << " - " << msg.c_str();
-            return false;
-        }
-
-        if (json_data.contains("session"))
-        {
-            auto session = json_data["session"];
-            m_session_key = session.value("key", "");
-
-            // Save session to file
-            std::string username = session.value("name", "");
-            if (foo_lastfm::g_session_manager)
-            {
-                foo_lastfm::g_session_manager->save_session(m_session_key, username);
-            }
-
-            foo_lastfm::cfg_username.set(username.c_str());
-            return true;
-        }
-
-        FB2K_console_formatter() << "Last.fm ERROR: Unexpected JSON format (missing session)";
+        LASTFM_LOG_INFO("Last.fm ERROR: Unexpected JSON format (missing session)");
         return false;
     }
-    catch (const std::exception& e)
+    m_session_key = answer.session_key;
+
+    // Save session to file
+    if (foo_lastfm::g_session_manager)
     {
-        FB2K_console_formatter() << "Last.fm JSON parse error: " << e.what();
-        return false;
+        foo_lastfm::g_session_manager->save_session(m_session_key, answer.session_name);
     }
+
+    foo_lastfm::platform().store_username(answer.session_name);
+    return true;
 }
 
 bool LastfmApi::update_now_playing(const TrackInfo& track)
@@ -178,7 +157,26 @@ bool LastfmApi::update_now_playing(const TrackInfo& track)
     std::string response;
     bool ok = send_api_request(params, response);
     if (!ok)
-        FB2K_console_formatter() << "Last.fm: Failed to update now playing";
+        LASTFM_LOG_INFO("Last.fm: Failed to update now playing");
+    return ok;
+}
+
+bool LastfmApi::love_track(const TrackInfo& track, bool loved)
+{
+    if (!is_authenticated())
+        return false;
+    std::map<std::string, std::string> params{
+        {"method", loved ? "track.love" : "track.unlove"},
+        {"api_key", m_api_key},
+        {"sk", m_session_key},
+        {"artist", track.artist},
+        {"track", track.track},
+    };
+
+    std::string response;
+    bool ok = send_api_request(params, response);
+    if (!ok)
+        LASTFM_LOG_INFO("Last.fm: Failed to %s track", loved ? "love" : "unlove");
     return ok;
 }
 
@@ -203,10 +201,177 @@ bool LastfmApi::scrobble_track(const TrackInfo& track)
     std::string response;
     bool ok = send_api_request(params, response);
     if (!ok)
-        FB2K_console_formatter() << "Last.fm: Scrobble failed";
+        LASTFM_LOG_INFO("Last.fm: Scrobble failed");
     return ok;
 }
 
+bool LastfmApi::scrobble_tracks(const std::vector<TrackInfo>& tracks)
+{
+    if (!is_authenticated() || tracks.empty() || tracks.size() > kMaxScrobbleBatch)
+        return false;
+
+    // Array notation: artist[0], track[0], timestamp[0], artist[1] ...
+    std::map<std::string, std::string> params{
+        {"method", "track.scrobble"}, {"api_key", m_api_key}, {"sk", m_session_key}};
+    for (size_t i = 0; i < tracks.size(); ++i)
+    {
+        const TrackInfo& track = tracks[i];
+        const std::string index = "[" + std::to_string(i) + "]";
+        params["artist" + index] = track.artist;
+        params["track" + index] = track.track;
+        params["timestamp" + index] = std::to_string(track.timestamp);
+        if (!track.album.empty())
+            params["album" + index] = track.album;
+        if (!track.album_artist.empty())
+            params["albumArtist" + index] = track.album_artist;
+        if (track.duration > 0)
+            params["duration" + index] = std::to_string(track.duration);
+        if (track.track_number > 0)
+            params["trackNumber" + index] = std::to_string(track.track_number);
+    }
+
+    std::string response;
+    foo_lastfm::ApiResponse answer;
+    if (!send_api_request(params, response, nullptr, nullptr, &answer))
+    {
+        LASTFM_LOG_INFO("Last.fm: Scrobble of %zu tracks failed", tracks.size());
+        return false;
+    }
+
+    // Ignored scrobbles (too old, filtered by Last.fm) are final, like a single accepted-but-ignored scrobble
+    LASTFM_LOG_DEBUG("Last.fm: Batch of %zu scrobbles: %u accepted, %u ignored", tracks.size(), answer.accepted,
+                     answer.ignored);
+    return true;
+}
+
+bool LastfmApi::get_recent_tracks(const std::string& user, int page, int limit, time_t from, time_t to,
+                                  RecentTracksPage& out)
+{
+    std::map<std::string, std::string> params{
+        {"method", "user.getRecentTracks"},
+        {"api_key", m_api_key},
+        {"user", user},
+        {"page", std::to_string(page)},
+        {"limit", std::to_string(limit)},
+    };
+    if (from > 0)
+        params["from"] = std::to_string(from);
+    if (to > 0)
+        params["to"] = std::to_string(to);
+
+    // The rows are collected while the answer is decoded
+    std::string response;
+    foo_lastfm::ApiResponse answer;
+    out = RecentTracksPage();
+    answer.page = &out;
+    if (!send_api_request(params, response, nullptr, nullptr, &answer))
+        return false;
+
+    if (out.page == 0)
+    {
+        LASTFM_LOG_INFO("Last.fm ERROR: Unexpected user.getRecentTracks response (page %d)", page);
+        return false;
+    }
+    return true;
+}
+
+bool LastfmApi::get_loved_tracks(const std::string& user, int page, int limit, RecentTracksPage& out)
+{
+    std::map<std::string, std::string> params{
+        {"method", "user.getLovedTracks"},
+        {"api_key", m_api_key},
+        {"user", user},
+        {"page", std::to_string(page)},
+        {"limit", std::to_string(limit)},
+    };
+
+    // The rows are collected while the answer is decoded
+    std::string response;
+    foo_lastfm::ApiResponse answer;
+    out = RecentTracksPage();
+    answer.page = &out;
+    if (!send_api_request(params, response, nullptr, nullptr, &answer))
+        return false;
+
+    if (out.page == 0)
+    {
+        LASTFM_LOG_INFO("Last.fm ERROR: Unexpected user.getLovedTracks response (page %d)", page);
+        return false;
+    }
+    return true;
+}
+
+bool LastfmApi::get_track_user_info(const std::string& artist, const std::string& track, const std::string& user,
+                                    TrackUserInfo& out)
+{
+    std::map<std::string, std::string> params{
+        {"method", "track.getInfo"}, {"api_key", m_api_key}, {"artist", artist},
+        {"track", track},            {"username", user},     {"autocorrect", "0"},
+    };
+
+    std::string response;
+    foo_lastfm::ApiResponse answer;
+    if (!send_read_request(params, response, answer))
+        return false;
+
+    if (!answer.has_track)
+    {
+        LASTFM_LOG_INFO("Last.fm ERROR: Unexpected track.getInfo response (missing track)");
+        return false;
+    }
+    out = TrackUserInfo();
+    out.playcount = answer.user_playcount;
+    out.loved = answer.user_loved;
+    return true;
+}
+
+bool LastfmApi::send_read_request(const std::map<std::string, std::string>& params, std::string& response,
+                                  foo_lastfm::ApiResponse& answer)
+{
+    if (!foo_lastfm::g_api_cache)
+        return send_api_request(params, response, nullptr, nullptr, &answer);
+
+    bool decoded = false;
+    auto fetch = [this, &params, &answer, &decoded](std::string& body)
+    {
+        decoded = true;
+        if (send_api_request(params, body, nullptr, nullptr, &answer))
+            return foo_lastfm::ApiCacheResult::ok;
+
+        // Error 6 is how Last.fm reports an unknown track, artist or album
+        return answer.error == 6 ? foo_lastfm::ApiCacheResult::not_found : foo_lastfm::ApiCacheResult::failed;
+    };
+    if (foo_lastfm::g_api_cache->get(params, fetch, response) != foo_lastfm::ApiCacheResult::ok)
+        return false;
+
+    // A body from the cache (or fetched by another caller of the same key) has not been decoded yet
+    if (!decoded && !foo_lastfm::decode_api_response(response, answer))
+    {
+        LASTFM_LOG_INFO("Last.fm: Response not valid JSON (%s)", answer.parse_error);
+        return false;
+    }
+    return true;
+}
+
+bool LastfmApi::is_reachable()
+{
+    if (m_connections.answered_within(kReachableMs))
+        return true;
+
+    CURL* curl = curl_easy_init();
+    if (!curl)
+        return false;
+    m_connections.attach(curl);
+    curl_easy_setopt(curl, CURLOPT_URL, m_api_url.c_str());
+    curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 5L);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 3L);
+    const CURLcode res = curl_easy_perform(curl);
+    m_connections.record(curl, res);
+    curl_easy_cleanup(curl);
+    return res == CURLE_OK;
+}
+
 bool LastfmApi::validate_session()
 {
     if (m_session_key.empty())
@@ -225,20 +390,20 @@ bool LastfmApi::validate_session()
     if (curl_res == CURLE_COULDNT_CONNECT || curl_res == CURLE_OPERATION_TIMEDOUT ||
         curl_res == CURLE_COULDNT_RESOLVE_HOST || http_code == 0)
     {
-        FB2K_console_formatter() << "Last.fm: Offline mode detected, skipping session validation";
+        LASTFM_LOG_INFO("Last.fm: Offline mode detected, skipping session validation");
         return true; // Keep session in offline mode
     }
 
     if (!ok || http_code == 403 || http_code == 401)
     {
-        FB2K_console_formatter() << "Last.fm: Saved session is invalid (HTTP " << http_code << "), clearing...";
+        LASTFM_LOG_INFO("Last.fm: Saved session is invalid (HTTP %ld), clearing...", http_code);
         m_session_key.clear();
         if (foo_lastfm::g_session_manager)
             foo_lastfm::g_session_manager->clear_session();
         return false;
     }
 
-    FB2K_console_formatter() << "Last.fm: Session key validated (length: " << (int)m_session_key.length() << ")";
+    LASTFM_LOG_INFO("Last.fm: Session key validated (length: %zu)", m_session_key.length());
     return true;
 }
 
@@ -261,13 +426,7 @@ std::string LastfmApi::calculate_signature(const std::map<std::string, std::stri
     }
     sig += m_api_secret;
 
-    unsigned char hash[CC_MD5_DIGEST_LENGTH];
-    CC_MD5(sig.c_str(), (CC_LONG)sig.length(), hash);
-
-    std::ostringstream ss;
-    for (int i = 0; i < CC_MD5_DIGEST_LENGTH; ++i)
-        ss << std::hex << std::setw(2) << std::setfill('0') << (int)hash[i];
-    return ss.str();
+    return foo_lastfm::platform().md5_hex(sig);
 }
 
 std::string LastfmApi::url_encode(const std::string& v) const
@@ -295,11 +454,12 @@ size_t LastfmApi::write_callback(void* c, size_t s, size_t n, void* u)
 }
 
 bool LastfmApi::send_api_request(const std::map<std::string, std::string>& params, std::string& response,
-                                 CURLcode* res_out, long* http_code_out)
+                                 CURLcode* res_out, long* http_code_out, foo_lastfm::ApiResponse* decoded)
 {
     CURL* curl = curl_easy_init();
     if (!curl)
         return false;
+    m_connections.attach(curl);
 
     // Sanitize session key in parameters
     std::map<std::string, std::string> params_clean = params;
@@ -312,13 +472,12 @@ bool LastfmApi::send_api_request(const std::map<std::string, std::string>& param
 
     std::map<std::string, std::string> signed_params = params;
     signed_params["format"] = "json";
-    if (foo_lastfm::cfg_debug_enabled.get())
+    if (foo_lastfm::g_logger.is_enabled(foo_lastfm::LogLevel::debug))
     {
         for (const auto& [k, v] : signed_params)
         {
             const bool sensitive = (k == "api_key" || k == "sk" || k == "token");
-            FB2K_console_formatter() << "  " << k.c_str() << " = "
-                                     << (sensitive ? redact_secret(v).c_str() : v.c_str());
+            LASTFM_LOG_DEBUG("  %s = %s", k, sensitive ? redact_secret(v) : v);
         }
     }
 
@@ -338,7 +497,7 @@ bool LastfmApi::send_api_request(const std::map<std::string, std::string>& param
     response.clear();
 
     // Configure CURL for secure API request
-    curl_easy_setopt(curl, CURLOPT_URL, API_URL);
+    curl_easy_setopt(curl, CURLOPT_URL, m_api_url.c_str());
     curl_easy_setopt(curl, CURLOPT_POSTFIELDS, post_data.c_str());
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
     curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
@@ -353,26 +512,26 @@ bool LastfmApi::send_api_request(const std::map<std::string, std::string>& param
     // Log request details for debugging
     auto it_method = signed_params.find("method");
     std::string method = (it_method != signed_params.end()) ? it_method->second : "";
-    if (foo_lastfm::cfg_debug_enabled.get())
+    const auto api_method = foo_lastfm::api_method_from_name(method);
+    const auto method_slot = static_cast<size_t>(api_method);
+    foo_lastfm::g_metrics.requests[method_slot].fetch_add(1, std::memory_order_relaxed);
+    if (method == "auth.getSession" || method == "auth.getToken")
     {
-        if (method == "auth.getSession" || method == "auth.getToken")
-        {
-            FB2K_console_formatter() << "---- cURL configuration ----";
-            FB2K_console_formatter() << "CURLOPT_URL: " << API_URL;
-            FB2K_console_formatter() << "CURLOPT_SSL_VERIFYPEER: 1";
-            FB2K_console_formatter() << "CURLOPT_SSL_VERIFYHOST: 2";
-            FB2K_console_formatter() << "CURLOPT_TIMEOUT: 15";
-            FB2K_console_formatter() << "CURLOPT_CONNECTTIMEOUT: 5";
-            FB2K_console_formatter() << "CURLOPT_FOLLOWLOCATION: 0";
-            FB2K_console_formatter() << "CURLOPT_USERAGENT: foo_mac_scrobble/0.1.4 (macOS)";
-            FB2K_console_formatter() << "CURLOPT_ACCEPT_ENCODING: <empty>";
-            FB2K_console_formatter() << "Post data length: " << (int)post_data.size();
-            FB2K_console_formatter() << "----------------------------";
-        }
-        else
-        {
-            FB2K_console_formatter() << "Post data length: " << (int)post_data.size();
-        }
+        LASTFM_LOG_DEBUG("---- cURL configuration ----");
+        LASTFM_LOG_DEBUG("CURLOPT_URL: %s", m_api_url);
+        LASTFM_LOG_DEBUG("CURLOPT_SSL_VERIFYPEER: 1");
+        LASTFM_LOG_DEBUG("CURLOPT_SSL_VERIFYHOST: 2");
+        LASTFM_LOG_DEBUG("CURLOPT_TIMEOUT: 15");
+        LASTFM_LOG_DEBUG("CURLOPT_CONNECTTIMEOUT: 5");
+        LASTFM_LOG_DEBUG("CURLOPT_FOLLOWLOCATION: 0");
+        LASTFM_LOG_DEBUG("CURLOPT_USERAGENT: foo_mac_scrobble/0.1.4 (macOS)");
+        LASTFM_LOG_DEBUG("CURLOPT_ACCEPT_ENCODING: <empty>");
+        LASTFM_LOG_DEBUG("Post data length: %zu", post_data.size());
+        LASTFM_LOG_DEBUG("----------------------------");
+    }
+    else
+    {
+        LASTFM_LOG_DEBUG("Post data length: %zu", post_data.size());
     }
 
     // Retry logic with exponential backoff
@@ -383,22 +542,28 @@ bool LastfmApi::send_api_request(const std::map<std::string, std::string>& param
 
     for (; attempt < 3; ++attempt)
     {
+        if (attempt > 0)
+            foo_lastfm::g_metrics.retries.fetch_add(1, std::memory_order_relaxed);
+
         response.clear();
+        const auto attempt_start = std::chrono::steady_clock::now();
         res = curl_easy_perform(curl);
+        m_connections.record(curl, res);
         curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+        const auto attempt_time = std::chrono::steady_clock::now() - attempt_start;
+        foo_lastfm::g_metrics.record_http_attempt(api_method, http_code, attempt_time);
+        foo_lastfm::g_metrics.bytes_sent.fetch_add(post_data.size(), std::memory_order_relaxed);
+        foo_lastfm::g_metrics.bytes_received.fetch_add(response.size(), std::memory_order_relaxed);
 
         if (res_out)
             *res_out = res;
         if (http_code_out)
             *http_code_out = http_code;
 
-        if (foo_lastfm::cfg_debug_enabled.get())
+        if (http_code == 403)
         {
-            if (http_code == 403)
-            {
-                FB2K_console_formatter() << "Last.fm: 403 Forbidden - likely signature or authentication issue";
-                FB2K_console_formatter() << "Last.fm: Response body: " << response.c_str();
-            }
+            LASTFM_LOG_DEBUG("Last.fm: 403 Forbidden - likely signature or authentication issue");
+            LASTFM_LOG_DEBUG("Last.fm: Response body: %s", response);
         }
 
         // Handle session invalidation on 403 errors
@@ -407,15 +572,12 @@ bool LastfmApi::send_api_request(const std::map<std::string, std::string>& param
             if (method != "auth.getSession" && method != "auth.getToken")
             {
                 m_session_key.clear();
-                foo_lastfm::cfg_session_key.set("");
-                if (foo_lastfm::cfg_debug_enabled.get())
-                {
-                    FB2K_console_formatter() << "Last.fm: Session invalidated due to 403 error";
-                }
+                foo_lastfm::platform().store_session_key("");
+                LASTFM_LOG_DEBUG("Last.fm: Session invalidated due to 403 error");
             }
-            else if (foo_lastfm::cfg_debug_enabled.get())
+            else
             {
-                FB2K_console_formatter() << "Last.fm: 403 during authentication (ignored)";
+                LASTFM_LOG_DEBUG("Last.fm: 403 during authentication (ignored)");
             }
         }
 
@@ -424,24 +586,18 @@ bool LastfmApi::send_api_request(const std::map<std::string, std::string>& param
             break; // Success
         }
 
-        if (foo_lastfm::cfg_debug_enabled.get())
+        LASTFM_LOG_DEBUG("Last.fm: HTTP %ld (%s) attempt %d", http_code, curl_easy_strerror(res), attempt + 1);
+        if ((http_code == 400 || http_code == 401 || http_code == 403) && !response.empty())
         {
-            FB2K_console_formatter() << "Last.fm: HTTP " << http_code << " (" << curl_easy_strerror(res) << ") attempt "
-                                     << (attempt + 1);
-            if ((http_code == 400 || http_code == 401 || http_code == 403) && !response.empty())
-            {
-                FB2K_console_formatter() << "Last.fm: Response body: " << response.c_str();
-            }
+            LASTFM_LOG_DEBUG("Last.fm: Response body: %s", response);
         }
 
         // Retry on rate limit or server errors
         if (http_code == 429 || (http_code >= 500 && http_code < 600))
         {
-            if (foo_lastfm::cfg_debug_enabled.get())
-            {
-                FB2K_console_formatter() << "Last.fm: Backing off for " << backoff_ms << " ms";
-            }
-            std::this_thread::sleep_for(std::chrono::milliseconds(backoff_ms));
+            ++t_pushback;
+            LASTFM_LOG_DEBUG("Last.fm: Backing off for %ld ms", backoff_ms);
+            foo_lastfm::current_clock().sleep_for(std::chrono::milliseconds(backoff_ms));
             backoff_ms = std::min(backoff_ms * 2, 1600L);
             continue;
         }
@@ -452,26 +608,29 @@ bool LastfmApi::send_api_request(const std::map<std::string, std::string>& param
     curl_easy_cleanup(curl);
 
     // Check for request failure
+    foo_lastfm::ApiResponse local_answer;
+    foo_lastfm::ApiResponse& answer = decoded ? *decoded : local_answer;
     if (res != CURLE_OK || http_code < 200 || http_code >= 300)
     {
-        FB2K_console_formatter() << "Last.fm ERROR: HTTP " << http_code << " (" << curl_easy_strerror(res) << ")";
+        LASTFM_LOG_INFO("Last.fm ERROR: HTTP %ld (%s)", http_code, curl_easy_strerror(res));
+        foo_lastfm::g_metrics.failures[method_slot].fetch_add(1, std::memory_order_relaxed);
+        // Last.fm sends most errors (e.g. 6, not found) with a 4xx status; the caller may want the code
+        if (decoded && !response.empty())
+            foo_lastfm::decode_api_response(response, answer);
         return false;
     }
 
-    // Parse JSON response
-    try
+    // One streaming pass checks for an error and picks out the fields the caller wants
+    if (!foo_lastfm::decode_api_response(response, answer))
     {
-        auto test = json::parse(response);
-        if (test.contains("error"))
-        {
-            FB2K_console_formatter() << "Last.fm API error: " << test["error"].get<int>() << " - "
-                                     << test["message"].get<std::string>().c_str();
-            return false;
-        }
+        LASTFM_LOG_INFO("Last.fm: Response not valid JSON (%s)", answer.parse_error);
+        foo_lastfm::g_metrics.failures[method_slot].fetch_add(1, std::memory_order_relaxed);
+        return false;
     }
-    catch (const std::exception& e)
+    if (answer.error != 0)
     {
-        FB2K_console_formatter() << "Last.fm: Response not valid JSON (" << e.what() << ")";
+        LASTFM_LOG_INFO("Last.fm API error: %d - %s", answer.error, answer.message);
+        foo_lastfm::g_metrics.failures[method_slot].fetch_add(1, std::memory_order_relaxed);
         return false;
     }
 
@@ -479,23 +638,24 @@ bool LastfmApi::send_api_request(const std::map<std::string, std::string>& param
 }
 
 void LastfmApi::execute_async_request(const std::map<std::string, std::string>& params,
-                                      std::function<void(bool success, const std::string& response)> callback)
+                                      std::function<void(bool success, const foo_lastfm::ApiResponse& answer)> callback)
 {
     // Execute API request in a background thread
     std::thread(
         [params, callback, this]()
         {
             std::string response;
+            foo_lastfm::ApiResponse answer;
             bool success = false;
             try
             {
-                success = send_api_request(params, response);
+                success = send_api_request(params, response, nullptr, nullptr, &answer);
             }
             catch (...)
             {
                 success = false;
             }
-            fb2k::inMainThread([callback, success, response]() { callback(success, response); });
+            foo_lastfm::platform().run_on_main_thread([callback, success, answer]() { callback(success, answer); });
         })
         .detach();
 }
@@ -509,63 +669,31 @@ void LastfmApi::authenticate_async(const std::string& token, std::function<void(
     params["token"] = token;
 
     execute_async_request(params,
-                          [this, callback](bool success, const std::string& response)
+                          [this, callback](bool success, const foo_lastfm::ApiResponse& answer)
                           {
-                              if (success)
+                              // API errors were logged by send_api_request()
+                              if (!success)
                               {
-                                  try
-                                  {
-                                      auto json_data = json::parse(response);
-                                      if (json_data.contains("error"))
-                                      {
-                                          int code = json_data["error"].get<int>();
-                                          std::string msg = json_data["message"].get<std::string>();
-                                          if (foo_lastfm::cfg_debug_enabled.get())
-                                          {
-                                              FB2K_console_formatter()
-                                                  << "Last.fm ERROR: " << code << " - " << msg.c_str();
-                                          }
-                                          callback(false);
-                                          return;
-                                      }
-
-                                      if (json_data.contains("session"))
-                                      {
-                                          auto session = json_data["session"];
-                                          m_session_key = session.value("key", "");
-                                          std::string username = session.value("name", "");
-                                          if (foo_lastfm::g_session_manager)
-                                          {
-                                              foo_lastfm::g_session_manager->save_session(m_session_key, username);
-                                          }
-                                          if (!username.empty())
-                                          {
-                                              foo_lastfm::cfg_username.set(username.c_str());
-                                          }
-                                          callback(true);
-                                          return;
-                                      }
-
-                                      if (foo_lastfm::cfg_debug_enabled.get())
-                                      {
-                                          FB2K_console_formatter()
-                                              << "Last.fm ERROR: Unexpected JSON format (missing session)";
-                                      }
-                                      callback(false);
-                                  }
-                                  catch (const std::exception& e)
-                                  {
-                                      if (foo_lastfm::cfg_debug_enabled.get())
-                                      {
-                                          FB2K_console_formatter() << "Last.fm JSON parse error: " << e.what();
-                                      }
-                                      callback(false);
-                                  }
+                                  callback(false);
+                                  return;
                               }
-                              else
+                              if (answer.session_key.empty())
                               {
+                                  LASTFM_LOG_DEBUG("Last.fm ERROR: Unexpected JSON format (missing session)");
                                   callback(false);
+                                  return;
+                              }
+
+                              m_session_key = answer.session_key;
+                              if (foo_lastfm::g_session_manager)
+                              {
+                                  foo_lastfm::g_session_manager->save_session(m_session_key, answer.session_name);
                               }
+                              if (!answer.session_name.empty())
+                              {
+                                  foo_lastfm::platform().store_username(answer.session_name);
+                              }
+                              callback(true);
                           });
 }
 
@@ -591,11 +719,9 @@ void LastfmApi::update_now_playing_async(const TrackInfo& track)
     }
 
     execute_async_request(params,
-                          [](bool success, const std::string& response)
+                          [](bool /*success*/, const foo_lastfm::ApiResponse& /*answer*/)
                           {
                               // Silently ignore result for now playing
-                              (void)success;
-                              (void)response;
                           });
 }
 
@@ -622,15 +748,11 @@ void LastfmApi::scrobble_track_async(const TrackInfo& track)
     }
 
     execute_async_request(params,
-                          [](bool success, const std::string& response)
+                          [](bool success, const foo_lastfm::ApiResponse& /*answer*/)
                           {
-                              if (!success && foo_lastfm::cfg_debug_enabled.get())
-                              {
-                                  FB2K_console_formatter() << "Last.fm: Scrobble failed silently in background";
-                              }
-                              else if (success && foo_lastfm::cfg_debug_enabled.get())
-                              {
-                                  FB2K_console_formatter() << "Last.fm: Scrobble successful";
-                              }
+                              if (!success)
+                                  LASTFM_LOG_DEBUG("Last.fm: Scrobble failed silently in background");
+                              else
+                                  LASTFM_LOG_DEBUG("Last.fm: Scrobble successful");
                           });
 }
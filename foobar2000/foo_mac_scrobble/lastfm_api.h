@@ -7,14 +7,27 @@
 
 #pragma once
 
+#include "connection_pool.h"
+
+#include <cstdint>
 #include <ctime>
 #include <curl/curl.h>
+#include <functional>
 #include <map>
 #include <string>
+#include <vector>
+
+namespace foo_lastfm
+{
+struct ApiResponse;
+} // namespace foo_lastfm
 
 class LastfmApi
 {
   public:
+    // Most tracks track.scrobble takes in one request
+    static constexpr size_t kMaxScrobbleBatch = 50;
+
     // Constructor: Initializes Last.fm API instance
     LastfmApi();
     // Destructor: Cleans up resources
@@ -34,6 +47,32 @@ class LastfmApi
         TrackInfo() : duration(0), track_number(0), timestamp(0) {}
     };
 
+    // One row of the user's scrobble history
+    struct RecentTrack
+    {
+        std::string artist;
+        std::string track;
+        std::string album;
+        time_t timestamp = 0;     // Scrobble time (0 for the "now playing" row)
+        bool now_playing = false; // Currently playing, not a scrobble yet
+    };
+
+    // One page of user.getRecentTracks
+    struct RecentTracksPage
+    {
+        int page = 0;        // Page number as reported by Last.fm
+        int total_pages = 0; // Number of pages in the requested range
+        uint64_t total = 0;  // Number of scrobbles in the requested range
+        std::vector<RecentTrack> tracks;
+    };
+
+    // The user's own counters of one track (track.getInfo with a username)
+    struct TrackUserInfo
+    {
+        uint32_t playcount = 0; // Scrobbles of the track by the user
+        bool loved = false;     // Track is in the user's loved tracks
+    };
+
     // Authenticates user with a token (synchronous)
     bool authenticate(const std::string& token);
     // Generates URL for user authentication
@@ -48,18 +87,43 @@ class LastfmApi
     bool update_now_playing(const TrackInfo& track);
     // Submits a track for scrobbling
     bool scrobble_track(const TrackInfo& track);
+    // Adds the track to the user's loved tracks (track.love), or removes it (track.unlove)
+    bool love_track(const TrackInfo& track, bool loved);
+    // Submits up to kMaxScrobbleBatch tracks in one track.scrobble request; returns true once the batch was accepted
+    bool scrobble_tracks(const std::vector<TrackInfo>& tracks);
+    // Fetches one page of a user's scrobbles in [from, to] (0 = unbounded); safe to call from several threads
+    bool get_recent_tracks(const std::string& user, int page, int limit, time_t from, time_t to,
+                           RecentTracksPage& out);
+    // Fetches one page of a user's loved tracks (timestamp is when the track was loved)
+    bool get_loved_tracks(const std::string& user, int page, int limit, RecentTracksPage& out);
+    // Fetches the user's play count and loved flag of one track
+    bool get_track_user_info(const std::string& artist, const std::string& track, const std::string& user,
+                             TrackUserInfo& out);
     // Sets API key and secret for authentication
     void set_credentials(const char* api_key, const char* api_secret);
     // Sets session key for authenticated requests
     void set_session_key(const char* session_key);
     // Returns the current session key
     std::string get_session_key() const { return m_session_key; }
+    // Overrides the API endpoint (e.g. a local stand-in server for benchmarks)
+    void set_api_url(const std::string& url) { m_api_url = url; }
+    // Returns the API endpoint requests are sent to
+    const std::string& get_api_url() const { return m_api_url; }
+    // Checks that the API host answers (a HEAD request); an answer to any request within the last kReachableMs
+    // counts without asking again, so a scrobble right after a warm connection costs one request
+    bool is_reachable();
+    // Opens the connection the next request will use in the background (see ConnectionPool::warm())
+    void prewarm() { m_connections.warm(m_api_url); }
+    // Connections shared by this instance's requests
+    foo_lastfm::ConnectionPool& connections() { return m_connections; }
     // Authenticates user with a token (asynchronous)
     void authenticate_async(const std::string& token, std::function<void(bool success)> callback);
     // Updates "now playing" status on Last.fm (asynchronous)
     void update_now_playing_async(const TrackInfo& track);
     // Submits a track for scrobbling (asynchronous)
     void scrobble_track_async(const TrackInfo& track);
+    // Returns the 429 and 5xx answers this thread's requests got since the last call and resets the count
+    static int take_pushback();
 
   private:
     // API key for Last.fm
@@ -68,9 +132,13 @@ class LastfmApi
     std::string m_api_secret;
     // Session key for authenticated requests
     std::string m_session_key;
+    // API endpoint requests are sent to
+    std::string m_api_url = API_URL;
+    // Connections, DNS answers and TLS sessions shared by all requests
+    foo_lastfm::ConnectionPool m_connections;
     // Executes an API request in a background thread
     void execute_async_request(const std::map<std::string, std::string>& params,
-                               std::function<void(bool success, const std::string& response)> callback);
+                               std::function<void(bool success, const foo_lastfm::ApiResponse& answer)> callback);
     // Base URL for Last.fm API
     static const char* API_URL;
     // Base URL for authentication
@@ -79,9 +147,20 @@ class LastfmApi
     std::string calculate_signature(const std::map<std::string, std::string>& params) const;
     // URL-encodes a string for API requests
     std::string url_encode(const std::string& value) const;
-    // Sends an API request with parameters and stores response
+    // Sends a read-only request through the API cache (when installed); "not found" answers are cached too.
+    // answer receives the decoded fields of the response, whether it was fetched or came from the cache.
+    bool send_read_request(const std::map<std::string, std::string>& params, std::string& response,
+                           foo_lastfm::ApiResponse& answer);
+    // Sends an API request with parameters and stores response. The response is decoded in one streaming pass
+    // (see decode_api_response()); decoded receives its fields, also those of an error answer.
     bool send_api_request(const std::map<std::string, std::string>& params, std::string& response,
-                          CURLcode* res_out = nullptr, long* http_code_out = nullptr);
+                          CURLcode* res_out = nullptr, long* http_code_out = nullptr,
+                          foo_lastfm::ApiResponse* decoded = nullptr);
     // CURL callback to collect response data
     static size_t write_callback(void* contents, size_t size, size_t nmemb, void* userp);
 };
+
+namespace foo_lastfm
+{
+extern LastfmApi* g_lastfm_api;
+} // namespace foo_lastfm
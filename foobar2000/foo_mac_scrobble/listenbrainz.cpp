@@ -0,0 +1,185 @@
+//
+//  listenbrainz.cpp
+//  foo_mac_scrobble
+//
+//  Created by Oleksandr Velychko on 18/10/2026.
+//
+
+#include "listenbrainz.h"
+
+#include "async_logger.h"
+
+#include <algorithm>
+#include <curl/curl.h>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+namespace foo_lastfm
+{
+
+// 429 and 5xx answers seen by this thread, for the queue's drain controller
+static thread_local int t_pushback = 0;
+
+static size_t append_response(void* data, size_t size, size_t count, void* user)
+{
+    static_cast<std::string*>(user)->append(static_cast<const char*>(data), size * count);
+    return size * count;
+}
+
+void ListenBrainzTransport::configure(const std::string& url, const std::string& token)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_url = url;
+    while (!m_url.empty() && m_url.back() == '/')
+        m_url.pop_back();
+    m_token = token;
+}
+
+bool ListenBrainzTransport::is_online()
+{
+    std::string url;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        url = m_url + "/";
+    }
+
+    // Perform HEAD request to check the service's availability
+    CURL* curl = curl_easy_init();
+    if (!curl)
+        return false;
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 5L);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 3L);
+
+    CURLcode res = curl_easy_perform(curl);
+    curl_easy_cleanup(curl);
+
+    return (res == CURLE_OK);
+}
+
+bool ListenBrainzTransport::has_session()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return !m_token.empty();
+}
+
+int ListenBrainzTransport::take_pushback()
+{
+    const int pushback = t_pushback;
+    t_pushback = 0;
+    return pushback;
+}
+
+bool ListenBrainzTransport::scrobble(const LastfmApi::TrackInfo& track)
+{
+    std::vector<bool> results;
+    scrobble_batch({track}, results);
+    return results[0];
+}
+
+void ListenBrainzTransport::scrobble_batch(const std::vector<LastfmApi::TrackInfo>& tracks,
+                                           std::vector<bool>& results)
+{
+    results.assign(tracks.size(), false);
+    for (size_t first = 0; first < tracks.size(); first += kMaxListenBatch)
+        submit_split(tracks, first, std::min(tracks.size(), first + kMaxListenBatch), results);
+}
+
+void ListenBrainzTransport::submit_split(const std::vector<LastfmApi::TrackInfo>& tracks, size_t first, size_t last,
+                                         std::vector<bool>& results)
+{
+    const SubmitResult result = submit(tracks, first, last);
+    if (result == SubmitResult::accepted)
+    {
+        std::fill(results.begin() + first, results.begin() + last, true);
+    }
+    else if (result == SubmitResult::rejected && last - first > 1)
+    {
+        // One bad listen fails the whole request; halve it so the others get through (at most ~2 log2(n) requests
+        // per bad listen)
+        const size_t middle = first + (last - first) / 2;
+        submit_split(tracks, first, middle, results);
+        submit_split(tracks, middle, last, results);
+    }
+    else if (result == SubmitResult::rejected)
+    {
+        LASTFM_LOG_INFO("ListenBrainz: Listen of %s - %s was rejected, it stays queued", tracks[first].artist,
+                        tracks[first].track);
+    }
+}
+
+ListenBrainzTransport::SubmitResult ListenBrainzTransport::submit(const std::vector<LastfmApi::TrackInfo>& tracks,
+                                                                  size_t first, size_t last)
+{
+    std::string url;
+    std::string authorization;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        url = m_url + "/1/submit-listens";
+        authorization = "Authorization: Token " + m_token;
+    }
+
+    // "single" is a live listen; several listens at once are submitted as an "import"
+    json payload;
+    payload["listen_type"] = last - first == 1 ? "single" : "import";
+    payload["payload"] = json::array();
+    for (size_t i = first; i < last; ++i)
+    {
+        const LastfmApi::TrackInfo& track = tracks[i];
+        json metadata;
+        metadata["artist_name"] = track.artist;
+        metadata["track_name"] = track.track;
+        if (!track.album.empty())
+            metadata["release_name"] = track.album;
+        json info;
+        info["submission_client"] = "foo_mac_scrobble";
+        if (track.duration > 0)
+            info["duration_ms"] = static_cast<int64_t>(track.duration) * 1000;
+        if (track.track_number > 0)
+            info["tracknumber"] = track.track_number;
+        metadata["additional_info"] = info;
+        payload["payload"].push_back(
+            {{"listened_at", static_cast<int64_t>(track.timestamp)}, {"track_metadata", metadata}});
+    }
+    const std::string body = payload.dump(-1, ' ', false, json::error_handler_t::replace);
+
+    CURL* curl = curl_easy_init();
+    if (!curl)
+        return SubmitResult::failed;
+
+    curl_slist* headers = nullptr;
+    headers = curl_slist_append(headers, authorization.c_str());
+    headers = curl_slist_append(headers, "Content-Type: application/json");
+
+    std::string response;
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body.c_str());
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, static_cast<long>(body.size()));
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, append_response);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 15L);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 5L);
+    curl_easy_setopt(curl, CURLOPT_USERAGENT, "foo_mac_scrobble/0.1.4 (macOS)");
+
+    long http_code = 0;
+    const CURLcode res = curl_easy_perform(curl);
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+    curl_slist_free_all(headers);
+    curl_easy_cleanup(curl);
+
+    if (http_code == 429 || (http_code >= 500 && http_code < 600))
+        ++t_pushback;
+    if (res != CURLE_OK || http_code != 200)
+    {
+        LASTFM_LOG_DEBUG("ListenBrainz: submit-listens failed, HTTP %ld (%s): %s", http_code, curl_easy_strerror(res),
+                         response);
+        return res == CURLE_OK && (http_code == 400 || http_code == 413) ? SubmitResult::rejected
+                                                                          : SubmitResult::failed;
+    }
+    return SubmitResult::accepted;
+}
+
+} // namespace foo_lastfm
@@ -0,0 +1,62 @@
+//
+//  listenbrainz.h
+//  foo_mac_scrobble
+//
+//  Created by Oleksandr Velychko on 18/10/2026.
+//
+
+#pragma once
+
+#include "scrobble_queue.h"
+
+#include <mutex>
+#include <string>
+
+namespace foo_lastfm
+{
+
+// Name of the ListenBrainz target in the scrobble queue
+static constexpr const char* kListenBrainzTarget = "listenbrainz";
+
+// Scrobble transport for ListenBrainz and compatible services (JSON POST to {url}/1/submit-listens with a
+// user token), so the queue can feed them from the same play log as Last.fm
+class ListenBrainzTransport : public ScrobbleTransport
+{
+  public:
+    // Listens per submit-listens request
+    static constexpr size_t kMaxListenBatch = 100;
+
+    // Sets the service root (e.g. "https://api.listenbrainz.org") and the user token
+    void configure(const std::string& url, const std::string& token);
+
+    bool is_online() override;
+    bool has_session() override;
+    bool scrobble(const LastfmApi::TrackInfo& track) override;
+    // One request per 100 tracks; a 200 answer accepts every listen of the request. A request the service rejects
+    // as invalid is split in halves until the listens it objects to are alone, so only those stay queued.
+    void scrobble_batch(const std::vector<LastfmApi::TrackInfo>& tracks, std::vector<bool>& results) override;
+    size_t max_batch() const override { return kMaxListenBatch; }
+    int take_pushback() override;
+
+  private:
+    // Guards m_url and m_token, which the preferences page may change while the worker submits
+    std::mutex m_mutex;
+    std::string m_url;
+    std::string m_token;
+
+    // Outcome of one submit-listens request
+    enum class SubmitResult
+    {
+        accepted, // HTTP 200
+        rejected, // HTTP 400 or 413: something in the listens themselves
+        failed    // Network, token (401/403), 429 or server errors: worth retrying as is later
+    };
+
+    // Sends one submit-listens request
+    SubmitResult submit(const std::vector<LastfmApi::TrackInfo>& tracks, size_t first, size_t last);
+    // Submits tracks [first, last), splitting a rejected request; marks the accepted listens in results
+    void submit_split(const std::vector<LastfmApi::TrackInfo>& tracks, size_t first, size_t last,
+                      std::vector<bool>& results);
+};
+
+} // namespace foo_lastfm
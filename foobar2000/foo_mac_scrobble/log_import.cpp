@@ -0,0 +1,146 @@
+//
+//  log_import.cpp
+//  foo_mac_scrobble
+//
+//  Created by Oleksandr Velychko on 18/10/2026.
+//
+
+#include "log_import.h"
+
+#include "async_logger.h"
+#include "config.h"
+#include "scrobbler_log.h"
+#include "stdafx.h"
+
+#include <atomic>
+#include <ctime>
+#include <main_thread_callback.h>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace foo_lastfm
+{
+
+static std::thread g_import_thread;
+static std::atomic<bool> g_import_running{false};
+static std::atomic<bool> g_import_abort{false};
+
+// Where an import stopped, until the main thread stores it in cfg_import_path and cfg_import_offset
+struct ImportResume
+{
+    std::string path;
+    int64_t offset = 0;
+    bool pending = false;
+};
+static std::mutex g_resume_mutex;
+static ImportResume g_resume;
+
+// Stores the resume state of the last import; main thread only (cfg_vars)
+static void store_import_resume()
+{
+    std::lock_guard<std::mutex> lock(g_resume_mutex);
+    if (!g_resume.pending)
+        return;
+    cfg_import_path = g_resume.path.c_str();
+    cfg_import_offset = g_resume.offset;
+    g_resume.pending = false;
+}
+
+static void run_log_import(const ScrobblerLogImportOptions& options)
+{
+    LASTFM_LOG_INFO("Last.fm: Importing %s%s", options.path,
+                    options.start_offset > 0 ? " (continuing an interrupted import)" : "");
+
+    int reported_decile = 0;
+    const ScrobblerLogImportResult result =
+        import_scrobbler_log(*g_scrobble_queue, options, g_import_abort,
+                             [&reported_decile](uint64_t done, uint64_t total)
+                             {
+                                 const int decile = total > 0 ? static_cast<int>(done * 10 / total) : 0;
+                                 if (decile > reported_decile)
+                                 {
+                                     reported_decile = decile;
+                                     LASTFM_LOG_INFO("Last.fm: Log import %d%%", decile * 10);
+                                 }
+                             });
+    if (!result.error.empty())
+    {
+        LASTFM_LOG_INFO("Last.fm: Cannot import %s: %s", options.path, result.error);
+        return;
+    }
+
+    // Remember where to continue; a finished import starts over if the file is picked again. Stored on the main
+    // thread, or by stop_log_import() at quit if that never runs.
+    {
+        std::lock_guard<std::mutex> lock(g_resume_mutex);
+        g_resume.path = options.path;
+        g_resume.offset = result.complete ? 0 : static_cast<int64_t>(result.resume_offset);
+        g_resume.pending = true;
+    }
+    fb2k::inMainThread([]() { store_import_resume(); });
+
+    LASTFM_LOG_INFO("Last.fm: Log import %s - %llu scrobbled, %llu already scrobbled, %llu skipped, %llu older than "
+                    "14 days, %llu invalid (%.1fs)",
+                    result.complete ? "finished" : (g_import_abort.load() ? "aborted" : "interrupted"),
+                    (unsigned long long)result.submitted, (unsigned long long)result.duplicates,
+                    (unsigned long long)result.skipped, (unsigned long long)result.too_old,
+                    (unsigned long long)result.invalid, result.seconds);
+    if (!result.complete)
+        LASTFM_LOG_INFO("Last.fm: Import the same file again to continue");
+}
+
+bool start_log_import(const char* path)
+{
+    if (g_import_running.load())
+    {
+        LASTFM_LOG_INFO("Last.fm: A log import is already running");
+        return false;
+    }
+    if (!g_scrobble_queue || !g_lastfm_api || !g_lastfm_api->has_saved_session())
+    {
+        LASTFM_LOG_INFO("Last.fm: Log import needs an authenticated user - please configure in preferences");
+        return false;
+    }
+    if (g_import_thread.joinable())
+        g_import_thread.join();
+    store_import_resume();
+
+    ScrobblerLogImportOptions options;
+    options.path = path;
+    if (options.path == cfg_import_path.get().c_str())
+        options.start_offset = static_cast<uint64_t>(cfg_import_offset.get());
+
+    // Players that log "#TZ/UNKNOWN" use their local clock; assume it matches this machine's time zone
+    const time_t now = time(nullptr);
+    tm local{};
+    localtime_r(&now, &local);
+    options.utc_offset_seconds = local.tm_gmtoff;
+
+    g_import_abort.store(false);
+    g_import_running.store(true);
+    g_import_thread = std::thread(
+        [options]()
+        {
+            try
+            {
+                run_log_import(options);
+            }
+            catch (const std::exception& e)
+            {
+                LASTFM_LOG_INFO("Last.fm: Log import failed: %s", e.what());
+            }
+            g_import_running.store(false);
+        });
+    return true;
+}
+
+void stop_log_import()
+{
+    g_import_abort.store(true);
+    if (g_import_thread.joinable())
+        g_import_thread.join();
+    store_import_resume();
+}
+
+} // namespace foo_lastfm
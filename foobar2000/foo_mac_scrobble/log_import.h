@@ -0,0 +1,19 @@
+//
+//  log_import.h
+//  foo_mac_scrobble
+//
+//  Created by Oleksandr Velychko on 18/10/2026.
+//
+
+#pragma once
+
+namespace foo_lastfm
+{
+
+// Starts importing a portable player's .scrobbler.log in the background. An import of the same file that
+// was interrupted continues where it stopped. Returns false if an import is already running or there is no session.
+bool start_log_import(const char* path);
+// Aborts a running import (its resume offset is kept) and waits for it to finish
+void stop_log_import();
+
+} // namespace foo_lastfm
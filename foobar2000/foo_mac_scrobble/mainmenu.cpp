@@ -0,0 +1,276 @@
+//
+//  mainmenu.cpp
+//  foo_mac_scrobble
+//
+//  Created by Oleksandr Velychko on 18/10/2026.
+//
+
+#include "clock.h"
+#include "history_store.h"
+#include "log_import.h"
+#include "metrics.h"
+#include "playcount_index.h"
+#include "scrobble_queue.h"
+#include "stdafx.h"
+#include "track_mapping.h"
+
+#include <SDK/console.h>
+#include <SDK/fileDialog.h>
+#include <SDK/menu.h>
+#include <SDK/metadb.h>
+#include <SDK/playback_control.h>
+#include <ctime>
+
+namespace foo_lastfm
+{
+
+static const GUID guid_mainmenu_group = {0x9c1d2e3f, 0x4a5b, 0x4c6d, {0x8e, 0x7f, 0x90, 0xa1, 0xb2, 0xc3, 0xd4, 0xe5}};
+static const GUID guid_cmd_dump = {0x9c1d2e40, 0x4a5b, 0x4c6d, {0x8e, 0x7f, 0x90, 0xa1, 0xb2, 0xc3, 0xd4, 0xe6}};
+static const GUID guid_cmd_reset = {0x9c1d2e41, 0x4a5b, 0x4c6d, {0x8e, 0x7f, 0x90, 0xa1, 0xb2, 0xc3, 0xd4, 0xe7}};
+static const GUID guid_cmd_history = {0x9c1d2e42, 0x4a5b, 0x4c6d, {0x8e, 0x7f, 0x90, 0xa1, 0xb2, 0xc3, 0xd4, 0xe8}};
+static const GUID guid_cmd_sync = {0x9c1d2e43, 0x4a5b, 0x4c6d, {0x8e, 0x7f, 0x90, 0xa1, 0xb2, 0xc3, 0xd4, 0xe9}};
+static const GUID guid_cmd_import = {0x9c1d2e44, 0x4a5b, 0x4c6d, {0x8e, 0x7f, 0x90, 0xa1, 0xb2, 0xc3, 0xd4, 0xea}};
+static const GUID guid_cmd_love = {0x9c1d2e45, 0x4a5b, 0x4c6d, {0x8e, 0x7f, 0x90, 0xa1, 0xb2, 0xc3, 0xd4, 0xeb}};
+static const GUID guid_cmd_unlove = {0x9c1d2e46, 0x4a5b, 0x4c6d, {0x8e, 0x7f, 0x90, 0xa1, 0xb2, 0xc3, 0xd4, 0xec}};
+
+static mainmenu_group_popup_factory g_mainmenu_group(guid_mainmenu_group, mainmenu_groups::view,
+                                                     mainmenu_commands::sort_priority_dontcare, "Last.fm Scrobbler");
+
+// ============================================================
+// Helper: Print the metrics report line by line
+// ============================================================
+static void dump_metrics_to_console()
+{
+    const std::string report = format_metrics_report(g_metrics.snapshot());
+
+    size_t start = 0;
+    while (start <= report.size())
+    {
+        size_t end = report.find('\n', start);
+        if (end == std::string::npos)
+            end = report.size();
+        FB2K_console_formatter() << report.substr(start, end - start).c_str();
+        start = end + 1;
+    }
+}
+
+// ============================================================
+// Helper: Print listening stats from the local history
+// ============================================================
+static void dump_history_to_console()
+{
+    if (!g_scrobble_history)
+        return;
+
+    const int64_t now = current_clock().now_seconds();
+    const int64_t month_ago = now - 30 * 86400;
+    FB2K_console_formatter() << "Last.fm: Local history has " << (uint64_t)g_scrobble_history->size()
+                             << " scrobbles, " << g_scrobble_history->count_plays(month_ago, now + 1)
+                             << " in the last 30 days";
+
+    FB2K_console_formatter() << "Last.fm: Top artists (last 30 days):";
+    for (const auto& entry : g_scrobble_history->top_artists(10, month_ago, now + 1))
+        FB2K_console_formatter() << "  " << entry.plays << "  " << entry.artist.c_str();
+
+    FB2K_console_formatter() << "Last.fm: Scrobbles per day (last 7 days, UTC):";
+    for (const auto& day : g_scrobble_history->daily_counts(now - 7 * 86400, now + 1))
+    {
+        char date[16];
+        const time_t day_start = static_cast<time_t>(day.day_start);
+        strftime(date, sizeof(date), "%Y-%m-%d", gmtime(&day_start));
+        FB2K_console_formatter() << "  " << date << "  " << day.plays;
+    }
+}
+
+// ============================================================
+// Helper: Ask for a .scrobbler.log and import it
+// ============================================================
+static void import_log_from_dialog()
+{
+    auto setup = fb2k::fileDialog::get()->setupOpen();
+    setup->setTitle("Import .scrobbler.log");
+    setup->setFileTypes("Audioscrobbler logs|*.log|All files|*.*");
+    // Runs asynchronously on macOS; the reply arrives on the main thread
+    setup->runSimple(
+        [](fb2k::stringRef path)
+        {
+            pfc::string8 native;
+            if (!filesystem::g_get_native_path(path->c_str(), native))
+                native = path->c_str();
+            start_log_import(native.c_str());
+        });
+}
+
+// ============================================================
+// Helper: Queue a love or unlove of the playing track
+// ============================================================
+static void love_playing_track(bool loved)
+{
+    if (!g_scrobble_queue || !g_lastfm_api || !g_lastfm_api->has_saved_session())
+    {
+        FB2K_console_formatter() << "Last.fm: No authenticated user - please configure in preferences";
+        return;
+    }
+
+    metadb_handle_ptr playing;
+    static_api_ptr_t<playback_control> playback_control;
+    if (!playback_control->get_now_playing(playing))
+    {
+        FB2K_console_formatter() << "Last.fm: Nothing is playing";
+        return;
+    }
+    // The artist and title the scrobble is sent with, through the field scripts (cached for the playing track)
+    const LastfmApi::TrackInfo& mapped = g_track_mapping.lookup(playing).info;
+    if (mapped.artist.empty() || mapped.track.empty())
+    {
+        FB2K_console_formatter() << "Last.fm: The playing track has no artist or title";
+        return;
+    }
+
+    // Sent by the Last.fm worker, or kept in the queue file until Last.fm is reachable
+    LastfmApi::TrackInfo track;
+    track.artist = mapped.artist;
+    track.track = mapped.track;
+    g_scrobble_queue->add_op(loved ? QueueOp::love : QueueOp::unlove, track);
+    g_scrobble_queue->wake_target(ScrobbleQueue::kLastfmTarget);
+    FB2K_console_formatter() << "Last.fm: " << (loved ? "Loving " : "Unloving ") << track.artist.c_str() << " - "
+                             << track.track.c_str();
+}
+
+class mainmenu_commands_lastfm : public mainmenu_commands
+{
+  public:
+    enum
+    {
+        cmd_dump_metrics = 0,
+        cmd_reset_metrics,
+        cmd_show_history,
+        cmd_sync_playcounts,
+        cmd_import_log,
+        cmd_love_playing,
+        cmd_unlove_playing,
+        cmd_total
+    };
+
+    t_uint32 get_command_count() override { return cmd_total; }
+
+    GUID get_command(t_uint32 p_index) override
+    {
+        switch (p_index)
+        {
+        case cmd_dump_metrics:
+            return guid_cmd_dump;
+        case cmd_reset_metrics:
+            return guid_cmd_reset;
+        case cmd_show_history:
+            return guid_cmd_history;
+        case cmd_sync_playcounts:
+            return guid_cmd_sync;
+        case cmd_import_log:
+            return guid_cmd_import;
+        case cmd_love_playing:
+            return guid_cmd_love;
+        case cmd_unlove_playing:
+            return guid_cmd_unlove;
+        default:
+            uBugCheck();
+        }
+    }
+
+    void get_name(t_uint32 p_index, pfc::string_base& p_out) override
+    {
+        switch (p_index)
+        {
+        case cmd_dump_metrics:
+            p_out = "Dump metrics to console";
+            break;
+        case cmd_reset_metrics:
+            p_out = "Reset metrics";
+            break;
+        case cmd_show_history:
+            p_out = "Show listening stats";
+            break;
+        case cmd_sync_playcounts:
+            p_out = "Sync play counts from Last.fm";
+            break;
+        case cmd_import_log:
+            p_out = "Import .scrobbler.log...";
+            break;
+        case cmd_love_playing:
+            p_out = "Love playing track";
+            break;
+        case cmd_unlove_playing:
+            p_out = "Unlove playing track";
+            break;
+        default:
+            uBugCheck();
+        }
+    }
+
+    bool get_description(t_uint32 p_index, pfc::string_base& p_out) override
+    {
+        switch (p_index)
+        {
+        case cmd_dump_metrics:
+            p_out = "Prints Last.fm Scrobbler request, queue and disk metrics to the console.";
+            return true;
+        case cmd_reset_metrics:
+            p_out = "Resets all Last.fm Scrobbler metrics counters.";
+            return true;
+        case cmd_show_history:
+            p_out = "Prints play counts from the local scrobble history to the console.";
+            return true;
+        case cmd_sync_playcounts:
+            p_out = "Downloads your Last.fm scrobble history and stores play counts for matching library tracks.";
+            return true;
+        case cmd_import_log:
+            p_out = "Scrobbles the plays a portable player recorded in its .scrobbler.log file.";
+            return true;
+        case cmd_love_playing:
+            p_out = "Adds the playing track to your Last.fm loved tracks, as soon as Last.fm is reachable.";
+            return true;
+        case cmd_unlove_playing:
+            p_out = "Removes the playing track from your Last.fm loved tracks, as soon as Last.fm is reachable.";
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    GUID get_parent() override { return guid_mainmenu_group; }
+
+    void execute(t_uint32 p_index, service_ptr_t<service_base> p_callback) override
+    {
+        switch (p_index)
+        {
+        case cmd_dump_metrics:
+            dump_metrics_to_console();
+            break;
+        case cmd_reset_metrics:
+            g_metrics.reset();
+            FB2K_console_formatter() << "Last.fm: Metrics reset";
+            break;
+        case cmd_show_history:
+            dump_history_to_console();
+            break;
+        case cmd_sync_playcounts:
+            start_playcount_sync();
+            break;
+        case cmd_import_log:
+            import_log_from_dialog();
+            break;
+        case cmd_love_playing:
+            love_playing_track(true);
+            break;
+        case cmd_unlove_playing:
+            love_playing_track(false);
+            break;
+        default:
+            uBugCheck();
+        }
+    }
+};
+
+static mainmenu_commands_factory_t<mainmenu_commands_lastfm> g_mainmenu_commands_lastfm;
+
+} // namespace foo_lastfm
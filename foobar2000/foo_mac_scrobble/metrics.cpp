@@ -0,0 +1,310 @@
+//
+//  metrics.cpp
+//  foo_mac_scrobble
+//
+//  Created by Oleksandr Velychko on 18/10/2026.
+//
+
+#include "metrics.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace foo_lastfm
+{
+
+Metrics g_metrics;
+
+static int64_t steady_now_seconds()
+{
+    return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+ApiMethod api_method_from_name(const std::string& method)
+{
+    if (method == "track.scrobble")
+        return ApiMethod::track_scrobble;
+    if (method == "track.updateNowPlaying")
+        return ApiMethod::track_update_now_playing;
+    if (method == "track.love" || method == "track.unlove")
+        return ApiMethod::track_love;
+    if (method == "auth.getSession")
+        return ApiMethod::auth_get_session;
+    return ApiMethod::other;
+}
+
+const char* api_method_name(ApiMethod method)
+{
+    switch (method)
+    {
+    case ApiMethod::auth_get_session:
+        return "auth.getSession";
+    case ApiMethod::track_scrobble:
+        return "track.scrobble";
+    case ApiMethod::track_update_now_playing:
+        return "track.updateNowPlaying";
+    case ApiMethod::track_love:
+        return "track.love/unlove";
+    default:
+        return "other";
+    }
+}
+
+HttpStatusClass http_status_class(long http_code)
+{
+    if (http_code == 429)
+        return HttpStatusClass::rate_limited_429;
+    if (http_code >= 200 && http_code < 300)
+        return HttpStatusClass::success_2xx;
+    if (http_code >= 300 && http_code < 400)
+        return HttpStatusClass::redirect_3xx;
+    if (http_code >= 400 && http_code < 500)
+        return HttpStatusClass::client_4xx;
+    if (http_code >= 500 && http_code < 600)
+        return HttpStatusClass::server_5xx;
+    return HttpStatusClass::transport_error;
+}
+
+// ============================================================
+// Histogram
+// ============================================================
+uint64_t HistogramSnapshot::percentile_us(double percentile) const
+{
+    if (count == 0)
+        return 0;
+
+    // Rank of the requested sample, rounded up so p100 is the last sample
+    uint64_t rank = static_cast<uint64_t>(percentile / 100.0 * static_cast<double>(count) + 0.999999);
+    rank = std::clamp<uint64_t>(rank, 1, count);
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kBuckets; ++i)
+    {
+        seen += buckets[i];
+        if (seen >= rank)
+            return std::min<uint64_t>(uint64_t(1) << i, max_us);
+    }
+    return max_us;
+}
+
+void LatencyHistogram::record(std::chrono::microseconds sample)
+{
+    const uint64_t us = sample.count() > 0 ? static_cast<uint64_t>(sample.count()) : 0;
+
+    // Smallest i with us < 2^i
+    size_t bucket = 0;
+    while (bucket < kBuckets - 1 && (uint64_t(1) << bucket) <= us)
+        ++bucket;
+
+    m_buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    m_sum_us.fetch_add(us, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+
+    uint64_t prev = m_max_us.load(std::memory_order_relaxed);
+    while (prev < us && !m_max_us.compare_exchange_weak(prev, us, std::memory_order_relaxed))
+    {
+    }
+}
+
+HistogramSnapshot LatencyHistogram::snapshot() const
+{
+    HistogramSnapshot s;
+    s.count = m_count.load(std::memory_order_relaxed);
+    s.sum_us = m_sum_us.load(std::memory_order_relaxed);
+    s.max_us = m_max_us.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < kBuckets; ++i)
+        s.buckets[i] = m_buckets[i].load(std::memory_order_relaxed);
+    return s;
+}
+
+void LatencyHistogram::reset()
+{
+    m_count.store(0, std::memory_order_relaxed);
+    m_sum_us.store(0, std::memory_order_relaxed);
+    m_max_us.store(0, std::memory_order_relaxed);
+    for (auto& b : m_buckets)
+        b.store(0, std::memory_order_relaxed);
+}
+
+// ============================================================
+// Metrics
+// ============================================================
+Metrics::Metrics() : m_started_at(steady_now_seconds()) {}
+
+void Metrics::set_queue_depth(size_t depth)
+{
+    const uint64_t d = depth;
+    m_queue_depth.store(d, std::memory_order_relaxed);
+
+    uint64_t peak = m_queue_depth_peak.load(std::memory_order_relaxed);
+    while (peak < d && !m_queue_depth_peak.compare_exchange_weak(peak, d, std::memory_order_relaxed))
+    {
+    }
+}
+
+void Metrics::set_drain_state(const DrainControllerState& state)
+{
+    m_drain_batch_size.store(state.batch_size, std::memory_order_relaxed);
+    m_drain_concurrency.store(state.concurrency, std::memory_order_relaxed);
+    m_drain_latency_ms.store(state.latency_ms, std::memory_order_relaxed);
+    m_drain_increases.store(state.increases, std::memory_order_relaxed);
+    m_drain_decreases.store(state.decreases, std::memory_order_relaxed);
+}
+
+void Metrics::record_http_attempt(ApiMethod method, long http_code, std::chrono::steady_clock::duration latency)
+{
+    const auto latency_us = std::chrono::duration_cast<std::chrono::microseconds>(latency);
+    request_latency[static_cast<size_t>(method)].record(latency_us);
+    http_status[static_cast<size_t>(http_status_class(http_code))].fetch_add(1, std::memory_order_relaxed);
+}
+
+MetricsSnapshot Metrics::snapshot() const
+{
+    MetricsSnapshot s;
+    for (size_t i = 0; i < MetricsSnapshot::kMethods; ++i)
+    {
+        s.request_latency[i] = request_latency[i].snapshot();
+        s.requests[i] = requests[i].load(std::memory_order_relaxed);
+        s.failures[i] = failures[i].load(std::memory_order_relaxed);
+    }
+    for (size_t i = 0; i < MetricsSnapshot::kStatusClasses; ++i)
+        s.http_status[i] = http_status[i].load(std::memory_order_relaxed);
+
+    s.retries = retries.load(std::memory_order_relaxed);
+    s.bytes_sent = bytes_sent.load(std::memory_order_relaxed);
+    s.bytes_received = bytes_received.load(std::memory_order_relaxed);
+    s.connections_opened = connections_opened.load(std::memory_order_relaxed);
+    s.connections_reused = connections_reused.load(std::memory_order_relaxed);
+    s.queue_depth = m_queue_depth.load(std::memory_order_relaxed);
+    s.queue_depth_peak = m_queue_depth_peak.load(std::memory_order_relaxed);
+    s.scrobbles_acked = scrobbles_acked.load(std::memory_order_relaxed);
+    s.scrobbles_failed = scrobbles_failed.load(std::memory_order_relaxed);
+    s.log_dropped = log_dropped.load(std::memory_order_relaxed);
+    s.fsyncs = fsyncs.load(std::memory_order_relaxed);
+    s.enqueue_to_ack = enqueue_to_ack.snapshot();
+    s.live_enqueue_to_ack = live_enqueue_to_ack.snapshot();
+    s.save_queue_time = save_queue_time.snapshot();
+    s.load_queue_time = load_queue_time.snapshot();
+    s.drain.batch_size = m_drain_batch_size.load(std::memory_order_relaxed);
+    s.drain.concurrency = m_drain_concurrency.load(std::memory_order_relaxed);
+    s.drain.latency_ms = m_drain_latency_ms.load(std::memory_order_relaxed);
+    s.drain.increases = m_drain_increases.load(std::memory_order_relaxed);
+    s.drain.decreases = m_drain_decreases.load(std::memory_order_relaxed);
+    s.uptime = std::chrono::seconds(steady_now_seconds() - m_started_at.load(std::memory_order_relaxed));
+    return s;
+}
+
+void Metrics::reset()
+{
+    for (size_t i = 0; i < MetricsSnapshot::kMethods; ++i)
+    {
+        request_latency[i].reset();
+        requests[i].store(0, std::memory_order_relaxed);
+        failures[i].store(0, std::memory_order_relaxed);
+    }
+    for (auto& c : http_status)
+        c.store(0, std::memory_order_relaxed);
+
+    retries.store(0, std::memory_order_relaxed);
+    bytes_sent.store(0, std::memory_order_relaxed);
+    bytes_received.store(0, std::memory_order_relaxed);
+    connections_opened.store(0, std::memory_order_relaxed);
+    connections_reused.store(0, std::memory_order_relaxed);
+    scrobbles_acked.store(0, std::memory_order_relaxed);
+    scrobbles_failed.store(0, std::memory_order_relaxed);
+    log_dropped.store(0, std::memory_order_relaxed);
+    fsyncs.store(0, std::memory_order_relaxed);
+    enqueue_to_ack.reset();
+    live_enqueue_to_ack.reset();
+    save_queue_time.reset();
+    load_queue_time.reset();
+    m_queue_depth_peak.store(m_queue_depth.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    m_started_at.store(steady_now_seconds(), std::memory_order_relaxed);
+}
+
+// ============================================================
+// Report formatting
+// ============================================================
+static std::string format_duration_us(uint64_t us)
+{
+    char buf[32];
+    if (us < 1000)
+        snprintf(buf, sizeof(buf), "%lluus", (unsigned long long)us);
+    else if (us < 1000000)
+        snprintf(buf, sizeof(buf), "%.1fms", us / 1000.0);
+    else
+        snprintf(buf, sizeof(buf), "%.2fs", us / 1000000.0);
+    return buf;
+}
+
+static std::string format_histogram(const HistogramSnapshot& h)
+{
+    if (h.count == 0)
+        return "n=0";
+
+    char buf[160];
+    snprintf(buf, sizeof(buf), "n=%llu mean=%s p50<=%s p90<=%s p99<=%s max=%s", (unsigned long long)h.count,
+             format_duration_us(h.mean_us()).c_str(), format_duration_us(h.percentile_us(50)).c_str(),
+             format_duration_us(h.percentile_us(90)).c_str(), format_duration_us(h.percentile_us(99)).c_str(),
+             format_duration_us(h.max_us).c_str());
+    return buf;
+}
+
+std::string format_metrics_report(const MetricsSnapshot& s)
+{
+    std::string out;
+    char line[256];
+
+    const long long up = s.uptime.count();
+    snprintf(line, sizeof(line), "Last.fm Scrobbler metrics (uptime %lldh %02lldm %02llds)\n", up / 3600,
+             (up / 60) % 60, up % 60);
+    out += line;
+
+    out += "Requests:\n";
+    for (size_t i = 0; i < MetricsSnapshot::kMethods; ++i)
+    {
+        snprintf(line, sizeof(line), "  %-24s calls=%llu failed=%llu %s\n", api_method_name(static_cast<ApiMethod>(i)),
+                 (unsigned long long)s.requests[i], (unsigned long long)s.failures[i],
+                 format_histogram(s.request_latency[i]).c_str());
+        out += line;
+    }
+
+    using H = HttpStatusClass;
+    auto status = [&](H c) { return (unsigned long long)s.http_status[static_cast<size_t>(c)]; };
+    snprintf(line, sizeof(line), "HTTP: 2xx=%llu 3xx=%llu 4xx=%llu 429=%llu 5xx=%llu no-response=%llu, retries=%llu\n",
+             status(H::success_2xx), status(H::redirect_3xx), status(H::client_4xx), status(H::rate_limited_429),
+             status(H::server_5xx), status(H::transport_error), (unsigned long long)s.retries);
+    out += line;
+
+    snprintf(line, sizeof(line), "Traffic: sent %.1f KB, received %.1f KB\n", s.bytes_sent / 1024.0,
+             s.bytes_received / 1024.0);
+    out += line;
+
+    snprintf(line, sizeof(line), "Connections: %llu opened, %llu requests on a reused connection\n",
+             (unsigned long long)s.connections_opened, (unsigned long long)s.connections_reused);
+    out += line;
+
+    snprintf(line, sizeof(line), "Queue: depth=%llu peak=%llu acked=%llu failed attempts=%llu\n",
+             (unsigned long long)s.queue_depth, (unsigned long long)s.queue_depth_peak,
+             (unsigned long long)s.scrobbles_acked, (unsigned long long)s.scrobbles_failed);
+    out += line;
+
+    out += "Enqueue-to-ack: " + format_histogram(s.enqueue_to_ack) + "\n";
+    out += "Enqueue-to-ack (live): " + format_histogram(s.live_enqueue_to_ack) + "\n";
+    snprintf(line, sizeof(line), "save_queue: fsyncs=%llu ", (unsigned long long)s.fsyncs);
+    out += line + format_histogram(s.save_queue_time) + "\n";
+    out += "load_queue: " + format_histogram(s.load_queue_time) + "\n";
+
+    snprintf(line, sizeof(line),
+             "Drain controller: batch=%zu in-flight=%d latency=%lldms increases=%llu decreases=%llu\n",
+             s.drain.batch_size, s.drain.concurrency, (long long)s.drain.latency_ms,
+             (unsigned long long)s.drain.increases, (unsigned long long)s.drain.decreases);
+    out += line;
+
+    snprintf(line, sizeof(line), "Log: dropped=%llu", (unsigned long long)s.log_dropped);
+    out += line;
+    return out;
+}
+
+} // namespace foo_lastfm
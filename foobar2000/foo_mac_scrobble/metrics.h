@@ -0,0 +1,208 @@
+//
+//  metrics.h
+//  foo_mac_scrobble
+//
+//  Created by Oleksandr Velychko on 18/10/2026.
+//
+
+#pragma once
+
+#include "drain_controller.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace foo_lastfm
+{
+
+// Last.fm API methods tracked separately in the metrics
+enum class ApiMethod : int
+{
+    auth_get_session = 0,
+    track_scrobble,
+    track_update_now_playing,
+    track_love, // track.love and track.unlove
+    other,
+    count
+};
+
+// Maps a Last.fm "method" parameter to its metrics slot
+ApiMethod api_method_from_name(const std::string& method);
+// Returns a printable name for a metrics slot
+const char* api_method_name(ApiMethod method);
+
+// HTTP status classes counted by the metrics
+enum class HttpStatusClass : int
+{
+    transport_error = 0, // No HTTP response (DNS, connect, timeout)
+    success_2xx,
+    redirect_3xx,
+    client_4xx,
+    rate_limited_429,
+    server_5xx,
+    count
+};
+
+// Maps an HTTP status code to its metrics class
+HttpStatusClass http_status_class(long http_code);
+
+// Plain copy of a histogram, safe to read without atomics
+struct HistogramSnapshot
+{
+    // 2^39 us is about 6 days, enough for enqueue-to-ack after a long offline period
+    static constexpr size_t kBuckets = 40;
+
+    uint64_t count = 0;  // Number of recorded samples
+    uint64_t sum_us = 0; // Sum of all samples in microseconds
+    uint64_t max_us = 0; // Largest recorded sample in microseconds
+    std::array<uint64_t, kBuckets> buckets{};
+
+    // Mean sample in microseconds (0 when empty)
+    uint64_t mean_us() const { return count ? sum_us / count : 0; }
+    // Upper bound of the bucket holding the given percentile (0..100) in microseconds
+    uint64_t percentile_us(double percentile) const;
+};
+
+// Lock-free latency histogram with power-of-two microsecond buckets.
+// Bucket i holds samples below 2^i us; the last bucket also takes everything above.
+class LatencyHistogram
+{
+  public:
+    static constexpr size_t kBuckets = HistogramSnapshot::kBuckets;
+
+    // Records a single sample
+    void record(std::chrono::microseconds sample);
+    // Copies current values into a snapshot
+    HistogramSnapshot snapshot() const;
+    // Resets all values to zero
+    void reset();
+
+  private:
+    std::atomic<uint64_t> m_count{0};
+    std::atomic<uint64_t> m_sum_us{0};
+    std::atomic<uint64_t> m_max_us{0};
+    std::array<std::atomic<uint64_t>, kBuckets> m_buckets{};
+};
+
+// Records the lifetime of the scope into a histogram
+class ScopedLatency
+{
+  public:
+    explicit ScopedLatency(LatencyHistogram& histogram)
+        : m_histogram(histogram), m_start(std::chrono::steady_clock::now())
+    {
+    }
+    ~ScopedLatency()
+    {
+        m_histogram.record(
+            std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_start));
+    }
+    ScopedLatency(const ScopedLatency&) = delete;
+    ScopedLatency& operator=(const ScopedLatency&) = delete;
+
+  private:
+    LatencyHistogram& m_histogram;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+// Plain copy of all counters, taken with relaxed loads
+struct MetricsSnapshot
+{
+    static constexpr size_t kMethods = static_cast<size_t>(ApiMethod::count);
+    static constexpr size_t kStatusClasses = static_cast<size_t>(HttpStatusClass::count);
+
+    std::array<HistogramSnapshot, kMethods> request_latency;
+    std::array<uint64_t, kMethods> requests{};
+    std::array<uint64_t, kMethods> failures{};
+    std::array<uint64_t, kStatusClasses> http_status{};
+    uint64_t retries = 0;
+    uint64_t bytes_sent = 0;
+    uint64_t bytes_received = 0;
+    uint64_t connections_opened = 0;
+    uint64_t connections_reused = 0;
+    uint64_t queue_depth = 0;
+    uint64_t queue_depth_peak = 0;
+    uint64_t scrobbles_acked = 0;
+    uint64_t scrobbles_failed = 0;
+    uint64_t log_dropped = 0;
+    uint64_t fsyncs = 0;
+    HistogramSnapshot enqueue_to_ack;
+    HistogramSnapshot live_enqueue_to_ack;
+    HistogramSnapshot save_queue_time;
+    HistogramSnapshot load_queue_time;
+    DrainControllerState drain;
+    std::chrono::seconds uptime{0};
+};
+
+// Process-wide scrobbler metrics. Every member is a relaxed atomic so hot paths never take a lock.
+class Metrics
+{
+  public:
+    Metrics();
+
+    // Per-method request latency (one sample per HTTP attempt)
+    std::array<LatencyHistogram, MetricsSnapshot::kMethods> request_latency;
+    // Per-method request count (one per send_api_request call)
+    std::array<std::atomic<uint64_t>, MetricsSnapshot::kMethods> requests{};
+    // Per-method failed request count
+    std::array<std::atomic<uint64_t>, MetricsSnapshot::kMethods> failures{};
+    // HTTP responses by status class (one per attempt)
+    std::array<std::atomic<uint64_t>, MetricsSnapshot::kStatusClasses> http_status{};
+    // HTTP attempts beyond the first one
+    std::atomic<uint64_t> retries{0};
+    // Request body bytes sent
+    std::atomic<uint64_t> bytes_sent{0};
+    // Response body bytes received
+    std::atomic<uint64_t> bytes_received{0};
+    // Connections opened to API hosts (DNS, TCP and TLS setup)
+    std::atomic<uint64_t> connections_opened{0};
+    // Requests answered over a connection an earlier request left open
+    std::atomic<uint64_t> connections_reused{0};
+    // Tracks acknowledged by Last.fm from the queue
+    std::atomic<uint64_t> scrobbles_acked{0};
+    // Failed queue submission attempts
+    std::atomic<uint64_t> scrobbles_failed{0};
+    // Log messages dropped because the async log ring was full
+    std::atomic<uint64_t> log_dropped{0};
+    // Syncs of files to stable storage (durable queue writes)
+    std::atomic<uint64_t> fsyncs{0};
+    // Time from add_track() until Last.fm acknowledged the scrobble
+    LatencyHistogram enqueue_to_ack;
+    // Same, for scrobbles submitted from the live lane
+    LatencyHistogram live_enqueue_to_ack;
+    // Time spent writing the queue file
+    LatencyHistogram save_queue_time;
+    // Time spent in ScrobbleQueue::load_queue()
+    LatencyHistogram load_queue_time;
+
+    // Updates the queue depth gauge and its peak
+    void set_queue_depth(size_t depth);
+    // Updates the gauges of the Last.fm target's drain controller
+    void set_drain_state(const DrainControllerState& state);
+    // Records one HTTP attempt for a method
+    void record_http_attempt(ApiMethod method, long http_code, std::chrono::steady_clock::duration latency);
+    // Copies all counters
+    MetricsSnapshot snapshot() const;
+    // Resets all counters except the queue depth gauge
+    void reset();
+
+  private:
+    std::atomic<uint64_t> m_queue_depth{0};
+    std::atomic<uint64_t> m_queue_depth_peak{0};
+    std::atomic<uint64_t> m_drain_batch_size{0};
+    std::atomic<int> m_drain_concurrency{0};
+    std::atomic<int64_t> m_drain_latency_ms{0};
+    std::atomic<uint64_t> m_drain_increases{0};
+    std::atomic<uint64_t> m_drain_decreases{0};
+    std::atomic<int64_t> m_started_at{0};
+};
+
+extern Metrics g_metrics;
+
+// Formats a snapshot as multi-line human readable text
+std::string format_metrics_report(const MetricsSnapshot& snapshot);
+
+} // namespace foo_lastfm
@@ -0,0 +1,28 @@
+//
+//  platform.cpp
+//  foo_mac_scrobble
+//
+//  Created by Oleksandr Velychko on 18/10/2026.
+//
+
+#include "platform.h"
+
+#include <cassert>
+
+namespace foo_lastfm
+{
+
+static Platform* g_platform = nullptr;
+
+void set_platform(Platform* platform)
+{
+    g_platform = platform;
+}
+
+Platform& platform()
+{
+    assert(g_platform && "set_platform() must be called before using the scrobbler core");
+    return *g_platform;
+}
+
+} // namespace foo_lastfm
@@ -0,0 +1,40 @@
+//
+//  platform.h
+//  foo_mac_scrobble
+//
+//  Created by Oleksandr Velychko on 18/10/2026.
+//
+
+#pragma once
+
+#include <functional>
+#include <string>
+
+namespace foo_lastfm
+{
+
+// Host services used by the scrobbler core (LastfmApi, ScrobbleQueue, SessionManager).
+// The component provides a foobar2000 implementation; headless tools provide their own.
+class Platform
+{
+  public:
+    virtual ~Platform() = default;
+
+    // Native directory for persistent files, always ending with '/'
+    virtual std::string profile_dir() = 0;
+    // Lowercase hex MD5 digest of the data
+    virtual std::string md5_hex(const std::string& data) = 0;
+    // Runs a callback on the host's main thread (or inline if there is none)
+    virtual void run_on_main_thread(std::function<void()> fn) = 0;
+    // Stores the authenticated user name in the host settings
+    virtual void store_username(const std::string& username) = 0;
+    // Stores the session key in the host settings
+    virtual void store_session_key(const std::string& session_key) = 0;
+};
+
+// Installs the platform implementation; must be called before any core object is created
+void set_platform(Platform* platform);
+// Returns the installed platform implementation
+Platform& platform();
+
+} // namespace foo_lastfm
@@ -0,0 +1,81 @@
+//
+//  platform_fb2k.cpp
+//  foo_mac_scrobble
+//
+//  Created by Oleksandr Velychko on 18/10/2026.
+//
+
+#include "platform_fb2k.h"
+
+#include "config.h"
+#include "playcount_cache.h"
+#include "playcount_index.h"
+#include "stdafx.h"
+
+#include <CommonCrypto/CommonDigest.h>
+#include <SDK/filesystem.h>
+#include <main_thread_callback.h>
+
+namespace foo_lastfm
+{
+
+Fb2kPlatform g_fb2k_platform;
+
+std::string Fb2kPlatform::profile_dir()
+{
+    // Convert the profile URL to a native path
+    pfc::string8 profile_path = core_api::get_profile_path();
+    pfc::string8 native_path;
+    std::string dir;
+    if (filesystem::g_get_native_path(profile_path, native_path))
+    {
+        dir = native_path.c_str();
+    }
+    else
+    {
+        dir = profile_path.c_str();
+        if (dir.find("file://") == 0)
+            dir = dir.substr(7);
+    }
+
+    if (!dir.empty() && dir.back() != '/' && dir.back() != '\\')
+        dir += "/";
+    return dir;
+}
+
+std::string Fb2kPlatform::md5_hex(const std::string& data)
+{
+    unsigned char hash[CC_MD5_DIGEST_LENGTH];
+    CC_MD5(data.c_str(), (CC_LONG)data.length(), hash);
+
+    static const char* digits = "0123456789abcdef";
+    std::string out;
+    out.reserve(CC_MD5_DIGEST_LENGTH * 2);
+    for (int i = 0; i < CC_MD5_DIGEST_LENGTH; ++i)
+    {
+        out += digits[hash[i] >> 4];
+        out += digits[hash[i] & 0x0f];
+    }
+    return out;
+}
+
+void Fb2kPlatform::run_on_main_thread(std::function<void()> fn)
+{
+    fb2k::inMainThread(std::move(fn));
+}
+
+void Fb2kPlatform::store_username(const std::string& username)
+{
+    cfg_username.set(username.c_str());
+    PlaycountCacheUse cache;
+    if (cache.get())
+        cache->set_user(username);
+    playcount_set_account(username);
+}
+
+void Fb2kPlatform::store_session_key(const std::string& session_key)
+{
+    cfg_session_key.set(session_key.c_str());
+}
+
+} // namespace foo_lastfm
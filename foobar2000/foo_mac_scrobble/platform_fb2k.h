@@ -0,0 +1,28 @@
+//
+//  platform_fb2k.h
+//  foo_mac_scrobble
+//
+//  Created by Oleksandr Velychko on 18/10/2026.
+//
+
+#pragma once
+
+#include "platform.h"
+
+namespace foo_lastfm
+{
+
+// Platform implementation backed by foobar2000 services and CommonCrypto
+class Fb2kPlatform : public Platform
+{
+  public:
+    std::string profile_dir() override;
+    std::string md5_hex(const std::string& data) override;
+    void run_on_main_thread(std::function<void()> fn) override;
+    void store_username(const std::string& username) override;
+    void store_session_key(const std::string& session_key) override;
+};
+
+extern Fb2kPlatform g_fb2k_platform;
+
+} // namespace foo_lastfm
@@ -5,37 +5,118 @@
 //  Created by Oleksandr Velychko on 09/11/2025.
 //
 
-#include "config.h"
+#include "async_logger.h"
 #include "lastfm_api.h"
+#include "playback_tracker.h"
+#include "runtime_config.h"
 #include "scrobble_queue.h"
 #include "stdafx.h"
+#include "track_mapping.h"
 
 #include <SDK/console.h>
 #include <SDK/metadb.h>
 #include <SDK/play_callback.h>
 #include <SDK/playback_control.h>
+#include <SDK/timer.h>
 #include <cmath> // for std::isfinite
+#include <string_view>
 
 namespace foo_lastfm
 {
-class scrobble_callback : public play_callback_static
+
+// Forwards playback events to a PlaybackTracker and hands its decisions to the Last.fm worker, off the main thread
+class scrobble_callback : public play_callback_static, private PlaybackTracker::Host
 {
   private:
-    LastfmApi::TrackInfo m_current_track;
-    double m_length = 0;
-    double m_threshold = 0;
-    bool m_scrobbled = false;
+    PlaybackTracker m_tracker{*this};
+    StreamTitle m_stream_title;
+    bool m_stream = false; // The playing track is an internet radio stream; songs come with its dynamic info
+    fb2k::objRef m_timer;
+
+    // First value of a tag, or an empty view
+    static std::string_view meta_view(const file_info& info, const char* name)
+    {
+        const char* value = info.meta_get(name, 0);
+        return value ? std::string_view(value) : std::string_view();
+    }
+
+    void now_playing(const LastfmApi::TrackInfo& track) override
+    {
+        // Non-blocking; held while offline, newest only. The request also opens the connection the scrobble reuses.
+        if (g_lastfm_api && g_lastfm_api->has_saved_session() && g_scrobble_queue)
+        {
+            g_scrobble_queue->add_op(QueueOp::now_playing, track);
+            g_scrobble_queue->wake_target(ScrobbleQueue::kLastfmTarget);
+            console::print("Last.fm Scrobbler: Updating now playing...");
+        }
+    }
+
+    bool scrobble(const LastfmApi::TrackInfo& track) override
+    {
+        // Turned off while the track played
+        if (!g_runtime_config.get().enabled)
+            return true;
+
+        try
+        {
+            static_api_ptr_t<playback_control> playback_control;
+            if (!playback_control->is_playing())
+                return false;
+
+            if (g_lastfm_api && g_lastfm_api->has_saved_session() && g_scrobble_queue)
+            {
+                // Add to the queue (to make sure nothing is lost)
+                g_scrobble_queue->add_track(track);
+
+                // Let the background workers submit it right away, off the main thread
+                g_scrobble_queue->wake_workers();
+
+                console::print("Last.fm Scrobbler: Track queued for scrobbling");
+            }
+            return true;
+        }
+        catch (const std::exception& e)
+        {
+            console::complain("Last.fm Scrobbler", e.what());
+            return false;
+        }
+    }
+
+    void prewarm() override
+    {
+        if (g_lastfm_api)
+            g_lastfm_api->prewarm();
+    }
+
+    void set_timer(double seconds) override
+    {
+        m_timer.release();
+        if (seconds < 0)
+            return;
+        m_timer = fb2k::registerTimer(seconds,
+                                      [this]()
+                                      {
+                                          // Released only after on_timer() (which may set a new timer) returns:
+                                          // dropping the last reference destroys this closure
+                                          fb2k::objRef running = std::move(m_timer);
+                                          m_tracker.on_timer();
+                                      });
+    }
 
   public:
     unsigned get_flags() override
     {
-        return flag_on_playback_new_track | flag_on_playback_time | flag_on_playback_seek | flag_on_playback_stop |
-               flag_on_playback_pause;
+        // No flag_on_playback_time: the tracker's timer fires when the threshold is reached
+        return flag_on_playback_new_track | flag_on_playback_seek | flag_on_playback_stop | flag_on_playback_pause |
+               flag_on_playback_dynamic_info_track;
     }
 
     void on_playback_new_track(metadb_handle_ptr track) override
     {
-        if (!cfg_enabled.get())
+        const RuntimeConfig& config = g_runtime_config.get();
+        m_tracker.on_stop();
+        m_stream = false;
+        if (!config.enabled)
             return;
 
         // Check for a saved session, not an active connection
@@ -44,64 +125,49 @@ class scrobble_callback : public play_callback_static
 
         try
         {
-            m_scrobbled = false;
             static_api_ptr_t<playback_control> playback_control;
             if (!playback_control->is_playing())
                 return;
 
-            file_info_impl info;
-            if (!track->get_info(info))
-                return;
-
             // Validate metadata safety to avoid player crashes
+            double length = 0;
             try
             {
+                // Length (read from the metadb's cached info, without copying it) and artist, title, album, album
+                // artist and track number through the compiled field scripts; a repeat play takes them from the cache
+                const TrackMapping::Mapped& mapped = g_track_mapping.lookup(track);
+
                 // Length must be valid
-                m_length = info.get_length();
-                if (!(m_length > 0.0 && std::isfinite(m_length)))
+                length = mapped.length;
+                if (!(length > 0.0 && std::isfinite(length)))
                 {
+                    // Internet radio has no length; its songs arrive as dynamic info
+                    if (filesystem::g_is_remote_safe(track->get_path()))
+                    {
+                        m_stream = true;
+                        m_stream_title.reset();
+                        LASTFM_LOG_DEBUG("Last.fm Debug: Stream started, waiting for song titles");
+                        return;
+                    }
                     console::print("Last.fm Scrobbler: Track length invalid or missing, skipping.");
-                    // Clear current track data to prevent re-scrobbling when switching to streams
-                    m_current_track = LastfmApi::TrackInfo();
-                    m_scrobbled = false;
-                    m_threshold = 0;
                     return;
                 }
 
-                // Safely assign metadata with fallback for missing values
-                auto safeMeta = [&](const char* key)
-                {
-                    const char* v = info.meta_get(key, 0);
-                    return v ? v : "";
-                };
-
-                m_current_track.artist = safeMeta("artist");
-                m_current_track.track = safeMeta("title");
-                m_current_track.album = safeMeta("album");
-                m_current_track.album_artist = safeMeta("album artist");
-
-                // Track number (must validate ptr manually, pfc::string8 won't!)
-                const char* tn = info.meta_get("tracknumber", 0);
-                if (tn && *tn)
-                    m_current_track.track_number = atoi(tn);
-                else
-                    m_current_track.track_number = 0;
-
-                m_current_track.duration = static_cast<int>(m_length);
-                m_current_track.timestamp = time(nullptr); // Initial timestamp for now playing
-
-                if (m_current_track.artist.empty() || m_current_track.track.empty())
+                // Copied into the tracker's buffers, which keep their capacity from track to track
+                LastfmApi::TrackInfo& info = m_tracker.next_track();
+                info.artist = mapped.info.artist;
+                info.track = mapped.info.track;
+                info.album = mapped.info.album;
+                info.album_artist = mapped.info.album_artist;
+                info.track_number = mapped.info.track_number;
+                if (info.artist.empty() || info.track.empty())
                 {
                     console::print("Last.fm Scrobbler: Missing metadata — skip to prevent crash.");
                     return;
                 }
 
-                if (cfg_debug_enabled.get())
-                {
-                    console::printf("Last.fm Debug: Artist: %s | Title: %s | Album: %s | Album Artist: %s",
-                                    m_current_track.artist.c_str(), m_current_track.track.c_str(),
-                                    m_current_track.album.c_str(), m_current_track.album_artist.c_str());
-                }
+                LASTFM_LOG_DEBUG("Last.fm Debug: Artist: %s | Title: %s | Album: %s | Album Artist: %s", info.artist,
+                                 info.track, info.album, info.album_artist);
             }
             catch (...)
             {
@@ -109,21 +175,8 @@ class scrobble_callback : public play_callback_static
                 return;
             }
 
-            // Setup scrobbling threshold
-            m_threshold = (cfg_scrobble_percent.get() / 100.0) * m_length;
-            if (m_threshold > 240)
-                m_threshold = 240; // Max 4 minutes
-            if (m_length < 30)
-                return; // Minimum track length
-
-            m_scrobbled = false;
-
-            // Update now playing asynchronously — non-blocking
-            if (g_lastfm_api && g_lastfm_api->has_saved_session())
-            {
-                g_lastfm_api->update_now_playing_async(m_current_track);
-                console::print("Last.fm Scrobbler: Updating now playing...");
-            }
+            // Sets up the scrobbling threshold and sends now playing
+            m_tracker.on_new_track(length, config.scrobble_percent, playback_control->is_paused());
         }
         catch (const std::exception& e)
         {
@@ -131,72 +184,68 @@ class scrobble_callback : public play_callback_static
         }
     }
 
-    void on_playback_time(double p_time) override
+    void on_playback_seek(double p_time) override { m_tracker.on_seek(p_time); }
+
+    void on_playback_stop(play_control::t_stop_reason p_reason) override
+    {
+        m_stream = false;
+        m_tracker.on_stop();
+    }
+
+    void on_playback_pause(bool p_state) override { m_tracker.on_pause(p_state); }
+
+    // Unused callbacks
+    void on_playback_time(double p_time) override {}
+    void on_playback_starting(play_control::t_track_command p_command, bool p_paused) override {}
+    void on_playback_edited(metadb_handle_ptr p_track) override {}
+    void on_playback_dynamic_info(const file_info& p_info) override {}
+    void on_playback_dynamic_info_track(const file_info& p_info) override
     {
-        if (!cfg_enabled.get() || m_scrobbled || p_time < m_threshold)
+        if (!m_stream)
             return;
 
-        // Don't scrobble if current track data is empty (e.g., after switching to radio streams)
-        if (m_current_track.artist.empty() || m_current_track.track.empty())
+        // Stations send their StreamTitle as "Artist - Title"; some fill in the tags instead
+        std::string_view artist = StreamTitle::trim(meta_view(p_info, "artist"));
+        std::string_view title = StreamTitle::trim(meta_view(p_info, "title"));
+        if (artist.empty())
+            StreamTitle::split(title, artist, title);
+
+        // Most updates repeat the song that is playing; they cost the hash and nothing else
+        if (!m_stream_title.update(artist, title))
             return;
 
+        // Another song (or an ident or ad without one): the last one is scrobbled already or was too short
+        m_tracker.on_stop();
+        const RuntimeConfig& config = g_runtime_config.get();
+        if (!config.enabled || !g_lastfm_api || !g_lastfm_api->has_saved_session())
+            return;
+        if (artist.empty() || title.empty())
+        {
+            LASTFM_LOG_DEBUG("Last.fm Debug: Stream title without artist and title, not scrobbled");
+            return;
+        }
+
         try
         {
             static_api_ptr_t<playback_control> playback_control;
             if (!playback_control->is_playing())
                 return;
 
-            // Prepare the track for scrobbling
-            auto copy = m_current_track;
-            copy.timestamp = time(nullptr) - static_cast<time_t>(p_time);
-
-            if (g_lastfm_api && g_lastfm_api->has_saved_session() && g_scrobble_queue)
-            {
-                // Add to the queue (to make sure nothing is lost)
-                g_scrobble_queue->add_track(copy);
-
-                // Try to process the queue right away
-                g_scrobble_queue->process_queue();
-
-                console::print("Last.fm Scrobbler: Track queued for scrobbling");
-            }
+            LastfmApi::TrackInfo& info = m_tracker.next_track();
+            info.artist.assign(artist);
+            info.track.assign(title);
+            info.album.assign(StreamTitle::trim(meta_view(p_info, "album")));
+            info.album_artist.clear();
+            info.track_number = 0;
+            LASTFM_LOG_DEBUG("Last.fm Debug: Stream song: %s - %s", info.artist, info.track);
 
-            m_scrobbled = true;
+            m_tracker.on_new_stream_title(playback_control->is_paused());
         }
         catch (const std::exception& e)
         {
             console::complain("Last.fm Scrobbler", e.what());
         }
     }
-
-    void on_playback_seek(double p_time) override
-    {
-        // If seeked back below threshold, allow re-scrobble
-        if (p_time < m_threshold)
-        {
-            m_scrobbled = false;
-        }
-    }
-
-    void on_playback_stop(play_control::t_stop_reason p_reason) override
-    {
-        m_scrobbled = false;
-        m_length = 0;
-        m_threshold = 0;
-        // Clear current track data to prevent stale data from being used
-        m_current_track = LastfmApi::TrackInfo();
-    }
-
-    void on_playback_pause(bool p_state) override
-    {
-        // No action needed: playback time doesn't advance while paused
-    }
-
-    // Unused callbacks
-    void on_playback_starting(play_control::t_track_command p_command, bool p_paused) override {}
-    void on_playback_edited(metadb_handle_ptr p_track) override {}
-    void on_playback_dynamic_info(const file_info& p_info) override {}
-    void on_playback_dynamic_info_track(const file_info& p_info) override {}
     void on_volume_change(float p_new_val) override {}
 };
 
@@ -0,0 +1,217 @@
+//
+//  playback_tracker.cpp
+//  foo_mac_scrobble
+//
+//  Created by Oleksandr Velychko on 18/10/2026.
+//
+
+#include "playback_tracker.h"
+
+#include "clock.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace foo_lastfm
+{
+
+// Played time is measured in whole milliseconds; a timer that fires within this of its point is on time
+static constexpr double kToleranceSeconds = 0.001;
+
+void PlaybackTracker::on_new_track(double length, int scrobble_percent, bool paused)
+{
+    start(length > kMinLengthSeconds, length, std::min(scrobble_percent / 100.0 * length, kMaxThresholdSeconds),
+          paused);
+}
+
+void PlaybackTracker::on_new_stream_title(bool paused)
+{
+    start(true, 0, kStreamThresholdSeconds, paused);
+}
+
+void PlaybackTracker::start(bool armed, double length, double threshold, bool paused)
+{
+    m_scrobbled = false;
+    m_prewarmed = false;
+    m_played = 0;
+    m_resumed_ms = -1;
+    m_armed = armed;
+    if (!m_armed)
+    {
+        m_threshold = 0;
+        m_host.set_timer(-1);
+        return;
+    }
+
+    Clock& clock = current_clock();
+    const int64_t now_ms = clock.now_ms();
+    m_track.duration = static_cast<int>(std::lround(length)); // 0 (not sent) for a stream title
+    m_track.timestamp = static_cast<time_t>(now_ms / 1000);   // When the track started, also the scrobble's time
+    m_threshold = threshold;
+    if (!paused)
+        m_resumed_ms = now_ms;
+    m_host.now_playing(m_track);
+    arm();
+}
+
+void PlaybackTracker::on_pause(bool paused)
+{
+    if (!m_armed)
+        return;
+
+    settle();
+    if (paused)
+        m_resumed_ms = -1;
+    else if (m_resumed_ms < 0)
+        m_resumed_ms = current_clock().now_ms();
+    arm();
+}
+
+void PlaybackTracker::on_seek(double position)
+{
+    if (!m_armed)
+        return;
+
+    settle();
+    if (m_scrobbled && position < m_threshold)
+    {
+        m_scrobbled = false;
+        m_prewarmed = false;
+        m_played = 0;
+        m_track.timestamp = current_clock().now_seconds() - static_cast<time_t>(position);
+    }
+    arm();
+}
+
+void PlaybackTracker::on_stop()
+{
+    if (m_armed)
+        m_host.set_timer(-1);
+    m_armed = false;
+    m_scrobbled = false;
+    m_resumed_ms = -1;
+    m_threshold = 0;
+}
+
+void PlaybackTracker::on_timer()
+{
+    if (!m_armed || m_scrobbled || m_resumed_ms < 0)
+        return;
+
+    const double played = this->played();
+    if (!m_prewarmed && played + kToleranceSeconds >= m_threshold - kPrewarmLeadSeconds)
+    {
+        // The server may have closed the now-playing connection by now; make sure one is open at the threshold
+        m_prewarmed = true;
+        m_host.prewarm();
+    }
+    if (played + kToleranceSeconds < m_threshold)
+    {
+        arm();
+        return;
+    }
+
+    m_scrobble = m_track;
+    m_scrobbled = m_host.scrobble(m_scrobble);
+    if (!m_scrobbled)
+        m_host.set_timer(kRetrySeconds);
+}
+
+double PlaybackTracker::played() const
+{
+    if (m_resumed_ms < 0)
+        return m_played;
+    return m_played + static_cast<double>(current_clock().now_ms() - m_resumed_ms) / 1000.0;
+}
+
+void PlaybackTracker::settle()
+{
+    if (m_resumed_ms < 0)
+        return;
+    const int64_t now_ms = current_clock().now_ms();
+    m_played += static_cast<double>(now_ms - m_resumed_ms) / 1000.0;
+    m_resumed_ms = now_ms;
+}
+
+void PlaybackTracker::arm()
+{
+    if (!m_armed || m_scrobbled || m_resumed_ms < 0)
+    {
+        m_host.set_timer(-1);
+        return;
+    }
+
+    double due = m_threshold - played();
+    if (!m_prewarmed)
+        due -= kPrewarmLeadSeconds;
+    m_host.set_timer(std::max(due, 0.0));
+}
+
+// ============================================================
+// Stream titles
+// ============================================================
+
+static bool is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+std::string_view StreamTitle::trim(std::string_view text)
+{
+    while (!text.empty() && is_space(text.front()))
+        text.remove_prefix(1);
+    while (!text.empty() && is_space(text.back()))
+        text.remove_suffix(1);
+    return text;
+}
+
+bool StreamTitle::split(std::string_view text, std::string_view& artist, std::string_view& title)
+{
+    const size_t separator = text.find(" - ");
+    if (separator == std::string_view::npos)
+        return false;
+    artist = trim(text.substr(0, separator));
+    title = trim(text.substr(separator + 3));
+    return true;
+}
+
+uint64_t StreamTitle::hash(std::string_view artist, std::string_view title)
+{
+    // FNV-1a over the fields with runs of whitespace folded to one space and ASCII letters lowered
+    uint64_t hash = 14695981039346656037ull;
+    auto add = [&hash](unsigned char c)
+    {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    };
+    for (std::string_view field : {artist, title})
+    {
+        bool space = false;
+        for (char c : trim(field))
+        {
+            if (is_space(c))
+            {
+                space = true;
+                continue;
+            }
+            if (space)
+                add(' ');
+            space = false;
+            add(static_cast<unsigned char>(c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c));
+        }
+        add(0x1f); // Field separator, so "a b" + "c" differs from "a" + "b c"
+    }
+    return hash;
+}
+
+bool StreamTitle::update(std::string_view artist, std::string_view title)
+{
+    const uint64_t hash = StreamTitle::hash(artist, title);
+    if (m_known && hash == m_hash)
+        return false;
+    m_hash = hash;
+    m_known = true;
+    return true;
+}
+
+} // namespace foo_lastfm
@@ -0,0 +1,122 @@
+//
+//  playback_tracker.h
+//  foo_mac_scrobble
+//
+//  Created by Oleksandr Velychko on 18/10/2026.
+//
+
+#pragma once
+
+#include "lastfm_api.h"
+
+#include <cstdint>
+#include <string_view>
+
+namespace foo_lastfm
+{
+
+// Decides when the playing track is scrobbled, from the player's playback events. It adds up the time the track
+// actually played (pauses excluded, seeks not counted as played) and keeps one one-shot timer set for the moment
+// the next decision is due, re-armed on seek, pause and resume, so a track costs a handful of calls however long
+// it plays. The component forwards foobar2000's play_callback to it; scrobblectl tick-bench drives it with
+// synthetic playback. Not thread-safe: playback events and the timer arrive on the main thread.
+class PlaybackTracker
+{
+  public:
+    // The scrobble's connection is opened this long before the threshold
+    static constexpr double kPrewarmLeadSeconds = 10;
+    // Tracks this long or shorter are not scrobbled
+    static constexpr double kMinLengthSeconds = 30;
+    // A track is scrobbled after this much playback at the latest, however long it is
+    static constexpr double kMaxThresholdSeconds = 240;
+    // How long to wait before offering a scrobble the host did not take again
+    static constexpr double kRetrySeconds = 1;
+    // A stream title (its length is unknown) is scrobbled after this much playback: half a typical song, past
+    // station idents, jingles and most ads
+    static constexpr double kStreamThresholdSeconds = 90;
+
+    // What the tracker needs from the player and the scrobbler; the component queues for Last.fm
+    class Host
+    {
+      public:
+        virtual ~Host() = default;
+
+        // The track started playing
+        virtual void now_playing(const LastfmApi::TrackInfo& track) = 0;
+        // The track reached the threshold (timestamp is when it started); false offers it again kRetrySeconds later
+        virtual bool scrobble(const LastfmApi::TrackInfo& track) = 0;
+        // The threshold is near; open the connection the scrobble will use
+        virtual void prewarm() = 0;
+        // Calls on_timer() once, seconds from now, replacing the timer set before; a negative value only cancels it
+        virtual void set_timer(double seconds) = 0;
+    };
+
+    explicit PlaybackTracker(Host& host) : m_host(host) {}
+
+    // Metadata of the track about to start. Fill it in place, so its strings keep their buffers from track to
+    // track, then call on_new_track(); artist and title must not be empty.
+    LastfmApi::TrackInfo& next_track() { return m_track; }
+    // The track in next_track() started; length in seconds, scrobbled once scrobble_percent of it was played
+    void on_new_track(double length, int scrobble_percent, bool paused = false);
+    // The song in next_track() started on an internet radio stream; scrobbled after kStreamThresholdSeconds
+    void on_new_stream_title(bool paused = false);
+    // Playback was paused or resumed
+    void on_pause(bool paused);
+    // The user moved to position (seconds into the track). Going back before the threshold after the scrobble
+    // starts another play of the track.
+    void on_seek(double position);
+    // Playback stopped; nothing is scrobbled until the next track
+    void on_stop();
+    // The timer set through Host::set_timer() fired
+    void on_timer();
+
+    // A track is playing that will be (or was) scrobbled
+    bool is_armed() const { return m_armed; }
+    // Played seconds at which the playing track is scrobbled
+    double threshold() const { return m_threshold; }
+    // Seconds of the playing track played so far
+    double played() const;
+
+  private:
+    Host& m_host;
+    LastfmApi::TrackInfo m_track;
+    LastfmApi::TrackInfo m_scrobble; // What is handed to the host; reused like m_track
+    double m_threshold = 0;
+    double m_played = 0;       // Played seconds up to m_resumed_ms
+    int64_t m_resumed_ms = -1; // Clock time playback last started or resumed (-1 while paused or stopped)
+    bool m_armed = false;
+    bool m_scrobbled = false;
+    bool m_prewarmed = false;
+
+    // Starts tracking the track in m_track, if armed; length is 0 for a stream title
+    void start(bool armed, double length, double threshold, bool paused);
+    // Moves the running stretch of playback into m_played
+    void settle();
+    // Sets the timer for the next decision (prewarm or scrobble), or cancels it if there is none
+    void arm();
+};
+
+// Tells real song changes on an internet radio stream from the metadata refreshes many stations repeat every few
+// seconds. The fields are hashed normalised (ASCII case and surrounding or repeated whitespace ignored) in place,
+// so an unchanged title costs one pass over a few dozen bytes and no allocation. Not thread-safe.
+class StreamTitle
+{
+  public:
+    // Splits "Artist - Title", as stations send their StreamTitle, at the first separator; false if there is none
+    static bool split(std::string_view text, std::string_view& artist, std::string_view& title);
+    // Returns text without surrounding whitespace
+    static std::string_view trim(std::string_view text);
+    // Returns the hash of the normalised fields
+    static uint64_t hash(std::string_view artist, std::string_view title);
+
+    // Records the fields of a metadata update; true if they name another song than the update before
+    bool update(std::string_view artist, std::string_view title);
+    // Forgets the song (a new stream started)
+    void reset() { m_known = false; }
+
+  private:
+    uint64_t m_hash = 0;
+    bool m_known = false;
+};
+
+} // namespace foo_lastfm
@@ -0,0 +1,329 @@
+//
+//  playcount_cache.cpp
+//  foo_mac_scrobble
+//
+//  Created by Oleksandr Velychko on 18/10/2026.
+//
+
+#include "playcount_cache.h"
+
+#include "async_logger.h"
+#include "clock.h"
+#include "durable_file.h"
+#include "platform.h"
+#include "playcount_index.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+namespace foo_lastfm
+{
+
+std::atomic<PlaycountCache*> g_playcount_cache{nullptr};
+// PlaycountCacheUses in flight
+static std::atomic<int> g_cache_uses{0};
+
+PlaycountCacheUse::PlaycountCacheUse()
+{
+    // Counted before the load: wait_playcount_cache_uses() either sees this use or it is the one that cleared the
+    // pointer first, so this use reads nullptr (both sequentially consistent)
+    g_cache_uses.fetch_add(1);
+    m_cache = g_playcount_cache.load();
+}
+
+PlaycountCacheUse::~PlaycountCacheUse()
+{
+    g_cache_uses.fetch_sub(1);
+}
+
+PlaycountCache* wait_playcount_cache_uses()
+{
+    PlaycountCache* cache = g_playcount_cache.exchange(nullptr);
+    // The fields' uses only probe hash maps or queue a request, and on_quit stops the sync thread first
+    while (g_cache_uses.load() != 0)
+        std::this_thread::yield();
+    return cache;
+}
+
+// Requests handled per worker pass
+static constexpr size_t kRefillBatch = 256;
+// Queued requests beyond this are not taken; they queue again on a later repaint
+static constexpr size_t kMaxQueued = 4096;
+// Pause between track.getInfo requests (made for tracks without a record)
+static constexpr auto kTrackInfoInterval = std::chrono::milliseconds(500);
+
+// "LFMLOVE1" followed by u64 track_match_hash() values (native byte order)
+static const char kLovedMagic[8] = {'L', 'F', 'M', 'L', 'O', 'V', 'E', '1'};
+
+PlaycountCache::PlaycountCache(const std::string& user) : m_user(user)
+{
+    m_loved_path = platform().profile_dir();
+    m_loved_path += "lastfm_loved_tracks.bin";
+    load_loved();
+
+    m_thread = std::thread([this]() { worker(); });
+}
+
+PlaycountCache::~PlaycountCache()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_queue_mutex);
+        m_stop = true;
+    }
+    m_queue_cv.notify_all();
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+// ============================================================
+// Lookups (display field hot path)
+// ============================================================
+bool PlaycountCache::get_plays(uint64_t hash, const char* artist, const char* title, RemotePlayStats& out)
+{
+    {
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+        auto it = m_entries.find(hash);
+        if (it != m_entries.end())
+        {
+            out = it->second.plays;
+            return it->second.known;
+        }
+    }
+
+    bool wake = false;
+    {
+        std::lock_guard<std::mutex> lock(m_queue_mutex);
+        if (m_requests.size() < kMaxQueued && m_queued.insert(hash).second)
+        {
+            m_requests.push_back({hash, artist ? artist : "", title ? title : ""});
+            wake = m_requests.size() == 1;
+        }
+    }
+    if (wake)
+        m_queue_cv.notify_one();
+    return false;
+}
+
+bool PlaycountCache::is_loved(uint64_t hash) const
+{
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    return m_loved.count(hash) != 0;
+}
+
+std::vector<uint64_t> PlaycountCache::store(const std::vector<std::pair<uint64_t, RemotePlayStats>>& records)
+{
+    std::vector<uint64_t> forgotten;
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    for (auto it = m_entries.begin(); it != m_entries.end();)
+    {
+        if (it->second.known)
+        {
+            ++it;
+            continue;
+        }
+        forgotten.push_back(it->first);
+        it = m_entries.erase(it);
+    }
+    for (const auto& [hash, plays] : records)
+    {
+        // Tracks never displayed load from the index when they first are
+        auto it = m_entries.find(hash);
+        if (it != m_entries.end())
+            it->second = {plays, true};
+    }
+    return forgotten;
+}
+
+std::vector<uint64_t> PlaycountCache::replace_loved(std::unordered_set<uint64_t> loved)
+{
+    std::vector<uint64_t> changed;
+    {
+        std::unique_lock<std::shared_mutex> lock(m_mutex);
+        for (uint64_t hash : loved)
+            if (m_loved.count(hash) == 0)
+                changed.push_back(hash);
+        for (uint64_t hash : m_loved)
+            if (loved.count(hash) == 0)
+                changed.push_back(hash);
+        m_loved = std::move(loved);
+    }
+    if (!changed.empty())
+        save_loved();
+    return changed;
+}
+
+void PlaycountCache::set_user(const std::string& user)
+{
+    std::lock_guard<std::mutex> lock(m_queue_mutex);
+    m_user = user;
+}
+
+void PlaycountCache::forget_all()
+{
+    {
+        std::unique_lock<std::shared_mutex> lock(m_mutex);
+        m_entries.clear();
+        m_loved.clear();
+    }
+    save_loved();
+}
+
+// ============================================================
+// Refill worker
+// ============================================================
+void PlaycountCache::worker()
+{
+    std::vector<Request> batch;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_queue_mutex);
+            m_queue_cv.wait(lock, [this]() { return m_stop || !m_requests.empty(); });
+            if (m_stop)
+                return;
+
+            const size_t count = std::min(kRefillBatch, m_requests.size());
+            const auto first = m_requests.end() - static_cast<std::ptrdiff_t>(count);
+            batch.assign(std::make_move_iterator(first), std::make_move_iterator(m_requests.end()));
+            m_requests.erase(first, m_requests.end());
+        }
+
+        try
+        {
+            refill(batch);
+        }
+        catch (const std::exception& e)
+        {
+            LASTFM_LOG_INFO("Last.fm: Play count refill failed: %s", e.what());
+        }
+
+        std::lock_guard<std::mutex> lock(m_queue_mutex);
+        for (const auto& request : batch)
+            m_queued.erase(request.hash);
+    }
+}
+
+void PlaycountCache::refill(std::vector<Request>& batch)
+{
+    // A track without a record is unknown, not unplayed: it may have joined the library after the full sync, or
+    // not be in it at all. Ask Last.fm for its total.
+    std::string user;
+    {
+        std::lock_guard<std::mutex> lock(m_queue_mutex);
+        user = m_user;
+    }
+    const bool can_ask = !user.empty() && g_lastfm_api && g_lastfm_api->has_saved_session();
+
+    std::vector<std::pair<uint64_t, Entry>> filled;
+    std::vector<std::pair<uint64_t, RemotePlayStats>> fetched;
+    std::vector<std::pair<uint64_t, bool>> loved_updates;
+    filled.reserve(batch.size());
+    for (const auto& request : batch)
+    {
+        Entry entry;
+        if (playcount_get(request.hash, entry.plays))
+        {
+            entry.known = true;
+        }
+        else if (can_ask && !request.artist.empty() && !request.title.empty())
+        {
+            {
+                std::unique_lock<std::mutex> lock(m_queue_mutex);
+                if (m_queue_cv.wait_for(lock, kTrackInfoInterval, [this]() { return m_stop; }))
+                    break;
+            }
+            LastfmApi::TrackUserInfo info;
+            if (g_lastfm_api->get_track_user_info(request.artist, request.title, user, info))
+            {
+                // The total includes every scrobble so far; later syncs only add the newer ones
+                entry.known = true;
+                entry.plays.playcount = info.playcount;
+                entry.plays.counted_to = current_clock().now_seconds();
+                fetched.emplace_back(request.hash, entry.plays);
+                loved_updates.emplace_back(request.hash, info.loved);
+            }
+        }
+        filled.emplace_back(request.hash, entry);
+    }
+
+    // Answers for an account that signed out meanwhile would mix its plays into the next one's
+    {
+        std::lock_guard<std::mutex> lock(m_queue_mutex);
+        if (m_user != user)
+            return;
+    }
+
+    // Persist track.getInfo answers so they are not asked again on the next start
+    if (!fetched.empty())
+        playcount_write(fetched);
+
+    bool loved_changed = false;
+    std::vector<uint64_t> changed;
+    {
+        std::unique_lock<std::shared_mutex> lock(m_mutex);
+        for (const auto& [hash, loved] : loved_updates)
+            loved_changed |= loved ? m_loved.insert(hash).second : m_loved.erase(hash) != 0;
+        for (auto& [hash, entry] : filled)
+        {
+            // Rows showed empty fields while loading; only those that now show something need a redraw
+            if (entry.known)
+                changed.push_back(hash);
+            m_entries[hash] = entry;
+        }
+    }
+    if (loved_changed)
+        save_loved();
+    if (!changed.empty())
+        playcount_refresh(std::move(changed));
+}
+
+// ============================================================
+// Loved tracks file
+// ============================================================
+void PlaycountCache::load_loved()
+{
+    std::string data;
+    {
+        std::ifstream file(m_loved_path, std::ios::binary);
+        if (!file.is_open())
+            return;
+        data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+
+    if (data.size() < sizeof(kLovedMagic) || memcmp(data.data(), kLovedMagic, sizeof(kLovedMagic)) != 0)
+    {
+        LASTFM_LOG_INFO("Last.fm: Loved tracks file has an unknown format, ignoring it until the next sync");
+        return;
+    }
+
+    const size_t count = (data.size() - sizeof(kLovedMagic)) / sizeof(uint64_t);
+    m_loved.reserve(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        uint64_t hash = 0;
+        memcpy(&hash, data.data() + sizeof(kLovedMagic) + i * sizeof(hash), sizeof(hash));
+        m_loved.insert(hash);
+    }
+    LASTFM_LOG_DEBUG("Last.fm: Loaded %zu loved tracks", count);
+}
+
+void PlaycountCache::save_loved()
+{
+    std::string data(kLovedMagic, sizeof(kLovedMagic));
+    {
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+        data.reserve(data.size() + m_loved.size() * sizeof(uint64_t));
+        for (uint64_t hash : m_loved)
+            data.append(reinterpret_cast<const char*>(&hash), sizeof(hash));
+    }
+
+    // A crash never leaves half a list; the next sync fetches the list again anyway, so no sync
+    std::lock_guard<std::mutex> save_lock(m_save_mutex);
+    if (!replace_file(m_loved_path, data, false))
+        LASTFM_LOG_INFO("Last.fm: Failed to save loved tracks to %s", m_loved_path);
+}
+
+} // namespace foo_lastfm
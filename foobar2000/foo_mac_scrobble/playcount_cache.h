@@ -0,0 +1,122 @@
+//
+//  playcount_cache.h
+//  foo_mac_scrobble
+//
+//  Created by Oleksandr Velychko on 18/10/2026.
+//
+
+#pragma once
+
+#include "playcount_sync.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace foo_lastfm
+{
+
+// In-memory view of the play count index and the loved tracks for the title formatting fields.
+// Playlist views evaluate the fields for thousands of rows per repaint, so lookups only probe hash
+// maps. A miss queues the track for a worker thread, which reads the index record (or asks
+// track.getInfo for a track without one) and then refreshes only the tracks it filled in.
+class PlaycountCache
+{
+  public:
+    // Constructor: Loads the loved tracks file and starts the refill worker. user is the account track.getInfo
+    // asks for, as the main thread knows it (cfg_vars are not read off it).
+    explicit PlaycountCache(const std::string& user);
+    // Destructor: Stops the refill worker
+    ~PlaycountCache();
+
+    // Returns the play counts of a track, or false while they are not loaded (a refill is then queued).
+    // Safe from any thread; never touches disk or network.
+    bool get_plays(uint64_t hash, const char* artist, const char* title, RemotePlayStats& out);
+    // Returns true if the track is in the user's loved tracks
+    bool is_loved(uint64_t hash) const;
+    // Updates loaded tracks after a sync wrote their records and forgets the ones that failed to load,
+    // so they load again; returns those forgotten hashes (their rows need a refresh too)
+    std::vector<uint64_t> store(const std::vector<std::pair<uint64_t, RemotePlayStats>>& records);
+    // Replaces the loved tracks and saves them; returns the hashes whose flag changed
+    std::vector<uint64_t> replace_loved(std::unordered_set<uint64_t> loved);
+    // The user whose play counts track.getInfo asks for changed
+    void set_user(const std::string& user);
+    // Forgets every loaded track and the loved tracks (they belonged to another account), so they load again
+    void forget_all();
+
+  private:
+    // A track waiting for the worker
+    struct Request
+    {
+        uint64_t hash;
+        std::string artist;
+        std::string title;
+    };
+
+    // Cached state of one track
+    struct Entry
+    {
+        RemotePlayStats plays;
+        bool known = false; // False if the refill failed; the fields stay empty until the next sync
+    };
+
+    // Worker loop: takes the newest requests first, so rows on screen load before rows scrolled past
+    void worker();
+    // Fills in one batch of requests and refreshes the affected tracks
+    void refill(std::vector<Request>& batch);
+    // Loads and saves the loved tracks file
+    void load_loved();
+    void save_loved();
+
+    // Path to the loved tracks file
+    std::string m_loved_path;
+    // Serializes saves from the worker and the sync thread
+    std::mutex m_save_mutex;
+    // Guards m_entries and m_loved; lookups take it shared
+    mutable std::shared_mutex m_mutex;
+    std::unordered_map<uint64_t, Entry> m_entries;
+    std::unordered_set<uint64_t> m_loved;
+    // Guards the request queue
+    std::mutex m_queue_mutex;
+    std::condition_variable m_queue_cv;
+    std::vector<Request> m_requests;
+    std::unordered_set<uint64_t> m_queued;
+    bool m_stop = false;
+    std::string m_user;
+    // Refill worker thread
+    std::thread m_thread;
+};
+
+extern std::atomic<PlaycountCache*> g_playcount_cache;
+
+// Keeps g_playcount_cache alive while the display fields or the sync thread use it. Lock-free, as the fields take
+// one per row drawn. on_quit calls wait_playcount_cache_uses() before it deletes the cache; a use taken after that
+// is empty.
+class PlaycountCacheUse
+{
+  public:
+    PlaycountCacheUse();
+    ~PlaycountCacheUse();
+    PlaycountCacheUse(const PlaycountCacheUse&) = delete;
+    PlaycountCacheUse& operator=(const PlaycountCacheUse&) = delete;
+
+    // The cache, or nullptr if there is none or it is about to be deleted
+    PlaycountCache* get() const { return m_cache; }
+    PlaycountCache* operator->() const { return m_cache; }
+
+  private:
+    PlaycountCache* m_cache;
+};
+
+// Clears g_playcount_cache and waits for the uses in flight; returns the cache for the caller to delete
+PlaycountCache* wait_playcount_cache_uses();
+
+} // namespace foo_lastfm
@@ -0,0 +1,563 @@
+//
+//  playcount_index.cpp
+//  foo_mac_scrobble
+//
+//  Created by Oleksandr Velychko on 18/10/2026.
+//
+
+#include "playcount_index.h"
+
+#include "async_logger.h"
+#include "config.h"
+#include "durable_file.h"
+#include "platform.h"
+#include "playcount_cache.h"
+#include "stdafx.h"
+
+#include <SDK/console.h>
+#include <SDK/library_manager.h>
+#include <SDK/metadb_display_field_provider.h>
+#include <SDK/metadb_index.h>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <main_thread_callback.h>
+#include <thread>
+#include <unordered_set>
+
+namespace foo_lastfm
+{
+
+// Recreate this GUID if playcount_hash() ever changes, or old records will match the wrong tracks
+const GUID guid_playcount_index = {0x3d5e7f90, 0x1a2b, 0x4c3d, {0x9e, 0x8f, 0x70, 0x61, 0x52, 0x43, 0x34, 0x25}};
+
+// Keep synced counts of tracks that left the library for four weeks
+static const t_filetimestamp kRetentionPeriod = system_time_periods::week * 4;
+// Records written per metadb transaction
+static constexpr size_t kTransactionBatch = 1000;
+
+// ============================================================
+// Index client and registration
+// ============================================================
+metadb_index_hash playcount_hash(const file_info& info)
+{
+    const char* artist = info.meta_get("artist", 0);
+    const char* title = info.meta_get("title", 0);
+    return track_match_hash(artist ? artist : "", title ? title : "");
+}
+
+class playcount_index_client : public metadb_index_client
+{
+  public:
+    metadb_index_hash transform(const file_info& info, const playable_location&) override
+    {
+        return playcount_hash(info);
+    }
+};
+
+// Cached because the display fields look records up per track
+static metadb_index_manager::ptr index_api()
+{
+    static metadb_index_manager* cached = metadb_index_manager::get().detach();
+    return cached;
+}
+
+class playcount_init_stage : public init_stage_callback
+{
+  public:
+    void on_init_stage(t_uint32 stage) override
+    {
+        // Register before the configuration is read so playlists do not refresh twice
+        if (stage != init_stages::before_config_read)
+            return;
+
+        static playcount_index_client* client = new service_impl_single_t<playcount_index_client>();
+        try
+        {
+            index_api()->add(client, guid_playcount_index, kRetentionPeriod);
+        }
+        catch (const std::exception& e)
+        {
+            // The logger is not running yet at this stage
+            index_api()->remove(guid_playcount_index);
+            FB2K_console_formatter() << "Last.fm: Play count index initialization failed: " << e.what();
+            return;
+        }
+        index_api()->dispatch_global_refresh();
+    }
+};
+
+static service_factory_single_t<playcount_init_stage> g_playcount_init_stage;
+
+// ============================================================
+// Records: u32 play count, i64 first played, i64 last played, i64 counted to (missing in older records)
+// ============================================================
+bool playcount_get(metadb_index_hash hash, RemotePlayStats& out)
+{
+    mem_block_container_impl data;
+    index_api()->get_user_data(guid_playcount_index, hash, data);
+    if (data.get_size() == 0)
+        return false;
+
+    try
+    {
+        RemotePlayStats stats;
+        stream_reader_formatter_simple_ref<false> reader(data.get_ptr(), data.get_size());
+        reader >> stats.playcount >> stats.first_played >> stats.last_played;
+        if (data.get_size() >= sizeof(uint32_t) + 3 * sizeof(int64_t))
+            reader >> stats.counted_to;
+        out = stats;
+        return true;
+    }
+    catch (const exception_io_data&)
+    {
+        return false;
+    }
+}
+
+void playcount_write(const std::vector<std::pair<metadb_index_hash, RemotePlayStats>>& records)
+{
+    auto api = metadb_index_manager_v2::get();
+    for (size_t start = 0; start < records.size(); start += kTransactionBatch)
+    {
+        auto transaction = api->begin_transaction();
+        const size_t end = std::min(records.size(), start + kTransactionBatch);
+        for (size_t i = start; i < end; ++i)
+        {
+            const RemotePlayStats& stats = records[i].second;
+            stream_writer_formatter_simple<false> writer;
+            writer << stats.playcount << stats.first_played << stats.last_played << stats.counted_to;
+            transaction->set_user_data(guid_playcount_index, records[i].first, writer.m_buffer.get_ptr(),
+                                       writer.m_buffer.get_size());
+        }
+        transaction->commit();
+    }
+}
+
+// Deletes the records of these hashes; playcount_get() then finds none
+static void playcount_clear(const std::unordered_set<uint64_t>& hashes)
+{
+    auto api = metadb_index_manager_v2::get();
+    auto transaction = api->begin_transaction();
+    size_t pending = 0;
+    for (uint64_t hash : hashes)
+    {
+        transaction->set_user_data(guid_playcount_index, hash, nullptr, 0);
+        if (++pending == kTransactionBatch)
+        {
+            transaction->commit();
+            transaction = api->begin_transaction();
+            pending = 0;
+        }
+    }
+    transaction->commit();
+}
+
+void playcount_refresh(std::vector<metadb_index_hash> hashes)
+{
+    platform().run_on_main_thread(
+        [hashes = std::move(hashes)]()
+        {
+            pfc::list_t<metadb_index_hash> list;
+            list.prealloc(hashes.size());
+            for (metadb_index_hash hash : hashes)
+                list.add_item(hash);
+            index_api()->dispatch_refresh(guid_playcount_index, list);
+        });
+}
+
+// ============================================================
+// Title formatting fields
+// ============================================================
+enum PlaycountField : t_uint32
+{
+    kFieldPlaycount,
+    kFieldLoved,
+    kFieldFirstPlayed,
+    kFieldLastPlayed,
+    kFieldCount
+};
+
+static const char* const kFieldNames[kFieldCount] = {"lastfm_playcount", "lastfm_loved", "lastfm_first_played",
+                                                     "lastfm_last_played"};
+
+// Same layout as foobar2000's own %last_played%
+static void write_time(titleformat_text_out* out, int64_t timestamp)
+{
+    const time_t value = static_cast<time_t>(timestamp);
+    struct tm local = {};
+    localtime_r(&value, &local);
+    char text[32];
+    const size_t length = strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", &local);
+    out->write(titleformat_inputtypes::unknown, text, length);
+}
+
+// Serves the fields from PlaycountCache only: the backend may call this for every row of every
+// playlist view, from several threads at once, so it must not query the index or the network
+class playcount_field_provider : public metadb_display_field_provider_v2
+{
+  public:
+    t_uint32 get_field_count() override { return kFieldCount; }
+    void get_field_name(t_uint32 index, pfc::string_base& out) override { out = kFieldNames[index]; }
+
+    bool process_field(t_uint32 index, metadb_handle* handle, titleformat_text_out* out) override
+    {
+        metadb_info_container::ptr info;
+        if (!handle->get_info_ref(info))
+            return false;
+        return process_info(index, info->info(), out);
+    }
+
+    bool process_field_v2(t_uint32 index, metadb_handle*, metadb_v2::rec_t const& rec,
+                          titleformat_text_out* out) override
+    {
+        if (rec.info.is_empty())
+            return false;
+        return process_info(index, rec.info->info(), out);
+    }
+
+  private:
+    static bool process_info(t_uint32 index, const file_info& info, titleformat_text_out* out)
+    {
+        PlaycountCacheUse cache;
+        if (!cache.get())
+            return false;
+
+        const metadb_index_hash hash = playcount_hash(info);
+        if (index == kFieldLoved)
+        {
+            if (!cache->is_loved(hash))
+                return false;
+            out->write(titleformat_inputtypes::unknown, "1");
+            return true;
+        }
+
+        RemotePlayStats plays;
+        if (!cache->get_plays(hash, info.meta_get("artist", 0), info.meta_get("title", 0), plays))
+            return false;
+        switch (index)
+        {
+        case kFieldPlaycount:
+            out->write_int(titleformat_inputtypes::unknown, plays.playcount);
+            return true;
+        case kFieldFirstPlayed:
+        case kFieldLastPlayed:
+        {
+            const int64_t timestamp = index == kFieldFirstPlayed ? plays.first_played : plays.last_played;
+            if (timestamp == 0)
+                return false;
+            write_time(out, timestamp);
+            return true;
+        }
+        default:
+            return false;
+        }
+    }
+};
+
+static service_factory_single_t<playcount_field_provider> g_playcount_field_provider;
+
+// ============================================================
+// Background sync
+// ============================================================
+static std::thread g_sync_thread;
+static std::atomic<bool> g_sync_running{false};
+static std::atomic<bool> g_sync_abort{false};
+// High-water mark of the last sync; ahead of cfg_sync_high_water until the main thread has stored it
+static std::atomic<int64_t> g_sync_high_water{0};
+// Bumped when the sync state is reset for another account, so a mark posted by an older sync is not stored
+static uint64_t g_sync_generation = 0;
+
+// "LFMWIN01", the high-water mark the window belongs to (i64), then (i64 timestamp, u64 hash) pairs, native byte order
+static const char kWindowMagic[8] = {'L', 'F', 'M', 'W', 'I', 'N', '0', '1'};
+
+static std::string sync_window_path()
+{
+    return platform().profile_dir() + "lastfm_sync_window.bin";
+}
+
+// Loads the scrobbles of the last sync's delivery window; returns the high-water mark they belong to, 0 if none
+static int64_t load_sync_window(std::vector<CountedScrobble>& out)
+{
+    std::string data;
+    {
+        std::ifstream file(sync_window_path(), std::ios::binary);
+        if (!file.is_open())
+            return 0;
+        data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+
+    const size_t header = sizeof(kWindowMagic) + sizeof(int64_t);
+    if (data.size() < header || memcmp(data.data(), kWindowMagic, sizeof(kWindowMagic)) != 0)
+        return 0;
+
+    int64_t high_water = 0;
+    memcpy(&high_water, data.data() + sizeof(kWindowMagic), sizeof(high_water));
+    const size_t count = (data.size() - header) / (sizeof(int64_t) + sizeof(uint64_t));
+    out.resize(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        const char* p = data.data() + header + i * (sizeof(int64_t) + sizeof(uint64_t));
+        memcpy(&out[i].first, p, sizeof(int64_t));
+        memcpy(&out[i].second, p + sizeof(int64_t), sizeof(uint64_t));
+    }
+    return high_water;
+}
+
+static void save_sync_window(int64_t high_water, const std::vector<CountedScrobble>& window)
+{
+    std::string data(kWindowMagic, sizeof(kWindowMagic));
+    data.reserve(sizeof(kWindowMagic) + sizeof(high_water) + window.size() * (sizeof(int64_t) + sizeof(uint64_t)));
+    data.append(reinterpret_cast<const char*>(&high_water), sizeof(high_water));
+    for (const auto& [timestamp, hash] : window)
+    {
+        data.append(reinterpret_cast<const char*>(&timestamp), sizeof(timestamp));
+        data.append(reinterpret_cast<const char*>(&hash), sizeof(hash));
+    }
+    // The next sync falls back to fetching from its mark without a window if this fails
+    if (!replace_file(sync_window_path(), data, true))
+        LASTFM_LOG_INFO("Last.fm: Failed to save the play count sync window");
+}
+
+// Hashes of the library tracks; library_manager is main thread only
+static std::unordered_set<uint64_t> hash_library()
+{
+    std::unordered_set<uint64_t> library;
+    metadb_handle_list items;
+    library_manager::get()->get_all_items(items);
+    library.reserve(items.get_count());
+    for (t_size i = 0; i < items.get_count(); ++i)
+    {
+        metadb_info_container::ptr info;
+        if (items[i]->get_info_ref(info))
+            library.insert(playcount_hash(info->info()));
+    }
+    return library;
+}
+
+// Forgets the high-water mark, the library's records and the loved tracks of the previous account, so the next
+// sync of user fetches the full history and replaces them. Main thread only.
+static void reset_sync_state(const std::string& user)
+{
+    stop_playcount_sync();
+    ++g_sync_generation;
+    g_sync_high_water.store(0);
+    cfg_sync_high_water = 0;
+    cfg_sync_account = user.c_str();
+    std::error_code ec;
+    std::filesystem::remove(sync_window_path(), ec);
+
+    playcount_clear(hash_library());
+    PlaycountCacheUse cache;
+    if (cache.get())
+    {
+        cache->set_user(user);
+        cache->forget_all();
+    }
+    index_api()->dispatch_global_refresh();
+    LASTFM_LOG_INFO("Last.fm: Play counts belong to another account now, they are synced again from scratch");
+}
+
+// Checks that the sync state belongs to user, resetting it if not; true if it was reset. Main thread only.
+static bool check_sync_account(const std::string& user)
+{
+    const std::string account = cfg_sync_account.get().c_str();
+    if (account == user)
+        return false;
+    if (account.empty())
+    {
+        // Nothing synced yet, or synced before the account was stored with the mark, which was for this user
+        cfg_sync_account = user.c_str();
+        return false;
+    }
+    reset_sync_state(user);
+    return true;
+}
+
+// options.from is the high-water mark of the previous sync (0 for a full sync)
+static void run_playcount_sync(RecentTracksSyncOptions options, const std::unordered_set<uint64_t>& library,
+                               uint64_t generation)
+{
+    int64_t mark = options.from;
+    if (mark > 0)
+    {
+        // Fetch the delivery window again, skipping what the previous sync counted. A window saved for an older
+        // mark does not tell which of the newer scrobbles were counted, so then fetch from the mark only.
+        std::vector<CountedScrobble> counted;
+        const int64_t window_mark = load_sync_window(counted);
+        if (window_mark >= mark)
+        {
+            mark = window_mark;
+            options.from = std::max<int64_t>(0, mark - kDeliveryWindowSeconds);
+            options.counted = std::move(counted);
+        }
+        else
+        {
+            LASTFM_LOG_DEBUG("Last.fm: No play count sync window for the current mark, late scrobbles are missed");
+        }
+        // A track.getInfo answer already counts the scrobbles up to when it was asked
+        options.counted_to = [](uint64_t hash)
+        {
+            RemotePlayStats stats;
+            return playcount_get(hash, stats) ? stats.counted_to : 0;
+        };
+    }
+    LASTFM_LOG_INFO("Last.fm: Play count sync started for %s (%s)", options.user,
+                    mark > 0 ? "new scrobbles" : "full history");
+
+    int reported_decile = 0;
+    const RecentTracksSyncResult result =
+        fetch_recent_tracks(*g_lastfm_api, options, g_sync_abort,
+                            [&reported_decile](int done, int total)
+                            {
+                                const int decile = total > 0 ? done * 10 / total : 0;
+                                if (decile > reported_decile)
+                                {
+                                    reported_decile = decile;
+                                    LASTFM_LOG_INFO("Last.fm: Play count sync %d%% (%d of %d pages)", decile * 10,
+                                                    done, total);
+                                }
+                            });
+    if (!result.complete)
+    {
+        // A partial fetch would count the missing pages as zero and move the high-water mark past them
+        LASTFM_LOG_INFO("Last.fm: Play count sync %s after %d of %d pages, nothing was written",
+                        g_sync_abort.load() ? "aborted" : "failed", result.pages, result.total_pages);
+        return;
+    }
+
+    // Write only tracks that are in the library. A full sync replaces the record of every library track, with no
+    // plays if the history has none, so nothing of another account or an older count survives it. An incremental
+    // sync only adds to existing records: a track added to the library since has no count to add to, and stays
+    // without a record until the display fields ask track.getInfo for its total.
+    std::vector<std::pair<metadb_index_hash, RemotePlayStats>> records;
+    if (mark == 0)
+    {
+        records.reserve(library.size());
+        for (uint64_t hash : library)
+        {
+            auto found = result.plays.find(hash);
+            records.emplace_back(hash, found != result.plays.end() ? found->second : RemotePlayStats());
+        }
+    }
+    else
+    {
+        for (const auto& [hash, plays] : result.plays)
+        {
+            if (library.count(hash) == 0)
+                continue;
+
+            RemotePlayStats stats;
+            if (!playcount_get(hash, stats))
+                continue;
+            stats.merge(plays);
+            records.emplace_back(hash, stats);
+        }
+    }
+    playcount_write(records);
+    const int64_t high_water = std::max(result.high_water, mark);
+    save_sync_window(high_water, result.window);
+    // cfg_vars belong to the main thread
+    g_sync_high_water.store(high_water);
+    fb2k::inMainThread(
+        [high_water, generation]()
+        {
+            if (generation == g_sync_generation)
+                cfg_sync_high_water = high_water;
+        });
+
+    LASTFM_LOG_INFO("Last.fm: Play count sync finished - %llu scrobbles in %d pages, %zu library tracks updated in "
+                    "%.1fs",
+                    (unsigned long long)result.scrobbles, result.pages, records.size(), result.seconds);
+
+    // The loved list is small enough to replace as a whole on every sync
+    std::vector<metadb_index_hash> changed;
+    std::unordered_set<uint64_t> loved;
+    PlaycountCacheUse cache;
+    if (fetch_loved_tracks(*g_lastfm_api, options.user, g_sync_abort, loved))
+    {
+        LASTFM_LOG_DEBUG("Last.fm: %zu loved tracks", loved.size());
+        if (cache.get())
+            changed = cache->replace_loved(std::move(loved));
+    }
+    else
+    {
+        LASTFM_LOG_INFO("Last.fm: Failed to fetch loved tracks, keeping the previous list");
+    }
+
+    if (cache.get())
+    {
+        const auto forgotten = cache->store(records);
+        changed.insert(changed.end(), forgotten.begin(), forgotten.end());
+    }
+    for (const auto& record : records)
+        changed.push_back(record.first);
+    if (!changed.empty())
+        playcount_refresh(std::move(changed));
+}
+
+bool start_playcount_sync()
+{
+    if (g_sync_running.load())
+    {
+        LASTFM_LOG_INFO("Last.fm: Play count sync is already running");
+        return false;
+    }
+
+    const pfc::string8 user = cfg_username.get();
+    if (!g_lastfm_api || !g_lastfm_api->has_saved_session() || user.is_empty())
+    {
+        LASTFM_LOG_INFO("Last.fm: Play count sync needs an authenticated user - please configure in preferences");
+        return false;
+    }
+    if (g_sync_thread.joinable())
+        g_sync_thread.join();
+    check_sync_account(user.c_str());
+
+    RecentTracksSyncOptions options;
+    options.user = user.c_str();
+    options.from = std::max<int64_t>(cfg_sync_high_water.get(), g_sync_high_water.load());
+
+    g_sync_abort.store(false);
+    g_sync_running.store(true);
+    g_sync_thread = std::thread(
+        [options, library = hash_library(), generation = g_sync_generation]()
+        {
+            try
+            {
+                run_playcount_sync(options, library, generation);
+            }
+            catch (const std::exception& e)
+            {
+                LASTFM_LOG_INFO("Last.fm: Play count sync failed: %s", e.what());
+            }
+            g_sync_running.store(false);
+        });
+    return true;
+}
+
+void stop_playcount_sync()
+{
+    g_sync_abort.store(true);
+    if (g_sync_thread.joinable())
+        g_sync_thread.join();
+
+    // A sync that finished while the player quit may not have had its mark stored
+    if (g_sync_high_water.load() > cfg_sync_high_water.get())
+        cfg_sync_high_water = g_sync_high_water.load();
+}
+
+void playcount_set_account(const std::string& user)
+{
+    platform().run_on_main_thread(
+        [user]()
+        {
+            if (!user.empty() && check_sync_account(user))
+                start_playcount_sync();
+        });
+}
+
+} // namespace foo_lastfm
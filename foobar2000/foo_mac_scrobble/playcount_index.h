@@ -0,0 +1,41 @@
+//
+//  playcount_index.h
+//  foo_mac_scrobble
+//
+//  Created by Oleksandr Velychko on 18/10/2026.
+//
+
+#pragma once
+
+#include "playcount_sync.h"
+
+#include <foobar2000/SDK/foobar2000.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace foo_lastfm
+{
+
+// Metadb index holding Last.fm play counts, pinned to the normalized %artist% / %title% of each track
+extern const GUID guid_playcount_index;
+
+// Returns the index hash of a track (track_match_hash() of its artist and title)
+metadb_index_hash playcount_hash(const file_info& info);
+// Reads the stored play counts for a hash; returns false if there is no record
+bool playcount_get(metadb_index_hash hash, RemotePlayStats& out);
+// Writes records in batched transactions
+void playcount_write(const std::vector<std::pair<metadb_index_hash, RemotePlayStats>>& records);
+// Refreshes the tracks showing these hashes (from any thread; dispatched on the main thread)
+void playcount_refresh(std::vector<metadb_index_hash> hashes);
+
+// Starts a background play count sync from Last.fm (incremental after the first one).
+// Main thread only; returns false if a sync is already running or there is no session.
+bool start_playcount_sync();
+// Aborts a running sync and waits for it to finish
+void stop_playcount_sync();
+// user signed in (from any thread). If the play counts belong to another account, they are cleared and a full
+// sync of user's history starts.
+void playcount_set_account(const std::string& user);
+
+} // namespace foo_lastfm
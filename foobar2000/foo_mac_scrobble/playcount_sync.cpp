@@ -0,0 +1,214 @@
+//
+//  playcount_sync.cpp
+//  foo_mac_scrobble
+//
+//  Created by Oleksandr Velychko on 18/10/2026.
+//
+
+#include "playcount_sync.h"
+
+#include "async_logger.h"
+#include "clock.h"
+
+#include <algorithm>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+namespace foo_lastfm
+{
+
+// ============================================================
+// Matching key
+// ============================================================
+static void hash_normalized(uint64_t& hash, const std::string& value)
+{
+    // FNV-1a over the lowercased value with whitespace runs folded to one space and trimmed
+    bool pending_space = false;
+    bool any = false;
+    for (unsigned char c : value)
+    {
+        if (c == ' ' || c == '\t' || c == '\n' || c == '\r')
+        {
+            pending_space = any;
+            continue;
+        }
+        if (pending_space)
+        {
+            hash = (hash ^ ' ') * 1099511628211ULL;
+            pending_space = false;
+        }
+        if (c >= 'A' && c <= 'Z')
+            c = static_cast<unsigned char>(c - 'A' + 'a');
+        hash = (hash ^ c) * 1099511628211ULL;
+        any = true;
+    }
+}
+
+uint64_t track_match_hash(const std::string& artist, const std::string& title)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    hash_normalized(hash, artist);
+    hash = (hash ^ 0x1f) * 1099511628211ULL;
+    hash_normalized(hash, title);
+    return hash;
+}
+
+// ============================================================
+// Request pacing shared by all workers
+// ============================================================
+class RequestPacer
+{
+  public:
+    explicit RequestPacer(double per_second) : m_interval_ms(per_second > 0 ? 1000.0 / per_second : 0) {}
+
+    // Blocks until the caller's request slot
+    void wait()
+    {
+        double slot = 0;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_next_ms = std::max(m_next_ms, static_cast<double>(current_clock().now_ms()));
+            slot = m_next_ms;
+            m_next_ms += m_interval_ms;
+        }
+        const int64_t delay = static_cast<int64_t>(slot) - current_clock().now_ms();
+        if (delay > 0)
+            current_clock().sleep_for(std::chrono::milliseconds(delay));
+    }
+
+  private:
+    std::mutex m_mutex;
+    double m_interval_ms;
+    double m_next_ms = 0;
+};
+
+RecentTracksSyncResult fetch_recent_tracks(LastfmApi& api, const RecentTracksSyncOptions& options,
+                                           const std::atomic<bool>& abort, std::function<void(int, int)> progress)
+{
+    RecentTracksSyncResult result;
+    result.high_water = options.from;
+    const auto start = std::chrono::steady_clock::now();
+    const time_t to = options.to > 0 ? static_cast<time_t>(options.to) : current_clock().now_seconds();
+
+    RequestPacer pacer(options.requests_per_second);
+    auto fetch = [&](int page, LastfmApi::RecentTracksPage& out)
+    {
+        // send_api_request() already retries 429/5xx; retry a little more for dropped connections
+        for (int attempt = 0; attempt < 3 && !abort.load(); ++attempt)
+        {
+            pacer.wait();
+            if (api.get_recent_tracks(options.user, page, options.page_size, static_cast<time_t>(options.from), to,
+                                      out))
+                return true;
+        }
+        return false;
+    };
+
+    std::mutex merge_mutex;
+    std::multiset<CountedScrobble> counted(options.counted.begin(), options.counted.end());
+    std::vector<CountedScrobble> seen;
+    std::unordered_map<uint64_t, int64_t> counted_to;
+    auto merge = [&](const LastfmApi::RecentTracksPage& page)
+    {
+        std::lock_guard<std::mutex> lock(merge_mutex);
+        for (const auto& row : page.tracks)
+        {
+            // The scrobble at the previous high-water mark was counted by the previous sync
+            if (row.now_playing || row.timestamp <= options.from)
+                continue;
+            const CountedScrobble scrobble(row.timestamp, track_match_hash(row.artist, row.track));
+            seen.push_back(scrobble);
+            result.high_water = std::max<int64_t>(result.high_water, row.timestamp);
+            auto it = counted.find(scrobble);
+            if (it != counted.end())
+            {
+                counted.erase(it);
+                continue;
+            }
+            if (options.counted_to)
+            {
+                auto [known, inserted] = counted_to.try_emplace(scrobble.second, 0);
+                if (inserted)
+                    known->second = options.counted_to(scrobble.second);
+                if (row.timestamp <= known->second)
+                    continue;
+            }
+            RemotePlayStats add;
+            add.playcount = 1;
+            add.first_played = add.last_played = row.timestamp;
+            result.plays[scrobble.second].merge(add);
+            ++result.scrobbles;
+        }
+        ++result.pages;
+        if (progress)
+            progress(result.pages, result.total_pages);
+    };
+
+    // Page 1 tells how many pages the range has
+    LastfmApi::RecentTracksPage first;
+    if (!fetch(1, first))
+    {
+        LASTFM_LOG_INFO("Last.fm: Play count sync failed to fetch the first page");
+        return result;
+    }
+    result.total_pages = std::max(1, first.total_pages);
+    merge(first);
+    LASTFM_LOG_DEBUG("Last.fm: Play count sync: %llu scrobbles in %d pages", (unsigned long long)first.total,
+                     result.total_pages);
+
+    std::atomic<int> next_page{2};
+    std::atomic<bool> failed{false};
+    std::vector<std::thread> workers;
+    const int worker_count = std::clamp(options.concurrency, 1, std::max(1, result.total_pages - 1));
+    for (int w = 0; w < worker_count && result.total_pages > 1; ++w)
+    {
+        workers.emplace_back(
+            [&]()
+            {
+                while (!abort.load() && !failed.load())
+                {
+                    const int page = next_page.fetch_add(1);
+                    if (page > result.total_pages)
+                        break;
+                    LastfmApi::RecentTracksPage out;
+                    if (!fetch(page, out))
+                    {
+                        LASTFM_LOG_INFO("Last.fm: Play count sync failed to fetch page %d", page);
+                        failed.store(true);
+                        break;
+                    }
+                    merge(out);
+                }
+            });
+    }
+    for (auto& worker : workers)
+        worker.join();
+
+    result.complete = !failed.load() && !abort.load() && result.pages == result.total_pages;
+    for (const auto& scrobble : seen)
+        if (scrobble.first > result.high_water - kDeliveryWindowSeconds)
+            result.window.push_back(scrobble);
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+bool fetch_loved_tracks(LastfmApi& api, const std::string& user, const std::atomic<bool>& abort,
+                        std::unordered_set<uint64_t>& out)
+{
+    out.clear();
+    int total_pages = 1;
+    for (int page = 1; page <= total_pages; ++page)
+    {
+        LastfmApi::RecentTracksPage loved;
+        if (abort.load() || !api.get_loved_tracks(user, page, 1000, loved))
+            return false;
+        total_pages = std::max(1, loved.total_pages);
+        for (const auto& row : loved.tracks)
+            out.insert(track_match_hash(row.artist, row.track));
+    }
+    return true;
+}
+
+} // namespace foo_lastfm
@@ -0,0 +1,95 @@
+//
+//  playcount_sync.h
+//  foo_mac_scrobble
+//
+//  Created by Oleksandr Velychko on 18/10/2026.
+//
+
+#pragma once
+
+#include "lastfm_api.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace foo_lastfm
+{
+
+// Scrobbles can reach Last.fm days after their timestamp (offline players, queued submissions), so an incremental
+// sync fetches again from this long before the high-water mark and skips the scrobbles it counted already
+static constexpr int64_t kDeliveryWindowSeconds = 14 * 24 * 3600;
+
+// One scrobble as (timestamp, track_match_hash()), remembered to tell a late delivery from a counted play
+using CountedScrobble = std::pair<int64_t, uint64_t>;
+
+// Plays of one artist/title pair aggregated from the user's Last.fm history
+struct RemotePlayStats
+{
+    uint32_t playcount = 0;   // Number of scrobbles
+    int64_t first_played = 0; // Oldest scrobble timestamp (0 when unknown)
+    int64_t last_played = 0;  // Newest scrobble timestamp (0 when unknown)
+    int64_t counted_to = 0;   // Scrobbles up to this time are in playcount though not synced (a track.getInfo answer)
+
+    // Adds the plays of another (non-overlapping) range
+    void merge(const RemotePlayStats& other)
+    {
+        playcount += other.playcount;
+        if (other.first_played != 0 && (first_played == 0 || other.first_played < first_played))
+            first_played = other.first_played;
+        last_played = std::max(last_played, other.last_played);
+        counted_to = std::max(counted_to, other.counted_to);
+    }
+};
+
+// Artist/title key shared by Last.fm rows and library tracks: ASCII case and whitespace runs are ignored
+uint64_t track_match_hash(const std::string& artist, const std::string& title);
+
+// What to fetch and how fast
+struct RecentTracksSyncOptions
+{
+    std::string user;                 // Last.fm user name
+    int64_t from = 0;                 // Only scrobbles newer than this (the previous high-water mark; 0 = all)
+    int64_t to = 0;                   // Newest scrobble to include; fixed up front so pages do not shift (0 = now)
+    int page_size = 200;              // Rows per page (Last.fm maximum)
+    int concurrency = 4;              // Pages in flight at once
+    double requests_per_second = 4.0; // Request pacing shared by all workers (Last.fm allows about 5/s)
+    std::vector<CountedScrobble> counted; // Scrobbles newer than from that were counted already (skipped)
+    // Optional: the time up to which a track's scrobbles were counted already (skipped), called once per track
+    std::function<int64_t(uint64_t hash)> counted_to;
+};
+
+// Outcome of a fetch
+struct RecentTracksSyncResult
+{
+    bool complete = false;  // Every page was fetched; only then may the high-water mark move
+    int pages = 0;          // Pages fetched
+    int total_pages = 0;    // Pages in the range
+    uint64_t scrobbles = 0; // Rows aggregated (the "now playing" row is skipped)
+    int64_t high_water = 0; // Newest scrobble timestamp seen (or options.from if none)
+    double seconds = 0;     // Wall time of the fetch
+    // Aggregated plays keyed by track_match_hash()
+    std::unordered_map<uint64_t, RemotePlayStats> plays;
+    // Scrobbles fetched within kDeliveryWindowSeconds of high_water, counted or skipped; the next sync's counted
+    std::vector<CountedScrobble> window;
+};
+
+// Fetches user.getRecentTracks pages concurrently within the pacing limit and aggregates them by
+// artist/title. Stops early when abort becomes true or a page keeps failing. progress is called
+// with (pages fetched, total pages) from the worker threads, one call at a time.
+RecentTracksSyncResult fetch_recent_tracks(LastfmApi& api, const RecentTracksSyncOptions& options,
+                                           const std::atomic<bool>& abort,
+                                           std::function<void(int, int)> progress = nullptr);
+
+// Fetches the user's loved tracks (1000 per page) as track_match_hash() keys.
+// Returns false if a page failed or abort became true; out is then incomplete.
+bool fetch_loved_tracks(LastfmApi& api, const std::string& user, const std::atomic<bool>& abort,
+                        std::unordered_set<uint64_t>& out);
+
+} // namespace foo_lastfm
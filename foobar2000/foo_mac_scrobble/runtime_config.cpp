@@ -0,0 +1,41 @@
+//
+//  runtime_config.cpp
+//  foo_mac_scrobble
+//
+//  Created by Oleksandr Velychko on 18/10/2026.
+//
+
+#include "runtime_config.h"
+
+namespace foo_lastfm
+{
+
+RuntimeConfigStore g_runtime_config;
+
+RuntimeConfigStore::RuntimeConfigStore()
+{
+    m_snapshots.push_back(std::make_unique<const RuntimeConfig>());
+    m_current.store(m_snapshots.back().get(), std::memory_order_release);
+}
+
+void RuntimeConfigStore::publish(const RuntimeConfig& config)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (config == *m_current.load(std::memory_order_relaxed))
+        return;
+
+    m_snapshots.push_back(std::make_unique<const RuntimeConfig>(config));
+    const RuntimeConfig& current = *m_snapshots.back();
+    m_current.store(&current, std::memory_order_release);
+    for (const Listener& listener : m_listeners)
+        listener(current);
+}
+
+void RuntimeConfigStore::subscribe(Listener listener)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    listener(*m_current.load(std::memory_order_relaxed));
+    m_listeners.push_back(std::move(listener));
+}
+
+} // namespace foo_lastfm
@@ -0,0 +1,57 @@
+//
+//  runtime_config.h
+//  foo_mac_scrobble
+//
+//  Created by Oleksandr Velychko on 18/10/2026.
+//
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace foo_lastfm
+{
+
+// The settings hot paths read: the playback callback on every tick, worker threads and every log statement
+struct RuntimeConfig
+{
+    bool enabled = true;        // Scrobbling is on
+    int scrobble_percent = 50;  // Share of a track that has to be played before it is scrobbled
+    bool debug_enabled = false; // Debug level logging
+
+    bool operator==(const RuntimeConfig& other) const = default;
+};
+
+// Publishes immutable RuntimeConfig snapshots. Readers on any thread get the current one with a single atomic
+// load and no lock; the preferences panel publishes a new one when the user changes a setting, and subscribers are
+// told on the publishing thread. A published snapshot is never freed while the store lives, so a reference from
+// get() stays valid (settings change at the pace of clicks, so the kept snapshots stay small).
+class RuntimeConfigStore
+{
+  public:
+    using Listener = std::function<void(const RuntimeConfig& config)>;
+
+    RuntimeConfigStore();
+
+    // The current snapshot
+    const RuntimeConfig& get() const { return *m_current.load(std::memory_order_acquire); }
+    // Makes config the current snapshot and calls the subscribers with it; does nothing if nothing changed
+    void publish(const RuntimeConfig& config);
+    // Calls listener with the current snapshot now and with every snapshot published later. Listeners run with
+    // the store locked and must not publish.
+    void subscribe(Listener listener);
+
+  private:
+    std::atomic<const RuntimeConfig*> m_current;
+    std::mutex m_mutex;                                            // Serialises publish() and subscribe()
+    std::vector<std::unique_ptr<const RuntimeConfig>> m_snapshots; // Every snapshot published so far
+    std::vector<Listener> m_listeners;
+};
+
+extern RuntimeConfigStore g_runtime_config;
+
+} // namespace foo_lastfm
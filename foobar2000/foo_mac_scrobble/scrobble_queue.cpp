@@ -7,14 +7,20 @@
 
 #include "scrobble_queue.h"
 
-#include "config.h"
+#include "async_logger.h"
+#include "clock.h"
+#include "history_store.h"
+#include "metrics.h"
+#include "platform.h"
+#include "playcount_sync.h"
 #include "session_manager.h"
-#include "stdafx.h"
 
-#include <SDK/filesystem.h>
-#include <curl/curl.h>
+#include <algorithm>
+#include <filesystem>
 #include <fstream>
+#include <map>
 #include <nlohmann/json.hpp>
+#include <thread>
 
 using json = nlohmann::json;
 
@@ -23,178 +29,1542 @@ namespace foo_lastfm
 
 ScrobbleQueue* g_scrobble_queue = nullptr;
 
+// QueueUses in flight; none are handed out once the queue is going away
+static std::mutex g_use_mutex;
+static std::condition_variable g_use_cv;
+static int g_uses = 0;
+static bool g_uses_closed = false;
+
+QueueUse::QueueUse()
+{
+    std::lock_guard<std::mutex> lock(g_use_mutex);
+    if (g_uses_closed || !g_scrobble_queue)
+        return;
+    m_queue = g_scrobble_queue;
+    ++g_uses;
+}
+
+QueueUse::~QueueUse()
+{
+    if (!m_queue)
+        return;
+    std::lock_guard<std::mutex> lock(g_use_mutex);
+    if (--g_uses == 0)
+        g_use_cv.notify_all();
+}
+
+void wait_queue_uses()
+{
+    std::unique_lock<std::mutex> lock(g_use_mutex);
+    g_uses_closed = true;
+    g_use_cv.wait(lock, []() { return g_uses == 0; });
+}
+
+// ============================================================
+// Default transport: Last.fm through g_lastfm_api
+// ============================================================
+class LastfmTransport : public ScrobbleTransport
+{
+  public:
+    // HEAD request to the API host over the pooled connection, skipped while a recent answer proves it reachable
+    bool is_online() override { return g_lastfm_api && g_lastfm_api->is_reachable(); }
+
+    bool has_session() override { return g_lastfm_api && g_lastfm_api->has_saved_session(); }
+
+    bool scrobble(const LastfmApi::TrackInfo& track) override
+    {
+        return g_lastfm_api && g_lastfm_api->scrobble_track(track);
+    }
+
+    // One track.scrobble request per 50 tracks instead of one per track
+    void scrobble_batch(const std::vector<LastfmApi::TrackInfo>& tracks, std::vector<bool>& results) override
+    {
+        results.assign(tracks.size(), false);
+        if (!g_lastfm_api)
+            return;
+        for (size_t first = 0; first < tracks.size(); first += LastfmApi::kMaxScrobbleBatch)
+        {
+            const size_t last = std::min(tracks.size(), first + LastfmApi::kMaxScrobbleBatch);
+            const std::vector<LastfmApi::TrackInfo> chunk(tracks.begin() + first, tracks.begin() + last);
+            const bool accepted = chunk.size() == 1 ? g_lastfm_api->scrobble_track(chunk[0])
+                                                    : g_lastfm_api->scrobble_tracks(chunk);
+            std::fill(results.begin() + first, results.begin() + last, accepted);
+        }
+    }
+
+    int take_pushback() override { return LastfmApi::take_pushback(); }
+
+    bool update_now_playing(const LastfmApi::TrackInfo& track) override
+    {
+        return g_lastfm_api && g_lastfm_api->update_now_playing(track);
+    }
+
+    bool love(const LastfmApi::TrackInfo& track, bool loved) override
+    {
+        return g_lastfm_api && g_lastfm_api->love_track(track, loved);
+    }
+};
+
+// A now-playing update is sent at most this long after it was queued, however short its track
+static constexpr int kMinNowPlayingSeconds = 30;
+
+static LastfmTransport g_lastfm_transport;
+
+uint64_t scrobble_key(const std::string& artist, const std::string& track, time_t timestamp)
+{
+    return track_match_hash(artist, track) ^ (static_cast<uint64_t>(timestamp) * 0x9e3779b97f4a7c15ull);
+}
+
+// One log entry as stored in the queue file and the segment files
+static json track_to_json(const QueuedTrack& track)
+{
+    json item;
+    item["artist"] = track.artist;
+    item["track"] = track.track;
+    item["album"] = track.album;
+    item["album_artist"] = track.album_artist;
+    item["duration"] = track.duration;
+    item["track_number"] = track.track_number;
+    item["timestamp"] = track.timestamp;
+    item["queued_at"] = track.queued_at_ms;
+    item["seq"] = track.seq;
+    return item;
+}
+
+static QueuedTrack track_from_json(const json& item)
+{
+    QueuedTrack track;
+    track.artist = item.value("artist", "");
+    track.track = item.value("track", "");
+    track.album = item.value("album", "");
+    track.album_artist = item.value("album_artist", "");
+    track.duration = item.value("duration", 0);
+    track.track_number = item.value("track_number", 0);
+    track.timestamp = item.value("timestamp", 0);
+    track.queued_at_ms = item.value("queued_at", int64_t(0));
+    track.seq = item.value("seq", uint64_t(0));
+    return track;
+}
+
 ScrobbleQueue::ScrobbleQueue()
 {
-    // Determine path for queue storage
-    pfc::string8 profile_path = core_api::get_profile_path();
-    pfc::string8 file_path;
-    if (filesystem::g_get_native_path(profile_path, file_path))
+    // Determine path for queue storage
+    m_queue_file_path = platform().profile_dir();
+    m_queue_file_path += "lastfm_scrobble_queue.json";
+    m_segment_dir = platform().profile_dir();
+    m_segment_dir += "lastfm_scrobble_queue.segments/";
+
+    // Load existing queue from disk
+    load_queue();
+    remove_stray_segments();
+    add_target(kLastfmTarget, &g_lastfm_transport);
+
+    LASTFM_LOG_DEBUG("Last.fm: Queue initialized, %zu tracks loaded", get_queue_size());
+}
+
+ScrobbleQueue::~ScrobbleQueue()
+{
+    stop_workers();
+
+    // Write changes still waiting for their group commit before the queue goes away
+    flush();
+}
+
+void ScrobbleQueue::add_track(const LastfmApi::TrackInfo& track)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    QueuedTrack queued = from_track_info(track);
+
+    // The same play queued twice is one scrobble; duplicates arrive close together, so the head is enough
+    auto same_play = [&queued](const QueuedTrack& pending)
+    {
+        return pending.timestamp == queued.timestamp && pending.track == queued.track &&
+               pending.artist == queued.artist;
+    };
+    if (std::any_of(m_head.rbegin(), m_head.rend(), same_play))
+    {
+        LASTFM_LOG_DEBUG("Last.fm: Track already queued: %s - %s", track.artist, track.track);
+        return;
+    }
+
+    queued.queued_at_ms = current_clock().now_ms();
+    queued.seq = m_next_seq++;
+    queued.live = true;
+    m_head.push_back(queued);
+    log_change(Change::added, queued.seq);
+    publish_changes();
+    if (m_head.size() >= kSegmentTracks)
+        seal_head();
+    const size_t queued_count = count_undelivered();
+    g_metrics.set_queue_depth(queued_count);
+    save_queue();
+
+    LASTFM_LOG_DEBUG("Last.fm: Track added to queue (%zu total): %s - %s", queued_count, track.artist, track.track);
+}
+
+void ScrobbleQueue::add_op(QueueOp op, const LastfmApi::TrackInfo& track)
+{
+    if (op == QueueOp::scrobble)
+    {
+        add_track(track);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    PendingOp pending;
+    pending.id = m_next_op_id++;
+    pending.op = op;
+    pending.track = from_track_info(track);
+    pending.track.queued_at_ms = current_clock().now_ms();
+    if (op == QueueOp::now_playing)
+    {
+        // Only the newest now-playing update is worth sending
+        m_now_playing = std::move(pending);
+        return;
+    }
+
+    // The newest op for the track decides: the same op again is a duplicate, the opposite one cancels it unless
+    // it is on its way already
+    pending.hash = track_match_hash(track.artist, track.track);
+    auto last = std::find_if(m_ops.rbegin(), m_ops.rend(),
+                             [&pending](const PendingOp& queued) { return queued.hash == pending.hash; });
+    if (last != m_ops.rend() && last->op == op)
+        return;
+    if (last != m_ops.rend() && !last->sending)
+    {
+        LASTFM_LOG_DEBUG("Last.fm: Love and unlove cancel out: %s - %s", track.artist, track.track);
+        m_ops.erase(std::next(last).base());
+    }
+    else
+    {
+        m_ops.push_back(std::move(pending));
+    }
+    save_queue();
+}
+
+// ============================================================
+// Targets
+// ============================================================
+std::shared_ptr<ScrobbleQueue::Target> ScrobbleQueue::find_target(const std::string& name) const
+{
+    for (const auto& target : m_targets)
+    {
+        if (target->name == name)
+            return target;
+    }
+    return nullptr;
+}
+
+bool ScrobbleQueue::is_pending(const Target& target, uint64_t seq)
+{
+    return seq > target.cursor && target.acked.count(seq) == 0;
+}
+
+std::vector<std::pair<uint64_t, uint64_t>> ScrobbleQueue::stored_ranges() const
+{
+    std::vector<std::pair<uint64_t, uint64_t>> ranges;
+    ranges.reserve(m_segments.size() + 1);
+    for (const auto& segment : m_segments)
+        ranges.emplace_back(segment.first_seq, segment.last_seq);
+    if (!m_head.empty())
+        ranges.emplace_back(m_head.front().seq, m_head.back().seq);
+    return ranges;
+}
+
+size_t ScrobbleQueue::count_pending(const Target& target) const
+{
+    // Everything stored after the cursor, less what was delivered out of order; no segment is read
+    size_t count = 0;
+    for (const auto& [first, last] : stored_ranges())
+    {
+        if (last > target.cursor)
+            count += last - std::max(first - 1, target.cursor);
+    }
+    return count - std::min(count, target.acked.size());
+}
+
+const ScrobbleQueue::Target* ScrobbleQueue::slowest_target() const
+{
+    const Target* behind = nullptr;
+    for (const auto& target : m_targets)
+    {
+        if (!behind || target->cursor < behind->cursor)
+            behind = target.get();
+    }
+    return behind;
+}
+
+bool ScrobbleQueue::is_undelivered(uint64_t seq) const
+{
+    return std::any_of(m_targets.begin(), m_targets.end(),
+                       [seq](const std::shared_ptr<Target>& target) { return is_pending(*target, seq); });
+}
+
+size_t ScrobbleQueue::count_undelivered() const
+{
+    const Target* behind = slowest_target();
+    if (!behind)
+        return 0;
+
+    // Everything after the cursor furthest behind, less the entries that target and every other one delivered
+    size_t count = count_pending(*behind) + behind->acked.size();
+    for (const uint64_t seq : behind->acked)
+    {
+        if (!is_undelivered(seq))
+            --count;
+    }
+    return count;
+}
+
+void ScrobbleQueue::advance_cursor(Target& target)
+{
+    // Entries missing from the log between the cursor and the first pending one were delivered by everyone
+    uint64_t cursor = m_next_seq - 1;
+    uint64_t walked = target.cursor;
+    for (const auto& [first, last] : stored_ranges())
+    {
+        if (last <= walked)
+            continue;
+        walked = std::max(walked, first - 1);
+        while (walked < last && target.acked.count(walked + 1) != 0)
+            ++walked;
+        if (walked < last)
+        {
+            cursor = walked;
+            break;
+        }
+    }
+    target.cursor = std::max(target.cursor, cursor);
+    target.acked.erase(target.acked.begin(), target.acked.upper_bound(target.cursor));
+    for (auto it = target.attempts.begin(); it != target.attempts.end();)
+        it = it->first <= target.cursor ? target.attempts.erase(it) : std::next(it);
+}
+
+void ScrobbleQueue::trim()
+{
+    uint64_t delivered = m_next_seq - 1;
+    for (const auto& target : m_targets)
+        delivered = std::min(delivered, target->cursor);
+
+    // A delivered segment goes as a whole, however many entries it holds
+    while (!m_segments.empty() && m_segments.front().last_seq <= delivered)
+    {
+        m_retired_segments.push_back(m_segments.front().first_seq);
+        m_segments.pop_front();
+    }
+    auto kept = std::find_if(m_head.begin(), m_head.end(),
+                             [delivered](const QueuedTrack& queued) { return queued.seq > delivered; });
+    m_head.erase(m_head.begin(), kept);
+}
+
+void ScrobbleQueue::add_target(const std::string& name, ScrobbleTransport* transport)
+{
+    std::shared_ptr<Target> target;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (find_target(name))
+            return;
+
+        target = std::make_shared<Target>();
+        target->name = name;
+        target->transport = transport;
+        auto saved = m_saved_targets.find(name);
+        if (saved != m_saved_targets.end())
+        {
+            target->cursor = saved->second.cursor;
+            target->acked = std::move(saved->second.acked);
+            target->attempts = std::move(saved->second.attempts);
+            m_saved_targets.erase(saved);
+            advance_cursor(*target);
+            // Entries the other targets delivered can be pending for it again
+            reset_changes();
+        }
+        else
+        {
+            // A new target starts with the tracks queued from now on
+            target->cursor = m_next_seq - 1;
+        }
+        m_targets.push_back(target);
+    }
+    LASTFM_LOG_DEBUG("Last.fm: Scrobbling target %s added (%zu tracks pending)", name, get_pending(name));
+
+    std::lock_guard<std::mutex> lock(m_worker_mutex);
+    if (m_workers_started)
+        start_worker(target);
+}
+
+void ScrobbleQueue::remove_target(const std::string& name)
+{
+    std::shared_ptr<Target> target;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        target = find_target(name);
+        if (!target || name == kLastfmTarget)
+            return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_worker_mutex);
+        target->stop = true;
+    }
+    m_worker_cv.notify_all();
+    if (target->worker.joinable())
+        target->worker.join();
+
+    // Wait for a drain in progress (process_queue() from another thread) before dropping the target
+    std::lock_guard<std::mutex> process_lock(target->process_mutex);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_targets.erase(std::find(m_targets.begin(), m_targets.end(), target));
+    reset_changes();
+    trim();
+    g_metrics.set_queue_depth(count_undelivered());
+    save_queue();
+    LASTFM_LOG_DEBUG("Last.fm: Scrobbling target %s removed", name);
+}
+
+void ScrobbleQueue::set_transport(ScrobbleTransport* transport)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_targets.front()->transport = transport ? transport : &g_lastfm_transport;
+}
+
+// ============================================================
+// Segments
+// ============================================================
+std::string ScrobbleQueue::segment_path(uint64_t first_seq) const
+{
+    return m_segment_dir + std::to_string(first_seq) + ".json";
+}
+
+bool ScrobbleQueue::write_segment(const std::vector<QueuedTrack>& tracks, bool sync)
+{
+    json j;
+    j["version"] = 3;
+    j["first_seq"] = tracks.front().seq;
+    j["queue"] = json::array();
+    for (const auto& track : tracks)
+        j["queue"].push_back(track_to_json(track));
+
+    std::error_code ec;
+    std::filesystem::create_directories(m_segment_dir, ec);
+    const std::string path = segment_path(tracks.front().seq);
+    if (!replace_file(path, j.dump(2, ' ', false, json::error_handler_t::replace), sync))
+    {
+        LASTFM_LOG_INFO("Last.fm ERROR: Failed to write queue segment: %s", path);
+        return false;
+    }
+    return true;
+}
+
+void ScrobbleQueue::seal_head()
+{
+    // The segment is on disk before a queue file without its entries can be written. If it cannot be written, the
+    // head keeps growing in the queue file and sealing is tried again with the next track.
+    if (!write_segment(m_head, m_policy.durability != Durability::best_effort))
+        return;
+    const std::string path = segment_path(m_head.front().seq);
+
+    Segment segment;
+    segment.first_seq = m_head.front().seq;
+    segment.last_seq = m_head.back().seq;
+    m_segments.push_back(std::move(segment));
+    m_head.clear();
+    LASTFM_LOG_DEBUG("Last.fm: Sealed queue segment %s (%zu segments)", path, m_segments.size());
+}
+
+bool ScrobbleQueue::read_segment(uint64_t first_seq, uint64_t last_seq, std::vector<QueuedTrack>& tracks) const
+{
+    std::ifstream file(segment_path(first_seq));
+    if (!file.is_open())
+        return false;
+    try
+    {
+        json j;
+        file >> j;
+        tracks.clear();
+        tracks.reserve(last_seq - first_seq + 1);
+        for (const auto& item : j["queue"])
+            tracks.push_back(track_from_json(item));
+    }
+    catch (const std::exception& e)
+    {
+        LASTFM_LOG_DEBUG("Last.fm: Failed to parse queue segment %s: %s", segment_path(first_seq), e.what());
+        return false;
+    }
+    for (size_t i = 0; i < tracks.size(); ++i)
+    {
+        if (tracks[i].seq != first_seq + i)
+            return false;
+    }
+    return tracks.size() == last_seq - first_seq + 1;
+}
+
+bool ScrobbleQueue::page_in(Segment& segment)
+{
+    segment.last_used = ++m_page_clock;
+    if (segment.resident)
+        return true;
+    std::vector<QueuedTrack> tracks;
+    if (!read_segment(segment.first_seq, segment.last_seq, tracks))
+        return false;
+    make_resident(segment, std::move(tracks));
+    return true;
+}
+
+ScrobbleQueue::Segment* ScrobbleQueue::load_segment(uint64_t first_seq, std::unique_lock<std::mutex>& lock)
+{
+    auto find = [this, first_seq]() -> Segment*
+    {
+        for (auto& segment : m_segments)
+        {
+            if (segment.first_seq == first_seq)
+                return &segment;
+        }
+        return nullptr;
+    };
+    Segment* segment = find();
+    if (!segment || segment->resident)
+        return segment && page_in(*segment) ? segment : nullptr;
+
+    const uint64_t last_seq = segment->last_seq;
+    const uint64_t generation = segment->generation;
+    std::vector<QueuedTrack> tracks;
+    lock.unlock();
+    const bool read = read_segment(first_seq, last_seq, tracks);
+    lock.lock();
+
+    // Trimmed meanwhile, or paged in by someone else; a file rewritten meanwhile is read again under the lock
+    segment = find();
+    if (!segment || (!read && !segment->resident))
+        return nullptr;
+    if (segment->resident || segment->generation != generation)
+        return page_in(*segment) ? segment : nullptr;
+    segment->last_used = ++m_page_clock;
+    make_resident(*segment, std::move(tracks));
+    return segment;
+}
+
+void ScrobbleQueue::make_resident(Segment& segment, std::vector<QueuedTrack>&& tracks)
+{
+    segment.tracks = std::move(tracks);
+    segment.resident = true;
+
+    size_t resident = 0;
+    Segment* least_recent = nullptr;
+    for (auto& other : m_segments)
+    {
+        if (!other.resident)
+            continue;
+        ++resident;
+        if (!least_recent || other.last_used < least_recent->last_used)
+            least_recent = &other;
+    }
+    if (resident > kResidentSegments)
+    {
+        least_recent->tracks = std::vector<QueuedTrack>();
+        least_recent->resident = false;
+    }
+}
+
+void ScrobbleQueue::drop_segment(size_t index)
+{
+    const Segment& segment = m_segments[index];
+    LASTFM_LOG_INFO("Last.fm ERROR: Cannot read queue segment %s, its %llu tracks are skipped",
+                    segment_path(segment.first_seq),
+                    static_cast<unsigned long long>(segment.last_seq - segment.first_seq + 1));
+    for (const auto& target : m_targets)
+    {
+        target->acked.erase(target->acked.lower_bound(segment.first_seq),
+                            target->acked.upper_bound(segment.last_seq));
+        for (auto it = target->attempts.begin(); it != target->attempts.end();)
+        {
+            const bool dropped = it->first >= segment.first_seq && it->first <= segment.last_seq;
+            it = dropped ? target->attempts.erase(it) : std::next(it);
+        }
+    }
+    m_retired_segments.push_back(segment.first_seq);
+    m_segments.erase(m_segments.begin() + static_cast<std::ptrdiff_t>(index));
+    for (const auto& target : m_targets)
+        advance_cursor(*target);
+    reset_changes();
+}
+
+void ScrobbleQueue::remove_stray_segments()
+{
+    std::error_code ec;
+    std::filesystem::directory_iterator it(m_segment_dir, ec);
+    if (ec)
+        return;
+    std::unordered_set<std::string> listed;
+    for (const auto& segment : m_segments)
+        listed.insert(std::to_string(segment.first_seq) + ".json");
+    for (const auto& entry : it)
+    {
+        if (listed.count(entry.path().filename().string()) == 0)
+            std::filesystem::remove(entry.path(), ec);
+    }
+}
+
+// ============================================================
+// Processing
+// ============================================================
+void ScrobbleQueue::process_queue()
+{
+    std::vector<std::shared_ptr<Target>> targets;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        targets = m_targets;
+    }
+
+    // Every target but the first drains on its own thread
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < targets.size(); ++i)
+        threads.emplace_back([this, target = targets[i]]() { drain_target(*target); });
+    drain_target(*targets.front());
+    for (auto& thread : threads)
+        thread.join();
+}
+
+void ScrobbleQueue::process_target(const std::string& name)
+{
+    std::shared_ptr<Target> target;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        target = find_target(name);
+    }
+    if (target)
+        drain_target(*target);
+}
+
+void ScrobbleQueue::drain_target(Target& target)
+{
+    // Only one submitter per target at a time; a concurrent call has nothing left to do
+    std::unique_lock<std::mutex> process_lock(target.process_mutex, std::try_to_lock);
+    if (!process_lock.owns_lock())
+        return;
+
+    // Last.fm keeps the plain messages; other targets name themselves
+    const bool primary = target.name == kLastfmTarget;
+    const std::string label = primary ? std::string() : " (" + target.name + ")";
+
+    // Check network availability
+    bool online = target.transport->is_online();
+    if (!online)
+    {
+        if (!target.network_was_unavailable.exchange(true))
+        {
+            LASTFM_LOG_DEBUG("Last.fm%s: Network unavailable - scrobbling paused (%zu tracks stored offline). New "
+                             "tracks will continue to be queued and saved to disk until connection is restored.",
+                             label, get_pending(target.name));
+        }
+        return;
+    }
+    else if (target.network_was_unavailable.exchange(false))
+    {
+        LASTFM_LOG_DEBUG("Last.fm%s: Network connection restored - resuming queued scrobbles (%zu tracks pending).",
+                         label, get_pending(target.name));
+    }
+
+    if (!target.transport->has_session())
+    {
+        return;
+    }
+
+    // Now-playing and love/unlove go first: there are few of them, and the listener waits to see them
+    if (primary)
+        send_ops(target);
+
+    // Pick the entries that are due, then release the lock for the network calls
+    std::vector<QueuedTrack> batch;
+    std::vector<int> attempt_numbers;
+    size_t live_batched = 0;
+    size_t capacity = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        DrainLimits limits;
+        limits.adaptive = m_policy.adaptive_drain;
+        limits.initial_batch = static_cast<size_t>(std::max(m_policy.max_per_run, 0));
+        limits.max_batch = target.transport->max_batch();
+        limits.max_concurrency = m_policy.max_concurrency;
+        limits.target_latency_ms = m_policy.target_latency_ms;
+        target.controller.configure(limits);
+        capacity = target.controller.run_capacity();
+
+        const size_t pending = count_pending(target);
+        if (pending == 0)
+        {
+            return;
+        }
+
+        LASTFM_LOG_DEBUG("Last.fm%s: Processing queue with %zu tracks", label, pending);
+
+        const time_t now = current_clock().now_seconds();
+        auto due = [&](const QueuedTrack& queued, int& retry_count)
+        {
+            if (!is_pending(target, queued.seq))
+                return false;
+            auto attempt = target.attempts.find(queued.seq);
+            retry_count = attempt != target.attempts.end() ? attempt->second.retry_count : 0;
+            const time_t last_attempt = attempt != target.attempts.end() ? attempt->second.last_attempt : 0;
+            int backoff_seconds =
+                m_policy.backoff_base_seconds * (1 << std::min(retry_count, m_policy.backoff_max_shift));
+            return now - last_attempt >= backoff_seconds;
+        };
+
+        // Live lane: the newest entries, played in this session within the live window. They form a suffix
+        // of the head, so a backward scan finds them without walking the backlog.
+        size_t live_begin = m_head.size();
+        if (m_policy.live_weight > 0)
+        {
+            const int64_t live_after_ms = current_clock().now_ms() - m_policy.live_window_seconds * 1000LL;
+            while (live_begin > 0 && m_head[live_begin - 1].live &&
+                   m_head[live_begin - 1].queued_at_ms >= live_after_ms)
+                --live_begin;
+        }
+
+        // Each lane fills up to capacity candidates, oldest first
+        std::vector<std::pair<size_t, int>> live;
+        std::vector<std::pair<QueuedTrack, int>> bulk;
+        for (size_t i = live_begin; i < m_head.size() && live.size() < capacity; ++i)
+        {
+            int retry_count = 0;
+            if (due(m_head[i], retry_count))
+                live.emplace_back(i, retry_count);
+        }
+
+        // The backlog pages in the sealed segments the target is not past yet, at most kResidentSegments per
+        // run, so a backlog waiting out its retry delays is not read end to end every time
+        size_t paged = 0;
+        for (size_t index = 0; index < m_segments.size() && bulk.size() < capacity && paged < kResidentSegments;)
+        {
+            Segment& segment = m_segments[index];
+            const uint64_t from = std::max(segment.first_seq, target.cursor + 1);
+            const auto acked = static_cast<uint64_t>(std::distance(target.acked.lower_bound(from),
+                                                                   target.acked.upper_bound(segment.last_seq)));
+            if (segment.last_seq < from || acked == segment.last_seq - from + 1)
+            {
+                ++index;
+                continue;
+            }
+            if (!page_in(segment))
+            {
+                drop_segment(index);
+                continue;
+            }
+            ++paged;
+            for (size_t i = from - segment.first_seq; i < segment.tracks.size() && bulk.size() < capacity; ++i)
+            {
+                int retry_count = 0;
+                if (due(segment.tracks[i], retry_count))
+                    bulk.emplace_back(segment.tracks[i], retry_count);
+            }
+            ++index;
+        }
+        for (size_t i = 0; i < live_begin && bulk.size() < capacity; ++i)
+        {
+            int retry_count = 0;
+            if (due(m_head[i], retry_count))
+                bulk.emplace_back(m_head[i], retry_count);
+        }
+
+        // Live plays get their weighted share of the slots and the backlog the rest; slots a lane cannot use
+        // go to the other one
+        const size_t slots = capacity;
+        size_t live_share = 0;
+        if (!live.empty())
+        {
+            const int weights = m_policy.live_weight + std::max(m_policy.bulk_weight, 0);
+            live_share = std::min(slots, std::max<size_t>(1, slots * m_policy.live_weight / weights));
+        }
+        const size_t bulk_count = std::min(bulk.size(), slots - std::min(live.size(), live_share));
+        const size_t live_count = std::min(live.size(), slots - bulk_count);
+        for (size_t i = 0; i < live_count; ++i)
+        {
+            batch.push_back(m_head[live[i].first]);
+            attempt_numbers.push_back(live[i].second + 1);
+        }
+        for (size_t i = 0; i < bulk_count; ++i)
+        {
+            batch.push_back(std::move(bulk[i].first));
+            attempt_numbers.push_back(bulk[i].second + 1);
+        }
+        live_batched = live_count;
+    }
+
+    // Submit without holding the queue lock so add_track(), the other targets and the UI never wait on the network.
+    // The batch goes out in requests of the controller's batch size, up to its concurrency of them at once.
+    std::vector<LastfmApi::TrackInfo> tracks;
+    tracks.reserve(batch.size());
+    for (const auto& queued : batch)
+        tracks.push_back(to_track_info(queued));
+    const size_t chunk_size = std::max<size_t>(1, target.controller.batch_size());
+    const size_t chunks = (tracks.size() + chunk_size - 1) / chunk_size;
+    std::vector<std::vector<bool>> chunk_results(chunks);
+    std::vector<DrainSample> samples(chunks);
+    auto submit_chunk = [&](size_t index)
+    {
+        const size_t first = index * chunk_size;
+        const size_t last = std::min(tracks.size(), first + chunk_size);
+        const std::vector<LastfmApi::TrackInfo> chunk(tracks.begin() + first, tracks.begin() + last);
+        target.transport->take_pushback();
+        const auto start = std::chrono::steady_clock::now();
+        target.transport->scrobble_batch(chunk, chunk_results[index]);
+        DrainSample& sample = samples[index];
+        sample.latency =
+            std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+        sample.pushback = target.transport->take_pushback();
+        chunk_results[index].resize(chunk.size(), false);
+        sample.accepted =
+            std::all_of(chunk_results[index].begin(), chunk_results[index].end(), [](bool result) { return result; });
+    };
+    std::vector<std::thread> requests;
+    for (size_t index = 1; index < chunks; ++index)
+        requests.emplace_back(submit_chunk, index);
+    if (chunks > 0)
+        submit_chunk(0);
+    for (auto& request : requests)
+        request.join();
+    std::vector<bool> results;
+    results.reserve(batch.size());
+    for (const auto& chunk : chunk_results)
+        results.insert(results.end(), chunk.begin(), chunk.end());
+
+    if (target.controller.on_run(samples, batch.size() >= capacity))
+    {
+        const DrainControllerState state = target.controller.state();
+        LASTFM_LOG_DEBUG("Last.fm%s: Drain tuned to %zu tracks per request, %d in flight (latency %lld ms)", label,
+                         state.batch_size, state.concurrency, static_cast<long long>(state.latency_ms));
+    }
+    if (primary)
+        g_metrics.set_drain_state(target.controller.state());
+
+    for (size_t i = 0; i < batch.size(); ++i)
+    {
+        const QueuedTrack& queued = batch[i];
+        if (results[i])
+        {
+            if (primary)
+            {
+                g_metrics.scrobbles_acked.fetch_add(1, std::memory_order_relaxed);
+                if (queued.queued_at_ms > 0)
+                {
+                    const std::chrono::milliseconds waited(current_clock().now_ms() - queued.queued_at_ms);
+                    g_metrics.enqueue_to_ack.record(waited);
+                    if (i < live_batched)
+                        g_metrics.live_enqueue_to_ack.record(waited);
+                }
+            }
+
+            LASTFM_LOG_INFO("Last.fm Scrobbler%s: Scrobbled successfully - %s - %s", label, queued.artist,
+                            queued.track);
+            LASTFM_LOG_DEBUG("Last.fm%s: Successfully scrobbled from queue: %s - %s", label, queued.artist,
+                             queued.track);
+        }
+        else
+        {
+            LASTFM_LOG_INFO("Last.fm Scrobbler%s: Failed to scrobble - %s - %s", label, queued.artist, queued.track);
+            if (primary)
+                g_metrics.scrobbles_failed.fetch_add(1, std::memory_order_relaxed);
+            LASTFM_LOG_DEBUG("Last.fm%s: Failed to scrobble from queue (attempt %d): %s - %s", label,
+                             attempt_numbers[i], queued.artist, queued.track);
+        }
+    }
+    if (batch.size() >= capacity)
+    {
+        LASTFM_LOG_DEBUG("Last.fm%s: Processed %zu tracks this cycle - will continue later.", label, batch.size());
+    }
+
+    // Apply the results by seq; entries removed by clear_queue() in the meantime stay removed
+    if (!batch.empty())
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const time_t attempted_at = current_clock().now_seconds();
+        for (size_t i = 0; i < batch.size(); ++i)
+        {
+            const uint64_t seq = batch[i].seq;
+            if (seq <= target.cursor)
+                continue;
+            if (results[i])
+            {
+                // Deleted meanwhile: already delivered for every target
+                if (!is_pending(target, seq))
+                    continue;
+                target.acked.insert(seq);
+                target.attempts.erase(seq);
+                if (!is_undelivered(seq))
+                    log_change(Change::removed, seq);
+            }
+            else if (is_pending(target, seq))
+            {
+                Attempt& attempt = target.attempts[seq];
+                attempt.retry_count++;
+                attempt.last_attempt = attempted_at;
+            }
+        }
+
+        publish_changes();
+        advance_cursor(target);
+        trim();
+        g_metrics.set_queue_depth(count_undelivered());
+        save_queue();
+    }
+
+    // Record everything Last.fm accepted, including entries cleared while they were in flight
+    if (primary && g_scrobble_history)
+    {
+        std::vector<LastfmApi::TrackInfo> acked;
+        for (size_t i = 0; i < batch.size(); ++i)
+        {
+            if (results[i])
+                acked.push_back(std::move(tracks[i]));
+        }
+        g_scrobble_history->append(acked);
+    }
+}
+
+void ScrobbleQueue::send_ops(Target& target)
+{
+    std::vector<PendingOp> ops;
     {
-        m_queue_file_path = file_path.c_str();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        // A now-playing update that outlived its track is dropped rather than sent late
+        if (m_now_playing)
+        {
+            const int64_t expires_ms = m_now_playing->track.queued_at_ms +
+                                       std::max(m_now_playing->track.duration, kMinNowPlayingSeconds) * 1000LL;
+            if (current_clock().now_ms() < expires_ms)
+                ops.push_back(*m_now_playing);
+            m_now_playing.reset();
+        }
+        for (auto& op : m_ops)
+        {
+            op.sending = true;
+            ops.push_back(op);
+        }
     }
-    else
+    if (ops.empty())
+        return;
+
+    // One request each, oldest first, so a love and a later unlove of a track arrive in order
+    std::vector<bool> sent(ops.size(), false);
+    for (size_t i = 0; i < ops.size(); ++i)
+    {
+        const LastfmApi::TrackInfo track = to_track_info(ops[i].track);
+        if (ops[i].op == QueueOp::now_playing)
+        {
+            sent[i] = target.transport->update_now_playing(track);
+            continue;
+        }
+        const bool loved = ops[i].op == QueueOp::love;
+        sent[i] = target.transport->love(track, loved);
+        if (sent[i])
+            LASTFM_LOG_INFO("Last.fm Scrobbler: %s - %s - %s", loved ? "Loved" : "Unloved", track.artist, track.track);
+        else
+            LASTFM_LOG_DEBUG("Last.fm: Failed to %s %s - %s, will retry", loved ? "love" : "unlove", track.artist,
+                             track.track);
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    bool changed = false;
+    for (size_t i = 0; i < ops.size(); ++i)
     {
-        m_queue_file_path = profile_path.c_str();
-        if (m_queue_file_path.find("file://") == 0)
+        if (ops[i].op == QueueOp::now_playing)
+        {
+            // Retried with the next run unless a newer track started meanwhile
+            if (!sent[i] && !m_now_playing)
+                m_now_playing = ops[i];
+            continue;
+        }
+        auto it = std::find_if(m_ops.begin(), m_ops.end(), [&](const PendingOp& op) { return op.id == ops[i].id; });
+        if (it == m_ops.end())
+            continue;
+        if (sent[i])
+        {
+            m_ops.erase(it);
+            changed = true;
+        }
+        else
         {
-            m_queue_file_path = m_queue_file_path.substr(7);
+            it->sending = false;
         }
     }
+    if (changed)
+        save_queue();
+}
 
-    if (!m_queue_file_path.empty() && m_queue_file_path.back() != '/' && m_queue_file_path.back() != '\\')
+size_t ScrobbleQueue::submit_batch(const std::vector<LastfmApi::TrackInfo>& tracks, std::vector<bool>& results)
+{
+    ScrobbleTransport* transport = nullptr;
     {
-        m_queue_file_path += "/";
+        std::lock_guard<std::mutex> lock(m_mutex);
+        transport = m_targets.front()->transport;
     }
-    m_queue_file_path += "lastfm_scrobble_queue.json";
+    results.assign(tracks.size(), false);
+    if (tracks.empty() || !transport->has_session())
+        return 0;
 
-    // Load existing queue from disk
-    load_queue();
+    transport->scrobble_batch(tracks, results);
+    results.resize(tracks.size(), false);
 
-    if (cfg_debug_enabled.get())
+    std::vector<LastfmApi::TrackInfo> acked;
+    for (size_t i = 0; i < tracks.size(); ++i)
     {
-        FB2K_console_formatter() << "Last.fm: Queue initialized, " << m_queue.size() << " tracks loaded";
+        if (results[i])
+            acked.push_back(tracks[i]);
     }
+    g_metrics.scrobbles_acked.fetch_add(acked.size(), std::memory_order_relaxed);
+    g_metrics.scrobbles_failed.fetch_add(tracks.size() - acked.size(), std::memory_order_relaxed);
+    if (g_scrobble_history && !acked.empty())
+        g_scrobble_history->append(acked);
+    return acked.size();
 }
 
-ScrobbleQueue::~ScrobbleQueue()
+// ============================================================
+// Workers
+// ============================================================
+void ScrobbleQueue::start_workers()
 {
-    // Save queue to disk on destruction
-    save_queue();
+    std::vector<std::shared_ptr<Target>> targets;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        targets = m_targets;
+    }
+    std::lock_guard<std::mutex> lock(m_worker_mutex);
+    if (m_workers_started)
+        return;
+    m_workers_started = true;
+    for (const auto& target : targets)
+        start_worker(target);
 }
 
-void ScrobbleQueue::add_track(const LastfmApi::TrackInfo& track)
+void ScrobbleQueue::start_worker(const std::shared_ptr<Target>& target)
 {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    QueuedTrack queued = from_track_info(track);
-    m_queue.push_back(queued);
-    save_queue();
+    if (target->worker.joinable() || target->stop)
+        return;
+    target->worker = std::thread([this, target]() { run_worker(target); });
+}
 
-    if (cfg_debug_enabled.get())
+void ScrobbleQueue::run_worker(std::shared_ptr<Target> target)
+{
+    // The policy is read with m_worker_mutex released; the two locks are never nested
+    int interval = get_policy().worker_interval_seconds;
+    std::unique_lock<std::mutex> lock(m_worker_mutex);
+    while (!target->stop)
     {
-        FB2K_console_formatter() << "Last.fm: Track added to queue (" << m_queue.size()
-                                 << " total): " << track.artist.c_str() << " - " << track.track.c_str();
+        m_worker_cv.wait_for(lock, std::chrono::seconds(interval), [&]() { return target->stop || target->wake; });
+        if (target->stop)
+            break;
+        target->wake = false;
+
+        lock.unlock();
+        drain_target(*target);
+        interval = get_policy().worker_interval_seconds;
+        lock.lock();
     }
 }
 
-void ScrobbleQueue::process_queue()
+void ScrobbleQueue::wake_workers()
 {
-    // Check network availability
-    bool online = is_network_available();
-    if (!online)
+    std::vector<std::shared_ptr<Target>> targets;
     {
-        if (cfg_debug_enabled.get() && !m_network_was_unavailable)
-        {
-            FB2K_console_formatter()
-                << "Last.fm: Network unavailable - scrobbling paused (" << m_queue.size() << " tracks stored offline). "
-                << "New tracks will continue to be queued and saved to disk until connection is restored.";
-        }
-        m_network_was_unavailable = true;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        targets = m_targets;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_worker_mutex);
+        for (const auto& target : targets)
+            target->wake = true;
+    }
+    m_worker_cv.notify_all();
+}
+
+void ScrobbleQueue::wake_target(const std::string& name)
+{
+    std::shared_ptr<Target> target;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        target = find_target(name);
+    }
+    if (!target)
         return;
+    {
+        std::lock_guard<std::mutex> lock(m_worker_mutex);
+        target->wake = true;
+    }
+    m_worker_cv.notify_all();
+}
+
+void ScrobbleQueue::stop_workers()
+{
+    std::vector<std::shared_ptr<Target>> targets;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        targets = m_targets;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_worker_mutex);
+        m_workers_started = false;
+        for (const auto& target : targets)
+            target->stop = true;
     }
-    else if (m_network_was_unavailable)
+    m_worker_cv.notify_all();
+    for (const auto& target : targets)
     {
-        m_network_was_unavailable = false;
-        if (cfg_debug_enabled.get())
+        if (target->worker.joinable())
+            target->worker.join();
+        std::lock_guard<std::mutex> lock(m_worker_mutex);
+        target->stop = false;
+    }
+}
+
+// ============================================================
+// Queries
+// ============================================================
+std::unordered_set<uint64_t> ScrobbleQueue::pending_keys() const
+{
+    std::unordered_set<uint64_t> keys;
+    std::vector<std::pair<uint64_t, uint64_t>> paged_out;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const auto& segment : m_segments)
         {
-            FB2K_console_formatter() << "Last.fm: Network connection restored - resuming queued scrobbles ("
-                                     << m_queue.size() << " tracks pending).";
+            if (!segment.resident)
+                paged_out.emplace_back(segment.first_seq, segment.last_seq);
+            for (const auto& queued : segment.tracks)
+                keys.insert(scrobble_key(queued.artist, queued.track, queued.timestamp));
         }
+        for (const auto& queued : m_head)
+            keys.insert(scrobble_key(queued.artist, queued.track, queued.timestamp));
     }
 
-    if (!g_lastfm_api || !g_lastfm_api->has_saved_session())
+    // Segments that are not in memory are read one at a time and not kept; one deleted meanwhile was delivered
+    std::vector<QueuedTrack> tracks;
+    for (const auto& [first, last] : paged_out)
     {
-        return;
+        if (!read_segment(first, last, tracks))
+            continue;
+        for (const auto& queued : tracks)
+            keys.insert(scrobble_key(queued.artist, queued.track, queued.timestamp));
     }
+    return keys;
+}
+
+size_t ScrobbleQueue::get_queue_size() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return count_undelivered();
+}
+
+size_t ScrobbleQueue::get_pending_ops() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_ops.size() + (m_now_playing ? 1 : 0);
+}
+
+size_t ScrobbleQueue::get_pending(const std::string& name) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const auto target = find_target(name);
+    if (!target)
+        return 0;
+    return count_pending(*target);
+}
 
+QueueStorage ScrobbleQueue::get_storage() const
+{
     std::lock_guard<std::mutex> lock(m_mutex);
-    if (m_queue.empty())
+    QueueStorage storage;
+    storage.segments = m_segments.size();
+    storage.resident_tracks = m_head.size();
+    for (const auto& segment : m_segments)
     {
-        return;
+        if (!segment.resident)
+            continue;
+        ++storage.resident_segments;
+        storage.resident_tracks += segment.tracks.size();
     }
+    return storage;
+}
 
-    if (cfg_debug_enabled.get())
+void ScrobbleQueue::clear_queue()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const auto& segment : m_segments)
+        m_retired_segments.push_back(segment.first_seq);
+    m_segments.clear();
+    m_head.clear();
+    for (const auto& target : m_targets)
     {
-        FB2K_console_formatter() << "Last.fm: Processing queue with " << m_queue.size() << " tracks";
+        target->cursor = m_next_seq - 1;
+        target->acked.clear();
+        target->attempts.clear();
     }
+    reset_changes();
+    g_metrics.set_queue_depth(0);
+    save_queue();
+}
+
+void ScrobbleQueue::set_policy(const QueuePolicy& policy)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_policy = policy;
+}
+
+QueuePolicy ScrobbleQueue::get_policy() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_policy;
+}
+
+// ============================================================
+// Inspection
+// ============================================================
+uint64_t ScrobbleQueue::get_version() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_view_version;
+}
+
+QueuePage ScrobbleQueue::get_range(size_t offset, size_t count)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    QueuePage page;
+
+    // A segment the window needs is read with the lock released and the window located again, so scrolling never
+    // keeps a play or a drain waiting on the disk. A window spanning more segments than stay resident reads the
+    // rest under the lock.
+    for (size_t loads = 0;; ++loads)
+    {
+        page.version = m_view_version;
+        page.total = count_undelivered();
+        page.entries.clear();
+        const Target* behind = slowest_target();
+        if (!behind || offset >= page.total || count == 0)
+            return page;
+        page.entries.reserve(std::min(count, page.total - offset));
+
+        // Ranges before the window are skipped by counting: everything after the slowest cursor, less the entries
+        // every target delivered, which are all in that target's acked set
+        uint64_t load = 0;
+        size_t skip = offset;
+        const auto ranges = stored_ranges();
+        for (size_t index = 0; index < ranges.size() && page.entries.size() < count; ++index)
+        {
+            const uint64_t first = std::max(ranges[index].first, behind->cursor + 1);
+            const uint64_t last = ranges[index].second;
+            if (first > last)
+                continue;
+            size_t stored = last - first + 1;
+            for (auto it = behind->acked.lower_bound(first); it != behind->acked.end() && *it <= last; ++it)
+            {
+                if (!is_undelivered(*it))
+                    --stored;
+            }
+            if (skip >= stored)
+            {
+                skip -= stored;
+                continue;
+            }
 
-    // Process limited number of tracks to avoid blocking
-    const int kMaxPerRun = 10;
-    int processed = 0;
-    std::vector<QueuedTrack> remaining;
+            // An unreadable segment is left to the next drain, which drops it
+            const bool sealed = index < m_segments.size();
+            if (sealed && !m_segments[index].resident && loads < kResidentSegments)
+            {
+                load = m_segments[index].first_seq;
+                break;
+            }
+            if (sealed && !page_in(m_segments[index]))
+                continue;
+            const std::vector<QueuedTrack>& tracks = sealed ? m_segments[index].tracks : m_head;
+            for (size_t i = first - ranges[index].first; i < tracks.size() && page.entries.size() < count; ++i)
+            {
+                if (!is_undelivered(tracks[i].seq))
+                    continue;
+                if (skip > 0)
+                    --skip;
+                else
+                    page.entries.push_back(make_entry(tracks[i]));
+            }
+        }
+        if (load == 0)
+            return page;
+        load_segment(load, lock);
+    }
+}
 
-    for (auto& queued : m_queue)
+QueueChanges ScrobbleQueue::get_changes(uint64_t since)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    QueueChanges changes;
+    changes.version = m_view_version;
+    if (since < m_changes_since || since > m_view_version)
     {
-        time_t now = time(nullptr);
-        int backoff_seconds = 30 * (1 << std::min(queued.retry_count, 5));
+        changes.reset = true;
+        return changes;
+    }
 
-        if (now - queued.last_attempt < backoff_seconds)
+    // The last change of an entry wins, except that an entry added since stays added; one added and removed since
+    // was never seen
+    std::map<uint64_t, Change> latest;
+    auto after = [](uint64_t version, const ChangeRecord& change) { return version < change.version; };
+    auto record = std::upper_bound(m_changes.begin(), m_changes.end(), since, after);
+    for (; record != m_changes.end() && record->version <= m_view_version; ++record)
+    {
+        auto [entry, inserted] = latest.try_emplace(record->seq, record->change);
+        if (inserted || entry->second != Change::added)
+            entry->second = record->change;
+        else if (record->change == Change::removed)
+            latest.erase(entry);
+    }
+    for (const auto& [seq, change] : latest)
+    {
+        if (change == Change::removed)
         {
-            remaining.push_back(queued);
+            changes.removed.push_back(seq);
             continue;
         }
+        const QueuedTrack* queued = find_entry(seq);
+        if (queued && is_undelivered(seq))
+            (change == Change::added ? changes.added : changes.edited).push_back(make_entry(*queued));
+    }
+    return changes;
+}
 
-        LastfmApi::TrackInfo track_info = to_track_info(queued);
-        bool success = g_lastfm_api->scrobble_track(track_info);
+size_t ScrobbleQueue::remove_entries(const std::vector<uint64_t>& seqs)
+{
+    std::vector<uint64_t> sorted(seqs);
+    std::sort(sorted.begin(), sorted.end());
+    sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
 
-        if (success)
+    // No entry has to be read; a segment's worth of seqs per lock
+    size_t removed = 0;
+    for (size_t first = 0; first < sorted.size(); first += kSegmentTracks)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const auto ranges = stored_ranges();
+        const size_t last = std::min(sorted.size(), first + kSegmentTracks);
+        for (size_t i = first; i < last; ++i)
         {
-            FB2K_console_formatter() << "Last.fm Scrobbler: Scrobbled successfully - " << queued.artist.c_str() << " - "
-                                     << queued.track.c_str();
-            if (cfg_debug_enabled.get())
-            {
-                FB2K_console_formatter() << "Last.fm: Successfully scrobbled from queue: " << queued.artist.c_str()
-                                         << " - " << queued.track.c_str();
-            }
+            const uint64_t seq = sorted[i];
+            const bool stored = std::any_of(ranges.begin(), ranges.end(), [seq](const auto& range)
+                                            { return seq >= range.first && seq <= range.second; });
+            if (!stored || !is_undelivered(seq))
+                continue;
+            remove_entry(seq);
+            ++removed;
+        }
+        publish_changes();
+        for (const auto& target : m_targets)
+            advance_cursor(*target);
+        trim();
+        g_metrics.set_queue_depth(count_undelivered());
+        save_queue();
+    }
+    if (removed > 0)
+        LASTFM_LOG_DEBUG("Last.fm: Deleted %zu tracks from the queue", removed);
+    return removed;
+}
+
+size_t ScrobbleQueue::remove_if(const QueueMatch& match)
+{
+    return update_entries(match, nullptr);
+}
+
+size_t ScrobbleQueue::edit_if(const QueueMatch& match, const QueueEdit& edit)
+{
+    return edit ? update_entries(match, edit) : 0;
+}
+
+size_t ScrobbleQueue::update_entries(const QueueMatch& match, const QueueEdit& edit)
+{
+    std::lock_guard<std::mutex> edit_lock(m_edit_mutex);
+    size_t updated = 0;
+    uint64_t next = 0; // First seq the walk has not visited
+    for (;;)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        // The next chunk: the first sealed segment not visited yet, then the head. Segments trimmed or dropped
+        // meanwhile are simply not found.
+        auto unvisited = std::find_if(m_segments.begin(), m_segments.end(),
+                                      [next](const Segment& sealed) { return sealed.last_seq >= next; });
+        Segment* segment = nullptr;
+        std::vector<QueuedTrack>* tracks = &m_head;
+        if (unvisited != m_segments.end())
+        {
+            const uint64_t first_seq = unvisited->first_seq;
+            next = unvisited->last_seq + 1;
+            segment = load_segment(first_seq, lock);
+            if (!segment)
+                continue;
+            tracks = &segment->tracks;
+        }
+        else if (m_head.empty() || m_head.back().seq < next)
+        {
+            break;
         }
         else
         {
-            FB2K_console_formatter() << "Last.fm Scrobbler: Failed to scrobble - " << queued.artist.c_str() << " - "
-                                     << queued.track.c_str();
-            queued.retry_count++;
-            queued.last_attempt = now;
-            remaining.push_back(queued);
+            next = m_head.back().seq + 1;
+        }
 
-            if (cfg_debug_enabled.get())
+        size_t chunk = 0;
+        std::vector<QueuedTrack> edited;
+        std::vector<uint64_t> edited_seqs;
+        for (size_t i = 0; i < tracks->size(); ++i)
+        {
+            const QueuedTrack& queued = (*tracks)[i];
+            if (!is_undelivered(queued.seq) || !match(queued))
+                continue;
+            ++chunk;
+            if (!edit)
             {
-                FB2K_console_formatter() << "Last.fm: Failed to scrobble from queue (attempt " << queued.retry_count
-                                         << "): " << queued.artist.c_str() << " - " << queued.track.c_str();
+                remove_entry(queued.seq);
+                continue;
             }
+            if (edited.empty())
+                edited = *tracks;
+            QueuedTrack& changed = edited[i];
+            edit(changed);
+            changed.seq = queued.seq;
+            changed.queued_at_ms = queued.queued_at_ms;
+            changed.live = queued.live;
+            edited_seqs.push_back(queued.seq);
         }
-        if (++processed >= kMaxPerRun)
+
+        // A sealed segment is rewritten with the lock released (edits are serialized by m_edit_mutex, so nothing
+        // else changes it meanwhile) and changes in memory only once it is on disk
+        if (segment && !edited.empty())
         {
-            if (cfg_debug_enabled.get())
+            const uint64_t first_seq = segment->first_seq;
+            const bool sync = m_policy.durability != Durability::best_effort;
+            lock.unlock();
+            const bool written = write_segment(edited, sync);
+            lock.lock();
+            auto rewritten = std::find_if(m_segments.begin(), m_segments.end(),
+                                          [first_seq](const Segment& sealed) { return sealed.first_seq == first_seq; });
+            if (rewritten == m_segments.end())
             {
-                FB2K_console_formatter() << "Last.fm: Processed " << processed
-                                         << " tracks this cycle - will continue later.";
+                // Delivered meanwhile; its file was retired, so the rewritten one goes too
+                std::error_code ec;
+                std::filesystem::remove(segment_path(first_seq), ec);
+                continue;
             }
-            remaining.insert(remaining.end(), std::next(&queued), &m_queue.back() + 1);
-            break;
+            if (!written)
+            {
+                chunk = 0;
+                continue;
+            }
+            ++rewritten->generation;
+            if (rewritten->resident)
+                rewritten->tracks = std::move(edited);
+        }
+        else if (!edited.empty())
+        {
+            m_head = std::move(edited);
         }
+        for (const uint64_t seq : edited_seqs)
+            log_change(Change::edited, seq);
+        if (chunk == 0)
+            continue;
+        updated += chunk;
+        publish_changes();
+        for (const auto& target : m_targets)
+            advance_cursor(*target);
+        trim();
+        g_metrics.set_queue_depth(count_undelivered());
+        save_queue();
     }
+    if (updated > 0)
+        LASTFM_LOG_DEBUG("Last.fm: %s %zu tracks in the queue", edit ? "Edited" : "Deleted", updated);
+    return updated;
+}
 
-    m_queue = remaining;
-    save_queue();
+QueuedTrack* ScrobbleQueue::find_entry(uint64_t seq)
+{
+    if (!m_head.empty() && seq >= m_head.front().seq && seq <= m_head.back().seq)
+        return &m_head[seq - m_head.front().seq];
+    for (auto& segment : m_segments)
+    {
+        if (seq >= segment.first_seq && seq <= segment.last_seq)
+            return page_in(segment) ? &segment.tracks[seq - segment.first_seq] : nullptr;
+    }
+    return nullptr;
 }
 
-size_t ScrobbleQueue::get_queue_size() const
+QueueEntry ScrobbleQueue::make_entry(const QueuedTrack& queued) const
 {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    return m_queue.size();
+    QueueEntry entry;
+    entry.track = queued;
+    for (const auto& target : m_targets)
+    {
+        auto attempt = target->attempts.find(queued.seq);
+        if (attempt != target->attempts.end())
+            entry.retry_count = std::max(entry.retry_count, attempt->second.retry_count);
+    }
+    return entry;
 }
 
-void ScrobbleQueue::clear_queue()
+void ScrobbleQueue::remove_entry(uint64_t seq)
 {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    m_queue.clear();
-    save_queue();
+    for (const auto& target : m_targets)
+    {
+        if (!is_pending(*target, seq))
+            continue;
+        target->acked.insert(seq);
+        target->attempts.erase(seq);
+    }
+    log_change(Change::removed, seq);
 }
 
-void ScrobbleQueue::load_queue()
+void ScrobbleQueue::log_change(Change change, uint64_t seq)
+{
+    ChangeRecord record;
+    record.version = m_view_version + 1;
+    record.change = change;
+    record.seq = seq;
+    m_changes.push_back(record);
+    m_changes_pending = true;
+}
+
+void ScrobbleQueue::publish_changes()
 {
-    if (cfg_debug_enabled.get())
+    if (!m_changes_pending)
+        return;
+    ++m_view_version;
+    m_changes_pending = false;
+
+    // A reader at a version whose changes were partly dropped has to read its pages again
+    while (m_changes.size() > kMaxChanges)
     {
-        FB2K_console_formatter() << "Last.fm: Attempting to load queue from: " << m_queue_file_path.c_str();
+        m_changes_since = m_changes.front().version;
+        m_changes.pop_front();
     }
+}
+
+void ScrobbleQueue::reset_changes()
+{
+    m_changes.clear();
+    m_changes_pending = false;
+    ++m_view_version;
+    m_changes_since = m_view_version;
+}
+
+// ============================================================
+// Queue file
+// ============================================================
+// Version 3: {"version": 3, "next_seq": N, "segments": [[first, last], ...], "queue": [{..., "seq": S}],
+//             "targets": {"lastfm": {"cursor": C, "acked": [S, ...], "attempts": [[S, retries, last], ...]}},
+//             "ops": [{..., "op": "love" | "unlove"}]}
+// "queue" is the head segment; each sealed segment is lastfm_scrobble_queue.segments/<first>.json holding
+// {"version": 3, "first_seq": F, "queue": [...]}.
+// Version 2 kept the whole log in "queue", with gaps where entries had been delivered out of order.
+// Version 1 had no seq and one retry_count / last_attempt per entry, which now belong to the Last.fm target.
+void ScrobbleQueue::load_queue()
+{
+    ScopedLatency timer(g_metrics.load_queue_time);
+
+    LASTFM_LOG_DEBUG("Last.fm: Attempting to load queue from: %s", m_queue_file_path);
 
     // Load queue data from JSON file
     try
@@ -202,91 +1572,238 @@ void ScrobbleQueue::load_queue()
         std::ifstream file(m_queue_file_path);
         if (!file.is_open())
         {
-            if (cfg_debug_enabled.get())
-            {
-                FB2K_console_formatter() << "Last.fm: Queue file does not exist (first run or empty queue)";
-            }
+            LASTFM_LOG_DEBUG("Last.fm: Queue file does not exist (first run or empty queue)");
             return;
         }
 
         json j;
         file >> j;
-        m_queue.clear();
+        m_segments.clear();
+        m_head.clear();
+        m_ops.clear();
+        m_saved_targets.clear();
+        const int version = j.value("version", 1);
+        SavedTarget legacy;
+        std::vector<QueuedTrack> tracks;
         for (const auto& item : j["queue"])
         {
-            QueuedTrack track;
-            track.artist = item.value("artist", "");
-            track.track = item.value("track", "");
-            track.album = item.value("album", "");
-            track.album_artist = item.value("album_artist", "");
-            track.duration = item.value("duration", 0);
-            track.track_number = item.value("track_number", 0);
-            track.timestamp = item.value("timestamp", 0);
-            track.retry_count = item.value("retry_count", 0);
-            track.last_attempt = item.value("last_attempt", 0);
-            m_queue.push_back(track);
+            QueuedTrack track = track_from_json(item);
+            if (track.seq < m_next_seq)
+                track.seq = m_next_seq;
+            m_next_seq = track.seq + 1;
+
+            Attempt attempt;
+            attempt.retry_count = item.value("retry_count", 0);
+            attempt.last_attempt = item.value("last_attempt", 0);
+            if (attempt.retry_count > 0)
+                legacy.attempts[track.seq] = attempt;
+            tracks.push_back(std::move(track));
+        }
+        m_next_seq = std::max(m_next_seq, j.value("next_seq", uint64_t(1)));
+
+        if (j.contains("targets"))
+        {
+            for (const auto& [name, item] : j["targets"].items())
+            {
+                SavedTarget& saved = m_saved_targets[name];
+                saved.cursor = item.value("cursor", uint64_t(0));
+                for (const auto& seq : item.value("acked", json::array()))
+                    saved.acked.insert(seq.get<uint64_t>());
+                for (const auto& entry : item.value("attempts", json::array()))
+                    saved.attempts[entry.at(0).get<uint64_t>()] = {entry.at(1).get<int>(), entry.at(2).get<time_t>()};
+            }
+        }
+        else
+        {
+            m_saved_targets[kLastfmTarget] = std::move(legacy);
+        }
+
+        for (const auto& item : j.value("ops", json::array()))
+        {
+            PendingOp pending;
+            pending.id = m_next_op_id++;
+            pending.op = item.value("op", "") == "unlove" ? QueueOp::unlove : QueueOp::love;
+            pending.track = track_from_json(item);
+            pending.hash = track_match_hash(pending.track.artist, pending.track.track);
+            m_ops.push_back(std::move(pending));
+        }
+
+        size_t loaded = tracks.size();
+        if (version >= 3)
+        {
+            // Segments whose file is gone are left out; the cursors move over the gap when the targets are added
+            for (const auto& range : j.value("segments", json::array()))
+            {
+                Segment segment;
+                segment.first_seq = range.at(0).get<uint64_t>();
+                segment.last_seq = range.at(1).get<uint64_t>();
+                if (!std::filesystem::exists(segment_path(segment.first_seq)))
+                {
+                    LASTFM_LOG_INFO("Last.fm ERROR: Queue segment %s is missing, its %llu tracks are skipped",
+                                    segment_path(segment.first_seq),
+                                    static_cast<unsigned long long>(segment.last_seq - segment.first_seq + 1));
+                    for (auto& [name, saved] : m_saved_targets)
+                    {
+                        saved.acked.erase(saved.acked.lower_bound(segment.first_seq),
+                                          saved.acked.upper_bound(segment.last_seq));
+                        for (auto it = saved.attempts.begin(); it != saved.attempts.end();)
+                        {
+                            const bool missing = it->first >= segment.first_seq && it->first <= segment.last_seq;
+                            it = missing ? saved.attempts.erase(it) : std::next(it);
+                        }
+                    }
+                    continue;
+                }
+                loaded += segment.last_seq - segment.first_seq + 1;
+                m_segments.push_back(std::move(segment));
+            }
+            m_head = std::move(tracks);
         }
-        if (cfg_debug_enabled.get())
+        else
         {
-            FB2K_console_formatter() << "Last.fm: Successfully loaded " << m_queue.size() << " tracks from queue file";
+            // The whole log was in this file: number it 1..n without gaps, move the saved state along, and seal
+            // all but the newest entries into segments
+            std::vector<uint64_t> old_seqs;
+            old_seqs.reserve(tracks.size());
+            for (auto& track : tracks)
+            {
+                old_seqs.push_back(track.seq);
+                track.seq = old_seqs.size();
+            }
+            auto renumbered = [&old_seqs](uint64_t seq)
+            {
+                auto it = std::lower_bound(old_seqs.begin(), old_seqs.end(), seq);
+                return it != old_seqs.end() && *it == seq ? static_cast<uint64_t>(it - old_seqs.begin()) + 1 : 0;
+            };
+            for (auto& [name, saved] : m_saved_targets)
+            {
+                SavedTarget moved;
+                moved.cursor = static_cast<uint64_t>(
+                    std::upper_bound(old_seqs.begin(), old_seqs.end(), saved.cursor) - old_seqs.begin());
+                for (const uint64_t seq : saved.acked)
+                {
+                    if (const uint64_t now_seq = renumbered(seq))
+                        moved.acked.insert(now_seq);
+                }
+                for (const auto& [seq, attempt] : saved.attempts)
+                {
+                    if (const uint64_t now_seq = renumbered(seq))
+                        moved.attempts[now_seq] = attempt;
+                }
+                saved = std::move(moved);
+            }
+            m_next_seq = tracks.size() + 1;
+
+            size_t sealed = 0;
+            while (tracks.size() - sealed > kSegmentTracks)
+            {
+                m_head.assign(tracks.begin() + static_cast<std::ptrdiff_t>(sealed),
+                              tracks.begin() + static_cast<std::ptrdiff_t>(sealed + kSegmentTracks));
+                seal_head();
+                if (!m_head.empty())
+                    break;
+                sealed += kSegmentTracks;
+            }
+            m_head.insert(m_head.end(), tracks.begin() + static_cast<std::ptrdiff_t>(sealed + m_head.size()),
+                          tracks.end());
         }
+
+        g_metrics.set_queue_depth(loaded);
+        LASTFM_LOG_DEBUG("Last.fm: Successfully loaded %zu tracks from queue file", loaded);
     }
     catch (const std::exception& e)
     {
-        FB2K_console_formatter() << "Last.fm: Failed to load queue: " << e.what();
+        LASTFM_LOG_INFO("Last.fm: Failed to load queue: %s", e.what());
     }
 }
 
 void ScrobbleQueue::save_queue()
 {
-    if (cfg_debug_enabled.get())
+    const uint64_t version = ++m_state_version;
+    if (m_policy.durability == Durability::per_change)
     {
-        FB2K_console_formatter() << "Last.fm: Attempting to save queue (" << m_queue.size()
-                                 << " tracks) to: " << m_queue_file_path.c_str();
+        std::vector<uint64_t> retired;
+        retired.swap(m_retired_segments);
+        write_queue(serialize_queue(), version, true, retired);
+        return;
     }
+    m_committer.request(std::chrono::milliseconds(std::max(m_policy.commit_window_ms, 0)));
+}
 
-    // Save queue data to JSON file
-    try
+void ScrobbleQueue::commit_queue()
+{
+    std::string data;
+    uint64_t version = 0;
+    bool sync = false;
+    std::vector<uint64_t> retired;
     {
-        json j;
-        j["version"] = 1;
-        j["queue"] = json::array();
-        for (const auto& track : m_queue)
-        {
-            json item;
-            item["artist"] = track.artist;
-            item["track"] = track.track;
-            item["album"] = track.album;
-            item["album_artist"] = track.album_artist;
-            item["duration"] = track.duration;
-            item["track_number"] = track.track_number;
-            item["timestamp"] = track.timestamp;
-            item["retry_count"] = track.retry_count;
-            item["last_attempt"] = track.last_attempt;
-            j["queue"].push_back(item);
-        }
-
-        std::ofstream file(m_queue_file_path, std::ios::out | std::ios::trunc);
-        if (file.is_open())
-        {
-            file << j.dump(2);
-            file.flush();
-            file.close();
-            if (cfg_debug_enabled.get())
-            {
-                FB2K_console_formatter() << "Last.fm: Successfully saved queue to disk";
-            }
-        }
-        else
-        {
-            FB2K_console_formatter() << "Last.fm ERROR: Failed to open queue file for writing: "
-                                     << m_queue_file_path.c_str();
-        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        data = serialize_queue();
+        version = m_state_version;
+        sync = m_policy.durability != Durability::best_effort;
+        retired.swap(m_retired_segments);
     }
-    catch (const std::exception& e)
+    write_queue(data, version, sync, retired);
+}
+
+void ScrobbleQueue::flush()
+{
+    m_committer.flush();
+}
+
+std::string ScrobbleQueue::serialize_queue() const
+{
+    json j;
+    j["version"] = 3;
+    j["next_seq"] = m_next_seq;
+    j["segments"] = json::array();
+    for (const auto& segment : m_segments)
+        j["segments"].push_back({segment.first_seq, segment.last_seq});
+    j["queue"] = json::array();
+    for (const auto& track : m_head)
+        j["queue"].push_back(track_to_json(track));
+    j["targets"] = json::object();
+    for (const auto& target : m_targets)
+    {
+        json attempts = json::array();
+        for (const auto& [seq, attempt] : target->attempts)
+            attempts.push_back({seq, attempt.retry_count, attempt.last_attempt});
+        j["targets"][target->name] = {{"cursor", target->cursor}, {"acked", target->acked}, {"attempts", attempts}};
+    }
+    j["ops"] = json::array();
+    for (const auto& op : m_ops)
+    {
+        json item = track_to_json(op.track);
+        item["op"] = op.op == QueueOp::love ? "love" : "unlove";
+        j["ops"].push_back(item);
+    }
+    return j.dump(2, ' ', false, json::error_handler_t::replace);
+}
+
+void ScrobbleQueue::write_queue(const std::string& data, uint64_t version, bool sync,
+                                const std::vector<uint64_t>& retired)
+{
+    ScopedLatency timer(g_metrics.save_queue_time);
+    std::lock_guard<std::mutex> lock(m_write_mutex);
+    if (version >= m_written_version)
     {
-        FB2K_console_formatter() << "Last.fm: Failed to save queue: " << e.what();
+        LASTFM_LOG_DEBUG("Last.fm: Attempting to save queue (%zu bytes) to: %s", data.size(), m_queue_file_path);
+
+        // A temporary file renamed over the old one: a crash mid-write leaves the previous queue, never a torn one
+        if (!replace_file(m_queue_file_path, data, sync))
+        {
+            // The retired segment files stay until the next start removes them as strays
+            LASTFM_LOG_INFO("Last.fm ERROR: Failed to write queue file: %s", m_queue_file_path);
+            return;
+        }
+        m_written_version = version;
+        LASTFM_LOG_DEBUG("Last.fm: Successfully saved queue to disk");
     }
+
+    // The queue file on disk no longer lists these segments
+    std::error_code ec;
+    for (const uint64_t first_seq : retired)
+        std::filesystem::remove(segment_path(first_seq), ec);
 }
 
 QueuedTrack ScrobbleQueue::from_track_info(const LastfmApi::TrackInfo& track)
@@ -300,8 +1817,7 @@ QueuedTrack ScrobbleQueue::from_track_info(const LastfmApi::TrackInfo& track)
     queued.duration = track.duration;
     queued.track_number = track.track_number;
     queued.timestamp = track.timestamp;
-    queued.retry_count = 0;
-    queued.last_attempt = 0;
+    queued.queued_at_ms = 0;
     return queued;
 }
 
@@ -319,22 +1835,4 @@ LastfmApi::TrackInfo ScrobbleQueue::to_track_info(const QueuedTrack& queued)
     return track;
 }
 
-bool ScrobbleQueue::is_network_available()
-{
-    // Perform HEAD request to check Last.fm API availability
-    CURL* curl = curl_easy_init();
-    if (!curl)
-        return false;
-
-    curl_easy_setopt(curl, CURLOPT_URL, "https://ws.audioscrobbler.com/2.0/");
-    curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 5L);
-    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 3L);
-
-    CURLcode res = curl_easy_perform(curl);
-    curl_easy_cleanup(curl);
-
-    return (res == CURLE_OK);
-}
-
 } // namespace foo_lastfm
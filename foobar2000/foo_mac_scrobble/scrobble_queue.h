@@ -7,12 +7,24 @@
 
 #pragma once
 
+#include "drain_controller.h"
+#include "durable_file.h"
 #include "lastfm_api.h"
 #include "session_manager.h"
 
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
 #include <mutex>
+#include <optional>
+#include <set>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 namespace foo_lastfm
@@ -28,49 +40,417 @@ struct QueuedTrack
     int duration;             // Track duration in seconds
     int track_number;         // Track number in album
     time_t timestamp;         // Timestamp for scrobble submission
-    int retry_count;          // Number of failed scrobble attempts
-    time_t last_attempt;      // Timestamp of the last scrobble attempt
+    int64_t queued_at_ms;     // Wall-clock time the track entered the queue (ms since epoch)
+    uint64_t seq;             // Position in the play log; increases with every added track
+    bool live;                // Played in this session (not persisted); eligible for the live lane
 
-    QueuedTrack() : duration(0), track_number(0), timestamp(0), retry_count(0), last_attempt(0) {}
+    QueuedTrack() : duration(0), track_number(0), timestamp(0), queued_at_ms(0), seq(0), live(false) {}
 };
 
+// Operations the queue holds for Last.fm until they have been sent
+enum class QueueOp
+{
+    scrobble,    // track.scrobble: a play log entry, sent to every target, in batches
+    now_playing, // track.updateNowPlaying: only the newest is kept (in memory), and only until its track would end
+    love,        // track.love: cancels a pending unlove of the same track
+    unlove       // track.unlove: cancels a pending love of the same track
+};
+
+// Where the play log lives right now
+struct QueueStorage
+{
+    size_t segments = 0;          // Sealed segment files
+    size_t resident_segments = 0; // Sealed segments paged in
+    size_t resident_tracks = 0;   // Log entries in memory: the head segment plus the paged-in ones
+};
+
+// One undelivered log entry as the inspection API returns it
+struct QueueEntry
+{
+    QueuedTrack track;   // The entry; track.seq identifies it
+    int retry_count = 0; // Failed attempts of the target that failed it most often
+};
+
+// A window of the undelivered entries, in log order
+struct QueuePage
+{
+    uint64_t version = 0; // get_version() the page was read at
+    size_t total = 0;     // Undelivered entries in the whole log at that version
+    std::vector<QueueEntry> entries;
+};
+
+// What happened to the undelivered entries between two versions
+struct QueueChanges
+{
+    uint64_t version = 0;           // Version the changes lead to
+    bool reset = false;             // The changes are no longer known (or the log was cleared): read the pages again
+    std::vector<QueueEntry> added;  // New entries; they come after every entry seen before
+    std::vector<QueueEntry> edited; // Entries whose fields changed, as they are now
+    std::vector<uint64_t> removed;  // Seqs of entries delivered or deleted
+};
+
+// Selects entries for a bulk delete or edit. It is called with the queue lock held and must not call the queue.
+using QueueMatch = std::function<bool(const QueuedTrack&)>;
+// Changes the fields of a selected entry; seq, queued_at_ms and live are kept whatever it does
+using QueueEdit = std::function<void(QueuedTrack&)>;
+
+// Queue scheduling knobs; the defaults are the shipped behaviour
+struct QueuePolicy
+{
+    int max_per_run = 10;             // Tracks submitted per process_queue() call (the adaptive drain's start)
+    int backoff_base_seconds = 30;    // Delay before retrying a failed track
+    int backoff_max_shift = 5;        // Retry delay doubles per failure, up to base << max_shift
+    int worker_interval_seconds = 30; // Cadence of the background queue workers
+    int live_weight = 3;              // Live lane's share of each run against bulk_weight (0: one lane, log order)
+    int bulk_weight = 1;              // Backlog's share of each run
+    int live_window_seconds = 600;    // Plays queued in this session this recently are in the live lane
+    bool adaptive_drain = true;       // Tune tracks per request and requests in flight (DrainController)
+    int max_concurrency = 4;          // Most requests in flight per target and run when adaptive
+    int target_latency_ms = 2000;     // Request latency above which the adaptive drain backs off
+    int commit_window_ms = 500;       // Changes this close together share one write (unless per_change)
+    // How queue changes reach the disk
+    Durability durability = Durability::group_commit;
+};
+
+// Where queued tracks are submitted. The default sends them to g_lastfm_api;
+// benchmarks and stress tests install a fake.
+class ScrobbleTransport
+{
+  public:
+    virtual ~ScrobbleTransport() = default;
+    // Returns true if the endpoint is reachable
+    virtual bool is_online() = 0;
+    // Returns true if submissions can be authenticated
+    virtual bool has_session() = 0;
+    // Submits one track; returns true once it has been accepted
+    virtual bool scrobble(const LastfmApi::TrackInfo& track) = 0;
+    // Submits several tracks; results[i] is true once tracks[i] has been accepted.
+    // The default submits them one by one.
+    virtual void scrobble_batch(const std::vector<LastfmApi::TrackInfo>& tracks, std::vector<bool>& results)
+    {
+        results.clear();
+        for (const auto& track : tracks)
+            results.push_back(scrobble(track));
+    }
+    // Most tracks one request takes; the drain controller never hands scrobble_batch() more at once
+    virtual size_t max_batch() const { return LastfmApi::kMaxScrobbleBatch; }
+    // Returns the 429 and 5xx answers the calling thread's requests got since the last call, retried ones
+    // included, and starts counting again. The default reports none.
+    virtual int take_pushback() { return 0; }
+    // Tells the service what is playing now; returns true once it was accepted. The default sends nothing.
+    virtual bool update_now_playing(const LastfmApi::TrackInfo& /*track*/) { return true; }
+    // Loves or unloves a track; returns true once it was accepted. The default sends nothing.
+    virtual bool love(const LastfmApi::TrackInfo& /*track*/, bool /*loved*/) { return true; }
+};
+
+// Identity of one scrobble for de-duplication: the track (as track_match_hash()) and its timestamp
+uint64_t scrobble_key(const std::string& artist, const std::string& track, time_t timestamp);
+
+// Durable play log shared by every scrobbling service ("target"). Each track is stored once; every target
+// keeps its own committed cursor into the log (plus the entries it already delivered out of order and its
+// retry state), submits through its own transport and drains on its own worker, so a slow or offline
+// target never holds back another. The log is stored in segments: the newest entries (the head) live in the
+// queue file and in memory; every kSegmentTracks entries the head is sealed into a segment file of its own,
+// which is only read while a drain walks it and is deleted whole once every target has delivered it. Memory and
+// queue file writes stay bounded however long the machine was offline.
 class ScrobbleQueue
 {
   public:
+    // Changes kept for get_changes()
+    static constexpr size_t kMaxChanges = 4096;
+    // Name of the Last.fm target, registered by the constructor
+    static constexpr const char* kLastfmTarget = "lastfm";
+    // Log entries per sealed segment
+    static constexpr size_t kSegmentTracks = 500;
+    // Sealed segments kept in memory at once
+    static constexpr size_t kResidentSegments = 2;
+
     // Constructor: Initializes the scrobble queue and loads data from disk
     ScrobbleQueue();
-    // Destructor: Saves the queue to disk
+    // Destructor: Stops the workers and saves the queue to disk
     ~ScrobbleQueue();
-    // Adds a track to the scrobble queue
+    // Adds a track to the scrobble queue, unless the same play (track and timestamp) is still in the head
     void add_track(const LastfmApi::TrackInfo& track);
-    // Processes the queue, attempting to scrobble tracks
+    // Queues an operation for the Last.fm target, coalesced with the pending ones as QueueOp describes. A scrobble
+    // is add_track(); the others are sent by the Last.fm worker ahead of the scrobbles.
+    void add_op(QueueOp op, const LastfmApi::TrackInfo& track);
+    // Processes the queue for every target in parallel, attempting to scrobble tracks
     void process_queue();
-    // Returns the current size of the scrobble queue
+    // Processes the queue for one target
+    void process_target(const std::string& name);
+    // Submits tracks straight to the Last.fm transport, bypassing the queue file (bulk imports), and records
+    // the accepted ones like queued scrobbles; returns how many were accepted
+    size_t submit_batch(const std::vector<LastfmApi::TrackInfo>& tracks, std::vector<bool>& results);
+    // Returns the scrobble_key() of every queued track; reads the segments that are not in memory
+    std::unordered_set<uint64_t> pending_keys() const;
+    // Returns the number of tracks some target has not delivered yet
     size_t get_queue_size() const;
+    // Returns the number of tracks a target has not delivered yet (0 for an unknown target)
+    size_t get_pending(const std::string& name) const;
+    // Returns the number of operations other than scrobbles waiting to be sent
+    size_t get_pending_ops() const;
+    // Returns how the log is stored and how much of it is in memory
+    QueueStorage get_storage() const;
     // Clears all tracks from the queue and disk
     void clear_queue();
+    // Returns the version of the undelivered entries; it changes whenever one is added, delivered, deleted or edited
+    uint64_t get_version() const;
+    // Returns up to count undelivered entries starting at the offset-th one, in log order. Only the segments the
+    // window spans are read, with the lock released while their files are.
+    QueuePage get_range(size_t offset, size_t count);
+    // Returns what changed since a version get_range() or get_changes() returned. Only the last kMaxChanges
+    // changes are kept; an older version gets reset.
+    QueueChanges get_changes(uint64_t since);
+    // Deletes undelivered entries by seq, for every target; returns how many were deleted
+    size_t remove_entries(const std::vector<uint64_t>& seqs);
+    // Deletes the undelivered entries match selects, for every target; returns how many were deleted. The log is
+    // walked one segment per lock, so plays and drains go on in between.
+    size_t remove_if(const QueueMatch& match);
+    // Applies edit to the undelivered entries match selects, one segment per lock like remove_if(); returns how
+    // many were edited. A sealed segment holding an edited entry is rewritten.
+    size_t edit_if(const QueueMatch& match, const QueueEdit& edit);
+    // Replaces the scheduling policy
+    void set_policy(const QueuePolicy& policy);
+    // Returns the current scheduling policy
+    QueuePolicy get_policy() const;
+    // Replaces the Last.fm target's transport; nullptr restores the default. Not thread-safe against processing.
+    void set_transport(ScrobbleTransport* transport);
+    // Adds a target fed from the same log. It resumes its saved cursor, or receives tracks queued from now on.
+    // Saved state of a target that is not added again is dropped with the next save.
+    void add_target(const std::string& name, ScrobbleTransport* transport);
+    // Removes a target (not the Last.fm one); tracks only it still needed are dropped once nothing older is pending
+    void remove_target(const std::string& name);
+    // Starts one background worker per target (and for targets added later)
+    void start_workers();
+    // Makes every worker process its target now instead of at the next interval
+    void wake_workers();
+    // Makes the worker of one target process it now
+    void wake_target(const std::string& name);
+    // Stops and joins the workers
+    void stop_workers();
+    // Writes changes still waiting for their group commit to disk now
+    void flush();
 
   private:
-    // Queue of tracks pending scrobble
-    std::vector<QueuedTrack> m_queue;
-    // Mutex for thread-safe queue access
+    // Delivery attempts of one entry to one target
+    struct Attempt
+    {
+        int retry_count = 0;     // Number of failed attempts
+        time_t last_attempt = 0; // Time of the last failed attempt
+    };
+
+    // One scrobbling service fed from the log
+    struct Target
+    {
+        std::string name;
+        ScrobbleTransport* transport = nullptr;
+        // Every entry with seq <= cursor has been delivered
+        uint64_t cursor = 0;
+        // Entries after the cursor already delivered (a failed entry ahead of them is being retried)
+        std::set<uint64_t> acked;
+        // Failed entries after the cursor, by seq
+        std::unordered_map<uint64_t, Attempt> attempts;
+        // Serializes processing so an entry is never submitted twice at once
+        std::mutex process_mutex;
+        // Flag indicating if the endpoint was unreachable during the last check
+        std::atomic<bool> network_was_unavailable{false};
+        // Tracks per request and requests in flight; guarded by process_mutex
+        DrainController controller;
+        // Background worker; wake and stop are guarded by m_worker_mutex
+        std::thread worker;
+        bool wake = false;
+        bool stop = false;
+    };
+
+    // A pending operation other than a scrobble
+    struct PendingOp
+    {
+        uint64_t id = 0; // Matches the result of a send to its op
+        QueueOp op = QueueOp::love;
+        QueuedTrack track;    // queued_at_ms is when the op was queued
+        uint64_t hash = 0;    // track_match_hash() of the track
+        bool sending = false; // Handed to the transport; a later op for the track is queued after it, not merged
+    };
+
+    // Target state read from the queue file, picked up when the target is added
+    struct SavedTarget
+    {
+        uint64_t cursor = 0;
+        std::set<uint64_t> acked;
+        std::unordered_map<uint64_t, Attempt> attempts;
+    };
+
+    // Sealed run of consecutive log entries (first_seq..last_seq, none missing) in a file of its own. Only
+    // edit_if() changes it, by rewriting the file: a drain pages it in to read it, and it is deleted whole once
+    // every target is past last_seq. Deleted entries stay in it, delivered for every target.
+    struct Segment
+    {
+        uint64_t first_seq = 0;
+        uint64_t last_seq = 0;
+        std::vector<QueuedTrack> tracks; // The entries while paged in
+        bool resident = false;
+        uint64_t last_used = 0;  // m_page_clock when last read; the least recently used is evicted
+        uint64_t generation = 0; // Bumped whenever edit_if() rewrites the file
+    };
+
+    // Kinds of change the inspection API reports
+    enum class Change : uint8_t
+    {
+        added,
+        removed,
+        edited
+    };
+
+    // One change of an undelivered entry
+    struct ChangeRecord
+    {
+        uint64_t version = 0; // Version the change is part of
+        Change change = Change::added;
+        uint64_t seq = 0;
+    };
+
+    // Sealed segments, ordered by seq; entries missing between two were delivered by everyone
+    std::deque<Segment> m_segments;
+    // Head segment: the newest entries, consecutive seqs after the sealed ones, kept in the queue file
+    std::vector<QueuedTrack> m_head;
+    uint64_t m_page_clock = 0;
+    // Pending love and unlove operations, oldest first; saved with the queue file
+    std::vector<PendingOp> m_ops;
+    // Newest now-playing update not sent yet; never saved, it is stale by the next start
+    std::optional<PendingOp> m_now_playing;
+    uint64_t m_next_op_id = 1;
+    // Sealed segments dropped from the log; their files go once a queue file without them is written
+    std::vector<uint64_t> m_retired_segments;
+    // Mutex guarding the log, the targets' cursors and the target list; never held during network I/O
     mutable std::mutex m_mutex;
-    // Path to the file storing the scrobble queue
+    // Next log position
+    uint64_t m_next_seq = 1;
+    // Registered targets; the Last.fm target is first
+    std::vector<std::shared_ptr<Target>> m_targets;
+    // State of targets saved in the file but not added yet
+    std::unordered_map<std::string, SavedTarget> m_saved_targets;
+    // Guards the workers' wake/stop flags
+    std::mutex m_worker_mutex;
+    std::condition_variable m_worker_cv;
+    bool m_workers_started = false;
+    // Path to the file storing the scrobble queue (the head segment, the segment list and the targets)
     std::string m_queue_file_path;
+    // Directory of the sealed segment files, named by their first seq
+    std::string m_segment_dir;
+    // Scheduling policy
+    QueuePolicy m_policy;
+    // Bumped by every save_queue() call; writes of an older state than the file holds are skipped
+    uint64_t m_state_version = 0;
+    // Serializes writes of the queue file; taken after m_mutex, never before it
+    std::mutex m_write_mutex;
+    uint64_t m_written_version = 0;
+    // Version of the undelivered entries (get_version()), and the latest changes, oldest first. Every change after
+    // m_changes_since is in m_changes; changes logged since the last publish_changes() carry the next version.
+    uint64_t m_view_version = 0;
+    uint64_t m_changes_since = 0;
+    std::deque<ChangeRecord> m_changes;
+    bool m_changes_pending = false;
+    // Serializes remove_if() and edit_if(), which release m_mutex between segments; taken before m_mutex
+    std::mutex m_edit_mutex;
+    // Submits the due entries of one target and applies the results
+    void drain_target(Target& target);
+    // Sends the pending operations other than scrobbles through the Last.fm target's transport
+    void send_ops(Target& target);
+    // Worker loop of one target
+    void run_worker(std::shared_ptr<Target> target);
+    // Starts the worker of one target; m_worker_mutex must be held
+    void start_worker(const std::shared_ptr<Target>& target);
+    // Returns the registered target with this name; m_mutex must be held
+    std::shared_ptr<Target> find_target(const std::string& name) const;
+    // Returns true if the target has not delivered the entry; m_mutex must be held
+    static bool is_pending(const Target& target, uint64_t seq);
+    // Returns the seq ranges stored in the log, oldest first; m_mutex must be held
+    std::vector<std::pair<uint64_t, uint64_t>> stored_ranges() const;
+    // Returns the number of entries the target has not delivered; m_mutex must be held
+    size_t count_pending(const Target& target) const;
+    // Returns the number of entries some target has not delivered; m_mutex must be held
+    size_t count_undelivered() const;
+    // Returns the target furthest behind (nullptr without targets); m_mutex must be held
+    const Target* slowest_target() const;
+    // Returns true if some target has not delivered the entry; m_mutex must be held
+    bool is_undelivered(uint64_t seq) const;
+    // Returns the stored entry with this seq, paging its segment in; nullptr if it is not stored. m_mutex must be held.
+    QueuedTrack* find_entry(uint64_t seq);
+    // Returns an entry with its retry state; m_mutex must be held
+    QueueEntry make_entry(const QueuedTrack& queued) const;
+    // Marks an undelivered entry delivered for every target and logs it removed; m_mutex must be held
+    void remove_entry(uint64_t seq);
+    // Runs remove_if() (edit empty) or edit_if()
+    size_t update_entries(const QueueMatch& match, const QueueEdit& edit);
+    // Logs a change under the next version; m_mutex must be held
+    void log_change(Change change, uint64_t seq);
+    // Makes the changes logged since the last call the current version; m_mutex must be held
+    void publish_changes();
+    // Forgets the logged changes, so every reader reads its pages again; m_mutex must be held
+    void reset_changes();
+    // Moves the target's cursor past its delivered entries; m_mutex must be held
+    void advance_cursor(Target& target);
+    // Drops the oldest entries every target has delivered: whole sealed segments and the start of the head;
+    // m_mutex must be held
+    void trim();
+    // Writes the head to a new sealed segment file and starts an empty head; m_mutex must be held
+    void seal_head();
+    // Writes a sealed segment file (new or rewritten); false if it could not be written
+    bool write_segment(const std::vector<QueuedTrack>& tracks, bool sync);
+    // Reads a sealed segment into memory, evicting the least recently used one; false if its file is unreadable.
+    // m_mutex must be held.
+    bool page_in(Segment& segment);
+    // Pages in the sealed segment starting at first_seq like page_in(), reading its file with lock released.
+    // Returns the segment, or nullptr if it is gone (delivered meanwhile) or unreadable.
+    Segment* load_segment(uint64_t first_seq, std::unique_lock<std::mutex>& lock);
+    // Keeps a segment's entries in memory, evicting the least recently used one; m_mutex must be held
+    void make_resident(Segment& segment, std::vector<QueuedTrack>&& tracks);
+    // Forgets an unreadable sealed segment and moves the cursors over the gap; m_mutex must be held
+    void drop_segment(size_t index);
+    // Deletes segment files the log does not list (left by a crash, or by a queue file removed by hand)
+    void remove_stray_segments();
+    // Returns the path of the segment file starting at first_seq
+    std::string segment_path(uint64_t first_seq) const;
+    // Reads a segment file; false if it is missing or does not hold first_seq..last_seq
+    bool read_segment(uint64_t first_seq, uint64_t last_seq, std::vector<QueuedTrack>& tracks) const;
     // Loads the queue from disk
     void load_queue();
-    // Saves the queue to disk
+    // Saves the queue to disk as the durability policy says: now, or with the next group commit; m_mutex must be held
     void save_queue();
+    // Returns the queue file contents; m_mutex must be held
+    std::string serialize_queue() const;
+    // Writes a serialized state unless a newer one was written already, then deletes the retired segment files
+    void write_queue(const std::string& data, uint64_t version, bool sync, const std::vector<uint64_t>& retired);
+    // Writes the current state; the group commit runs this
+    void commit_queue();
     // Converts TrackInfo to QueuedTrack for queue storage
     QueuedTrack from_track_info(const LastfmApi::TrackInfo& track);
     // Converts QueuedTrack to TrackInfo for scrobbling
     LastfmApi::TrackInfo to_track_info(const QueuedTrack& queued);
-    // Checks if network is available for scrobbling
-    bool is_network_available();
-    // Flag indicating if network was unavailable during last check
-    bool m_network_was_unavailable = false;
+    // Batches queue writes; declared last so it commits while the state above is still alive
+    GroupCommitter m_committer{[this]() { commit_queue(); }};
 };
 
 extern ScrobbleQueue* g_scrobble_queue;
 
+// Keeps g_scrobble_queue alive for work on another thread than the queue's own workers (the preferences run bulk
+// edits on a GCD queue). on_quit calls wait_queue_uses() before it deletes the queue; a use taken after that is empty.
+class QueueUse
+{
+  public:
+    QueueUse();
+    ~QueueUse();
+    QueueUse(const QueueUse&) = delete;
+    QueueUse& operator=(const QueueUse&) = delete;
+
+    // The queue, or nullptr if there is none or it is about to be deleted
+    ScrobbleQueue* get() const { return m_queue; }
+
+  private:
+    ScrobbleQueue* m_queue = nullptr;
+};
+
+// Refuses new QueueUses and waits for those in flight; call before deleting g_scrobble_queue
+void wait_queue_uses();
+
 } // namespace foo_lastfm
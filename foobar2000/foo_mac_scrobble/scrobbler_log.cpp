@@ -0,0 +1,221 @@
+//
+//  scrobbler_log.cpp
+//  foo_mac_scrobble
+//
+//  Created by Oleksandr Velychko on 18/10/2026.
+//
+
+#include "scrobbler_log.h"
+
+#include "async_logger.h"
+#include "clock.h"
+#include "history_store.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <string_view>
+#include <vector>
+
+namespace foo_lastfm
+{
+
+// Last.fm ignores scrobbles older than this
+static constexpr int64_t kMaxAge = 14 * 24 * 3600;
+// Tolerated clock skew of the player before a timestamp counts as "in the future"
+static constexpr int64_t kMaxSkew = 10 * 60;
+// Tracks must be longer than this to be scrobbled
+static constexpr int kMinDuration = 30;
+
+// Columns of a row: artist, album, title, track number, length, rating, timestamp, MusicBrainz id
+enum LogColumn
+{
+    col_artist = 0,
+    col_album,
+    col_title,
+    col_track_number,
+    col_length,
+    col_rating,
+    col_timestamp,
+    col_count_required
+};
+
+static int64_t parse_int(std::string_view text)
+{
+    int64_t value = 0;
+    bool any = false;
+    for (char c : text)
+    {
+        if (c < '0' || c > '9')
+            return -1;
+        value = value * 10 + (c - '0');
+        any = true;
+    }
+    return any ? value : -1;
+}
+
+// Reads one line into line (without the line break); returns the number of bytes consumed, 0 at the end
+static uint64_t read_line(std::istream& in, std::string& line)
+{
+    if (!std::getline(in, line))
+        return 0;
+    const uint64_t consumed = line.size() + (in.eof() ? 0 : 1);
+    if (!line.empty() && line.back() == '\r')
+        line.pop_back();
+    return consumed;
+}
+
+ScrobblerLogImportResult import_scrobbler_log(ScrobbleQueue& queue, const ScrobblerLogImportOptions& options,
+                                              const std::atomic<bool>& abort,
+                                              std::function<void(uint64_t done, uint64_t total)> progress)
+{
+    const auto start = std::chrono::steady_clock::now();
+    ScrobblerLogImportResult result;
+    result.resume_offset = options.start_offset;
+
+    std::ifstream file(options.path, std::ios::binary);
+    if (!file.is_open())
+    {
+        result.error = "cannot open " + options.path;
+        return result;
+    }
+    file.seekg(0, std::ios::end);
+    const uint64_t file_size = static_cast<uint64_t>(file.tellg());
+    file.seekg(0);
+
+    // Header: "#AUDIOSCROBBLER/1.1", "#TZ/UNKNOWN" or "#TZ/UTC", "#CLIENT/..."
+    std::string line;
+    uint64_t offset = read_line(file, line);
+    if (line.rfind("#AUDIOSCROBBLER/", 0) != 0)
+    {
+        result.error = "not an Audioscrobbler log (missing #AUDIOSCROBBLER header)";
+        return result;
+    }
+    bool local_time = true;
+    while (file.peek() == '#')
+    {
+        offset += read_line(file, line);
+        if (line == "#TZ/UTC")
+            local_time = false;
+    }
+    if (options.start_offset > offset)
+    {
+        if (options.start_offset > file_size)
+        {
+            result.error = "resume offset is past the end of the file";
+            return result;
+        }
+        file.seekg(static_cast<std::streamoff>(options.start_offset));
+        offset = options.start_offset;
+    }
+    result.resume_offset = offset;
+
+    const int64_t now = current_clock().now_seconds();
+    const int64_t shift = local_time ? options.utc_offset_seconds : 0;
+    const std::unordered_set<uint64_t> queued = queue.pending_keys();
+    std::vector<LastfmApi::TrackInfo> batch;
+    std::vector<uint64_t> batch_keys;
+    std::vector<bool> results;
+    batch.reserve(LastfmApi::kMaxScrobbleBatch);
+
+    // Submits the batch; rows up to offset are then done
+    auto flush = [&]() -> bool
+    {
+        if (!batch.empty())
+        {
+            if (abort.load())
+                return false;
+            const size_t accepted = queue.submit_batch(batch, results);
+            result.submitted += accepted;
+            if (accepted < batch.size())
+            {
+                // Accepted rows are in the history now, so a resume skips them as duplicates
+                LASTFM_LOG_INFO("Last.fm: Log import stopped, %zu of %zu scrobbles in a batch were not accepted",
+                                batch.size() - accepted, batch.size());
+                return false;
+            }
+            batch.clear();
+            batch_keys.clear();
+            if (progress)
+                progress(offset, file_size);
+        }
+        result.resume_offset = offset;
+        return true;
+    };
+
+    bool accepted = true;
+    std::string_view columns[col_count_required];
+    for (uint64_t consumed = read_line(file, line); consumed > 0; consumed = read_line(file, line))
+    {
+        offset += consumed;
+        if (line.empty() || line[0] == '#')
+            continue;
+        ++result.rows;
+
+        size_t count = 0;
+        std::string_view rest(line);
+        while (count < col_count_required)
+        {
+            const size_t tab = rest.find('\t');
+            columns[count++] = rest.substr(0, tab);
+            if (tab == std::string_view::npos)
+                break;
+            rest.remove_prefix(tab + 1);
+        }
+
+        const int64_t logged_at = count == col_count_required ? parse_int(columns[col_timestamp]) : -1;
+        if (logged_at <= 0 || columns[col_artist].empty() || columns[col_title].empty())
+        {
+            ++result.invalid;
+            continue;
+        }
+        const int64_t length = parse_int(columns[col_length]);
+        if (columns[col_rating] == "S" || length <= kMinDuration)
+        {
+            ++result.skipped;
+            continue;
+        }
+        const int64_t timestamp = logged_at - shift;
+        if (timestamp > now + kMaxSkew)
+        {
+            ++result.invalid;
+            continue;
+        }
+        if (timestamp < now - kMaxAge)
+        {
+            ++result.too_old;
+            continue;
+        }
+
+        LastfmApi::TrackInfo track;
+        track.artist.assign(columns[col_artist]);
+        track.track.assign(columns[col_title]);
+        track.album.assign(columns[col_album]);
+        track.duration = static_cast<int>(length);
+        track.track_number = static_cast<int>(std::max<int64_t>(0, parse_int(columns[col_track_number])));
+        track.timestamp = static_cast<time_t>(timestamp);
+
+        // Rows of earlier batches are in the history by now, so this also catches repeats within the file
+        const uint64_t key = scrobble_key(track.artist, track.track, track.timestamp);
+        if (queued.count(key) != 0 || std::find(batch_keys.begin(), batch_keys.end(), key) != batch_keys.end() ||
+            (g_scrobble_history && g_scrobble_history->count_artist_plays(track.artist, timestamp, timestamp + 1) > 0))
+        {
+            ++result.duplicates;
+            continue;
+        }
+
+        batch.push_back(std::move(track));
+        batch_keys.push_back(key);
+        if (batch.size() == LastfmApi::kMaxScrobbleBatch && !flush())
+        {
+            accepted = false;
+            break;
+        }
+    }
+
+    result.complete = accepted && flush() && offset == file_size;
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+} // namespace foo_lastfm
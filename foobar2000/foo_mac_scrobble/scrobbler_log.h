@@ -0,0 +1,51 @@
+//
+//  scrobbler_log.h
+//  foo_mac_scrobble
+//
+//  Created by Oleksandr Velychko on 18/10/2026.
+//
+
+#pragma once
+
+#include "scrobble_queue.h"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace foo_lastfm
+{
+
+// What to import and how
+struct ScrobblerLogImportOptions
+{
+    std::string path;               // .scrobbler.log file written by a portable player
+    uint64_t start_offset = 0;      // Byte offset to resume from (a previous result's resume_offset)
+    int64_t utc_offset_seconds = 0; // How far the player's clock is ahead of UTC; used for "#TZ/UNKNOWN" logs
+};
+
+// Outcome of an import
+struct ScrobblerLogImportResult
+{
+    bool complete = false;      // The whole file was read and every batch was accepted
+    std::string error;          // Why the file could not be read (empty otherwise)
+    uint64_t rows = 0;          // Track rows read
+    uint64_t submitted = 0;     // Rows accepted by Last.fm
+    uint64_t skipped = 0;       // Rows the player marked as skipped ("S") or 30 seconds or shorter
+    uint64_t invalid = 0;       // Rows with missing fields or an unusable timestamp (in the future)
+    uint64_t too_old = 0;       // Rows older than Last.fm accepts (14 days)
+    uint64_t duplicates = 0;    // Rows already queued, in the local history or repeated in the file
+    uint64_t resume_offset = 0; // Offset of the first row not yet submitted; pass it back to continue
+    double seconds = 0;         // Wall time of the import
+};
+
+// Streams an Audioscrobbler .scrobbler.log (AUDIOSCROBBLER/1.1 TSV) into Last.fm, one line at a time, in
+// batches of LastfmApi::kMaxScrobbleBatch through ScrobbleQueue::submit_batch(), so memory stays constant
+// however long the log is. Rows already in the queue or in the local history are not submitted again.
+// Stops at the first failed batch, or when abort becomes true, with resume_offset pointing at that batch.
+ScrobblerLogImportResult import_scrobbler_log(ScrobbleQueue& queue, const ScrobblerLogImportOptions& options,
+                                              const std::atomic<bool>& abort,
+                                              std::function<void(uint64_t done, uint64_t total)> progress = nullptr);
+
+} // namespace foo_lastfm
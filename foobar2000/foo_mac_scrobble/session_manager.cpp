@@ -7,13 +7,14 @@
 
 #include "session_manager.h"
 
-#include "config.h"
+#include "async_logger.h"
+#include "platform.h"
 #include "safe_log_utils.h"
 
 #include <filesystem>
 #include <fstream>
+#include <iomanip>
 #include <nlohmann/json.hpp>
-#include <pfc/string_base.h>
 
 using json = nlohmann::json;
 
@@ -25,33 +26,11 @@ SessionManager* g_session_manager = nullptr;
 SessionManager::SessionManager()
 {
     // Initialize session manager and determine file path
-    pfc::string8 profileDir = core_api::get_profile_path();
-
-    // Check and remove the "file://" prefix
-    const char* prefix = "file://";
-    if (strncmp(profileDir.c_str(), prefix, 7) == 0)
-    {
-        // Create a new string without the prefix
-        pfc::string8 temp;
-        temp.add_string(profileDir.c_str() + 7);
-        profileDir = temp;
-    }
-
-    // Make sure the ending "/" is present
-    if (profileDir.length() > 0 && profileDir[profileDir.length() - 1] != '/')
-        profileDir.add_char('/');
-
-    // Build the full path to the JSON file
-    pfc::string8 sessionPath;
-    sessionPath << profileDir << "lastfm_session.json";
-    m_session_file_path = sessionPath.get_ptr();
+    m_session_file_path = platform().profile_dir() + "lastfm_session.json";
 
     // Debug Logging
-    if (foo_lastfm::cfg_debug_enabled.get())
-    {
-        FB2K_console_formatter() << "Last.fm: SessionManager initialized (path: " << m_session_file_path.c_str() << ")";
-        FB2K_console_formatter() << "Last.fm: SessionManager ready (file path: " << m_session_file_path.c_str() << ")";
-    }
+    LASTFM_LOG_DEBUG("Last.fm: SessionManager initialized (path: %s)", m_session_file_path);
+    LASTFM_LOG_DEBUG("Last.fm: SessionManager ready (file path: %s)", m_session_file_path);
 }
 
 SessionManager::~SessionManager() {}
@@ -62,10 +41,7 @@ bool SessionManager::load_session(std::string& session_key, std::string& usernam
     std::ifstream f(m_session_file_path);
     if (!f.good())
     {
-        if (foo_lastfm::cfg_debug_enabled.get())
-        {
-            FB2K_console_formatter() << "Last.fm: No existing session file found at " << m_session_file_path.c_str();
-        }
+        LASTFM_LOG_DEBUG("Last.fm: No existing session file found at %s", m_session_file_path);
         return false;
     }
 
@@ -80,25 +56,19 @@ bool SessionManager::load_session(std::string& session_key, std::string& usernam
             session_key = j["session_key"].get<std::string>();
             username = j["username"].get<std::string>();
 
-            if (foo_lastfm::cfg_debug_enabled.get())
-            {
-                FB2K_console_formatter() << "Last.fm: Session loaded from disk (username: " << username.c_str() << ")";
-            }
+            LASTFM_LOG_DEBUG("Last.fm: Session loaded from disk (username: %s)", username);
 
             return true;
         }
         else
         {
-            if (foo_lastfm::cfg_debug_enabled.get())
-            {
-                FB2K_console_formatter() << "Last.fm: Session file found, but missing required fields";
-            }
+            LASTFM_LOG_DEBUG("Last.fm: Session file found, but missing required fields");
             return false;
         }
     }
     catch (const std::exception& e)
     {
-        FB2K_console_formatter() << "Last.fm ERROR: Failed to parse session file (" << e.what() << ")";
+        LASTFM_LOG_INFO("Last.fm ERROR: Failed to parse session file (%s)", e.what());
         return false;
     }
 }
@@ -113,20 +83,15 @@ void SessionManager::save_session(const std::string& session_key, const std::str
     std::ofstream f(m_session_file_path);
     if (!f.good())
     {
-        FB2K_console_formatter() << "Last.fm ERROR: Cannot open session file for writing: "
-                                 << m_session_file_path.c_str();
+        LASTFM_LOG_INFO("Last.fm ERROR: Cannot open session file for writing: %s", m_session_file_path);
         return;
     }
 
     f << std::setw(4) << j << std::endl;
     f.close();
 
-    if (foo_lastfm::cfg_debug_enabled.get())
-    {
-        FB2K_console_formatter() << "Last.fm: Session saved to disk at " << m_session_file_path.c_str();
-        FB2K_console_formatter() << "Last.fm: Saved session for user: " << username.c_str()
-                                 << " (key length: " << (int)session_key.length() << ")";
-    }
+    LASTFM_LOG_DEBUG("Last.fm: Session saved to disk at %s", m_session_file_path);
+    LASTFM_LOG_DEBUG("Last.fm: Saved session for user: %s (key length: %zu)", username, session_key.length());
 }
 
 void SessionManager::clear_session()
@@ -137,15 +102,12 @@ void SessionManager::clear_session()
         if (std::filesystem::exists(m_session_file_path))
         {
             std::filesystem::remove(m_session_file_path);
-            if (foo_lastfm::cfg_debug_enabled.get())
-            {
-                FB2K_console_formatter() << "Last.fm: Session file deleted: " << m_session_file_path.c_str();
-            }
+            LASTFM_LOG_DEBUG("Last.fm: Session file deleted: %s", m_session_file_path);
         }
     }
     catch (const std::exception& e)
     {
-        FB2K_console_formatter() << "Last.fm ERROR: Failed to delete session file (" << e.what() << ")";
+        LASTFM_LOG_INFO("Last.fm ERROR: Failed to delete session file (%s)", e.what());
     }
 }
 
@@ -0,0 +1,43 @@
+//
+//  alloc_counter.cpp
+//  foo_mac_scrobble
+//
+//  Created by Oleksandr Velychko on 18/10/2026.
+//
+
+#include "alloc_counter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<uint64_t> g_allocations{0};
+
+// Kept in their own file, so no caller sees them inlined next to the library's allocations
+void* operator new(std::size_t size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* block = std::malloc(size ? size : 1))
+        return block;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* block) noexcept
+{
+    std::free(block);
+}
+
+void operator delete(void* block, std::size_t) noexcept
+{
+    std::free(block);
+}
+
+namespace foo_lastfm
+{
+
+uint64_t allocation_count()
+{
+    return g_allocations.load(std::memory_order_relaxed);
+}
+
+} // namespace foo_lastfm
@@ -0,0 +1,19 @@
+//
+//  alloc_counter.h
+//  foo_mac_scrobble
+//
+//  Created by Oleksandr Velychko on 18/10/2026.
+//
+
+#pragma once
+
+#include <cstdint>
+
+namespace foo_lastfm
+{
+
+// Heap allocations (operator new) the process made so far. scrobblectl replaces the global operator new and
+// delete to count them; the count is process-wide, so read it around single-threaded work.
+uint64_t allocation_count();
+
+} // namespace foo_lastfm
@@ -0,0 +1,222 @@
+//
+//  queue_stress.cpp
+//  foo_mac_scrobble
+//
+//  Created by Oleksandr Velychko on 18/10/2026.
+//
+
+#include "queue_stress.h"
+
+#include "../platform.h"
+#include "../scrobble_queue.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace foo_lastfm
+{
+
+namespace
+{
+
+// Accepts or rejects submissions in memory and counts how often each track was accepted
+class FakeTransport : public ScrobbleTransport
+{
+  public:
+    FakeTransport(double failure_rate, int latency_us, uint32_t seed)
+        : m_failure_rate(failure_rate), m_latency_us(latency_us), m_rng(seed)
+    {
+    }
+
+    bool is_online() override { return true; }
+    bool has_session() override { return true; }
+
+    bool scrobble(const LastfmApi::TrackInfo& track) override
+    {
+        if (m_latency_us > 0)
+            std::this_thread::sleep_for(std::chrono::microseconds(m_latency_us));
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_failure_rate > 0 && m_unit(m_rng) < m_failure_rate)
+        {
+            ++m_rejected;
+            return false;
+        }
+        ++m_accepted[track.track];
+        return true;
+    }
+
+    // Number of times each track title was accepted
+    std::unordered_map<std::string, int> accepted()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_accepted;
+    }
+    uint64_t rejected()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_rejected;
+    }
+
+  private:
+    double m_failure_rate;
+    int m_latency_us;
+    std::mutex m_mutex;
+    std::mt19937 m_rng;
+    std::uniform_real_distribution<double> m_unit{0.0, 1.0};
+    std::unordered_map<std::string, int> m_accepted;
+    uint64_t m_rejected = 0;
+};
+
+double seconds_between(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to)
+{
+    return std::chrono::duration<double>(to - from).count();
+}
+
+} // namespace
+
+StressResult run_queue_stress(const StressConfig& config)
+{
+    StressResult result;
+
+    std::error_code ec;
+    std::filesystem::remove(platform().profile_dir() + "lastfm_scrobble_queue.json", ec);
+
+    FakeTransport transport(config.failure_rate, config.submit_latency_us, config.seed);
+    LatencyHistogram enqueue_latency;
+    std::atomic<bool> stop{false};
+    std::atomic<int> producers_running{config.producers};
+
+    ScrobbleQueue queue;
+    queue.set_transport(&transport);
+    QueuePolicy policy;
+    policy.max_per_run = config.batch;
+    policy.backoff_base_seconds = 0; // Retry failed entries on the next pass
+    queue.set_policy(policy);
+
+    std::vector<std::thread> background;
+    for (int w = 0; w < config.workers; ++w)
+    {
+        background.emplace_back(
+            [&]()
+            {
+                while (!stop.load())
+                {
+                    queue.process_queue();
+                    std::this_thread::yield();
+                }
+            });
+    }
+    for (int r = 0; r < config.readers; ++r)
+    {
+        background.emplace_back(
+            [&]()
+            {
+                size_t sink = 0;
+                while (!stop.load())
+                    sink += queue.get_queue_size();
+                (void)sink;
+            });
+    }
+    if (config.with_clear)
+    {
+        background.emplace_back(
+            [&]()
+            {
+                while (!stop.load() && producers_running.load() > 0)
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                    queue.clear_queue();
+                }
+            });
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> producers;
+    for (int p = 0; p < config.producers; ++p)
+    {
+        producers.emplace_back(
+            [&, p]()
+            {
+                for (int i = 0; i < config.tracks_per_producer; ++i)
+                {
+                    LastfmApi::TrackInfo track;
+                    track.artist = "Stress Artist " + std::to_string(p);
+                    track.track = "p" + std::to_string(p) + "-" + std::to_string(i);
+                    track.album = "Stress Album";
+                    track.duration = 200;
+                    track.timestamp = 1767225600 + i;
+
+                    const auto t0 = std::chrono::steady_clock::now();
+                    queue.add_track(track);
+                    enqueue_latency.record(
+                        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t0));
+                }
+                producers_running.fetch_sub(1);
+            });
+    }
+    for (auto& t : producers)
+        t.join();
+    const auto produced = std::chrono::steady_clock::now();
+
+    // Let the workers drain what is left (bounded so a stuck queue still reports)
+    const auto deadline = produced + std::chrono::seconds(120);
+    while (queue.get_queue_size() > 0 && std::chrono::steady_clock::now() < deadline)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    const auto drained = std::chrono::steady_clock::now();
+
+    stop.store(true);
+    for (auto& t : background)
+        t.join();
+
+    result.enqueued = static_cast<uint64_t>(config.producers) * config.tracks_per_producer;
+    result.left_in_queue = queue.get_queue_size();
+    result.rejected = transport.rejected();
+    result.produce_seconds = seconds_between(start, produced);
+    result.drain_seconds = seconds_between(produced, drained);
+    result.enqueue_latency = enqueue_latency.snapshot();
+
+    const auto accepted = transport.accepted();
+    for (const auto& [title, count] : accepted)
+    {
+        result.accepted += count;
+        if (count > 1)
+            result.duplicates += count - 1;
+    }
+    if (!config.with_clear)
+        result.lost = result.enqueued - accepted.size() - result.left_in_queue;
+
+    return result;
+}
+
+std::string format_stress_result(const StressConfig& config, const StressResult& result)
+{
+    const HistogramSnapshot& h = result.enqueue_latency;
+    const double total = result.produce_seconds + result.drain_seconds;
+
+    char buf[1024];
+    snprintf(buf, sizeof(buf),
+             "Threads: %d producers, %d workers, %d readers%s; batch=%d, failure rate %.0f%%, latency %dus\n"
+             "Enqueued %llu tracks in %.3fs (%.0f tracks/s)\n"
+             "add_track latency: mean=%lluus p50<=%lluus p90<=%lluus p99<=%lluus max=%lluus\n"
+             "Accepted %llu (%llu rejected and retried), drain after last add %.3fs, %.0f tracks/s overall\n"
+             "Duplicates: %llu, lost: %llu, left in queue: %zu -> %s",
+             config.producers, config.workers, config.readers, config.with_clear ? ", 1 clearer" : "", config.batch,
+             config.failure_rate * 100, config.submit_latency_us, (unsigned long long)result.enqueued,
+             result.produce_seconds, result.enqueued / result.produce_seconds, (unsigned long long)h.mean_us(),
+             (unsigned long long)h.percentile_us(50), (unsigned long long)h.percentile_us(90),
+             (unsigned long long)h.percentile_us(99), (unsigned long long)h.max_us,
+             (unsigned long long)result.accepted, (unsigned long long)result.rejected, result.drain_seconds,
+             total > 0 ? result.accepted / total : 0.0, (unsigned long long)result.duplicates,
+             (unsigned long long)result.lost, result.left_in_queue, result.passed() ? "PASS" : "FAIL");
+    return buf;
+}
+
+} // namespace foo_lastfm
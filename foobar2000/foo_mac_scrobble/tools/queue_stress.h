@@ -0,0 +1,56 @@
+//
+//  queue_stress.h
+//  foo_mac_scrobble
+//
+//  Created by Oleksandr Velychko on 18/10/2026.
+//
+
+#pragma once
+
+#include "../metrics.h"
+
+#include <cstdint>
+#include <string>
+
+namespace foo_lastfm
+{
+
+// Thread mix and fake transport behaviour for one stress run
+struct StressConfig
+{
+    int producers = 4;             // Threads calling add_track() (the playback callback)
+    int tracks_per_producer = 250; // Tracks each producer adds
+    int workers = 2;               // Threads calling process_queue() (worker thread, playback callback)
+    int readers = 2;               // Threads calling get_queue_size() (preferences UI)
+    bool with_clear = false;       // Also call clear_queue() every 20 ms; disables the lost-entry check
+    double failure_rate = 0.0;     // Fraction of fake submissions that fail and are retried
+    int submit_latency_us = 0;     // Fake network latency per submission
+    int batch = 50;                // QueuePolicy::max_per_run
+    uint32_t seed = 1;             // Seed for fake failures
+};
+
+// Outcome of one stress run
+struct StressResult
+{
+    uint64_t enqueued = 0;      // Tracks added by the producers
+    uint64_t accepted = 0;      // Successful fake submissions
+    uint64_t rejected = 0;      // Failed fake submissions
+    uint64_t duplicates = 0;    // Tracks accepted more than once
+    uint64_t lost = 0;          // Tracks never accepted (only checked without clear_queue())
+    size_t left_in_queue = 0;   // Entries still queued when the drain timed out
+    double produce_seconds = 0; // Time until all producers finished
+    double drain_seconds = 0;   // Time from the last add_track() until the queue was empty
+    HistogramSnapshot enqueue_latency;
+
+    // True if no entry was lost or duplicated
+    bool passed() const { return duplicates == 0 && lost == 0 && left_in_queue == 0; }
+};
+
+// Hammers a ScrobbleQueue from many threads with a fake transport. Starts from an empty queue file in
+// the platform profile directory.
+StressResult run_queue_stress(const StressConfig& config);
+
+// Formats a multi-line report of a run
+std::string format_stress_result(const StressConfig& config, const StressResult& result);
+
+} // namespace foo_lastfm
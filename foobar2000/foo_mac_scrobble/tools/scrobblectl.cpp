@@ -0,0 +1,2342 @@
+//
+//  scrobblectl.cpp
+//  foo_mac_scrobble
+//
+//  Created by Oleksandr Velychko on 18/10/2026.
+//
+
+// Headless driver for the scrobbler core. Runs LastfmApi / ScrobbleQueue / SessionManager
+// outside foobar2000 so the queue can be inspected, drained and benchmarked on Linux or macOS.
+// Build with "make -C tools" (see tools/Makefile).
+
+#include "../api_cache.h"
+#include "../api_response.h"
+#include "../async_logger.h"
+#include "../clock.h"
+#include "../history_store.h"
+#include "../lastfm_api.h"
+#include "../listenbrainz.h"
+#include "../metrics.h"
+#include "../platform.h"
+#include "../playback_tracker.h"
+#include "../playcount_sync.h"
+#include "../scrobble_queue.h"
+#include "../scrobbler_log.h"
+#include "../session_manager.h"
+#include "alloc_counter.h"
+#include "queue_stress.h"
+#include "simulator.h"
+#include "standin_server.h"
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <nlohmann/json.hpp>
+#include <openssl/evp.h>
+#include <random>
+#include <sstream>
+#include <string>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_set>
+#include <vector>
+
+using namespace foo_lastfm;
+
+namespace
+{
+
+// ============================================================
+// POSIX platform: plain directory, OpenSSL MD5, no main thread
+// ============================================================
+class PosixPlatform : public Platform
+{
+  public:
+    explicit PosixPlatform(std::string dir) : m_dir(std::move(dir))
+    {
+        if (!m_dir.empty() && m_dir.back() != '/')
+            m_dir += '/';
+    }
+
+    std::string profile_dir() override { return m_dir; }
+
+    std::string md5_hex(const std::string& data) override
+    {
+        unsigned char hash[EVP_MAX_MD_SIZE];
+        unsigned int length = 0;
+        EVP_Digest(data.data(), data.size(), hash, &length, EVP_md5(), nullptr);
+
+        static const char* digits = "0123456789abcdef";
+        std::string out;
+        for (unsigned int i = 0; i < length; ++i)
+        {
+            out += digits[hash[i] >> 4];
+            out += digits[hash[i] & 0x0f];
+        }
+        return out;
+    }
+
+    // There is no UI thread; callbacks run on the calling thread
+    void run_on_main_thread(std::function<void()> fn) override { fn(); }
+    void store_username(const std::string& username) override { m_username = username; }
+    void store_session_key(const std::string& session_key) override { m_session_key = session_key; }
+
+  private:
+    std::string m_dir;
+    std::string m_username;
+    std::string m_session_key;
+};
+
+// ============================================================
+// Commands
+// ============================================================
+struct Options
+{
+    std::string profile = "scrobblectl-profile";
+    std::string endpoint;
+    std::string api_key;
+    std::string api_secret;
+    std::string session_key;
+    std::string listenbrainz_url;
+    std::string listenbrainz_token;
+    bool debug = false;
+};
+
+double seconds_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// The queue file and the directory of its sealed segments, as ScrobbleQueue names them in the profile
+const char* const kQueueFiles[] = {"lastfm_scrobble_queue.json", "lastfm_scrobble_queue.segments"};
+
+// Replaces the queue stored in to_dir with the one in from_dir
+void copy_queue(const std::string& from_dir, const std::string& to_dir)
+{
+    for (const char* name : kQueueFiles)
+    {
+        std::filesystem::remove_all(to_dir + name);
+        if (std::filesystem::exists(from_dir + name))
+            std::filesystem::copy(from_dir + name, to_dir + name, std::filesystem::copy_options::recursive);
+    }
+}
+
+// Bytes of the queue file and its segment files
+uintmax_t queue_bytes(const std::string& dir)
+{
+    std::error_code ec;
+    uintmax_t bytes = std::filesystem::file_size(dir + kQueueFiles[0], ec);
+    if (ec)
+        bytes = 0;
+    for (std::filesystem::directory_iterator it(dir + kQueueFiles[1], ec), end; !ec && it != end; it.increment(ec))
+        bytes += it->file_size();
+    return bytes;
+}
+
+// Calls process_queue() until the queue is empty or a cycle makes no progress
+size_t drain_queue(ScrobbleQueue& queue)
+{
+    size_t submitted = 0;
+    for (;;)
+    {
+        const size_t before = queue.get_queue_size();
+        if (before == 0)
+            break;
+        queue.process_queue();
+        const size_t after = queue.get_queue_size();
+        if (after >= before)
+            break;
+        submitted += before - after;
+    }
+    return submitted;
+}
+
+// Calls process_target() until the target has nothing pending or a cycle makes no progress
+size_t drain_target(ScrobbleQueue& queue, const std::string& name)
+{
+    size_t submitted = 0;
+    for (;;)
+    {
+        const size_t before = queue.get_pending(name);
+        if (before == 0)
+            break;
+        queue.process_target(name);
+        const size_t after = queue.get_pending(name);
+        if (after >= before)
+            break;
+        submitted += before - after;
+    }
+    return submitted;
+}
+
+void print_metrics()
+{
+    const std::string report = format_metrics_report(g_metrics.snapshot());
+    printf("%s\n", report.c_str());
+}
+
+int cmd_enqueue(ScrobbleQueue& queue, const std::vector<std::string>& args)
+{
+    if (args.size() < 2)
+    {
+        fprintf(stderr, "enqueue: ARTIST and TITLE are required\n");
+        return 2;
+    }
+
+    LastfmApi::TrackInfo track;
+    track.artist = args[0];
+    track.track = args[1];
+    track.album = args.size() > 2 ? args[2] : "";
+    track.duration = args.size() > 3 ? atoi(args[3].c_str()) : 0;
+    track.timestamp = time(nullptr);
+    queue.add_track(track);
+    printf("Queued %s - %s (%zu tracks in queue)\n", track.artist.c_str(), track.track.c_str(),
+           queue.get_queue_size());
+    return 0;
+}
+
+int cmd_drain(ScrobbleQueue& queue)
+{
+    const auto start = std::chrono::steady_clock::now();
+    const size_t submitted = drain_queue(queue);
+    const double elapsed = seconds_since(start);
+    printf("Submitted %zu tracks in %.2fs, %zu left in queue\n", submitted, elapsed, queue.get_queue_size());
+    return queue.get_queue_size() == 0 ? 0 : 1;
+}
+
+int cmd_list(ScrobbleQueue& queue, const std::vector<std::string>& args)
+{
+    const size_t offset = args.empty() ? 0 : strtoull(args[0].c_str(), nullptr, 10);
+    const size_t count = args.size() > 1 ? strtoull(args[1].c_str(), nullptr, 10) : 50;
+    const QueuePage page = queue.get_range(offset, count);
+    for (const auto& entry : page.entries)
+    {
+        const time_t played = entry.track.timestamp;
+        char when[32];
+        strftime(when, sizeof(when), "%Y-%m-%d %H:%M", localtime(&played));
+        printf("%8llu  %s  %s - %s", (unsigned long long)entry.track.seq, when, entry.track.artist.c_str(),
+               entry.track.track.c_str());
+        if (entry.retry_count > 0)
+            printf("  (%d failed attempts)", entry.retry_count);
+        printf("\n");
+    }
+    printf("%zu-%zu of %zu tracks in queue\n", page.entries.empty() ? 0 : offset + 1, offset + page.entries.size(),
+           page.total);
+    return 0;
+}
+
+int cmd_delete_artist(ScrobbleQueue& queue, const std::vector<std::string>& args)
+{
+    if (args.empty())
+    {
+        fprintf(stderr, "delete-artist: ARTIST is required\n");
+        return 2;
+    }
+    const std::string& artist = args[0];
+    const size_t removed = queue.remove_if([&artist](const QueuedTrack& queued) { return queued.artist == artist; });
+    queue.flush();
+    printf("Deleted %zu tracks by %s, %zu left in queue\n", removed, artist.c_str(), queue.get_queue_size());
+    return 0;
+}
+
+int cmd_bench(ScrobbleQueue& queue, const std::vector<std::string>& args)
+{
+    const int tracks = args.empty() ? 1000 : atoi(args[0].c_str());
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < tracks; ++i)
+    {
+        LastfmApi::TrackInfo track;
+        track.artist = "Bench Artist " + std::to_string(i % 50);
+        track.track = "Bench Track " + std::to_string(i);
+        track.album = "Bench Album";
+        track.duration = 180;
+        track.timestamp = time(nullptr) - tracks + i;
+        queue.add_track(track);
+    }
+    const double enqueue_s = seconds_since(start);
+
+    start = std::chrono::steady_clock::now();
+    const size_t submitted = drain_queue(queue);
+    const double drain_s = seconds_since(start);
+
+    printf("Enqueue: %d tracks in %.3fs (%.0f tracks/s)\n", tracks, enqueue_s, tracks / enqueue_s);
+    printf("Drain:   %zu tracks in %.3fs (%.0f tracks/s)\n", submitted, drain_s, submitted / drain_s);
+    print_metrics();
+    return submitted == static_cast<size_t>(tracks) ? 0 : 1;
+}
+
+// Parses "10,50,100" into a list of integers
+std::vector<int> parse_int_list(const std::string& value)
+{
+    std::vector<int> out;
+    std::stringstream ss(value);
+    std::string item;
+    while (std::getline(ss, item, ','))
+    {
+        if (!item.empty())
+            out.push_back(atoi(item.c_str()));
+    }
+    return out;
+}
+
+int cmd_simulate(const std::vector<std::string>& args, bool verbose)
+{
+    SimulationConfig base;
+    std::vector<int> batches = {base.policy.max_per_run};
+    std::vector<int> backoffs = {base.policy.backoff_base_seconds};
+    std::vector<int> intervals = {base.policy.worker_interval_seconds};
+    std::vector<int> live_weights = {base.policy.live_weight};
+
+    for (size_t i = 0; i < args.size(); ++i)
+    {
+        const std::string& arg = args[i];
+        const std::string value = i + 1 < args.size() ? args[i + 1] : "";
+        if (arg == "--days")
+            base.days = atoi(value.c_str());
+        else if (arg == "--hours")
+            base.listening_hours = atoi(value.c_str());
+        else if (arg == "--track-seconds")
+            base.track_seconds = atoi(value.c_str());
+        else if (arg == "--error-rate")
+            base.error_rate = atof(value.c_str());
+        else if (arg == "--seed")
+            base.seed = static_cast<uint32_t>(strtoul(value.c_str(), nullptr, 10));
+        else if (arg == "--outage")
+        {
+            // START_HOUR+DURATION_HOURS, e.g. 30+12 is offline from day 2 06:00 to 18:00
+            const size_t plus = value.find('+');
+            if (plus == std::string::npos)
+            {
+                fprintf(stderr, "simulate: --outage expects START_HOUR+DURATION_HOURS\n");
+                return 2;
+            }
+            base.outages.push_back({static_cast<int64_t>(atof(value.substr(0, plus).c_str()) * 3600),
+                                    static_cast<int64_t>(atof(value.substr(plus + 1).c_str()) * 3600)});
+        }
+        else if (arg == "--batch")
+            batches = parse_int_list(value);
+        else if (arg == "--backoff")
+            backoffs = parse_int_list(value);
+        else if (arg == "--interval")
+            intervals = parse_int_list(value);
+        else if (arg == "--live-weight")
+            live_weights = parse_int_list(value);
+        else
+        {
+            fprintf(stderr, "simulate: unknown option %s\n", arg.c_str());
+            return 2;
+        }
+        ++i;
+    }
+
+    // Keep per-track log lines out of the report unless asked for
+    if (!verbose)
+        g_logger.set_sink([](const char*) {});
+
+    printf("Simulating %d days, %dh/day, %zu outages, %.1f%% server errors\n", base.days, base.listening_hours,
+           base.outages.size(), base.error_rate * 100);
+    printf("%s\n", simulation_result_header().c_str());
+    for (int batch : batches)
+    {
+        for (int backoff : backoffs)
+        {
+            for (int interval : intervals)
+            {
+                for (int live_weight : live_weights)
+                {
+                    SimulationConfig config = base;
+                    config.policy.max_per_run = batch;
+                    config.policy.backoff_base_seconds = backoff;
+                    config.policy.worker_interval_seconds = interval;
+                    config.policy.live_weight = live_weight;
+                    const SimulationResult result = run_simulation(config);
+                    printf("%s\n", format_simulation_result(config, result).c_str());
+                    fflush(stdout);
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+int cmd_stress(const std::vector<std::string>& args, bool verbose)
+{
+    StressConfig config;
+    for (size_t i = 0; i < args.size(); ++i)
+    {
+        const std::string& arg = args[i];
+        const std::string value = i + 1 < args.size() ? args[i + 1] : "";
+        if (arg == "--clear")
+        {
+            config.with_clear = true;
+            continue;
+        }
+        if (arg == "--producers")
+            config.producers = atoi(value.c_str());
+        else if (arg == "--tracks")
+            config.tracks_per_producer = atoi(value.c_str());
+        else if (arg == "--workers")
+            config.workers = atoi(value.c_str());
+        else if (arg == "--readers")
+            config.readers = atoi(value.c_str());
+        else if (arg == "--failure-rate")
+            config.failure_rate = atof(value.c_str());
+        else if (arg == "--latency-us")
+            config.submit_latency_us = atoi(value.c_str());
+        else if (arg == "--batch")
+            config.batch = atoi(value.c_str());
+        else if (arg == "--seed")
+            config.seed = static_cast<uint32_t>(strtoul(value.c_str(), nullptr, 10));
+        else
+        {
+            fprintf(stderr, "stress: unknown option %s\n", arg.c_str());
+            return 2;
+        }
+        ++i;
+    }
+
+    if (!verbose)
+        g_logger.set_sink([](const char*) {});
+
+    const StressResult result = run_queue_stress(config);
+    printf("%s\n", format_stress_result(config, result).c_str());
+    return result.passed() ? 0 : 1;
+}
+
+// Prints what the local history knows about an artist (or an album), or a summary
+int cmd_history(HistoryStore& history, const std::vector<std::string>& args)
+{
+    const int64_t now = time(nullptr);
+    if (args.size() >= 2)
+    {
+        printf("%s - %s: %llu plays\n", args[0].c_str(), args[1].c_str(),
+               (unsigned long long)history.count_album_plays(args[0], args[1]));
+        return 0;
+    }
+    if (args.size() == 1)
+    {
+        printf("%s: %llu plays, %llu in the last 30 days\n", args[0].c_str(),
+               (unsigned long long)history.count_artist_plays(args[0]),
+               (unsigned long long)history.count_artist_plays(args[0], now - 30 * 86400, now + 1));
+        return 0;
+    }
+
+    printf("%zu scrobbles in history\n", history.size());
+    for (const auto& entry : history.top_artists(10))
+        printf("%8llu  %s\n", (unsigned long long)entry.plays, entry.artist.c_str());
+    return 0;
+}
+
+// Fills a fresh history with synthetic plays and times loading and the indexed queries
+int cmd_history_bench(const std::vector<std::string>& args)
+{
+    const int rows = args.empty() ? 500000 : atoi(args[0].c_str());
+    const int64_t first_play = 1704067200; // 2024-01-01
+    std::error_code ec;
+    std::filesystem::remove(platform().profile_dir() + "lastfm_scrobble_history.bin", ec);
+
+    // Skewed artist popularity: a few artists get most of the plays
+    std::mt19937 rng(1);
+    std::geometric_distribution<int> artist_rank(0.002);
+    std::uniform_int_distribution<int> album_pick(0, 7);
+
+    auto start = std::chrono::steady_clock::now();
+    {
+        HistoryStore history;
+        std::vector<LastfmApi::TrackInfo> batch;
+        for (int i = 0; i < rows; ++i)
+        {
+            const int artist = artist_rank(rng) % 5000;
+            const int album = album_pick(rng);
+            LastfmApi::TrackInfo track;
+            track.artist = "Artist " + std::to_string(artist);
+            track.album = "Album " + std::to_string(artist) + "-" + std::to_string(album);
+            track.track = track.album + " Track " + std::to_string(i % 12);
+            track.duration = 200;
+            track.timestamp = first_play + i * 180LL;
+            batch.push_back(track);
+            if (batch.size() == 50)
+            {
+                history.append(batch);
+                batch.clear();
+            }
+        }
+        history.append(batch);
+    }
+    const double append_s = seconds_since(start);
+    const uintmax_t file_bytes = std::filesystem::file_size(platform().profile_dir() + "lastfm_scrobble_history.bin");
+
+    start = std::chrono::steady_clock::now();
+    HistoryStore history;
+    const double load_s = seconds_since(start);
+
+    const int64_t last_play = first_play + rows * 180LL;
+    const int64_t month_from = last_play - 30 * 86400;
+    const int repeat = 20;
+    auto time_ms = [&](auto&& query)
+    {
+        const auto t0 = std::chrono::steady_clock::now();
+        for (int i = 0; i < repeat; ++i)
+            query();
+        return seconds_since(t0) * 1000 / repeat;
+    };
+
+    uint64_t sink = 0;
+    const double artist_ms = time_ms([&]() { sink += history.count_artist_plays("Artist 3", month_from, last_play); });
+    const double album_ms = time_ms([&]() { sink += history.count_album_plays("Artist 3", "Album 3-1"); });
+    const double top_all_ms = time_ms([&]() { sink += history.top_artists(10).size(); });
+    const double top_month_ms = time_ms([&]() { sink += history.top_artists(10, month_from, last_play).size(); });
+    const double daily_ms = time_ms([&]() { sink += history.daily_counts(first_play, last_play).size(); });
+
+    printf("Rows: %zu, file %.1f MB (%.1f bytes/row)\n", history.size(), file_bytes / 1e6,
+           history.size() ? double(file_bytes) / history.size() : 0.0);
+    printf("Append (batches of 50): %.2fs, load + index: %.0f ms\n", append_s, load_s * 1000);
+    printf("plays of artist in 30 days: %.3f ms\n", artist_ms);
+    printf("plays of album, all time:   %.3f ms\n", album_ms);
+    printf("top 10 artists, all time:   %.3f ms\n", top_all_ms);
+    printf("top 10 artists, 30 days:    %.3f ms\n", top_month_ms);
+    printf("daily counts, all time:     %.3f ms\n", daily_ms);
+    return sink > 0 ? 0 : 1;
+}
+
+// Parses --concurrency / --rps / --from into sync options
+bool parse_sync_options(const std::vector<std::string>& args, size_t first, RecentTracksSyncOptions& options)
+{
+    for (size_t i = first; i < args.size(); i += 2)
+    {
+        const std::string value = i + 1 < args.size() ? args[i + 1] : "";
+        if (args[i] == "--concurrency")
+            options.concurrency = atoi(value.c_str());
+        else if (args[i] == "--rps")
+            options.requests_per_second = atof(value.c_str());
+        else if (args[i] == "--from")
+            options.from = strtoll(value.c_str(), nullptr, 10);
+        else
+        {
+            fprintf(stderr, "sync: unknown option %s\n", args[i].c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+void print_sync_result(const RecentTracksSyncResult& result)
+{
+    printf("%s: %llu scrobbles, %zu distinct tracks, %d/%d pages in %.2fs (%.0f scrobbles/s), high-water %lld\n",
+           result.complete ? "Complete" : "INCOMPLETE", (unsigned long long)result.scrobbles, result.plays.size(),
+           result.pages, result.total_pages, result.seconds, result.seconds > 0 ? result.scrobbles / result.seconds : 0,
+           (long long)result.high_water);
+}
+
+// Fetches a user's scrobble history the way the component's play count sync does
+int cmd_sync(LastfmApi& api, const std::vector<std::string>& args)
+{
+    if (args.empty())
+    {
+        fprintf(stderr, "sync: USER is required\n");
+        return 2;
+    }
+    RecentTracksSyncOptions options;
+    options.user = args[0];
+    if (!parse_sync_options(args, 1, options))
+        return 2;
+
+    std::atomic<bool> abort{false};
+    const RecentTracksSyncResult result = fetch_recent_tracks(api, options, abort);
+    print_sync_result(result);
+    if (!result.complete)
+        return 1;
+
+    std::unordered_set<uint64_t> loved;
+    if (!fetch_loved_tracks(api, options.user, abort, loved))
+    {
+        fprintf(stderr, "sync: failed to fetch loved tracks\n");
+        return 1;
+    }
+    printf("%zu loved tracks\n", loved.size());
+    return 0;
+}
+
+// Compares sync concurrency against an in-process stand-in serving synthetic history
+int cmd_sync_bench(const std::vector<std::string>& args, bool verbose)
+{
+    const uint64_t scrobbles = args.empty() ? 200000 : strtoull(args[0].c_str(), nullptr, 10);
+    const int latency_ms = args.size() > 1 ? atoi(args[1].c_str()) : 100;
+
+    StandInServer server(0, latency_ms);
+    server.set_recent_tracks(scrobbles);
+    if (!server.start())
+    {
+        perror("sync-bench");
+        return 1;
+    }
+    if (!verbose)
+        g_logger.set_sink([](const char*) {});
+
+    LastfmApi api;
+    api.set_api_url(server.url());
+    api.set_credentials("scrobblectl", "scrobblectl");
+
+    printf("%llu scrobbles, %d ms server latency per page; no pacing unless noted\n", (unsigned long long)scrobbles,
+           latency_ms);
+    for (int concurrency : {1, 4, 8})
+    {
+        RecentTracksSyncOptions options;
+        options.user = "scrobblectl";
+        options.concurrency = concurrency;
+        options.requests_per_second = 0;
+        std::atomic<bool> abort{false};
+        printf("concurrency %d: ", concurrency);
+        print_sync_result(fetch_recent_tracks(api, options, abort));
+        fflush(stdout);
+    }
+
+    // An incremental sync fetches the delivery window again; none of it may be counted twice
+    {
+        RecentTracksSyncOptions options;
+        options.user = "scrobblectl";
+        options.concurrency = 8;
+        options.requests_per_second = 0;
+        std::atomic<bool> abort{false};
+        const RecentTracksSyncResult full = fetch_recent_tracks(api, options, abort);
+        options.from = std::max<int64_t>(0, full.high_water - kDeliveryWindowSeconds);
+        options.counted = full.window;
+        const RecentTracksSyncResult again = fetch_recent_tracks(api, options, abort);
+        printf("incremental: %zu scrobbles in the delivery window fetched again, %llu counted twice\n",
+               full.window.size(), (unsigned long long)again.scrobbles);
+        if (!full.complete || !again.complete || again.scrobbles != 0)
+        {
+            fprintf(stderr, "sync-bench: the incremental sync counted delivery window scrobbles again\n");
+            return 1;
+        }
+    }
+
+    // Default settings: 4 workers paced to 4 requests/s, as against Last.fm
+    const uint64_t pages = (scrobbles + 199) / 200;
+    printf("At the default 4 requests/s a full sync takes about %.1f minutes; an incremental one fetches two weeks\n",
+           pages / 4.0 / 60);
+    return 0;
+}
+
+// Measures the API cache: coalesced cold misses, warm lookups and a restart from the segment file
+int cmd_cache_bench(const std::vector<std::string>& args, bool verbose)
+{
+    const int keys = args.empty() ? 2000 : atoi(args[0].c_str());
+    const int lookups = args.size() > 1 ? atoi(args[1].c_str()) : 20000;
+    const int latency_ms = args.size() > 2 ? atoi(args[2].c_str()) : 20;
+    std::error_code ec;
+    std::filesystem::remove(platform().profile_dir() + "lastfm_api_cache.bin", ec);
+
+    StandInServer server(0, latency_ms);
+    if (!server.start())
+    {
+        perror("cache-bench");
+        return 1;
+    }
+    if (!verbose)
+        g_logger.set_sink([](const char*) {});
+
+    LastfmApi api;
+    api.set_api_url(server.url());
+    api.set_credentials("scrobblectl", "scrobblectl");
+
+    // Skewed popularity; one title in ten is unknown to Last.fm
+    auto title_of = [](int key) { return (key % 10 == 0 ? "Missing " : "Track ") + std::to_string(key); };
+    std::vector<int> picks(static_cast<size_t>(lookups));
+    std::mt19937 rng(7);
+    std::geometric_distribution<int> rank(8.0 / keys);
+    for (int& pick : picks)
+        pick = rank(rng) % keys;
+    const size_t unique = std::unordered_set<int>(picks.begin(), picks.end()).size();
+
+    auto run = [&](int threads)
+    {
+        std::atomic<size_t> next{0};
+        std::vector<std::thread> workers;
+        const auto start = std::chrono::steady_clock::now();
+        for (int t = 0; t < threads; ++t)
+            workers.emplace_back(
+                [&]()
+                {
+                    LastfmApi::TrackUserInfo info;
+                    for (size_t i = next.fetch_add(1); i < picks.size(); i = next.fetch_add(1))
+                        api.get_track_user_info("Cache Artist", title_of(picks[i]), "scrobblectl", info);
+                });
+        for (auto& worker : workers)
+            worker.join();
+        return seconds_since(start);
+    };
+
+    g_api_cache = new ApiCache();
+    const double cold_s = run(16);
+    const ApiCacheStats cold = g_api_cache->stats();
+    printf("cold, 16 threads: %d lookups of %zu unique keys in %.2fs -> %llu API requests, %llu coalesced\n", lookups,
+           unique, cold_s, (unsigned long long)server.api_requests(), (unsigned long long)cold.coalesced);
+
+    // Warm hits straight through the cache, without LastfmApi's JSON decoding of the body
+    const std::map<std::string, std::string> hot = {{"method", "track.getInfo"}, {"artist", "Cache Artist"},
+                                                    {"track", title_of(picks[0])}, {"username", "scrobblectl"},
+                                                    {"autocorrect", "0"}};
+    std::string body;
+    const int repeat = 1000000;
+    auto start = std::chrono::steady_clock::now();
+    auto must_not_fetch = [](std::string&) { return ApiCacheResult::failed; };
+    int hits = 0;
+    for (int i = 0; i < repeat; ++i)
+        hits += g_api_cache->get(hot, must_not_fetch, body) != ApiCacheResult::failed;
+    const double hit_ns = seconds_since(start) * 1e9 / repeat;
+    printf("warm hit: %.0f ns per ApiCache::get (%d hits); %zu responses, %zu KB in memory\n", hit_ns, hits,
+           g_api_cache->stats().memory_entries, g_api_cache->stats().memory_bytes / 1024);
+
+    // Restart: the LRU is empty, every key is answered from the segment file
+    delete g_api_cache;
+    start = std::chrono::steady_clock::now();
+    g_api_cache = new ApiCache();
+    const double load_s = seconds_since(start);
+    const uint64_t requests_before = server.api_requests();
+    const double restart_s = run(16);
+    const ApiCacheStats warm = g_api_cache->stats();
+    printf("restart: load %.1f ms, %d lookups in %.2fs -> %llu disk hits (%llu negative), %llu API requests\n",
+           load_s * 1000, lookups, restart_s, (unsigned long long)warm.disk_hits,
+           (unsigned long long)warm.negative_hits, (unsigned long long)(server.api_requests() - requests_before));
+
+    delete g_api_cache;
+    g_api_cache = nullptr;
+    return server.api_requests() == unique ? 0 : 1;
+}
+
+void print_import_result(const ScrobblerLogImportResult& result)
+{
+    printf("%s: %llu rows in %.2fs -> %llu submitted, %llu duplicates, %llu skipped, %llu too old, %llu invalid; "
+           "resume offset %llu\n",
+           result.complete ? "Complete" : "INCOMPLETE", (unsigned long long)result.rows, result.seconds,
+           (unsigned long long)result.submitted, (unsigned long long)result.duplicates,
+           (unsigned long long)result.skipped, (unsigned long long)result.too_old, (unsigned long long)result.invalid,
+           (unsigned long long)result.resume_offset);
+}
+
+// Imports a portable player's .scrobbler.log
+int cmd_import(ScrobbleQueue& queue, const std::vector<std::string>& args)
+{
+    if (args.empty())
+    {
+        fprintf(stderr, "import: FILE is required\n");
+        return 2;
+    }
+    ScrobblerLogImportOptions options;
+    options.path = args[0];
+    for (size_t i = 1; i < args.size(); i += 2)
+    {
+        const std::string value = i + 1 < args.size() ? args[i + 1] : "";
+        if (args[i] == "--offset")
+            options.start_offset = strtoull(value.c_str(), nullptr, 10);
+        else if (args[i] == "--utc-offset")
+            options.utc_offset_seconds = strtoll(value.c_str(), nullptr, 10);
+        else
+        {
+            fprintf(stderr, "import: unknown option %s\n", args[i].c_str());
+            return 2;
+        }
+    }
+
+    std::atomic<bool> abort{false};
+    const ScrobblerLogImportResult result = import_scrobbler_log(queue, options, abort);
+    if (!result.error.empty())
+    {
+        fprintf(stderr, "import: %s\n", result.error.c_str());
+        return 1;
+    }
+    print_import_result(result);
+    return result.complete ? 0 : 1;
+}
+
+// Imports a synthetic log against a stand-in that goes away halfway, then resumes it
+int cmd_import_bench(const std::vector<std::string>& args, bool verbose)
+{
+    const int rows = args.empty() ? 30000 : atoi(args[0].c_str());
+    const int latency_ms = args.size() > 1 ? atoi(args[1].c_str()) : 5;
+    const std::string dir = platform().profile_dir();
+    for (const char* name : {"lastfm_scrobble_queue.json", "lastfm_scrobble_history.bin"})
+        std::filesystem::remove(dir + name);
+
+    // Rows over the last 13 days; one in ten skipped by the listener, one in fifty logged twice
+    const std::string path = dir + "bench.scrobbler.log";
+    {
+        FILE* log = fopen(path.c_str(), "w");
+        if (!log)
+        {
+            perror("import-bench");
+            return 1;
+        }
+        fprintf(log, "#AUDIOSCROBBLER/1.1\n#TZ/UTC\n#CLIENT/scrobblectl 1.0\n");
+        const int64_t first = time(nullptr) - 13 * 86400;
+        for (int i = 0; i < rows; ++i)
+        {
+            const int64_t timestamp = first + int64_t(i) * 13 * 86400 / std::max(rows, 1);
+            const char* rating = i % 10 == 9 ? "S" : "L";
+            for (int copy = 0; copy < (i % 50 == 0 ? 2 : 1); ++copy)
+                fprintf(log, "Log Artist %d\tLog Album %d\tLog Track %d\t%d\t%d\t%s\t%lld\t\n", i % 300, i % 900, i,
+                        i % 12 + 1, 150 + i % 120, rating, (long long)timestamp);
+        }
+        fclose(log);
+    }
+    const auto file_size = std::filesystem::file_size(path);
+
+    StandInServer server(0, latency_ms);
+    std::atomic<bool> outage{false};
+    server.set_fault_hook([&]() { return outage.load() ? StandInFault::drop_connection : StandInFault::none; });
+    if (!server.start())
+    {
+        perror("import-bench");
+        return 1;
+    }
+    if (!verbose)
+        g_logger.set_sink([](const char*) {});
+
+    LastfmApi api;
+    api.set_api_url(server.url());
+    api.set_credentials("scrobblectl", "scrobblectl");
+    api.set_session_key("scrobblectl");
+    g_lastfm_api = &api;
+    HistoryStore history;
+    g_scrobble_history = &history;
+    int rc = 0;
+    {
+        ScrobbleQueue queue;
+        printf("%d rows, %.1f MB log, %d ms server latency\n", rows, file_size / 1e6, latency_ms);
+
+        // The connection drops once about half the file is in
+        ScrobblerLogImportOptions options;
+        options.path = path;
+        std::atomic<bool> abort{false};
+        ScrobblerLogImportResult first = import_scrobbler_log(
+            queue, options, abort, [&](uint64_t done, uint64_t total) { outage.store(done * 2 >= total); });
+        printf("first run:  ");
+        print_import_result(first);
+
+        outage.store(false);
+        options.start_offset = first.resume_offset;
+        ScrobblerLogImportResult resumed = import_scrobbler_log(queue, options, abort);
+        printf("resumed:    ");
+        print_import_result(resumed);
+
+        // Importing the same file again finds every row in the history
+        options.start_offset = 0;
+        ScrobblerLogImportResult again = import_scrobbler_log(queue, options, abort);
+        printf("again:      ");
+        print_import_result(again);
+
+        const uint64_t scrobbled = first.submitted + resumed.submitted;
+        printf("%llu scrobbles in %llu API requests (%.0f scrobbles/s), stand-in accepted %llu\n",
+               (unsigned long long)scrobbled, (unsigned long long)server.api_requests(),
+               scrobbled / (first.seconds + resumed.seconds), (unsigned long long)server.scrobbles());
+
+        // The queue path for comparison: one add_track() and one queue file rewrite per row
+        const int sample = std::min(rows, 2000);
+        const auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < sample; ++i)
+        {
+            LastfmApi::TrackInfo track;
+            track.artist = "Log Artist " + std::to_string(i % 300);
+            track.track = "Log Track " + std::to_string(i);
+            track.timestamp = time(nullptr) - i;
+            queue.add_track(track);
+        }
+        const double add_s = seconds_since(start);
+        printf("add_track() of %d rows for comparison: %.2fs (%.0f rows/s), before any submission\n", sample, add_s,
+               sample / add_s);
+        queue.clear_queue();
+
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        printf("peak RSS %ld MB\n", usage.ru_maxrss / 1024);
+        rc = resumed.complete && again.submitted == 0 && history.size() == scrobbled ? 0 : 1;
+    }
+    g_scrobble_history = nullptr;
+    g_lastfm_api = nullptr;
+    return rc;
+}
+
+// Feeds Last.fm and a slow ListenBrainz-style stand-in from one queue, each drained by its own thread,
+// and compares Last.fm's drain time with a run where it is the only target
+int cmd_fanout_bench(const std::vector<std::string>& args, bool verbose)
+{
+    const int tracks = args.empty() ? 2000 : atoi(args[0].c_str());
+    const int slow_ms = args.size() > 1 ? atoi(args[1].c_str()) : 100;
+    const std::string queue_file = platform().profile_dir() + "lastfm_scrobble_queue.json";
+    std::filesystem::remove(queue_file);
+
+    StandInServer lastfm_server(0, 0);
+    StandInServer listenbrainz_server(0, slow_ms);
+    if (!lastfm_server.start() || !listenbrainz_server.start())
+    {
+        perror("fanout-bench");
+        return 1;
+    }
+    if (!verbose)
+        g_logger.set_sink([](const char*) {});
+
+    LastfmApi api;
+    api.set_api_url(lastfm_server.url());
+    api.set_credentials("scrobblectl", "scrobblectl");
+    api.set_session_key("scrobblectl");
+    g_lastfm_api = &api;
+    ListenBrainzTransport listenbrainz;
+    listenbrainz.configure(listenbrainz_server.root_url(), "scrobblectl");
+    printf("%d tracks, Last.fm stand-in without latency, ListenBrainz stand-in %d ms per request\n", tracks, slow_ms);
+
+    int rc = 0;
+    for (const bool fan_out : {false, true})
+    {
+        ScrobbleQueue queue;
+        QueuePolicy policy = queue.get_policy();
+        policy.max_per_run = LastfmApi::kMaxScrobbleBatch;
+        queue.set_policy(policy);
+        if (fan_out)
+            queue.add_target(kListenBrainzTarget, &listenbrainz);
+        for (int i = 0; i < tracks; ++i)
+        {
+            LastfmApi::TrackInfo track;
+            track.artist = "Fanout Artist " + std::to_string(i % 50);
+            track.track = "Fanout Track " + std::to_string(i);
+            track.album = "Fanout Album";
+            track.duration = 180;
+            track.timestamp = time(nullptr) - tracks + i;
+            queue.add_track(track);
+        }
+        queue.flush();
+        const uintmax_t stored_bytes = queue_bytes(platform().profile_dir());
+
+        // One thread per target, as the component's workers do
+        const std::vector<std::string> names =
+            fan_out ? std::vector<std::string>{ScrobbleQueue::kLastfmTarget, kListenBrainzTarget}
+                    : std::vector<std::string>{ScrobbleQueue::kLastfmTarget};
+        std::vector<size_t> submitted(names.size());
+        std::vector<double> elapsed(names.size());
+        std::vector<size_t> left_when_done(names.size());
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < names.size(); ++i)
+        {
+            threads.emplace_back(
+                [&, i]()
+                {
+                    const auto start = std::chrono::steady_clock::now();
+                    submitted[i] = drain_target(queue, names[i]);
+                    elapsed[i] = seconds_since(start);
+                    left_when_done[i] = queue.get_queue_size();
+                });
+        }
+        for (auto& thread : threads)
+            thread.join();
+
+        printf("%s:\n", fan_out ? "Last.fm + ListenBrainz" : "Last.fm only");
+        printf("  queue files after enqueue: %.1f KB (%d entries, stored once)\n", stored_bytes / 1024.0, tracks);
+        for (size_t i = 0; i < names.size(); ++i)
+        {
+            printf("  %-12s %zu tracks in %.3fs, %zu entries still stored for other targets\n", names[i].c_str(),
+                   submitted[i], elapsed[i], left_when_done[i]);
+            if (submitted[i] != static_cast<size_t>(tracks))
+                rc = 1;
+        }
+        if (queue.get_queue_size() != 0)
+            rc = 1;
+    }
+    printf("stand-ins accepted %llu scrobbles and %llu listens\n", (unsigned long long)lastfm_server.scrobbles(),
+           (unsigned long long)listenbrainz_server.listens());
+
+    // A listen the service rejects must not hold back the others of its request
+    std::vector<LastfmApi::TrackInfo> batch(ListenBrainzTransport::kMaxListenBatch);
+    for (size_t i = 0; i < batch.size(); ++i)
+    {
+        batch[i].artist = "Fanout Artist";
+        batch[i].track = (i == 37 ? "Invalid Track " : "Fanout Track ") + std::to_string(i);
+        batch[i].timestamp = time(nullptr) - batch.size() + i;
+    }
+    const uint64_t requests_before = listenbrainz_server.api_requests();
+    std::vector<bool> results;
+    listenbrainz.scrobble_batch(batch, results);
+    const size_t accepted = std::count(results.begin(), results.end(), true);
+    printf("batch with one invalid listen: %zu of %zu accepted in %llu requests\n", accepted, batch.size(),
+           (unsigned long long)(listenbrainz_server.api_requests() - requests_before));
+    if (accepted != batch.size() - 1 || results[37])
+        rc = 1;
+
+    g_lastfm_api = nullptr;
+    return rc;
+}
+
+// Drains one backlog through Last.fm stand-ins that are fast, slow or rate limited, with the fixed drain
+// (max_per_run tracks, one request per run) and the adaptive one, and reports how each fared
+int cmd_drain_bench(const std::vector<std::string>& args, bool verbose)
+{
+    const int tracks = args.empty() ? 1000 : atoi(args[0].c_str());
+    const std::string dir = platform().profile_dir();
+    const std::string backlog_dir = dir + "backlog/";
+    if (!verbose)
+        g_logger.set_sink([](const char*) {});
+
+    // Enqueue once; every run starts from a copy of the same queue files
+    for (const char* name : kQueueFiles)
+        std::filesystem::remove_all(dir + name);
+    {
+        ScrobbleQueue queue;
+        for (int i = 0; i < tracks; ++i)
+        {
+            LastfmApi::TrackInfo track;
+            track.artist = "Drain Artist " + std::to_string(i % 50);
+            track.track = "Drain Track " + std::to_string(i);
+            track.album = "Drain Album";
+            track.duration = 180;
+            track.timestamp = time(nullptr) - tracks + i;
+            queue.add_track(track);
+        }
+    }
+    std::filesystem::create_directories(backlog_dir);
+    copy_queue(dir, backlog_dir);
+
+    struct Scenario
+    {
+        const char* name;
+        int latency_ms;      // Stand-in latency per request
+        int rate_per_second; // Requests the stand-in answers per second before it returns 429 (0: unlimited)
+    };
+    // The slow stand-in answers above the bench's latency target of 100 ms
+    const Scenario scenarios[] = {{"fast", 0, 0}, {"slow", 150, 0}, {"throttled", 20, 10}};
+    printf("%d tracks, latency target 100 ms, fixed drain submits max_per_run=10 per request\n", tracks);
+
+    int rc = 0;
+    for (const Scenario& scenario : scenarios)
+    {
+        for (const bool adaptive : {false, true})
+        {
+            // Token bucket of one second's worth of requests, refilled continuously
+            std::mutex bucket_mutex;
+            double tokens = scenario.rate_per_second;
+            auto refilled_at = std::chrono::steady_clock::now();
+            std::atomic<uint64_t> throttled{0};
+            StandInServer server(0, scenario.latency_ms);
+            if (scenario.rate_per_second > 0)
+            {
+                server.set_fault_hook(
+                    [&]()
+                    {
+                        std::lock_guard<std::mutex> lock(bucket_mutex);
+                        const auto now = std::chrono::steady_clock::now();
+                        tokens = std::min<double>(scenario.rate_per_second,
+                                                  tokens + std::chrono::duration<double>(now - refilled_at).count() *
+                                                               scenario.rate_per_second);
+                        refilled_at = now;
+                        if (tokens < 1)
+                        {
+                            throttled.fetch_add(1);
+                            return StandInFault::rate_limited;
+                        }
+                        tokens -= 1;
+                        return StandInFault::none;
+                    });
+            }
+            if (!server.start())
+            {
+                perror("drain-bench");
+                return 1;
+            }
+
+            LastfmApi api;
+            api.set_api_url(server.url());
+            api.set_credentials("scrobblectl", "scrobblectl");
+            api.set_session_key("scrobblectl");
+            g_lastfm_api = &api;
+            copy_queue(backlog_dir, dir);
+            g_metrics.reset();
+
+            ScrobbleQueue queue;
+            QueuePolicy policy = queue.get_policy();
+            policy.adaptive_drain = adaptive;
+            policy.backoff_base_seconds = 0;
+            policy.target_latency_ms = 100;
+            queue.set_policy(policy);
+
+            // Back-to-back runs, as a worker woken over and over would make
+            const auto start = std::chrono::steady_clock::now();
+            int runs = 0;
+            while (queue.get_pending(ScrobbleQueue::kLastfmTarget) > 0 && runs < 100000)
+            {
+                queue.process_target(ScrobbleQueue::kLastfmTarget);
+                ++runs;
+            }
+            const double elapsed = seconds_since(start);
+            const DrainControllerState state = g_metrics.snapshot().drain;
+            printf("%-9s %-8s %5zu tracks in %7.2fs (%6.0f tracks/s), %5d runs, %5llu requests, %4llu answered "
+                   "429, final batch=%zu in-flight=%d\n",
+                   scenario.name, adaptive ? "adaptive" : "fixed", static_cast<size_t>(server.scrobbles()), elapsed,
+                   server.scrobbles() / elapsed, runs, (unsigned long long)server.api_requests(),
+                   (unsigned long long)throttled.load(), state.batch_size, state.concurrency);
+            if (queue.get_queue_size() != 0)
+                rc = 1;
+            g_lastfm_api = nullptr;
+        }
+    }
+    std::filesystem::remove_all(backlog_dir);
+    return rc;
+}
+
+// Compares the durability policies of the queue file: disk syncs while plays are queued during a backlog drain,
+// and what a process killed mid-write leaves behind
+int cmd_durability_bench(const std::vector<std::string>& args, bool verbose)
+{
+    const int plays = args.empty() ? 1000 : atoi(args[0].c_str());
+    const int kills = args.size() > 1 ? atoi(args[1].c_str()) : 5;
+    const std::string queue_file = platform().profile_dir() + kQueueFiles[0];
+    const std::string segment_dir = platform().profile_dir() + kQueueFiles[1] + "/";
+    if (!verbose)
+        g_logger.set_sink([](const char*) {});
+
+    const std::pair<Durability, const char*> policies[] = {{Durability::per_change, "per-change"},
+                                                           {Durability::group_commit, "group"},
+                                                           {Durability::best_effort, "best-effort"}};
+    auto make_track = [](int i)
+    {
+        LastfmApi::TrackInfo track;
+        track.artist = "Durable Artist " + std::to_string(i % 50);
+        track.track = "Durable Track " + std::to_string(i);
+        track.album = "Durable Album";
+        track.duration = 180;
+        track.timestamp = time(nullptr) - 100000 + i;
+        return track;
+    };
+
+    // Crash test first, while this process has no other threads to fork with: a child queues a play every
+    // millisecond and reports each add_track() that returned, until it is killed at a random moment
+    int rc = 0;
+    std::mt19937 random(42);
+    printf("killed while queueing (%d kills each):\n", kills);
+    for (const auto& [durability, name] : policies)
+    {
+        int torn = 0;
+        long lost_max = 0;
+        long lost_total = 0;
+        for (int kill_index = 0; kill_index < kills; ++kill_index)
+        {
+            std::filesystem::remove(queue_file);
+            fflush(stdout);
+            // The child counts returned add_track() calls in memory shared with this process
+            void* shared = mmap(nullptr, sizeof(std::atomic<int>), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+                                -1, 0);
+            if (shared == MAP_FAILED)
+            {
+                perror("durability-bench");
+                return 1;
+            }
+            std::atomic<int>* returned = new (shared) std::atomic<int>(0);
+            const pid_t child = fork();
+            if (child == 0)
+            {
+                ScrobbleQueue queue;
+                QueuePolicy policy = queue.get_policy();
+                policy.durability = durability;
+                queue.set_policy(policy);
+                for (int i = 1;; ++i)
+                {
+                    queue.add_track(make_track(i));
+                    returned->store(i);
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(300 + random() % 1000));
+            kill(child, SIGKILL);
+            waitpid(child, nullptr, 0);
+            const int acknowledged = returned->load();
+            munmap(shared, sizeof(std::atomic<int>));
+
+            std::ifstream file(queue_file);
+            const nlohmann::json saved = nlohmann::json::parse(file, nullptr, false);
+            if (saved.is_discarded() && std::filesystem::exists(queue_file))
+            {
+                ++torn;
+                continue;
+            }
+            // The head entries in the queue file plus the sealed segments it lists
+            long on_disk = 0;
+            if (!saved.is_discarded())
+            {
+                on_disk = static_cast<long>(saved["queue"].size());
+                for (const auto& range : saved.value("segments", nlohmann::json::array()))
+                {
+                    const uint64_t first = range.at(0).get<uint64_t>();
+                    if (std::filesystem::exists(segment_dir + std::to_string(first) + ".json"))
+                        on_disk += static_cast<long>(range.at(1).get<uint64_t>() - first + 1);
+                }
+            }
+            const long lost = std::max(0L, static_cast<long>(acknowledged) - on_disk);
+            lost_max = std::max(lost_max, lost);
+            lost_total += lost;
+        }
+        printf("  %-12s torn files %d, plays lost after add_track() returned: max %ld, total %ld\n", name, torn,
+               lost_max, lost_total);
+        if (torn > 0 || (durability == Durability::per_change && lost_total > 0))
+            rc = 1;
+    }
+
+    // Steady state: a play every 5 ms while a worker drains a backlog of as many tracks from a fast stand-in
+    StandInServer server(0, 0);
+    if (!server.start())
+    {
+        perror("durability-bench");
+        return 1;
+    }
+    LastfmApi api;
+    api.set_api_url(server.url());
+    api.set_credentials("scrobblectl", "scrobblectl");
+    api.set_session_key("scrobblectl");
+    g_lastfm_api = &api;
+    printf("%d plays queued 5 ms apart while a backlog of %d drains:\n", plays, plays);
+    for (const auto& [durability, name] : policies)
+    {
+        std::filesystem::remove(queue_file);
+        {
+            ScrobbleQueue queue;
+            QueuePolicy policy = queue.get_policy();
+            policy.durability = Durability::best_effort;
+            queue.set_policy(policy);
+            for (int i = 0; i < plays; ++i)
+                queue.add_track(make_track(i));
+        }
+        g_metrics.reset();
+
+        ScrobbleQueue queue;
+        QueuePolicy policy = queue.get_policy();
+        policy.durability = durability;
+        queue.set_policy(policy);
+        std::atomic<bool> queued{false};
+        const auto start = std::chrono::steady_clock::now();
+        std::thread worker(
+            [&]()
+            {
+                while (!queued.load() || queue.get_pending(ScrobbleQueue::kLastfmTarget) > 0)
+                {
+                    queue.process_target(ScrobbleQueue::kLastfmTarget);
+                    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                }
+            });
+        for (int i = 0; i < plays; ++i)
+        {
+            queue.add_track(make_track(plays + i));
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        queued.store(true);
+        worker.join();
+        queue.flush();
+        const double elapsed = seconds_since(start);
+
+        const MetricsSnapshot snapshot = g_metrics.snapshot();
+        printf("  %-12s %5llu writes, %5llu syncs (%7.0f syncs/hour at this rate), write p99 <= %.1f ms, %.2fs\n", name,
+               (unsigned long long)snapshot.save_queue_time.count, (unsigned long long)snapshot.fsyncs,
+               snapshot.fsyncs / elapsed * 3600, snapshot.save_queue_time.percentile_us(99) / 1000.0, elapsed);
+    }
+    g_lastfm_api = nullptr;
+    return rc;
+}
+
+// Queues a long offline backlog, then drains it from a fast stand-in, and reports how much of the log stays in
+// memory and how much every queue file write rewrites
+int cmd_segment_bench(const std::vector<std::string>& args, bool verbose)
+{
+    const int tracks = args.empty() ? 20000 : atoi(args[0].c_str());
+    const std::string dir = platform().profile_dir();
+    if (!verbose)
+        g_logger.set_sink([](const char*) {});
+    for (const char* name : kQueueFiles)
+        std::filesystem::remove_all(dir + name);
+
+    // Offline: every play is queued and written, nothing is submitted
+    const size_t bound = (ScrobbleQueue::kResidentSegments + 1) * ScrobbleQueue::kSegmentTracks;
+    g_metrics.reset();
+    auto start = std::chrono::steady_clock::now();
+    {
+        ScrobbleQueue queue;
+        for (int i = 0; i < tracks; ++i)
+        {
+            LastfmApi::TrackInfo track;
+            track.artist = "Offline Artist " + std::to_string(i % 50);
+            track.track = "Offline Track " + std::to_string(i);
+            track.album = "Offline Album";
+            track.duration = 180;
+            track.timestamp = time(nullptr) - tracks + i;
+            queue.add_track(track);
+        }
+        queue.flush();
+        const QueueStorage storage = queue.get_storage();
+        const MetricsSnapshot snapshot = g_metrics.snapshot();
+        printf("queued %d tracks offline in %.2fs: %zu segment files, %zu tracks in memory (bound %zu)\n", tracks,
+               seconds_since(start), storage.segments, storage.resident_tracks, bound);
+        printf("  queue file %.1f KB of %.1f KB stored, %llu queue file writes, write p99 <= %.1f ms\n",
+               std::filesystem::file_size(dir + kQueueFiles[0]) / 1024.0, queue_bytes(dir) / 1024.0,
+               (unsigned long long)snapshot.save_queue_time.count, snapshot.save_queue_time.percentile_us(99) / 1000.0);
+    }
+
+    // Back online: the backlog drains oldest first, paging the segments in and deleting them as it goes
+    StandInServer server(0, 0);
+    if (!server.start())
+    {
+        perror("segment-bench");
+        return 1;
+    }
+    LastfmApi api;
+    api.set_api_url(server.url());
+    api.set_credentials("scrobblectl", "scrobblectl");
+    api.set_session_key("scrobblectl");
+    g_lastfm_api = &api;
+
+    int rc = 0;
+    start = std::chrono::steady_clock::now();
+    {
+        ScrobbleQueue queue;
+        const double load_ms = seconds_since(start) * 1000;
+        QueuePolicy policy = queue.get_policy();
+        policy.backoff_base_seconds = 0;
+        queue.set_policy(policy);
+        size_t peak_resident = queue.get_storage().resident_tracks;
+        int runs = 0;
+        while (queue.get_pending(ScrobbleQueue::kLastfmTarget) > 0 && runs < 100000)
+        {
+            queue.process_target(ScrobbleQueue::kLastfmTarget);
+            peak_resident = std::max(peak_resident, queue.get_storage().resident_tracks);
+            ++runs;
+        }
+        queue.flush();
+        printf("loaded in %.1f ms, drained %llu tracks in %.2fs (%d runs): at most %zu tracks in memory, %zu segment "
+               "files and %.1f KB left\n",
+               load_ms, (unsigned long long)server.scrobbles(), seconds_since(start), runs, peak_resident,
+               queue.get_storage().segments, queue_bytes(dir) / 1024.0);
+        if (peak_resident > bound || queue.get_queue_size() != 0 || queue.get_storage().segments != 0 ||
+            server.scrobbles() != static_cast<uint64_t>(tracks))
+            rc = 1;
+    }
+    g_lastfm_api = nullptr;
+    return rc;
+}
+
+// Queues plays, now-playing updates and love toggles while Last.fm is unreachable, then counts the requests the
+// queue sends once it is back against one request per operation
+int cmd_ops_bench(const std::vector<std::string>& args, bool verbose)
+{
+    const int plays = args.empty() ? 500 : atoi(args[0].c_str());
+    const std::string dir = platform().profile_dir();
+    if (!verbose)
+        g_logger.set_sink([](const char*) {});
+    for (const char* name : kQueueFiles)
+        std::filesystem::remove_all(dir + name);
+
+    std::atomic<bool> offline{true};
+    StandInServer server(0, 0);
+    server.set_fault_hook([&]() { return offline.load() ? StandInFault::drop_connection : StandInFault::none; });
+    if (!server.start())
+    {
+        perror("ops-bench");
+        return 1;
+    }
+    LastfmApi api;
+    api.set_api_url(server.url());
+    api.set_credentials("scrobblectl", "scrobblectl");
+    api.set_session_key("scrobblectl");
+    g_lastfm_api = &api;
+
+    int rc = 0;
+    {
+        ScrobbleQueue queue;
+        size_t ops = 0;
+        size_t loved = 0;
+        for (int i = 0; i < plays; ++i)
+        {
+            LastfmApi::TrackInfo track;
+            track.artist = "Ops Artist " + std::to_string(i % 50);
+            track.track = "Ops Track " + std::to_string(i);
+            track.album = "Ops Album";
+            track.duration = 180;
+            track.timestamp = time(nullptr) - plays + i;
+
+            // Every play starts with a now-playing update; one in 25 is reported twice
+            queue.add_op(QueueOp::now_playing, track);
+            queue.add_op(QueueOp::scrobble, track);
+            ops += 2;
+            if (i % 25 == 0)
+            {
+                queue.add_op(QueueOp::scrobble, track);
+                ++ops;
+            }
+            // One in five is loved with a double click, and every other of those unloved right away
+            if (i % 5 == 0)
+            {
+                queue.add_op(QueueOp::love, track);
+                queue.add_op(QueueOp::love, track);
+                ops += 2;
+                if (i % 10 == 0)
+                {
+                    queue.add_op(QueueOp::unlove, track);
+                    ++ops;
+                }
+                else
+                {
+                    ++loved;
+                }
+            }
+            // The worker keeps finding Last.fm unreachable
+            if (i % 50 == 49)
+                queue.process_target(ScrobbleQueue::kLastfmTarget);
+        }
+        queue.flush();
+        std::ifstream file(dir + kQueueFiles[0]);
+        const nlohmann::json saved = nlohmann::json::parse(file, nullptr, false);
+        const size_t saved_ops = saved.is_discarded() ? 0 : saved.value("ops", nlohmann::json::array()).size();
+        printf("%zu operations while offline (%d plays with now-playing updates, loves and unloves): %zu tracks and "
+               "%zu loves queued, %zu ops pending\n",
+               ops, plays, queue.get_queue_size(), saved_ops, queue.get_pending_ops());
+
+        // Back online: the worker catches up
+        offline.store(false);
+        const uint64_t requests_before = server.api_requests();
+        int runs = 0;
+        while ((queue.get_queue_size() > 0 || queue.get_pending_ops() > 0) && runs < 10000)
+        {
+            queue.process_target(ScrobbleQueue::kLastfmTarget);
+            ++runs;
+        }
+        const uint64_t requests = server.api_requests() - requests_before;
+        const uint64_t scrobble_requests = requests - server.love_requests() - server.now_playing_requests();
+        printf("back online: %llu requests instead of %zu - %llu track.scrobble (%llu scrobbles), %llu "
+               "track.love/unlove, %llu track.updateNowPlaying\n",
+               (unsigned long long)requests, ops, (unsigned long long)scrobble_requests,
+               (unsigned long long)server.scrobbles(), (unsigned long long)server.love_requests(),
+               (unsigned long long)server.now_playing_requests());
+        if (server.scrobbles() != static_cast<uint64_t>(plays) || server.love_requests() != loved ||
+            server.now_playing_requests() != 1 || queue.get_pending_ops() != 0)
+            rc = 1;
+    }
+    g_lastfm_api = nullptr;
+    return rc;
+}
+
+// Times the scrobble at the playback threshold (add_track() until Last.fm acknowledged it) against a stand-in that
+// charges for every new connection: one connection per request as before the pool, pooled connections the server
+// keeps open, pooled connections the server closes while the track plays, and the same warmed before the threshold
+int cmd_warm_bench(const std::vector<std::string>& args, bool verbose)
+{
+    const int tracks = args.empty() ? 3 : atoi(args[0].c_str());
+    const std::string dir = platform().profile_dir();
+    if (!verbose)
+        g_logger.set_sink([](const char*) {});
+
+    // Request round trip, and DNS, TCP and TLS setup of a new connection on top of it
+    const int rtt_ms = 20;
+    const int setup_ms = 60;
+    // Listening from the now-playing update until the threshold, and how early the connection is warmed
+    const int listen_ms = 2600;
+    const int lead_ms = 300;
+
+    struct Mode
+    {
+        const char* name;
+        bool reuse;        // Requests share pooled connections
+        int keep_alive_ms; // How long the stand-in keeps an idle connection open
+        bool warm;         // LastfmApi::prewarm() lead_ms before the threshold
+    };
+    const Mode modes[] = {{"per-request", false, 15000, false},
+                          {"pooled", true, 15000, false},
+                          {"pooled, server closes idle", true, 1000, false},
+                          {"pooled, warmed", true, 1000, true}};
+    printf("%d tracks, %d ms per request, %d ms more for a new connection, threshold %d ms after now-playing\n", tracks,
+           rtt_ms, setup_ms, listen_ms);
+
+    int rc = 0;
+    double per_request_ms = 0;
+    for (const Mode& mode : modes)
+    {
+        for (const char* name : kQueueFiles)
+            std::filesystem::remove_all(dir + name);
+        StandInServer server(0, rtt_ms);
+        server.set_connect_latency(setup_ms);
+        server.set_keep_alive(mode.keep_alive_ms);
+        if (!server.start())
+        {
+            perror("warm-bench");
+            return 1;
+        }
+        LastfmApi api;
+        api.set_api_url(server.url());
+        api.set_credentials("scrobblectl", "scrobblectl");
+        api.set_session_key("scrobblectl");
+        api.connections().set_reuse(mode.reuse);
+        g_lastfm_api = &api;
+        g_metrics.reset();
+
+        double total_ms = 0;
+        double max_ms = 0;
+        {
+            ScrobbleQueue queue;
+            for (int i = 0; i < tracks; ++i)
+            {
+                LastfmApi::TrackInfo track;
+                track.artist = "Warm Artist";
+                track.track = "Warm Track " + std::to_string(i);
+                track.duration = 180;
+
+                // Track start: the now-playing update goes out through the Last.fm worker
+                queue.add_op(QueueOp::now_playing, track);
+                queue.process_target(ScrobbleQueue::kLastfmTarget);
+                std::this_thread::sleep_for(std::chrono::milliseconds(listen_ms - lead_ms));
+                if (mode.warm)
+                    api.prewarm();
+                std::this_thread::sleep_for(std::chrono::milliseconds(lead_ms));
+
+                // Threshold
+                track.timestamp = time(nullptr) - listen_ms / 1000;
+                const auto start = std::chrono::steady_clock::now();
+                queue.add_track(track);
+                queue.process_target(ScrobbleQueue::kLastfmTarget);
+                const double ms =
+                    std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                total_ms += ms;
+                max_ms = std::max(max_ms, ms);
+                if (queue.get_queue_size() != 0)
+                    rc = 1;
+            }
+        }
+        g_lastfm_api = nullptr;
+
+        const MetricsSnapshot metrics = g_metrics.snapshot();
+        const double mean_ms = tracks > 0 ? total_ms / tracks : 0;
+        if (!mode.reuse)
+            per_request_ms = mean_ms;
+        printf("%-27s threshold-to-ack mean %5.0f ms, max %5.0f ms; %llu connections opened, %llu requests reused "
+               "one, %llu probes\n",
+               mode.name, mean_ms, max_ms, (unsigned long long)metrics.connections_opened,
+               (unsigned long long)metrics.connections_reused, (unsigned long long)server.probe_requests());
+        // Warmed, the scrobble is a single request on an open connection
+        if (mode.warm && mean_ms >= per_request_ms / 2)
+            rc = 1;
+    }
+    return rc;
+}
+
+// Decodes representative Last.fm answers the way send_api_request() used to (a DOM parse, then lookups) and with
+// the streaming decoder, and reports the time and heap allocations per response
+int cmd_decode_bench(const std::vector<std::string>& args, bool /*verbose*/)
+{
+    const int iterations = args.empty() ? 2000 : std::max(1, atoi(args[0].c_str()));
+    using json = nlohmann::json;
+
+    json scrobbles = json::array();
+    for (int i = 0; i < 50; ++i)
+    {
+        auto text = [](const std::string& value) { return json{{"corrected", "0"}, {"#text", value}}; };
+        scrobbles.push_back({{"artist", text("Decode Artist " + std::to_string(i % 7))},
+                             {"album", text("Decode Album")},
+                             {"track", text("Decode Track " + std::to_string(i))},
+                             {"albumArtist", text("")},
+                             {"timestamp", std::to_string(1760000000 + i * 200)},
+                             {"ignoredMessage", {{"code", "0"}, {"#text", ""}}}});
+    }
+    json rows = json::array();
+    for (int i = 0; i < 200; ++i)
+    {
+        rows.push_back(
+            {{"artist", {{"mbid", ""}, {"#text", "Decode Artist " + std::to_string(i % 7)}}},
+             {"streamable", "0"},
+             {"image", json::array({{{"size", "small"}, {"#text", "https://lastfm.freetls.fastly.net/i/u/34s/a.png"}},
+                                    {{"size", "large"}, {"#text", "https://lastfm.freetls.fastly.net/i/u/a.png"}}})},
+             {"mbid", ""},
+             {"album", {{"mbid", ""}, {"#text", "Decode Album"}}},
+             {"name", "Decode Track " + std::to_string(i)},
+             {"url", "https://www.last.fm/music/Decode+Artist/_/Decode+Track"},
+             {"date", {{"uts", std::to_string(1760000000 + i * 200)}, {"#text", "09 Oct 2025, 08:53"}}}});
+    }
+
+    struct Body
+    {
+        const char* name;
+        std::string text;
+    };
+    const Body bodies[] = {
+        {"error (track.getInfo)", R"({"error":6,"message":"Track not found","links":[]})"},
+        {"session (auth.getSession)",
+         R"({"session":{"subscriber":0,"name":"scrobblectl","key":"d580d57f32848f5dcf574d1ce18d78b2"}})"},
+        {"50 scrobbles (track.scrobble)",
+         json{{"scrobbles", {{"scrobble", scrobbles}, {"@attr", {{"accepted", 50}, {"ignored", 0}}}}}}.dump()},
+        {"200-row page (getRecentTracks)",
+         json{{"recenttracks",
+               {{"track", rows},
+                {"@attr", {{"user", "scrobblectl"}, {"page", "1"}, {"perPage", "200"}, {"totalPages", "5"},
+                           {"total", "1000"}}}}}}
+             .dump()},
+    };
+
+    int rc = 0;
+    printf("%-31s %8s  %14s %9s  %14s %9s\n", "response", "bytes", "DOM us", "allocs", "decoder us", "allocs");
+    for (const Body& body : bodies)
+    {
+        // Before: every answer was parsed into a DOM to look for "error", then looked up again by the caller
+        uint64_t checksum = 0;
+        uint64_t allocations = allocation_count();
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i)
+        {
+            const json dom = json::parse(body.text);
+            if (dom.contains("error"))
+                checksum += dom["error"].get<int>();
+            else if (dom.contains("session"))
+                checksum += dom["session"].value("key", "").size();
+            else if (dom.contains("scrobbles"))
+                checksum += dom["scrobbles"]["@attr"].value("accepted", 0);
+            else
+                checksum += dom["recenttracks"]["track"].size();
+        }
+        const double dom_us =
+            std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / iterations;
+        const double dom_allocations = static_cast<double>(allocation_count() - allocations) / iterations;
+
+        // After: one streaming pass that keeps only the decoded fields
+        uint64_t decoded_checksum = 0;
+        allocations = allocation_count();
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i)
+        {
+            ApiResponse answer;
+            LastfmApi::RecentTracksPage page;
+            answer.page = &page;
+            if (!decode_api_response(body.text, answer))
+                rc = 1;
+            decoded_checksum += answer.error + answer.session_key.size() + answer.accepted + page.tracks.size();
+        }
+        const double decoder_us =
+            std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / iterations;
+        const double decoder_allocations = static_cast<double>(allocation_count() - allocations) / iterations;
+
+        printf("%-31s %8zu  %14.2f %9.0f  %14.2f %9.0f\n", body.name, body.text.size(), dom_us, dom_allocations,
+               decoder_us, decoder_allocations);
+        if (decoded_checksum != checksum)
+        {
+            printf("  decoded fields differ from the DOM\n");
+            rc = 1;
+        }
+    }
+    return rc;
+}
+
+// Drives PlaybackTracker the way foobar2000 drives the playback callback (track changes, seeks, pauses and stops)
+// on a virtual clock, firing its timer when due. Reports the calls and their cost per track, the heap allocations
+// per track change, how late the scrobbles were and the once-a-second ticks the tracker no longer needs; then plays
+// an internet radio stream that resends its title every 5 s and checks that only real song changes cost anything.
+int cmd_tick_bench(const std::vector<std::string>& args, bool /*verbose*/)
+{
+    const int tracks = args.empty() ? 2000 : std::max(1, atoi(args[0].c_str()));
+
+    class BenchHost : public PlaybackTracker::Host
+    {
+      public:
+        PlaybackTracker* tracker = nullptr;
+        int64_t timer_due_ms = -1; // Virtual time the timer fires at (-1: not set)
+        uint64_t now_playing_calls = 0;
+        uint64_t scrobbles = 0;
+        uint64_t prewarms = 0;
+        uint64_t timers_set = 0;
+        time_t last_timestamp = 0;
+        double max_late_seconds = 0;
+
+        void now_playing(const LastfmApi::TrackInfo&) override { ++now_playing_calls; }
+        bool scrobble(const LastfmApi::TrackInfo& track) override
+        {
+            ++scrobbles;
+            last_timestamp = track.timestamp;
+            max_late_seconds = std::max(max_late_seconds, tracker->played() - tracker->threshold());
+            return true;
+        }
+        void prewarm() override { ++prewarms; }
+        void set_timer(double seconds) override
+        {
+            timer_due_ms = seconds < 0 ? -1 : current_clock().now_ms() + static_cast<int64_t>(seconds * 1000 + 0.5);
+            if (seconds >= 0)
+                ++timers_set;
+        }
+    };
+
+    VirtualClock virtual_clock(1760000000000);
+    set_clock(&virtual_clock);
+    BenchHost host;
+    PlaybackTracker tracker(host);
+    host.tracker = &tracker;
+
+    // Tag values as the field scripts produce them, most too long for the small-string buffer
+    std::vector<std::string> artists, titles, albums;
+    for (int i = 0; i < 97; ++i)
+    {
+        artists.push_back("Tick Bench Artist Number " + std::to_string(i));
+        titles.push_back("A Reasonably Long Track Title " + std::to_string(i * 7) + " (Remastered)");
+        albums.push_back("Tick Bench Album " + std::to_string(i % 13) + " - Deluxe Edition");
+    }
+
+    uint64_t calls = 0;
+    uint64_t ticks = 0; // on_playback_time() calls a per-second check would have handled
+    uint64_t expected_now_playing = 0;
+    uint64_t expected_scrobbles = 0;
+    uint64_t wrong_timestamps = 0;
+    uint64_t change_allocations = 0;
+    uint64_t call_allocations = 0;
+    double call_ns = 0;
+    auto timed = [&](auto&& call)
+    {
+        const uint64_t allocations = allocation_count();
+        const auto start = std::chrono::steady_clock::now();
+        call();
+        call_ns += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        call_allocations += allocation_count() - allocations;
+        ++calls;
+    };
+    // Plays for the given seconds, firing the timer whenever it is due
+    auto play = [&](double seconds)
+    {
+        const int64_t until_ms = virtual_clock.now_ms() + static_cast<int64_t>(seconds * 1000);
+        while (host.timer_due_ms >= 0 && host.timer_due_ms <= until_ms)
+        {
+            virtual_clock.advance_to(host.timer_due_ms);
+            host.timer_due_ms = -1;
+            timed([&]() { tracker.on_timer(); });
+        }
+        virtual_clock.advance_to(until_ms);
+        ticks += static_cast<uint64_t>(seconds);
+    };
+    // Waits without playing; the timer must not fire
+    auto wait = [&](int seconds) { virtual_clock.advance(std::chrono::seconds(seconds)); };
+    auto expect_timestamp = [&](time_t timestamp)
+    {
+        if (host.last_timestamp != timestamp)
+            ++wrong_timestamps;
+    };
+
+    for (int i = 0; i < tracks; ++i)
+    {
+        // One in 20 is too short to scrobble, one in 20 skipped early, one in 20 seeked ahead past the threshold,
+        // one in 20 replayed from the start after it ended and one in 20 paused for a while; the rest play through
+        const int kind = i % 20;
+        const double length = kind == 1 ? 20 : 120 + (i * 37) % 480;
+        const double threshold = std::min(length / 2, PlaybackTracker::kMaxThresholdSeconds);
+        const time_t started = virtual_clock.now_seconds();
+
+        const uint64_t allocations = allocation_count();
+        LastfmApi::TrackInfo& info = tracker.next_track();
+        info.artist = artists[i % artists.size()];
+        info.track = titles[i % titles.size()];
+        info.album = albums[i % albums.size()];
+        info.album_artist.clear();
+        info.track_number = i % 12 + 1;
+        tracker.on_new_track(length, 50);
+        change_allocations += allocation_count() - allocations;
+        ++calls;
+
+        if (kind != 1)
+            ++expected_now_playing;
+        if (kind == 0 || kind == 1)
+        {
+            play(kind == 0 ? 10 : length);
+        }
+        else if (kind == 2)
+        {
+            // Only played time counts: the scrobble comes once threshold seconds were actually heard
+            play(5);
+            timed([&]() { tracker.on_seek(threshold + 1); });
+            play(length - threshold - 1);
+            ++expected_scrobbles;
+            expect_timestamp(started);
+        }
+        else if (kind == 3)
+        {
+            play(length);
+            expect_timestamp(started);
+            const time_t replayed = virtual_clock.now_seconds();
+            timed([&]() { tracker.on_seek(0); });
+            play(length);
+            expected_scrobbles += 2;
+            expect_timestamp(replayed);
+        }
+        else if (kind == 4)
+        {
+            play(threshold / 2);
+            timed([&]() { tracker.on_pause(true); });
+            wait(300);
+            timed([&]() { tracker.on_pause(false); });
+            play(length - threshold / 2);
+            ++expected_scrobbles;
+            expect_timestamp(started);
+        }
+        else
+        {
+            play(length);
+            ++expected_scrobbles;
+            expect_timestamp(started);
+        }
+        if (i % 10 == 9)
+            timed([&]() { tracker.on_stop(); });
+    }
+    tracker.on_stop();
+
+    printf("%d track changes: %.1f tracker calls per track (%llu timers set) instead of %.0f ticks, %.1f ns per call, "
+           "%llu allocations in calls (%llu scrobbles)\n",
+           tracks, static_cast<double>(calls) / tracks, (unsigned long long)host.timers_set,
+           static_cast<double>(ticks) / tracks, calls > 0 ? call_ns / calls : 0.0,
+           (unsigned long long)call_allocations, (unsigned long long)host.scrobbles);
+    printf("%.2f allocations per track change; scrobbled at most %.3f s after the threshold, %llu wrong timestamps\n",
+           static_cast<double>(change_allocations) / tracks, host.max_late_seconds,
+           (unsigned long long)wrong_timestamps);
+    printf("now playing %llu (expected %llu), scrobbles %llu (expected %llu), prewarms %llu\n",
+           (unsigned long long)host.now_playing_calls, (unsigned long long)expected_now_playing,
+           (unsigned long long)host.scrobbles, (unsigned long long)expected_scrobbles,
+           (unsigned long long)host.prewarms);
+
+    // An internet radio stream: every song's "Artist - Title" resent every 5 s, one song in 10 a short ident
+    // without a separator. Only changes of the normalised title may reach the tracker.
+    const uint64_t file_now_playing = host.now_playing_calls;
+    const uint64_t file_scrobbles = host.scrobbles;
+    const int songs = std::max(1, tracks / 10);
+    StreamTitle stream_title;
+    std::string stream_text;
+    uint64_t updates = 0;
+    uint64_t title_changes = 0;
+    uint64_t repeat_allocations = 0;
+    uint64_t expected_stream_scrobbles = 0;
+    double repeat_ns = 0;
+    auto stream_update = [&](const std::string& text)
+    {
+        const uint64_t allocations = allocation_count();
+        const auto start = std::chrono::steady_clock::now();
+        std::string_view artist, title = StreamTitle::trim(text);
+        StreamTitle::split(title, artist, title);
+        const bool changed = stream_title.update(artist, title);
+        if (!changed)
+        {
+            repeat_ns += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+            repeat_allocations += allocation_count() - allocations;
+        }
+        ++updates;
+        if (!changed)
+            return;
+        ++title_changes;
+        tracker.on_stop();
+        if (artist.empty())
+            return;
+        LastfmApi::TrackInfo& info = tracker.next_track();
+        info.artist.assign(artist);
+        info.track.assign(title);
+        info.album.clear();
+        tracker.on_new_stream_title();
+    };
+    for (int i = 0; i < songs; ++i)
+    {
+        const bool ident = i % 10 == 9;
+        const int seconds = ident ? 20 : 60 + (i * 53) % 300;
+        stream_text = ident ? "Tick Bench FM" : artists[i % artists.size()] + " - " + titles[i % titles.size()];
+        if (!ident && seconds >= PlaybackTracker::kStreamThresholdSeconds)
+            ++expected_stream_scrobbles;
+        for (int second = 0; second < seconds; second += 5)
+        {
+            // Some stations pad the same title differently on refresh
+            if (second % 15 == 10)
+                stream_text.push_back(' ');
+            stream_update(stream_text);
+            play(std::min(5, seconds - second));
+        }
+    }
+    tracker.on_stop();
+    set_clock(nullptr);
+
+    printf("stream: %llu metadata updates, %llu title changes, %.1f ns and %llu allocations per repeated update; "
+           "now playing %llu, scrobbles %llu (expected %llu)\n",
+           (unsigned long long)updates, (unsigned long long)title_changes,
+           updates > title_changes ? repeat_ns / (updates - title_changes) : 0.0,
+           (unsigned long long)repeat_allocations, (unsigned long long)(host.now_playing_calls - file_now_playing),
+           (unsigned long long)(host.scrobbles - file_scrobbles), (unsigned long long)expected_stream_scrobbles);
+    const bool exact = host.max_late_seconds < 0.002 && wrong_timestamps == 0;
+    const bool stream = title_changes == static_cast<uint64_t>(songs) && repeat_allocations == 0 &&
+                        host.scrobbles - file_scrobbles == expected_stream_scrobbles;
+    const bool counted = file_now_playing == expected_now_playing && file_scrobbles == expected_scrobbles;
+    return counted && exact && stream ? 0 : 1;
+}
+
+// Browses and bulk-edits a long offline backlog the way the preferences table does, while another thread keeps
+// queueing plays: page latency against reading the whole log, and how long the bulk edits keep the lock
+int cmd_queue_bench(const std::vector<std::string>& args, bool verbose)
+{
+    const int tracks = args.empty() ? 100000 : atoi(args[0].c_str());
+    const int artists = 50;
+    const std::string dir = platform().profile_dir();
+    if (!verbose)
+        g_logger.set_sink([](const char*) {});
+    for (const char* name : kQueueFiles)
+        std::filesystem::remove_all(dir + name);
+
+    auto make_track = [](int i, const std::string& prefix)
+    {
+        LastfmApi::TrackInfo track;
+        track.artist = prefix + " Artist " + std::to_string(i % artists);
+        track.track = prefix + " Track " + std::to_string(i);
+        track.album = prefix + " Album";
+        track.duration = 180;
+        track.timestamp = time(nullptr) - 1000000 + i;
+        return track;
+    };
+    using micros = std::chrono::duration<double, std::micro>;
+
+    int rc = 0;
+    size_t expected = static_cast<size_t>(tracks);
+    const std::string renamed = "Renamed Artist";
+    {
+        // Offline (no Last.fm instance): everything stays queued
+        ScrobbleQueue queue;
+        QueuePolicy policy = queue.get_policy();
+        policy.durability = Durability::best_effort;
+        queue.set_policy(policy);
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < tracks; ++i)
+            queue.add_track(make_track(i, "Backlog"));
+        queue.flush();
+        printf("queued %d tracks offline in %.2fs (%zu segment files)\n", tracks, seconds_since(start),
+               queue.get_storage().segments);
+
+        // What a table without paging loads when it opens
+        start = std::chrono::steady_clock::now();
+        const size_t keys = queue.pending_keys().size();
+        printf("  whole log read (pending_keys):  %8.1f ms for %zu entries\n", seconds_since(start) * 1000, keys);
+
+        // Another thread keeps taking the queue lock, as add_track() and the drains do; its worst wait is the
+        // longest anything below holds the lock
+        std::atomic<bool> probing{true};
+        std::atomic<int64_t> wait_max_ns{0};
+        std::thread probe(
+            [&]()
+            {
+                while (probing.load())
+                {
+                    const auto wait_start = std::chrono::steady_clock::now();
+                    queue.get_version();
+                    const int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                           std::chrono::steady_clock::now() - wait_start)
+                                           .count();
+                    if (ns > wait_max_ns.load())
+                        wait_max_ns.store(ns);
+                    std::this_thread::sleep_for(std::chrono::microseconds(200));
+                }
+            });
+        auto take_wait_us = [&]() { return wait_max_ns.exchange(0) / 1000.0; };
+
+        // Pages the table asks for while scrolling: random offsets, 50 rows each
+        std::mt19937 random(7);
+        double page_total_us = 0;
+        double page_max_us = 0;
+        const int page_reads = 200;
+        for (int i = 0; i < page_reads; ++i)
+        {
+            const size_t offset = random() % static_cast<size_t>(tracks);
+            const auto page_start = std::chrono::steady_clock::now();
+            const QueuePage page = queue.get_range(offset, 50);
+            const double us = micros(std::chrono::steady_clock::now() - page_start).count();
+            page_total_us += us;
+            page_max_us = std::max(page_max_us, us);
+            if (page.total != expected || page.entries.empty() || page.entries.front().track.seq != offset + 1)
+                rc = 1;
+        }
+        printf("  page of 50 at a random offset: %8.1f us average, %.1f us worst (%d pages), lock wait <= %.1f us\n",
+               page_total_us / page_reads, page_max_us, page_reads, take_wait_us());
+
+        // Plays keep arriving during the bulk edits
+        std::atomic<bool> done{false};
+        std::atomic<int> played{0};
+        std::thread player(
+            [&]()
+            {
+                while (!done.load())
+                {
+                    queue.add_track(make_track(played.fetch_add(1), "Live"));
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+            });
+        // The plays alone, for comparison: sealing the head and the group commit take the lock too
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        const double plays_wait_us = take_wait_us();
+        const uint64_t version = queue.get_version();
+        const int played_before = played.load();
+        start = std::chrono::steady_clock::now();
+        const std::string deleted_artist = "Backlog Artist 7";
+        const size_t removed =
+            queue.remove_if([&](const QueuedTrack& queued) { return queued.artist == deleted_artist; });
+        const double remove_s = seconds_since(start);
+        const double remove_wait_us = take_wait_us();
+        start = std::chrono::steady_clock::now();
+        const std::string edited_artist = "Backlog Artist 3";
+        const size_t edited = queue.edit_if([&](const QueuedTrack& queued) { return queued.artist == edited_artist; },
+                                            [&](QueuedTrack& queued) { queued.artist = renamed; });
+        const double edit_s = seconds_since(start);
+        const double edit_wait_us = take_wait_us();
+        done.store(true);
+        player.join();
+        probing.store(false);
+        probe.join();
+        queue.flush();
+        expected = expected - removed + static_cast<size_t>(played.load());
+        printf("  plays alone (1 per ms):                     lock wait <= %.1f us\n", plays_wait_us);
+        printf("  delete %zu by one artist:       %8.1f ms, lock wait <= %.1f us\n", removed, remove_s * 1000,
+               remove_wait_us);
+        printf("  rename %zu by one artist:       %8.1f ms, lock wait <= %.1f us (segments rewritten)\n", edited,
+               edit_s * 1000, edit_wait_us);
+        printf("  %d plays queued meanwhile\n", played.load());
+        const size_t per_artist = static_cast<size_t>(tracks / artists);
+        if (removed != per_artist || edited != per_artist || queue.get_queue_size() != expected)
+            rc = 1;
+
+        // Over kMaxChanges changes since: the table reads its pages again; fewer come as a delta. The plays queued
+        // meanwhile are logged too, so a backlog near the limit may go either way.
+        const QueueChanges changes = queue.get_changes(version);
+        const size_t logged = removed + edited;
+        const size_t logged_with_plays = logged + static_cast<size_t>(played.load() - played_before);
+        printf("  changes since the bulk edits began: %s\n", changes.reset ? "reset (read the pages again)" : "delta");
+        if (logged > ScrobbleQueue::kMaxChanges && !changes.reset)
+            rc = 1;
+        if (logged_with_plays <= ScrobbleQueue::kMaxChanges && changes.reset)
+            rc = 1;
+
+        // A few changes: the delta names them
+        const uint64_t before = queue.get_version();
+        const QueuePage first = queue.get_range(0, 3);
+        std::vector<uint64_t> seqs;
+        for (const auto& entry : first.entries)
+            seqs.push_back(entry.track.seq);
+        queue.remove_entries(seqs);
+        for (int i = 0; i < 5; ++i)
+            queue.add_track(make_track(i, "Delta"));
+        const QueueChanges delta = queue.get_changes(before);
+        printf("  delta after 3 deletes and 5 plays: %zu removed, %zu added, %zu edited\n", delta.removed.size(),
+               delta.added.size(), delta.edited.size());
+        expected = expected - 3 + 5;
+        if (delta.reset || delta.removed != seqs || delta.added.size() != 5 || !delta.edited.empty())
+            rc = 1;
+        queue.flush();
+    }
+
+    // Everything above is on disk
+    {
+        ScrobbleQueue queue;
+        const QueuePage all = queue.get_range(0, expected);
+        const size_t renamed_count = static_cast<size_t>(
+            std::count_if(all.entries.begin(), all.entries.end(),
+                          [&](const QueueEntry& entry) { return entry.track.artist == renamed; }));
+        printf("reloaded: %zu tracks in queue, %zu renamed\n", all.total, renamed_count);
+        if (all.total != expected || all.entries.size() != expected ||
+            renamed_count != static_cast<size_t>(tracks / artists))
+            rc = 1;
+    }
+    return rc;
+}
+
+void usage()
+{
+    fprintf(stderr,
+            "usage: scrobblectl [options] <command> [args]\n"
+            "\n"
+            "options:\n"
+            "  --profile DIR        directory holding queue and session files (default: ./scrobblectl-profile)\n"
+            "  --endpoint URL       API endpoint (default: Last.fm)\n"
+            "  --api-key KEY        API key (or LASTFM_API_KEY)\n"
+            "  --api-secret SECRET  API secret (or LASTFM_API_SECRET)\n"
+            "  --session-key KEY    session key (or LASTFM_SESSION_KEY, default: saved session)\n"
+            "  --listenbrainz URL   also scrobble to a ListenBrainz-compatible service (https://api.listenbrainz.org)\n"
+            "  --listenbrainz-token TOKEN\n"
+            "                       user token for --listenbrainz (or LISTENBRAINZ_TOKEN)\n"
+            "  --debug              enable debug logging\n"
+            "\n"
+            "commands:\n"
+            "  enqueue ARTIST TITLE [ALBUM] [DURATION]  add a track to the queue\n"
+            "  drain                                   submit queued tracks until done or stuck\n"
+            "  replay FILE                             submit every track from a queue file\n"
+            "  status                                  print the queue size\n"
+            "  list [OFFSET] [COUNT]                   print queued tracks, oldest first (0, 50)\n"
+            "  delete-artist ARTIST                    delete an artist's tracks from the queue\n"
+            "  serve [PORT] [LATENCY_MS] [SCROBBLES]   run the stand-in endpoint (with synthetic history)\n"
+            "  bench [TRACKS] [LATENCY_MS]             enqueue and drain against an in-process stand-in\n"
+            "  simulate [sim options]                  replay days of listening on a virtual clock\n"
+            "  stress [stress options]                 hammer ScrobbleQueue from many threads (fake transport)\n"
+            "  history [ARTIST [ALBUM]]                play counts from the local scrobble history\n"
+            "  history-bench [ROWS]                    time history queries over synthetic plays (500000)\n"
+            "  sync USER [--concurrency N] [--rps R] [--from TS]\n"
+            "                                          fetch a user's scrobble history and loved tracks as\n"
+            "                                          play count sync does\n"
+            "  sync-bench [SCROBBLES] [LATENCY_MS]     compare sync concurrency against a stand-in (200000, 100)\n"
+            "  cache-bench [KEYS] [LOOKUPS] [LATENCY_MS]\n"
+            "                                          time the API cache against a stand-in (2000, 20000, 20)\n"
+            "  import FILE [--offset N] [--utc-offset S]\n"
+            "                                          scrobble a portable player's .scrobbler.log, resuming at\n"
+            "                                          byte offset N (S: player clock ahead of UTC, seconds)\n"
+            "  import-bench [ROWS] [LATENCY_MS]        import and resume a synthetic log (30000, 5)\n"
+            "  fanout-bench [TRACKS] [SLOW_MS]         drain Last.fm and a slow ListenBrainz stand-in in parallel\n"
+            "                                          from one queue (2000, 100)\n"
+            "  drain-bench [TRACKS]                    fixed vs adaptive drain on fast, slow and throttled stand-ins\n"
+            "  durability-bench [PLAYS] [KILLS]        disk syncs and crash safety of the queue durability policies\n"
+            "  ops-bench [PLAYS]                       requests sent for plays, now-playing and loves queued offline\n"
+            "  warm-bench [TRACKS]                     threshold-to-ack latency with and without pooled connections\n"
+            "  decode-bench [ITERATIONS]               time and allocations per response, DOM vs streaming decoder\n"
+            "  tick-bench [TRACKS]                     playback tracker calls, cost and scrobble precision per track\n"
+            "  queue-bench [TRACKS]                    page reads and bulk edits of an offline backlog (100000)\n"
+            "  segment-bench [TRACKS]                  memory and queue file writes of a long offline backlog (20000)\n"
+            "\n"
+            "sim options:\n"
+            "  --days N --hours N --track-seconds N    listening pattern (default 3 days, 8h/day, 210s)\n"
+            "  --outage START_H+DURATION_H             network outage, repeatable\n"
+            "  --error-rate P                          fraction of requests answered with HTTP 503\n"
+            "  --batch LIST --backoff LIST --interval LIST\n"
+            "                                          comma-separated queue policies to compare\n"
+            "  --live-weight LIST                      live lane weights against a backlog weight of 1 (0: no lanes)\n"
+            "  --seed N                                random seed\n"
+            "\n"
+            "stress options:\n"
+            "  --producers N --tracks N                add_track() threads and tracks per thread (4 x 250)\n"
+            "  --workers N --readers N                 process_queue() and get_queue_size() threads (2, 2)\n"
+            "  --clear                                 also call clear_queue() every 20 ms\n"
+            "  --failure-rate P --latency-us N         fake transport behaviour\n"
+            "  --batch N                               entries per process_queue() call (50)\n");
+}
+
+std::string env_or(const char* name, const std::string& fallback)
+{
+    const char* value = getenv(name);
+    return value && *value ? value : fallback;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    Options opt;
+    std::vector<std::string> positional;
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        auto next = [&]() -> std::string { return i + 1 < argc ? argv[++i] : ""; };
+        if (arg == "--profile")
+            opt.profile = next();
+        else if (arg == "--endpoint")
+            opt.endpoint = next();
+        else if (arg == "--api-key")
+            opt.api_key = next();
+        else if (arg == "--api-secret")
+            opt.api_secret = next();
+        else if (arg == "--session-key")
+            opt.session_key = next();
+        else if (arg == "--listenbrainz")
+            opt.listenbrainz_url = next();
+        else if (arg == "--listenbrainz-token")
+            opt.listenbrainz_token = next();
+        else if (arg == "--debug")
+            opt.debug = true;
+        else if (arg == "-h" || arg == "--help")
+        {
+            usage();
+            return 0;
+        }
+        else
+            positional.push_back(arg);
+    }
+    if (positional.empty())
+    {
+        usage();
+        return 2;
+    }
+
+    const std::string command = positional[0];
+    const std::vector<std::string> args(positional.begin() + 1, positional.end());
+
+    g_logger.set_debug_enabled(opt.debug);
+
+    if (command == "serve")
+    {
+        StandInServer server(args.empty() ? 8080 : atoi(args[0].c_str()), args.size() > 1 ? atoi(args[1].c_str()) : 0);
+        if (args.size() > 2)
+            server.set_recent_tracks(strtoull(args[2].c_str(), nullptr, 10));
+        if (!server.start())
+        {
+            perror("serve");
+            return 1;
+        }
+        printf("Stand-in endpoint listening on %s\n", server.url().c_str());
+        fflush(stdout);
+        server.wait();
+        return 0;
+    }
+
+    if (command == "simulate" || command == "stress" || command == "history-bench" || command == "sync-bench" ||
+        command == "cache-bench" || command == "import-bench" || command == "fanout-bench" ||
+        command == "drain-bench" || command == "durability-bench" || command == "segment-bench" ||
+        command == "ops-bench" || command == "warm-bench" || command == "decode-bench" ||
+        command == "tick-bench" || command == "queue-bench")
+    {
+        const std::string profile = opt.profile + "/" + command;
+        std::filesystem::create_directories(profile);
+        PosixPlatform posix_platform(profile);
+        set_platform(&posix_platform);
+        curl_global_init(CURL_GLOBAL_DEFAULT);
+        int rc = 0;
+        if (command == "simulate")
+            rc = cmd_simulate(args, opt.debug);
+        else if (command == "stress")
+            rc = cmd_stress(args, opt.debug);
+        else if (command == "sync-bench")
+            rc = cmd_sync_bench(args, opt.debug);
+        else if (command == "cache-bench")
+            rc = cmd_cache_bench(args, opt.debug);
+        else if (command == "import-bench")
+            rc = cmd_import_bench(args, opt.debug);
+        else if (command == "fanout-bench")
+            rc = cmd_fanout_bench(args, opt.debug);
+        else if (command == "drain-bench")
+            rc = cmd_drain_bench(args, opt.debug);
+        else if (command == "durability-bench")
+            rc = cmd_durability_bench(args, opt.debug);
+        else if (command == "segment-bench")
+            rc = cmd_segment_bench(args, opt.debug);
+        else if (command == "ops-bench")
+            rc = cmd_ops_bench(args, opt.debug);
+        else if (command == "warm-bench")
+            rc = cmd_warm_bench(args, opt.debug);
+        else if (command == "decode-bench")
+            rc = cmd_decode_bench(args, opt.debug);
+        else if (command == "tick-bench")
+            rc = cmd_tick_bench(args, opt.debug);
+        else if (command == "queue-bench")
+            rc = cmd_queue_bench(args, opt.debug);
+        else
+            rc = cmd_history_bench(args);
+        curl_global_cleanup();
+        return rc;
+    }
+
+    // The benchmark always runs against its own stand-in endpoint with dummy credentials
+    std::unique_ptr<StandInServer> bench_server;
+    if (command == "bench")
+    {
+        bench_server = std::make_unique<StandInServer>(0, args.size() > 1 ? atoi(args[1].c_str()) : 0);
+        if (!bench_server->start())
+        {
+            perror("bench");
+            return 1;
+        }
+        opt.endpoint = bench_server->url();
+        opt.profile += "/bench";
+        std::filesystem::remove_all(opt.profile);
+        opt.api_key = opt.api_secret = opt.session_key = "scrobblectl";
+    }
+
+    std::filesystem::create_directories(opt.profile);
+    PosixPlatform posix_platform(opt.profile);
+    set_platform(&posix_platform);
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+
+    LastfmApi api;
+    SessionManager sessions;
+    g_lastfm_api = &api;
+    g_session_manager = &sessions;
+
+    if (!opt.endpoint.empty())
+        api.set_api_url(opt.endpoint);
+    api.set_credentials(env_or("LASTFM_API_KEY", opt.api_key).c_str(),
+                        env_or("LASTFM_API_SECRET", opt.api_secret).c_str());
+
+    std::string session_key = env_or("LASTFM_SESSION_KEY", opt.session_key);
+    std::string username;
+    if (session_key.empty())
+        sessions.load_session(session_key, username);
+    api.set_session_key(session_key.c_str());
+
+    HistoryStore history;
+    g_scrobble_history = &history;
+    ListenBrainzTransport listenbrainz;
+    listenbrainz.configure(opt.listenbrainz_url, env_or("LISTENBRAINZ_TOKEN", opt.listenbrainz_token));
+
+    int rc = 2;
+    {
+        ScrobbleQueue queue;
+        g_scrobble_queue = &queue;
+        if (!opt.listenbrainz_url.empty())
+            queue.add_target(kListenBrainzTarget, &listenbrainz);
+
+        if (command == "enqueue")
+            rc = cmd_enqueue(queue, args);
+        else if (command == "drain")
+            rc = cmd_drain(queue);
+        else if (command == "status")
+        {
+            printf("%zu tracks in queue (%s)\n", queue.get_queue_size(), posix_platform.profile_dir().c_str());
+            if (!opt.listenbrainz_url.empty())
+                printf("%zu pending for Last.fm, %zu for ListenBrainz\n",
+                       queue.get_pending(ScrobbleQueue::kLastfmTarget), queue.get_pending(kListenBrainzTarget));
+            rc = 0;
+        }
+        else if (command == "list")
+            rc = cmd_list(queue, args);
+        else if (command == "delete-artist")
+            rc = cmd_delete_artist(queue, args);
+        else if (command == "bench")
+            rc = cmd_bench(queue, args);
+        else if (command == "history")
+            rc = cmd_history(history, args);
+        else if (command == "sync")
+            rc = cmd_sync(api, args);
+        else if (command == "import")
+            rc = cmd_import(queue, args);
+        else if (command != "replay")
+            usage();
+
+        g_scrobble_queue = nullptr;
+    }
+
+    if (command == "replay")
+    {
+        // Copy the file over the profile queue, then load and drain it
+        if (args.empty())
+        {
+            fprintf(stderr, "replay: FILE is required\n");
+        }
+        else
+        {
+            std::error_code ec;
+            const std::string target = posix_platform.profile_dir() + "lastfm_scrobble_queue.json";
+            std::filesystem::copy_file(args[0], target, std::filesystem::copy_options::overwrite_existing, ec);
+            if (ec)
+            {
+                fprintf(stderr, "replay: %s\n", ec.message().c_str());
+                rc = 1;
+            }
+            else
+            {
+                ScrobbleQueue queue;
+                g_scrobble_queue = &queue;
+                printf("Replaying %zu tracks from %s\n", queue.get_queue_size(), args[0].c_str());
+                rc = cmd_drain(queue);
+                g_scrobble_queue = nullptr;
+            }
+        }
+    }
+
+    g_scrobble_history = nullptr;
+    g_session_manager = nullptr;
+    g_lastfm_api = nullptr;
+    g_logger.flush();
+    curl_global_cleanup();
+    return rc;
+}
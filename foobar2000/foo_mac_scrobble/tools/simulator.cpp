@@ -0,0 +1,276 @@
+//
+//  simulator.cpp
+//  foo_mac_scrobble
+//
+//  Created by Oleksandr Velychko on 18/10/2026.
+//
+
+#include "simulator.h"
+
+#include "../clock.h"
+#include "../history_store.h"
+#include "../lastfm_api.h"
+#include "../platform.h"
+#include "standin_server.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <queue>
+#include <random>
+
+namespace foo_lastfm
+{
+
+// Simulations start at 2026-01-01 00:00:00 UTC
+static constexpr int64_t kSimulationEpochMs = 1767225600000;
+
+namespace
+{
+
+enum class EventKind
+{
+    play,       // A track finished playing and is handed to the queue
+    worker_tick // The background worker calls process_queue() on its interval
+};
+
+struct Event
+{
+    int64_t time_ms;
+    EventKind kind;
+    uint64_t sequence; // Keeps ordering stable for events at the same time
+
+    bool operator>(const Event& other) const
+    {
+        return time_ms != other.time_ms ? time_ms > other.time_ms : sequence > other.sequence;
+    }
+};
+
+} // namespace
+
+SimulationResult run_simulation(const SimulationConfig& config)
+{
+    SimulationResult result;
+    const auto wall_start = std::chrono::steady_clock::now();
+
+    VirtualClock virtual_clock(kSimulationEpochMs);
+    set_clock(&virtual_clock);
+
+    // Endpoint: drops connections during outages, otherwise fails a fraction of requests with 503
+    std::mt19937 server_rng(config.seed * 2654435761u);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    StandInServer server(0, 0);
+    server.set_fault_hook(
+        [&]()
+        {
+            const int64_t t = (virtual_clock.now_ms() - kSimulationEpochMs) / 1000;
+            for (const auto& outage : config.outages)
+            {
+                if (t >= outage.start_seconds && t < outage.start_seconds + outage.duration_seconds)
+                    return StandInFault::drop_connection;
+            }
+            if (config.error_rate > 0 && unit(server_rng) < config.error_rate)
+                return StandInFault::server_error;
+            return StandInFault::none;
+        });
+    if (!server.start())
+    {
+        set_clock(nullptr);
+        return result;
+    }
+
+    std::error_code ec;
+    std::filesystem::remove(platform().profile_dir() + "lastfm_scrobble_queue.json", ec);
+    std::filesystem::remove(platform().profile_dir() + "lastfm_scrobble_history.bin", ec);
+
+    LastfmApi api;
+    api.set_api_url(server.url());
+    api.set_credentials("simulator", "simulator");
+    api.set_session_key("simulator");
+    LastfmApi* previous_api = g_lastfm_api;
+    g_lastfm_api = &api;
+    g_metrics.reset();
+
+    // Accepted plays land in the history, which tells when each play queued while online was acknowledged
+    HistoryStore history;
+    HistoryStore* previous_history = g_scrobble_history;
+    g_scrobble_history = &history;
+    struct OnlinePlay
+    {
+        int64_t timestamp;
+        int64_t queued_ms;
+    };
+    std::vector<OnlinePlay> online_plays;
+    LatencyHistogram online_play_to_ack;
+    auto in_outage = [&](int64_t now_ms)
+    {
+        const int64_t t = (now_ms - kSimulationEpochMs) / 1000;
+        for (const auto& outage : config.outages)
+        {
+            if (t >= outage.start_seconds && t < outage.start_seconds + outage.duration_seconds)
+                return true;
+        }
+        return false;
+    };
+    auto collect_acks = [&]()
+    {
+        const int64_t now_ms = virtual_clock.now_ms();
+        online_plays.erase(std::remove_if(online_plays.begin(), online_plays.end(),
+                                          [&](const OnlinePlay& play)
+                                          {
+                                              if (history.count_plays(play.timestamp, play.timestamp + 1) == 0)
+                                                  return false;
+                                              online_play_to_ack.record(
+                                                  std::chrono::milliseconds(now_ms - play.queued_ms));
+                                              return true;
+                                          }),
+                           online_plays.end());
+    };
+
+    {
+        ScrobbleQueue queue;
+        queue.set_policy(config.policy);
+
+        // Listening pattern: one play per track length during the daily listening window
+        std::priority_queue<Event, std::vector<Event>, std::greater<Event>> events;
+        uint64_t sequence = 0;
+        std::mt19937 play_rng(config.seed);
+        std::uniform_int_distribution<int> jitter(-30, 30);
+        int64_t last_play_ms = kSimulationEpochMs;
+        for (int day = 0; day < config.days; ++day)
+        {
+            int64_t t = kSimulationEpochMs + (day * 86400LL + 9 * 3600LL) * 1000;
+            const int64_t window_end = t + config.listening_hours * 3600LL * 1000;
+            while ((t += std::max(30, config.track_seconds + jitter(play_rng)) * 1000LL) < window_end)
+            {
+                events.push({t, EventKind::play, sequence++});
+                last_play_ms = t;
+            }
+        }
+
+        // The queue must drain after the last play and after the last outage has ended
+        int64_t quiet_from_ms = last_play_ms;
+        for (const auto& outage : config.outages)
+        {
+            const int64_t end_ms = kSimulationEpochMs + (outage.start_seconds + outage.duration_seconds) * 1000;
+            quiet_from_ms = std::max(quiet_from_ms, end_ms);
+        }
+        const int64_t horizon_ms = quiet_from_ms + config.drain_horizon_hours * 3600LL * 1000;
+
+        const int64_t interval_ms = std::max(1, config.policy.worker_interval_seconds) * 1000LL;
+        events.push({kSimulationEpochMs + interval_ms, EventKind::worker_tick, sequence++});
+
+        while (!events.empty())
+        {
+            const Event event = events.top();
+            events.pop();
+            if (event.time_ms > horizon_ms)
+                break;
+            virtual_clock.advance_to(event.time_ms);
+
+            if (event.kind == EventKind::play)
+            {
+                LastfmApi::TrackInfo track;
+                track.artist = "Sim Artist " + std::to_string(result.plays % 40);
+                track.track = "Sim Track " + std::to_string(result.plays);
+                track.album = "Sim Album";
+                track.duration = config.track_seconds;
+                track.timestamp = virtual_clock.now_seconds();
+                queue.add_track(track);
+                ++result.plays;
+                if (!in_outage(event.time_ms))
+                    online_plays.push_back({track.timestamp, event.time_ms});
+
+                // The play callback wakes the workers right after queueing a play
+                queue.process_queue();
+                ++result.wakeups;
+                collect_acks();
+                continue;
+            }
+
+            queue.process_queue();
+            ++result.worker_ticks;
+            collect_acks();
+
+            // process_queue() may have advanced virtual time through retry backoff
+            const int64_t now_ms = virtual_clock.now_ms();
+            if (now_ms >= quiet_from_ms && queue.get_queue_size() == 0)
+            {
+                result.drain_seconds = (now_ms - quiet_from_ms) / 1000;
+                break;
+            }
+            events.push({std::max(now_ms, event.time_ms) + interval_ms, EventKind::worker_tick, sequence++});
+        }
+    }
+
+    const MetricsSnapshot metrics = g_metrics.snapshot();
+    result.scrobbled = metrics.scrobbles_acked;
+    result.failed_attempts = metrics.scrobbles_failed;
+    result.retries = metrics.retries;
+    result.peak_queue = metrics.queue_depth_peak;
+    result.enqueue_to_ack = metrics.enqueue_to_ack;
+    result.online_play_to_ack = online_play_to_ack.snapshot();
+    result.api_requests = server.api_requests();
+    result.probe_requests = server.probe_requests();
+    result.simulated_seconds = (virtual_clock.now_ms() - kSimulationEpochMs) / 1000;
+    result.wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+
+    g_scrobble_history = previous_history;
+    g_lastfm_api = previous_api;
+    server.stop();
+    set_clock(nullptr);
+    return result;
+}
+
+// ============================================================
+// Report formatting
+// ============================================================
+static std::string format_hours(int64_t seconds)
+{
+    char buf[32];
+    if (seconds < 0)
+        snprintf(buf, sizeof(buf), "never");
+    else if (seconds < 3600)
+        snprintf(buf, sizeof(buf), "%lldm%02llds", (long long)seconds / 60, (long long)seconds % 60);
+    else
+        snprintf(buf, sizeof(buf), "%.1fh", seconds / 3600.0);
+    return buf;
+}
+
+std::string simulation_result_header()
+{
+    char line[256];
+    snprintf(line, sizeof(line), "%-6s %-8s %-8s %-5s | %6s %6s %6s %7s %7s %6s %5s %9s %10s %10s %7s", "batch",
+             "backoff", "interval", "lanes", "plays", "acked", "api", "probes", "retries", "failed", "peak", "drain",
+             "p90 ack", "p99 online", "wall");
+    return line;
+}
+
+std::string format_simulation_result(const SimulationConfig& config, const SimulationResult& result)
+{
+    char backoff[16];
+    char interval[16];
+    snprintf(backoff, sizeof(backoff), "%ds", config.policy.backoff_base_seconds);
+    snprintf(interval, sizeof(interval), "%ds", config.policy.worker_interval_seconds);
+
+    char lanes[16];
+    snprintf(lanes, sizeof(lanes), "%d:%d", config.policy.live_weight, config.policy.bulk_weight);
+
+    // enqueue_to_ack is recorded in virtual milliseconds, stored as microseconds
+    const int64_t p90_ack_s = static_cast<int64_t>(result.enqueue_to_ack.percentile_us(90) / 1000000);
+    const int64_t p99_online_s = static_cast<int64_t>(result.online_play_to_ack.percentile_us(99) / 1000000);
+
+    char line[256];
+    snprintf(line, sizeof(line), "%-6d %-8s %-8s %-5s | %6llu %6llu %6llu %7llu %7llu %6llu %5llu %9s %10s %10s %6.2fs",
+             config.policy.max_per_run, backoff, interval, config.policy.live_weight > 0 ? lanes : "off",
+             (unsigned long long)result.plays,
+             (unsigned long long)result.scrobbled, (unsigned long long)result.api_requests,
+             (unsigned long long)result.probe_requests, (unsigned long long)result.retries,
+             (unsigned long long)result.failed_attempts, (unsigned long long)result.peak_queue,
+             format_hours(result.drain_seconds).c_str(), format_hours(p90_ack_s).c_str(),
+             format_hours(p99_online_s).c_str(), result.wall_seconds);
+    return line;
+}
+
+} // namespace foo_lastfm
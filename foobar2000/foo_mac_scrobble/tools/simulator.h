@@ -0,0 +1,69 @@
+//
+//  simulator.h
+//  foo_mac_scrobble
+//
+//  Created by Oleksandr Velychko on 18/10/2026.
+//
+
+#pragma once
+
+#include "../metrics.h"
+#include "../scrobble_queue.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace foo_lastfm
+{
+
+// Period during which the stand-in endpoint drops every connection
+struct SimulatedOutage
+{
+    int64_t start_seconds;    // Offset from the simulation start
+    int64_t duration_seconds; // Length of the outage
+};
+
+// Listening pattern, network conditions and queue policy for one simulation run
+struct SimulationConfig
+{
+    int days = 3;                 // Days of listening to replay
+    int listening_hours = 8;      // Listening hours per day, starting at 09:00
+    int track_seconds = 210;      // Average track length (each play jitters by +-30 s)
+    double error_rate = 0.0;      // Fraction of API requests answered with HTTP 503
+    int drain_horizon_hours = 72; // How long to keep ticking after the last play for the queue to drain
+    uint32_t seed = 1;            // Seed for play jitter and server errors
+    std::vector<SimulatedOutage> outages;
+    QueuePolicy policy;
+};
+
+// Outcome of one simulation run
+struct SimulationResult
+{
+    uint64_t plays = 0;            // Tracks added to the queue
+    uint64_t scrobbled = 0;        // Tracks acknowledged by the endpoint
+    uint64_t api_requests = 0;     // HTTP POSTs seen by the endpoint (including retries)
+    uint64_t probe_requests = 0;   // Reachability HEAD requests seen by the endpoint
+    uint64_t retries = 0;          // HTTP attempts beyond the first one
+    uint64_t failed_attempts = 0;  // Queue submissions that failed
+    uint64_t worker_ticks = 0;     // process_queue() calls on the worker interval
+    uint64_t wakeups = 0;          // process_queue() calls right after a play
+    uint64_t peak_queue = 0;       // Largest queue depth
+    int64_t drain_seconds = -1;    // Virtual time from the last play or outage end until the queue emptied
+    int64_t simulated_seconds = 0; // Virtual time covered by the run
+    double wall_seconds = 0;       // Real time the run took
+    HistogramSnapshot enqueue_to_ack;
+    HistogramSnapshot online_play_to_ack; // Play to acknowledgement for plays queued while the endpoint was up
+};
+
+// Replays the configured listening pattern against a real ScrobbleQueue driven by a VirtualClock
+// and an in-process stand-in endpoint. Starts from an empty queue file in the platform profile directory.
+// The platform must already be installed; the clock is restored to the system clock on return.
+SimulationResult run_simulation(const SimulationConfig& config);
+
+// Formats a one-line summary of a run
+std::string format_simulation_result(const SimulationConfig& config, const SimulationResult& result);
+// Column headings matching format_simulation_result()
+std::string simulation_result_header();
+
+} // namespace foo_lastfm
@@ -0,0 +1,303 @@
+//
+//  standin_server.cpp
+//  foo_mac_scrobble
+//
+//  Created by Oleksandr Velychko on 18/10/2026.
+//
+
+#include "standin_server.h"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstdlib>
+#include <cerrno>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+namespace foo_lastfm
+{
+
+bool StandInServer::start()
+{
+    m_listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (m_listen_fd < 0)
+        return false;
+
+    int reuse = 1;
+    setsockopt(m_listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(static_cast<uint16_t>(m_port));
+    if (bind(m_listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(m_listen_fd, 64) != 0)
+    {
+        close(m_listen_fd);
+        m_listen_fd = -1;
+        return false;
+    }
+
+    socklen_t len = sizeof(addr);
+    getsockname(m_listen_fd, reinterpret_cast<sockaddr*>(&addr), &len);
+    m_port = ntohs(addr.sin_port);
+
+    m_running = true;
+    m_thread = std::thread([this]() { serve(); });
+    return true;
+}
+
+void StandInServer::stop()
+{
+    if (!m_running.exchange(false))
+        return;
+    shutdown(m_listen_fd, SHUT_RDWR);
+    close(m_listen_fd);
+    if (m_thread.joinable())
+        m_thread.join();
+    // Connection threads are detached; wait for the ones still answering
+    while (m_connections.load() > 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+void StandInServer::wait()
+{
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+void StandInServer::serve()
+{
+    while (m_running)
+    {
+        const int fd = accept(m_listen_fd, nullptr, nullptr);
+        if (fd < 0)
+            continue;
+        m_connections.fetch_add(1);
+        m_connections_accepted.fetch_add(1);
+        std::thread(
+            [this, fd]()
+            {
+                serve_connection(fd);
+                close(fd);
+                m_connections.fetch_sub(1);
+            })
+            .detach();
+    }
+}
+
+void StandInServer::serve_connection(int fd)
+{
+    // Short receive timeouts, so idle connections notice stop() and the keep-alive time
+    timeval timeout{0, 50 * 1000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    for (bool first = true; m_running && handle(fd, first); first = false)
+    {
+    }
+}
+
+bool StandInServer::handle(int fd, bool first)
+{
+    // Read headers, then as much body as Content-Length announces
+    std::string request;
+    char buf[4096];
+    size_t header_end = std::string::npos;
+    size_t content_length = 0;
+    const auto idle_since = std::chrono::steady_clock::now();
+    for (;;)
+    {
+        const ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+        {
+            if (!m_running || (request.empty() && std::chrono::steady_clock::now() - idle_since >
+                                                      std::chrono::milliseconds(m_keep_alive_ms)))
+                return false;
+            continue;
+        }
+        if (n <= 0)
+            return false;
+        request.append(buf, static_cast<size_t>(n));
+
+        if (header_end == std::string::npos)
+        {
+            header_end = request.find("\r\n\r\n");
+            if (header_end == std::string::npos)
+                continue;
+            const size_t cl = request.find("Content-Length:");
+            if (cl != std::string::npos && cl < header_end)
+                content_length = std::strtoul(request.c_str() + cl + 15, nullptr, 10);
+        }
+        if (request.size() >= header_end + 4 + content_length)
+            break;
+    }
+
+    const bool head = request.compare(0, 5, "HEAD ") == 0;
+    (head ? m_probe_requests : m_api_requests).fetch_add(1);
+
+    const StandInFault fault = m_fault_hook ? m_fault_hook() : StandInFault::none;
+    if (fault == StandInFault::drop_connection)
+        return false;
+
+    const int latency_ms = m_latency_ms + (first ? m_connect_latency_ms : 0);
+    if (latency_ms > 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(latency_ms));
+
+    std::string status = "200 OK";
+    std::string body;
+    if (fault == StandInFault::server_error)
+    {
+        status = "503 Service Unavailable";
+        body = R"({"error":16,"message":"The service is temporarily unavailable, please try again."})";
+    }
+    else if (fault == StandInFault::rate_limited)
+    {
+        status = "429 Too Many Requests";
+        body = R"({"error":29,"message":"Rate limit exceeded"})";
+    }
+    else if (request.compare(0, 23, "POST /1/submit-listens ") == 0 &&
+             request.find(R"("track_name":"Invalid)") != std::string::npos)
+    {
+        // Titles starting with "Invalid" fail validation, which rejects the whole request as ListenBrainz does
+        status = "400 Bad Request";
+        body = R"({"code":400,"error":"Invalid listen"})";
+    }
+    else if (request.compare(0, 23, "POST /1/submit-listens ") == 0)
+        body = submit_listens_body(request);
+    else if (request.find("method=auth.getSession") != std::string::npos)
+        body = R"({"session":{"name":"scrobblectl","key":"standinsessionkey","subscriber":0}})";
+    else if (request.find("method=user.getRecentTracks") != std::string::npos)
+        body = recent_tracks_body(request);
+    else if (request.find("method=user.getLovedTracks") != std::string::npos)
+        body = loved_tracks_body(request);
+    else if (request.find("method=track.getInfo") != std::string::npos)
+        body = track_info_body(request);
+    else if (request.find("method=track.updateNowPlaying") != std::string::npos)
+    {
+        m_now_playing_requests.fetch_add(1);
+        body = R"({"nowplaying":{"ignoredMessage":{"code":"0","#text":""}}})";
+    }
+    else if (request.find("method=track.love") != std::string::npos ||
+             request.find("method=track.unlove") != std::string::npos)
+    {
+        m_love_requests.fetch_add(1);
+        body = "{}";
+    }
+    else if (request.find("method=track.scrobble") != std::string::npos)
+        body = scrobble_body(request);
+    else
+        body = R"({"scrobbles":{"@attr":{"accepted":1,"ignored":0}}})";
+
+    std::string response = "HTTP/1.1 " + status + "\r\nContent-Type: application/json\r\nConnection: keep-alive\r\n";
+    response += "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n";
+    if (!head)
+        response += body;
+    return send(fd, response.data(), response.size(), 0) == static_cast<ssize_t>(response.size());
+}
+
+// Value of a form field in the request body ("" when missing)
+static std::string form_value(const std::string& request, const std::string& key)
+{
+    const size_t body = request.find("\r\n\r\n");
+    if (body == std::string::npos)
+        return "";
+    size_t pos = body + 4;
+    while (pos < request.size())
+    {
+        const size_t end = std::min(request.find('&', pos), request.size());
+        if (request.compare(pos, key.size() + 1, key + "=") == 0)
+            return request.substr(pos + key.size() + 1, end - pos - key.size() - 1);
+        pos = end + 1;
+    }
+    return "";
+}
+
+std::string StandInServer::recent_tracks_body(const std::string& request) const
+{
+    // Row i (0 = newest) was scrobbled 3 * i minutes before 2026-01-01; honour "from" like Last.fm
+    const int64_t newest = 1767225600;
+    const int64_t from = std::strtoll(form_value(request, "from").c_str(), nullptr, 10);
+    uint64_t total = m_recent_tracks;
+    if (from > 0)
+        total = std::min<uint64_t>(total, newest > from ? static_cast<uint64_t>((newest - from - 1) / 180 + 1) : 0);
+
+    const int page = std::max(1, atoi(form_value(request, "page").c_str()));
+    const int limit = std::clamp(atoi(form_value(request, "limit").c_str()), 1, 1000);
+    const uint64_t total_pages = (total + limit - 1) / limit;
+
+    std::string body = R"({"recenttracks":{"track":[)";
+    for (uint64_t i = static_cast<uint64_t>(page - 1) * limit; i < total && i < static_cast<uint64_t>(page) * limit;
+         ++i)
+    {
+        const std::string artist = "Artist " + std::to_string(i * 7919 % 500);
+        const std::string title = "Track " + std::to_string(i % 3000);
+        if (body.back() == '}')
+            body += ',';
+        body += R"({"artist":{"mbid":"","#text":")" + artist + R"("},"streamable":"0","mbid":"","album":{"mbid":"",)";
+        body += R"("#text":"Album"},"name":")" + title + R"(","url":"https://www.last.fm/","date":{"uts":")";
+        body += std::to_string(newest - static_cast<int64_t>(i) * 180) + R"(","#text":""}})";
+    }
+    body += R"(],"@attr":{"user":"scrobblectl","totalPages":")" + std::to_string(total_pages) + R"(","page":")";
+    body += std::to_string(page) + R"(","perPage":")" + std::to_string(limit) + R"(","total":")";
+    body += std::to_string(total) + R"("}}})";
+    return body;
+}
+
+std::string StandInServer::scrobble_body(const std::string& request)
+{
+    // A batch carries timestamp[0], timestamp[1] ...; a single scrobble a plain timestamp
+    uint64_t accepted = 0;
+    for (size_t pos = request.find("timestamp["); pos != std::string::npos; pos = request.find("timestamp[", pos + 1))
+        ++accepted;
+    accepted = std::max<uint64_t>(accepted, 1);
+    m_scrobbles.fetch_add(accepted);
+    return R"({"scrobbles":{"@attr":{"accepted":)" + std::to_string(accepted) + R"(,"ignored":0}}})";
+}
+
+std::string StandInServer::submit_listens_body(const std::string& request)
+{
+    // Every listen of the payload carries its own listened_at
+    uint64_t listens = 0;
+    for (size_t pos = request.find("\"listened_at\""); pos != std::string::npos;
+         pos = request.find("\"listened_at\"", pos + 1))
+        ++listens;
+    m_listens.fetch_add(listens);
+    return R"({"status":"ok"})";
+}
+
+std::string StandInServer::track_info_body(const std::string& request) const
+{
+    // Titles starting with "Missing" are unknown to the stand-in, as Last.fm answers for them
+    const std::string track = form_value(request, "track");
+    if (track.compare(0, 7, "Missing") == 0)
+        return R"({"error":6,"message":"Track not found","links":[]})";
+    const std::string playcount = std::to_string(track.size() % 17);
+    return R"({"track":{"name":")" + track + R"(","listeners":"1","playcount":"1","userplaycount":")" + playcount +
+           R"(","userloved":"0","url":"https://www.last.fm/"}})";
+}
+
+std::string StandInServer::loved_tracks_body(const std::string& request) const
+{
+    const uint64_t total = m_recent_tracks / 100;
+    const int page = std::max(1, atoi(form_value(request, "page").c_str()));
+    const int limit = std::clamp(atoi(form_value(request, "limit").c_str()), 1, 1000);
+    const uint64_t total_pages = (total + limit - 1) / limit;
+
+    std::string body = R"({"lovedtracks":{"track":[)";
+    for (uint64_t i = static_cast<uint64_t>(page - 1) * limit; i < total && i < static_cast<uint64_t>(page) * limit;
+         ++i)
+    {
+        if (body.back() == '}')
+            body += ',';
+        body += R"({"artist":{"url":"","name":"Artist )" + std::to_string(i * 7919 % 500) + R"(","mbid":""},)";
+        body += R"("date":{"uts":"1767225600","#text":""},"mbid":"","url":"","name":"Track )";
+        body += std::to_string(i % 3000) + R"(","streamable":{"fulltrack":"0","#text":"0"}})";
+    }
+    body += R"(],"@attr":{"user":"scrobblectl","totalPages":")" + std::to_string(total_pages) + R"(","page":")";
+    body += std::to_string(page) + R"(","perPage":")" + std::to_string(limit) + R"(","total":")";
+    body += std::to_string(total) + R"("}}})";
+    return body;
+}
+
+} // namespace foo_lastfm
@@ -0,0 +1,110 @@
+//
+//  standin_server.h
+//  foo_mac_scrobble
+//
+//  Created by Oleksandr Velychko on 18/10/2026.
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+
+namespace foo_lastfm
+{
+
+// How the stand-in endpoint answers a single request
+enum class StandInFault
+{
+    none,            // 200 with a Last.fm-like JSON body
+    drop_connection, // Close without answering (looks like a network outage)
+    server_error,    // 503 Service Unavailable
+    rate_limited     // 429 Too Many Requests
+};
+
+// Minimal HTTP endpoint on 127.0.0.1 that answers like a successful Last.fm (or ListenBrainz) API call, one thread
+// per connection. Connections are kept alive between requests until they are idle for the keep-alive time. Used by
+// scrobblectl for benchmarks and by the simulator to inject outages and server errors.
+class StandInServer
+{
+  public:
+    StandInServer(int port, int latency_ms) : m_port(port), m_latency_ms(latency_ms) {}
+    ~StandInServer() { stop(); }
+
+    // Decides the fault for each request; called on the connection threads
+    void set_fault_hook(std::function<StandInFault()> hook) { m_fault_hook = std::move(hook); }
+    // Number of synthetic scrobbles served by user.getRecentTracks, one every 3 minutes before 2026-01-01;
+    // user.getLovedTracks then serves one loved track per hundred scrobbles
+    void set_recent_tracks(uint64_t total) { m_recent_tracks = total; }
+    // Extra delay before the first answer on a new connection, standing in for DNS, TCP and TLS setup
+    void set_connect_latency(int ms) { m_connect_latency_ms = ms; }
+    // How long an idle connection stays open for the next request (default 15 seconds)
+    void set_keep_alive(int ms) { m_keep_alive_ms = ms; }
+
+    // Binds to 127.0.0.1 (port 0 picks a free port) and starts serving in a background thread
+    bool start();
+    // Stops serving and joins the server thread
+    void stop();
+    // Blocks until the server thread exits
+    void wait();
+
+    // Endpoint URL to pass to LastfmApi::set_api_url()
+    std::string url() const { return root_url() + "/2.0/"; }
+    // Service root to pass to ListenBrainzTransport::configure()
+    std::string root_url() const { return "http://127.0.0.1:" + std::to_string(m_port); }
+    // Number of POST (API) requests answered
+    uint64_t api_requests() const { return m_api_requests.load(); }
+    // Number of HEAD (reachability probe) requests answered
+    uint64_t probe_requests() const { return m_probe_requests.load(); }
+    // Number of scrobbles accepted by track.scrobble (a batch counts each of its tracks)
+    uint64_t scrobbles() const { return m_scrobbles.load(); }
+    // Number of listens accepted by ListenBrainz-style /1/submit-listens
+    uint64_t listens() const { return m_listens.load(); }
+    // Number of track.updateNowPlaying requests answered
+    uint64_t now_playing_requests() const { return m_now_playing_requests.load(); }
+    // Number of track.love and track.unlove requests answered
+    uint64_t love_requests() const { return m_love_requests.load(); }
+    // Number of connections accepted
+    uint64_t connections_accepted() const { return m_connections_accepted.load(); }
+
+  private:
+    int m_port;
+    int m_latency_ms;
+    int m_connect_latency_ms = 0;
+    int m_keep_alive_ms = 15000;
+    int m_listen_fd = -1;
+    std::atomic<bool> m_running{false};
+    std::atomic<uint64_t> m_api_requests{0};
+    std::atomic<uint64_t> m_probe_requests{0};
+    std::atomic<uint64_t> m_scrobbles{0};
+    std::atomic<uint64_t> m_listens{0};
+    std::atomic<uint64_t> m_now_playing_requests{0};
+    std::atomic<uint64_t> m_love_requests{0};
+    std::atomic<uint64_t> m_connections_accepted{0};
+    std::atomic<int> m_connections{0};
+    uint64_t m_recent_tracks = 0;
+    std::function<StandInFault()> m_fault_hook;
+    std::thread m_thread;
+
+    // Accept loop
+    void serve();
+    // Answers requests on one connection until the client closes it or it stays idle for the keep-alive time
+    void serve_connection(int fd);
+    // Reads one request from the socket and answers it; returns false once the connection is to be closed
+    bool handle(int fd, bool first);
+    // Builds a user.getRecentTracks page from the request's form fields
+    std::string recent_tracks_body(const std::string& request) const;
+    // Builds a track.scrobble answer accepting every track of the request
+    std::string scrobble_body(const std::string& request);
+    // Builds a /1/submit-listens answer accepting every listen of the request
+    std::string submit_listens_body(const std::string& request);
+    // Builds a track.getInfo answer ("Track not found" for titles starting with "Missing")
+    std::string track_info_body(const std::string& request) const;
+    // Builds a user.getLovedTracks page from the request's form fields
+    std::string loved_tracks_body(const std::string& request) const;
+};
+
+} // namespace foo_lastfm
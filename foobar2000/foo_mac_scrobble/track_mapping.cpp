@@ -0,0 +1,146 @@
+//
+//  track_mapping.cpp
+//  foo_mac_scrobble
+//
+//  Created by Oleksandr Velychko on 18/10/2026.
+//
+
+#include "track_mapping.h"
+
+#include "async_logger.h"
+#include "config.h"
+#include "stdafx.h"
+
+#include <SDK/metadb_callbacks.h>
+
+namespace foo_lastfm
+{
+
+// $meta(name,0) is the first value of the tag, or nothing at all if the tag is missing
+const char* const kDefaultFieldScripts[TrackMapping::field_count] = {
+    "$meta(artist,0)", "$meta(title,0)", "$meta(album,0)", "$meta(album artist,0)", "$meta(tracknumber,0)",
+};
+
+TrackMapping g_track_mapping;
+
+// Leading digits of a track number ("3", "03", "3/12"); 0 if there are none
+static int parse_track_number(const char* text)
+{
+    int value = 0;
+    for (; *text >= '0' && *text <= '9' && value < 100000; ++text)
+        value = value * 10 + (*text - '0');
+    return value;
+}
+
+void TrackMapping::compile()
+{
+    cfg_string* const scripts[field_count] = {&cfg_map_artist, &cfg_map_title, &cfg_map_album, &cfg_map_album_artist,
+                                              &cfg_map_track_number};
+    auto compiler = titleformat_compiler::get();
+    m_custom_scripts = false;
+    for (int field = 0; field < field_count; ++field)
+    {
+        const std::string script = scripts[field]->get().c_str();
+        if (!script.empty() && script != kDefaultFieldScripts[field])
+            m_custom_scripts = true;
+        if (script.empty() || !compiler->compile(m_scripts[field], script.c_str()))
+        {
+            if (!script.empty())
+                LASTFM_LOG_INFO("Last.fm: Cannot compile the track field script \"%s\", using \"%s\"", script,
+                                kDefaultFieldScripts[field]);
+            compiler->compile_force(m_scripts[field], kDefaultFieldScripts[field]);
+        }
+    }
+
+    // Cached fields came from the old scripts
+    m_cache.clear();
+    m_cache_index.clear();
+}
+
+void TrackMapping::map(const metadb_handle_ptr& track, LastfmApi::TrackInfo& out)
+{
+    if (m_scripts[0].is_empty())
+        compile();
+
+    std::string* const fields[] = {&out.artist, &out.track, &out.album, &out.album_artist};
+    for (int field = 0; field < field_track_number; ++field)
+    {
+        track->format_title(nullptr, m_buffer, m_scripts[field], nullptr);
+        fields[field]->assign(m_buffer.get_ptr(), m_buffer.get_length());
+    }
+    track->format_title(nullptr, m_buffer, m_scripts[field_track_number], nullptr);
+    out.track_number = parse_track_number(m_buffer.get_ptr());
+}
+
+const TrackMapping::Mapped& TrackMapping::lookup(const metadb_handle_ptr& track)
+{
+    if (m_scripts[0].is_empty())
+        compile();
+
+    auto found = m_cache_index.find(track.get_ptr());
+    if (found != m_cache_index.end())
+    {
+        m_cache.splice(m_cache.begin(), m_cache, found->second);
+        return found->second->mapped;
+    }
+
+    // Take the least recently played entry once the cache is full, so its strings keep their buffers
+    if (m_cache.size() >= kCacheTracks)
+    {
+        m_cache_index.erase(m_cache.back().track.get_ptr());
+        m_cache.splice(m_cache.begin(), m_cache, std::prev(m_cache.end()));
+    }
+    else
+        m_cache.emplace_front();
+
+    CacheEntry& entry = m_cache.front();
+    entry.track = track;
+    try
+    {
+        entry.mapped.length = track->get_length();
+        map(track, entry.mapped.info);
+    }
+    catch (...)
+    {
+        // Not cached half-filled; the caller reports the failure
+        entry.track.release();
+        m_cache.pop_front();
+        throw;
+    }
+    m_cache_index[track.get_ptr()] = m_cache.begin();
+    return entry.mapped;
+}
+
+void TrackMapping::invalidate(metadb_handle_list_cref tracks, bool from_hook)
+{
+    if (m_cache_index.empty() || (from_hook && !m_custom_scripts))
+        return;
+
+    for (size_t i = 0, count = tracks.get_count(); i < count; ++i)
+    {
+        auto found = m_cache_index.find(tracks[i].get_ptr());
+        if (found == m_cache_index.end())
+            continue;
+        m_cache.erase(found->second);
+        m_cache_index.erase(found);
+    }
+}
+
+// ============================================================
+// Cache invalidation
+// ============================================================
+
+// Edited tags make cached fields stale; so may display providers (our %lastfm_playcount% after every scrobble) when
+// the user's scripts read them
+class track_mapping_io_callback : public metadb_io_callback
+{
+  public:
+    void on_changed_sorted(metadb_handle_list_cref p_items_sorted, bool p_fromhook) override
+    {
+        g_track_mapping.invalidate(p_items_sorted, p_fromhook);
+    }
+};
+
+static service_factory_single_t<track_mapping_io_callback> g_track_mapping_io_callback;
+
+} // namespace foo_lastfm
@@ -0,0 +1,84 @@
+//
+//  track_mapping.h
+//  foo_mac_scrobble
+//
+//  Created by Oleksandr Velychko on 18/10/2026.
+//
+
+#pragma once
+
+#include "lastfm_api.h"
+
+#include <foobar2000/SDK/foobar2000.h>
+
+#include <list>
+#include <unordered_map>
+
+namespace foo_lastfm
+{
+
+// Maps a track's metadata to the fields sent to Last.fm with one title formatting script per field (cfg_map_*),
+// so the user can add fallbacks such as [%album artist%] or strip "feat." with $replace(). The scripts are compiled
+// once and evaluated against the metadb's cached info into a reusable buffer: mapping a track copies no file_info
+// and, once the buffers have grown, allocates nothing. The result of the last kCacheTracks tracks played is kept,
+// so a repeat play maps nothing; a track leaves the cache when its tags change (metadb_io_callback) and the whole
+// cache is dropped when the scripts are recompiled. Main thread only.
+class TrackMapping
+{
+  public:
+    // Mapped fields, in the order of kDefaultFieldScripts
+    enum Field
+    {
+        field_artist = 0,
+        field_title,
+        field_album,
+        field_album_artist,
+        field_track_number,
+        field_count
+    };
+
+    // Tracks whose mapped fields are kept for repeat plays
+    static constexpr size_t kCacheTracks = 256;
+
+    // What a track change needs of a track
+    struct Mapped
+    {
+        LastfmApi::TrackInfo info; // artist, track, album, album_artist and track_number
+        double length = 0;         // Length in seconds, as the metadb reports it (may be invalid)
+    };
+
+    // Compiles the cfg_map_* scripts and empties the cache; a script that does not compile is replaced by the
+    // field's default
+    void compile();
+    // Fills artist, track, album, album_artist and track_number of out; compiles the scripts on first use
+    void map(const metadb_handle_ptr& track, LastfmApi::TrackInfo& out);
+    // Returns the mapped fields and length of a track, from the cache when it was played recently. The reference
+    // is valid until the next call.
+    const Mapped& lookup(const metadb_handle_ptr& track);
+    // Drops the cached fields of tracks whose tags changed; from_hook is set when only fields of display providers
+    // (such as %lastfm_playcount%) changed, which the default scripts do not read
+    void invalidate(metadb_handle_list_cref tracks, bool from_hook);
+
+  private:
+    // A recently played track; holding the handle keeps its address, the cache key, from being reused
+    struct CacheEntry
+    {
+        metadb_handle_ptr track;
+        Mapped mapped;
+    };
+
+    titleformat_object::ptr m_scripts[field_count];
+    pfc::string8_fastalloc m_buffer;
+    // Some script is not the field's default and may read display provider fields
+    bool m_custom_scripts = false;
+    // Most recently played first; an evicted entry is reused with its string buffers for the next miss
+    std::list<CacheEntry> m_cache;
+    std::unordered_map<const metadb_handle*, std::list<CacheEntry>::iterator> m_cache_index;
+};
+
+// Default script of each field, matching the plain tags the scrobbler used to read
+extern const char* const kDefaultFieldScripts[TrackMapping::field_count];
+
+extern TrackMapping g_track_mapping;
+
+} // namespace foo_lastfm